@@ -27,13 +27,15 @@
 #include <thread>
 #include <vector>
 #include "fcntl.h"
-#include "sys/select.h"
+#include "sys/epoll.h"
 #include "unistd.h"
 
-static const int INVALID_FD = -1;
-
 static const int BT_RT_PRIORITY = 1;
 
+// Enough for every file descriptor a transport watches plus the notification
+// pipe.
+static const int MAX_EPOLL_EVENTS = 8;
+
 namespace android {
 namespace hardware {
 namespace bluetooth {
@@ -41,14 +43,26 @@ namespace async {
 
 int AsyncFdWatcher::WatchFdForNonBlockingReads(
     int file_descriptor, const ReadCallback& on_read_fd_ready_callback) {
-  // Add file descriptor and callback
-  {
-    std::unique_lock<std::mutex> guard(internal_mutex_);
-    watched_fds_[file_descriptor] = on_read_fd_ready_callback;
-  }
-
   // Start the thread if not started yet
-  return tryStartThread();
+  if (tryStartThread()) return -1;
+
+  // Add file descriptor and callback. The watching thread picks it up from
+  // the epoll set without having to be woken up.
+  std::unique_lock<std::mutex> guard(internal_mutex_);
+  bool already_watched = watched_fds_.count(file_descriptor) != 0;
+  watched_fds_[file_descriptor] = on_read_fd_ready_callback;
+  if (already_watched) return 0;
+
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = file_descriptor;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, file_descriptor, &event)) {
+    ALOGE("%s unable to watch fd %d: %s", __func__, file_descriptor,
+          strerror(errno));
+    watched_fds_.erase(file_descriptor);
+    return -1;
+  }
+  return 0;
 }
 
 int AsyncFdWatcher::ConfigureTimeout(
@@ -69,20 +83,44 @@ void AsyncFdWatcher::StopWatchingFileDescriptors() { stopThread(); }
 
 AsyncFdWatcher::~AsyncFdWatcher() {}
 
-// Make sure to call this with at least one file descriptor ready to be
-// watched upon or the thread routine will return immediately
 int AsyncFdWatcher::tryStartThread() {
   if (std::atomic_exchange(&running_, true)) return 0;
 
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    ALOGE("%s unable to create epoll fd: %s", __func__, strerror(errno));
+    running_ = false;
+    return -1;
+  }
+
   // Set up the communication channel
   int pipe_fds[2];
-  if (pipe2(pipe_fds, O_NONBLOCK)) return -1;
+  if (pipe2(pipe_fds, O_NONBLOCK)) {
+    ALOGE("%s unable to create pipe: %s", __func__, strerror(errno));
+    closeFds();
+    running_ = false;
+    return -1;
+  }
 
   notification_listen_fd_ = pipe_fds[0];
   notification_write_fd_ = pipe_fds[1];
 
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = notification_listen_fd_;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, notification_listen_fd_, &event)) {
+    ALOGE("%s unable to watch notification fd: %s", __func__, strerror(errno));
+    closeFds();
+    running_ = false;
+    return -1;
+  }
+
   thread_ = std::thread([this]() { ThreadRoutine(); });
-  if (!thread_.joinable()) return -1;
+  if (!thread_.joinable()) {
+    closeFds();
+    running_ = false;
+    return -1;
+  }
 
   return 0;
 }
@@ -105,8 +143,7 @@ int AsyncFdWatcher::stopThread() {
     timeout_cb_ = nullptr;
   }
 
-  close(notification_listen_fd_);
-  close(notification_write_fd_);
+  closeFds();
 
   return 0;
 }
@@ -119,6 +156,14 @@ int AsyncFdWatcher::notifyThread() {
   return 0;
 }
 
+void AsyncFdWatcher::closeFds() {
+  for (int* fd :
+       {&notification_listen_fd_, &notification_write_fd_, &epoll_fd_}) {
+    if (*fd >= 0) close(*fd);
+    *fd = -1;
+  }
+}
+
 void AsyncFdWatcher::ThreadRoutine() {
   // Make watching thread RT.
   struct sched_param rt_params;
@@ -128,27 +173,18 @@ void AsyncFdWatcher::ThreadRoutine() {
           getpid(), gettid(), strerror(errno));
   }
 
+  struct epoll_event events[MAX_EPOLL_EVENTS];
   while (running_) {
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    FD_SET(notification_listen_fd_, &read_fds);
-    int max_read_fd = INVALID_FD;
-    for (auto& it : watched_fds_) {
-      FD_SET(it.first, &read_fds);
-      max_read_fd = std::max(max_read_fd, it.first);
-    }
-
-    struct timeval timeout;
-    struct timeval* timeout_ptr = NULL;
-    if (timeout_ms_ > std::chrono::milliseconds(0)) {
-      timeout.tv_sec = timeout_ms_.count() / 1000;
-      timeout.tv_usec = (timeout_ms_.count() % 1000) * 1000;
-      timeout_ptr = &timeout;
+    int timeout_ms = -1;
+    {
+      std::unique_lock<std::mutex> guard(timeout_mutex_);
+      if (timeout_ms_ > std::chrono::milliseconds(0)) {
+        timeout_ms = timeout_ms_.count();
+      }
     }
 
     // Wait until there is data available to read on some FD.
-    int nfds = std::max(notification_listen_fd_, max_read_fd);
-    int retval = select(nfds + 1, &read_fds, NULL, NULL, timeout_ptr);
+    int retval = epoll_wait(epoll_fd_, events, MAX_EPOLL_EVENTS, timeout_ms);
 
     // There was some error.
     if (retval < 0) continue;
@@ -165,20 +201,28 @@ void AsyncFdWatcher::ThreadRoutine() {
       continue;
     }
 
-    // Read data from the notification FD.
-    if (FD_ISSET(notification_listen_fd_, &read_fds)) {
-      char buffer[] = {0};
-      TEMP_FAILURE_RETRY(read(notification_listen_fd_, buffer, 1));
-      continue;
+    // Read data from the notification FD. Watched FDs that are also ready
+    // are reported again by the next epoll_wait.
+    bool notified = false;
+    for (int i = 0; i < retval; i++) {
+      if (events[i].data.fd == notification_listen_fd_) {
+        char buffer[16];
+        while (TEMP_FAILURE_RETRY(
+                   read(notification_listen_fd_, buffer, sizeof(buffer))) > 0) {
+        }
+        notified = true;
+      }
     }
+    if (notified) continue;
 
     // Invoke the data ready callbacks if appropriate.
     {
       // Hold the mutex to make sure that the callbacks are still valid.
       std::unique_lock<std::mutex> guard(internal_mutex_);
-      for (auto& it : watched_fds_) {
-        if (FD_ISSET(it.first, &read_fds)) {
-          it.second(it.first);
+      for (int i = 0; i < retval; i++) {
+        auto it = watched_fds_.find(events[i].data.fd);
+        if (it != watched_fds_.end()) {
+          it->second(it->first);
         }
       }
     }
@@ -46,6 +46,7 @@ class AsyncFdWatcher {
   int tryStartThread();
   int stopThread();
   int notifyThread();
+  void closeFds();
   void ThreadRoutine();
 
   std::atomic_bool running_{false};
@@ -54,8 +55,9 @@ class AsyncFdWatcher {
   std::mutex timeout_mutex_;
 
   std::map<int, ReadCallback> watched_fds_;
-  int notification_listen_fd_;
-  int notification_write_fd_;
+  int epoll_fd_ = -1;
+  int notification_listen_fd_ = -1;
+  int notification_write_fd_ = -1;
   TimeoutCallback timeout_cb_;
   std::chrono::milliseconds timeout_ms_;
 };
@@ -0,0 +1,262 @@
+//
+// Copyright 2018 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <benchmark/benchmark.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "async_fd_watcher.h"
+#include "h4_protocol.h"
+
+using android::hardware::hidl_vec;
+using android::hardware::bluetooth::async::AsyncFdWatcher;
+using android::hardware::bluetooth::hci::H4Protocol;
+
+namespace {
+
+// Packets written to the fake UART in one go, as a controller streaming
+// A2DP data while reporting LE advertisements would.
+constexpr size_t kPacketsPerBurst = 64;
+
+// An LE Advertising Report is typically around 40 bytes.
+constexpr uint8_t kEventPayloadSize = 40;
+
+class H4Loopback {
+ public:
+  H4Loopback() {
+    int sockfd[2];
+    socketpair(AF_LOCAL, SOCK_STREAM, 0, sockfd);
+    hci_fd_ = sockfd[0];
+    fake_uart_ = sockfd[1];
+
+    auto on_packet = [this](const hidl_vec<uint8_t>& packet) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      bytes_ += packet.size();
+      if (++packets_ == expected_packets_) done_.notify_one();
+    };
+    protocol_ = std::make_unique<H4Protocol>(hci_fd_, on_packet, on_packet,
+                                             on_packet);
+    watcher_.WatchFdForNonBlockingReads(hci_fd_, [this](int fd) {
+      reads_++;
+      protocol_->OnDataReady(fd);
+    });
+  }
+
+  ~H4Loopback() {
+    watcher_.StopWatchingFileDescriptors();
+    close(fake_uart_);
+    close(hci_fd_);
+  }
+
+  // Writes the stream to the fake UART and waits until its packets have all
+  // been reported.
+  void Transfer(const std::vector<uint8_t>& stream, size_t packets) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    expected_packets_ = packets_ + packets;
+    lock.unlock();
+
+    size_t written = 0;
+    while (written < stream.size()) {
+      ssize_t ret = TEMP_FAILURE_RETRY(write(
+          fake_uart_, stream.data() + written, stream.size() - written));
+      if (ret <= 0) return;
+      written += ret;
+    }
+
+    lock.lock();
+    done_.wait(lock, [this] { return packets_ >= expected_packets_; });
+  }
+
+  uint64_t packets() const { return packets_; }
+  uint64_t bytes() const { return bytes_; }
+  uint64_t reads() const { return reads_; }
+
+ private:
+  int hci_fd_;
+  int fake_uart_;
+  AsyncFdWatcher watcher_;
+  std::unique_ptr<H4Protocol> protocol_;
+
+  std::mutex mutex_;
+  std::condition_variable done_;
+  uint64_t packets_{0};
+  uint64_t expected_packets_{0};
+  uint64_t bytes_{0};
+  std::atomic<uint64_t> reads_{0};
+};
+
+// Alternates ACL data packets with the given payload size and LE
+// advertising report events.
+std::vector<uint8_t> BuildBurst(uint16_t acl_payload_size) {
+  std::vector<uint8_t> stream;
+  for (size_t i = 0; i < kPacketsPerBurst; i += 2) {
+    const uint8_t acl_preamble[] = {
+        HCI_PACKET_TYPE_ACL_DATA, 0x01, 0x20,
+        static_cast<uint8_t>(acl_payload_size),
+        static_cast<uint8_t>(acl_payload_size >> 8)};
+    stream.insert(stream.end(), std::begin(acl_preamble),
+                  std::end(acl_preamble));
+    stream.insert(stream.end(), acl_payload_size, 0xaa);
+
+    const uint8_t event_preamble[] = {HCI_PACKET_TYPE_EVENT, 0x3e,
+                                      kEventPayloadSize};
+    stream.insert(stream.end(), std::begin(event_preamble),
+                  std::end(event_preamble));
+    stream.insert(stream.end(), kEventPayloadSize, 0x02);
+  }
+  return stream;
+}
+
+// Reads H4 packets of a fixed size from the other end of the UART and notes
+// when each of them arrived.
+class UartSink {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  UartSink(int fd, size_t packet_size)
+      : fd_(fd), packet_size_(packet_size), buffer_(64 * 1024) {
+    thread_ = std::thread([this]() { Run(); });
+  }
+
+  ~UartSink() {
+    shutdown(fd_, SHUT_RDWR);
+    thread_.join();
+  }
+
+  // Waits for the given number of packets and returns their arrival times.
+  const std::vector<Clock::time_point>& Receive(size_t packets) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this, packets]() { return arrivals_.size() >= packets; });
+    received_.swap(arrivals_);
+    arrivals_.clear();
+    return received_;
+  }
+
+ private:
+  void Run() {
+    size_t partial = 0;
+    while (true) {
+      ssize_t ret =
+          TEMP_FAILURE_RETRY(read(fd_, buffer_.data(), buffer_.size()));
+      if (ret <= 0) return;
+      Clock::time_point now = Clock::now();
+      partial += ret;
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (; partial >= packet_size_; partial -= packet_size_) {
+        arrivals_.push_back(now);
+      }
+      done_.notify_one();
+    }
+  }
+
+  int fd_;
+  size_t packet_size_;
+  std::vector<uint8_t> buffer_;
+  std::mutex mutex_;
+  std::condition_variable done_;
+  std::vector<Clock::time_point> arrivals_;
+  std::vector<Clock::time_point> received_;
+  std::thread thread_;
+};
+
+double Percentile(std::vector<double>* values, double percentile) {
+  if (values->empty()) return 0;
+  size_t index = (values->size() - 1) * percentile / 100;
+  std::nth_element(values->begin(), values->begin() + index, values->end());
+  return (*values)[index];
+}
+
+}  // namespace
+
+// Streams bursts of packets through a socketpair standing in for the UART and
+// reports how many reads it took to parse them.
+static void BM_H4Receive(benchmark::State& state) {
+  H4Loopback loopback;
+  std::vector<uint8_t> stream = BuildBurst(state.range(0));
+
+  for (auto _ : state) {
+    loopback.Transfer(stream, kPacketsPerBurst);
+  }
+
+  state.SetBytesProcessed(loopback.bytes());
+  state.SetItemsProcessed(loopback.packets());
+  state.counters["reads_per_packet"] =
+      static_cast<double>(loopback.reads()) / loopback.packets();
+}
+BENCHMARK(BM_H4Receive)->Arg(27)->Arg(251)->Arg(1021)->UseRealTime();
+
+// Sends bursts of ACL packets with the given payload size, as the stack does
+// while streaming A2DP, and reports how many packets each write to the UART
+// carried and how long the packets took to get there.
+static void BM_H4Send(benchmark::State& state) {
+  int sockfd[2];
+  socketpair(AF_LOCAL, SOCK_STREAM, 0, sockfd);
+  auto ignore = [](const hidl_vec<uint8_t>&) {};
+  uint16_t acl_payload_size = state.range(0);
+  std::vector<uint8_t> acl_packet = {
+      0x01, 0x20, static_cast<uint8_t>(acl_payload_size),
+      static_cast<uint8_t>(acl_payload_size >> 8)};
+  acl_packet.insert(acl_packet.end(), acl_payload_size, 0xaa);
+
+  std::vector<double> latencies_us;
+  std::vector<UartSink::Clock::time_point> sent(kPacketsPerBurst);
+  uint64_t packets = 0;
+  uint64_t writes = 0;
+  {
+    UartSink sink(sockfd[1], acl_packet.size() + 1);
+    H4Protocol protocol(sockfd[0], ignore, ignore, ignore);
+    for (auto _ : state) {
+      for (size_t i = 0; i < kPacketsPerBurst; i++) {
+        sent[i] = UartSink::Clock::now();
+        protocol.Send(HCI_PACKET_TYPE_ACL_DATA, acl_packet.data(),
+                      acl_packet.size());
+      }
+      const auto& arrived = sink.Receive(kPacketsPerBurst);
+      for (size_t i = 0; i < kPacketsPerBurst; i++) {
+        latencies_us.push_back(
+            std::chrono::duration<double, std::micro>(arrived[i] - sent[i])
+                .count());
+      }
+      packets += kPacketsPerBurst;
+    }
+    protocol.Flush();
+    writes = protocol.GetTxWriteCount();
+  }
+  close(sockfd[0]);
+  close(sockfd[1]);
+
+  state.SetBytesProcessed(packets * (acl_packet.size() + 1));
+  state.SetItemsProcessed(packets);
+  state.counters["packets_per_write"] =
+      writes ? static_cast<double>(packets) / writes : 0;
+  state.counters["p50_latency_us"] = Percentile(&latencies_us, 50);
+  state.counters["p99_latency_us"] = Percentile(&latencies_us, 99);
+}
+BENCHMARK(BM_H4Send)->Arg(27)->Arg(251)->Arg(1021)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -22,6 +22,7 @@
 #include "bt_vendor_lib.h"
 #include "hci_internals.h"
 #include "hci_protocol.h"
+#include "hci_tx_queue.h"
 
 namespace android {
 namespace hardware {
@@ -36,10 +37,19 @@ class H4Protocol : public HciProtocol {
         event_cb_(event_cb),
         acl_cb_(acl_cb),
         sco_cb_(sco_cb),
-        hci_packetizer_([this]() { OnPacketReady(); }) {}
+        hci_packetizer_([this]() { OnPacketReady(); }),
+        tx_queue_(fd) {}
 
+  // Queues the packet to be written to the UART together with any others
+  // sent meanwhile. Returns the number of bytes queued.
   size_t Send(uint8_t type, const uint8_t* data, size_t length);
 
+  // Blocks until every packet sent so far has been written to the UART.
+  void Flush() { tx_queue_.Flush(); }
+
+  // Number of writes to the UART made so far.
+  uint64_t GetTxWriteCount() const { return tx_queue_.GetWriteCount(); }
+
   void OnPacketReady();
 
   void OnDataReady(int fd);
@@ -51,8 +61,8 @@ class H4Protocol : public HciProtocol {
   PacketReadCallback acl_cb_;
   PacketReadCallback sco_cb_;
 
-  HciPacketType hci_packet_type_{HCI_PACKET_TYPE_UNKNOWN};
   hci::HciPacketizer hci_packetizer_;
+  hci::HciTxQueue tx_queue_;
 };
 
 }  // namespace hci
@@ -21,6 +21,7 @@
 #include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
 #include <utils/Log.h>
 
@@ -39,6 +40,13 @@ size_t HciGetPacketLengthForType(HciPacketType type, const uint8_t* preamble) {
   return (((preamble[offset + 1]) << 8) | preamble[offset]);
 }
 
+// The largest packet is an ACL data packet with a 16-bit payload length.
+const size_t kMaxPacketSize = 1 + HCI_ACL_PREAMBLE_SIZE + 0xFFFF;
+
+// Room left for new data even when the buffer holds the start of a packet of
+// the largest size.
+const size_t kMinReadSize = 4096;
+
 }  // namespace
 
 namespace android {
@@ -46,61 +54,81 @@ namespace hardware {
 namespace bluetooth {
 namespace hci {
 
+HciPacketizer::HciPacketizer(HciPacketReadyCallback packet_cb)
+    : buffer_(kMaxPacketSize + kMinReadSize), packet_ready_cb_(packet_cb) {}
+
 const hidl_vec<uint8_t>& HciPacketizer::GetPacket() const { return packet_; }
 
+HciPacketType HciPacketizer::GetPacketType() const { return packet_type_; }
+
 void HciPacketizer::OnDataReady(int fd, HciPacketType packet_type) {
-  switch (state_) {
-    case HCI_PREAMBLE: {
-      ssize_t bytes_read = TEMP_FAILURE_RETRY(
-          read(fd, preamble_ + bytes_read_,
-               preamble_size_for_type[packet_type] - bytes_read_));
-      if (bytes_read == 0) {
-        // This is only expected if the UART got closed when shutting down.
-        ALOGE("%s: Unexpected EOF reading the header!", __func__);
-        sleep(5);  // Expect to be shut down within 5 seconds.
-        return;
-      }
-      if (bytes_read < 0) {
-        LOG_ALWAYS_FATAL("%s: Read header error: %s", __func__,
-                         strerror(errno));
-      }
-      bytes_read_ += bytes_read;
-      if (bytes_read_ == preamble_size_for_type[packet_type]) {
-        size_t packet_length =
-            HciGetPacketLengthForType(packet_type, preamble_);
-        packet_.resize(preamble_size_for_type[packet_type] + packet_length);
-        memcpy(packet_.data(), preamble_, preamble_size_for_type[packet_type]);
-        bytes_remaining_ = packet_length;
-        state_ = HCI_PAYLOAD;
-        bytes_read_ = 0;
-      }
-      break;
-    }
+  if (ReadAvailable(fd)) {
+    DispatchPackets(false /* has_type_byte */, packet_type);
+  }
+}
 
-    case HCI_PAYLOAD: {
-      ssize_t bytes_read = TEMP_FAILURE_RETRY(read(
-          fd,
-          packet_.data() + preamble_size_for_type[packet_type] + bytes_read_,
-          bytes_remaining_));
-      if (bytes_read == 0) {
-        // This is only expected if the UART got closed when shutting down.
-        ALOGE("%s: Unexpected EOF reading the payload!", __func__);
-        sleep(5);  // Expect to be shut down within 5 seconds.
-        return;
-      }
-      if (bytes_read < 0) {
-        LOG_ALWAYS_FATAL("%s: Read payload error: %s", __func__,
-                         strerror(errno));
-      }
-      bytes_remaining_ -= bytes_read;
-      bytes_read_ += bytes_read;
-      if (bytes_remaining_ == 0) {
-        packet_ready_cb_();
-        state_ = HCI_PREAMBLE;
-        bytes_read_ = 0;
+void HciPacketizer::OnH4DataReady(int fd) {
+  if (ReadAvailable(fd)) {
+    DispatchPackets(true /* has_type_byte */, HCI_PACKET_TYPE_UNKNOWN);
+  }
+}
+
+bool HciPacketizer::ReadAvailable(int fd) {
+  ssize_t bytes_read = TEMP_FAILURE_RETRY(read(
+      fd, buffer_.data() + buffer_end_, buffer_.size() - buffer_end_));
+  if (bytes_read == 0) {
+    // This is only expected if the UART got closed when shutting down.
+    ALOGE("%s: Unexpected EOF reading from the UART!", __func__);
+    sleep(5);  // Expect to be shut down within 5 seconds.
+    return false;
+  }
+  if (bytes_read < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return false;
+    LOG_ALWAYS_FATAL("%s: Read error: %s", __func__, strerror(errno));
+  }
+  buffer_end_ += bytes_read;
+  return true;
+}
+
+void HciPacketizer::DispatchPackets(bool has_type_byte,
+                                    HciPacketType packet_type) {
+  size_t offset = 0;
+  while (offset < buffer_end_) {
+    uint8_t* data = buffer_.data() + offset;
+    size_t available = buffer_end_ - offset;
+
+    size_t type_size = 0;
+    if (has_type_byte) {
+      packet_type = static_cast<HciPacketType>(data[0]);
+      if (packet_type < HCI_PACKET_TYPE_COMMAND ||
+          packet_type > HCI_PACKET_TYPE_EVENT) {
+        LOG_ALWAYS_FATAL("%s: Unimplemented packet type %d", __func__,
+                         static_cast<int>(packet_type));
       }
-      break;
+      type_size = 1;
     }
+
+    size_t preamble_size = preamble_size_for_type[packet_type];
+    if (available < type_size + preamble_size) break;
+    size_t packet_size =
+        preamble_size +
+        HciGetPacketLengthForType(packet_type, data + type_size);
+    if (available < type_size + packet_size) break;
+
+    packet_type_ = packet_type;
+    packet_.setToExternal(data + type_size, packet_size);
+    packet_ready_cb_();
+    offset += type_size + packet_size;
+  }
+
+  packet_type_ = HCI_PACKET_TYPE_UNKNOWN;
+  packet_ = hidl_vec<uint8_t>();
+
+  // Move what is left of a partial packet to the front, so that the next read
+  // completes it in place.
+  buffer_end_ -= offset;
+  if (buffer_end_ > 0 && offset > 0) {
+    memmove(buffer_.data(), buffer_.data() + offset, buffer_end_);
   }
 }
 
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <functional>
+#include <vector>
 
 #include <hidl/HidlSupport.h>
 
@@ -30,20 +31,38 @@ namespace hci {
 using ::android::hardware::hidl_vec;
 using HciPacketReadyCallback = std::function<void(void)>;
 
+// Reassembles HCI packets from a byte stream. Each OnDataReady call reads as
+// much as is available into a buffer that is allocated once, and reports every
+// complete packet it holds, so a burst of small packets costs a single read.
 class HciPacketizer {
  public:
-  HciPacketizer(HciPacketReadyCallback packet_cb)
-      : packet_ready_cb_(packet_cb){};
+  HciPacketizer(HciPacketReadyCallback packet_cb);
+
+  // For transports with one channel per packet type: every packet on the
+  // stream is of type packet_type.
   void OnDataReady(int fd, HciPacketType packet_type);
+
+  // For H4: every packet on the stream is preceded by its packet type.
+  void OnH4DataReady(int fd);
+
+  // The packet being reported. Only valid during the packet ready callback,
+  // since it refers to the packetizer's buffer.
   const hidl_vec<uint8_t>& GetPacket() const;
+  HciPacketType GetPacketType() const;
 
  protected:
-  enum State { HCI_PREAMBLE, HCI_PAYLOAD };
-  State state_{HCI_PREAMBLE};
-  uint8_t preamble_[HCI_PREAMBLE_SIZE_MAX];
+  // Reads from fd into the free space of the buffer. Returns false if
+  // nothing was read.
+  bool ReadAvailable(int fd);
+
+  // Reports every complete packet in the buffer and moves the start of the
+  // partial packet that follows them, if any, to the front of the buffer.
+  void DispatchPackets(bool has_type_byte, HciPacketType packet_type);
+
+  std::vector<uint8_t> buffer_;
+  size_t buffer_end_{0};
+  HciPacketType packet_type_{HCI_PACKET_TYPE_UNKNOWN};
   hidl_vec<uint8_t> packet_;
-  size_t bytes_remaining_{0};
-  size_t bytes_read_{0};
   HciPacketReadyCallback packet_ready_cb_;
 };
 
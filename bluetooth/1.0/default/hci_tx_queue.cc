@@ -0,0 +1,188 @@
+//
+// Copyright 2018 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "hci_tx_queue.h"
+
+#define LOG_TAG "android.hardware.bluetooth-hci-tx-queue"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace android {
+namespace hardware {
+namespace bluetooth {
+namespace hci {
+
+constexpr size_t HciTxQueue::kMaxQueuedPackets;
+constexpr std::chrono::microseconds HciTxQueue::kDefaultLatencyBudget;
+constexpr std::chrono::milliseconds HciTxQueue::kWriteTimeout;
+
+HciTxQueue::HciTxQueue(int fd, std::chrono::microseconds latency_budget)
+    : uart_fd_(fd), latency_budget_(latency_budget) {
+  // WriteBatch() only gets to apply kWriteTimeout if writev() returns EAGAIN
+  // instead of blocking.
+  int flags = fcntl(uart_fd_, F_GETFL);
+  if (flags == -1 || fcntl(uart_fd_, F_SETFL, flags | O_NONBLOCK) == -1) {
+    ALOGE("%s unable to make the UART non-blocking (%s)", __func__,
+          strerror(errno));
+  }
+  queue_.reserve(kMaxQueuedPackets);
+  batch_.reserve(kMaxQueuedPackets);
+  iov_.reserve(kMaxQueuedPackets);
+  spare_.reserve(2 * kMaxQueuedPackets);
+  thread_ = std::thread([this]() { ThreadRoutine(); });
+}
+
+HciTxQueue::~HciTxQueue() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  queued_cv_.notify_one();
+  space_cv_.notify_all();
+  thread_.join();
+}
+
+size_t HciTxQueue::Send(uint8_t type, const uint8_t* data, size_t length) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  space_cv_.wait(lock, [this]() {
+    return stopped_ || queue_.size() < kMaxQueuedPackets;
+  });
+  if (stopped_ || write_failed_) return 0;
+
+  std::vector<uint8_t> packet;
+  if (!spare_.empty()) {
+    packet = std::move(spare_.back());
+    spare_.pop_back();
+  }
+  packet.resize(length + 1);
+  packet[0] = type;
+  memcpy(packet.data() + 1, data, length);
+
+  if (queue_.empty()) oldest_ = std::chrono::steady_clock::now();
+  queue_.push_back(std::move(packet));
+  queued_sequence_++;
+  // The stack waits for the controller's response to a command, and SCO is
+  // isochronous, so holding either back only adds latency.
+  if (type != HCI_PACKET_TYPE_ACL_DATA ||
+      queue_.size() == kMaxQueuedPackets) {
+    urgent_ = true;
+  }
+  queued_cv_.notify_one();
+  return length + 1;
+}
+
+bool HciTxQueue::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  uint64_t sequence = queued_sequence_;
+  if (!queue_.empty()) {
+    urgent_ = true;
+    queued_cv_.notify_one();
+  }
+  written_cv_.wait(lock, [this, sequence]() {
+    return written_sequence_ >= sequence || thread_exited_;
+  });
+  return !write_failed_ && written_sequence_ >= sequence;
+}
+
+void HciTxQueue::ThreadRoutine() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    queued_cv_.wait(lock, [this]() { return stopped_ || !queue_.empty(); });
+    if (queue_.empty()) break;
+
+    if (!stopped_ && !urgent_) {
+      queued_cv_.wait_until(lock, oldest_ + latency_budget_,
+                            [this]() { return stopped_ || urgent_; });
+    }
+
+    batch_.swap(queue_);
+    urgent_ = false;
+    space_cv_.notify_all();
+
+    // Once the UART failed, the packets are dropped rather than each batch
+    // waiting out the write timeout again.
+    bool failed = write_failed_;
+    lock.unlock();
+    if (!failed && !WriteBatch()) failed = true;
+    lock.lock();
+
+    if (failed) {
+      write_failed_ = true;
+      space_cv_.notify_all();
+    }
+
+    written_sequence_ += batch_.size();
+    for (auto& packet : batch_) spare_.push_back(std::move(packet));
+    batch_.clear();
+    written_cv_.notify_all();
+  }
+  thread_exited_ = true;
+  written_cv_.notify_all();
+}
+
+bool HciTxQueue::WriteBatch() {
+  iov_.clear();
+  for (auto& packet : batch_) {
+    iov_.push_back({packet.data(), packet.size()});
+  }
+  packet_count_ += batch_.size();
+
+  size_t first = 0;
+  while (first < iov_.size()) {
+    ssize_t ret = TEMP_FAILURE_RETRY(
+        writev(uart_fd_, iov_.data() + first, iov_.size() - first));
+    if (ret == -1) {
+      if (errno == EAGAIN) {
+        struct pollfd pfd = {uart_fd_, POLLOUT, 0};
+        int timeout_ms = kWriteTimeout.count();
+        if (TEMP_FAILURE_RETRY(poll(&pfd, 1, timeout_ms)) == 0) {
+          ALOGE("%s UART not writable for %d ms", __func__, timeout_ms);
+          return false;
+        }
+        continue;
+      }
+      ALOGE("%s error writing to UART (%s)", __func__, strerror(errno));
+      return false;
+    } else if (ret == 0) {
+      ALOGE("%s zero bytes written - something went wrong...", __func__);
+      return false;
+    }
+    write_count_++;
+
+    // Skip what was written, resuming within a packet after a short write.
+    size_t written = ret;
+    while (first < iov_.size() && written >= iov_[first].iov_len) {
+      written -= iov_[first].iov_len;
+      first++;
+    }
+    if (written > 0) {
+      iov_[first].iov_base =
+          static_cast<uint8_t*>(iov_[first].iov_base) + written;
+      iov_[first].iov_len -= written;
+    }
+  }
+  return true;
+}
+
+}  // namespace hci
+}  // namespace bluetooth
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,112 @@
+//
+// Copyright 2018 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <sys/uio.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "hci_internals.h"
+
+namespace android {
+namespace hardware {
+namespace bluetooth {
+namespace hci {
+
+// Writes H4 packets to a UART from a dedicated thread, gathering every packet
+// queued since the previous write into a single writev(). Packets are written
+// in the order they were queued.
+//
+// HCI commands and SCO packets are written as soon as the thread gets to them.
+// ACL packets may wait up to the latency budget for more packets to join them,
+// unless the queue fills up first. Send() blocks while the queue is full.
+//
+// Once a write fails, or the UART accepts no data for kWriteTimeout, the queue
+// drops the packets still queued and refuses new ones. To detect the timeout,
+// the constructor sets O_NONBLOCK on fd; readers of the same fd must handle
+// EAGAIN.
+class HciTxQueue {
+ public:
+  static constexpr size_t kMaxQueuedPackets = 64;
+  static constexpr std::chrono::microseconds kDefaultLatencyBudget{500};
+  static constexpr std::chrono::milliseconds kWriteTimeout{1000};
+
+  HciTxQueue(int fd, std::chrono::microseconds latency_budget =
+                         kDefaultLatencyBudget);
+  // Writes out the packets still queued before returning.
+  ~HciTxQueue();
+
+  // Copies the packet into the queue. Returns the number of bytes queued,
+  // including the packet type, or 0 if the queue is shutting down or an
+  // earlier write failed.
+  size_t Send(uint8_t type, const uint8_t* data, size_t length);
+
+  // Blocks until every packet queued so far has been written. Returns false
+  // if some of them could not be.
+  bool Flush();
+
+  uint64_t GetPacketCount() const { return packet_count_; }
+  uint64_t GetWriteCount() const { return write_count_; }
+
+ private:
+  HciTxQueue(const HciTxQueue&) = delete;
+  HciTxQueue& operator=(const HciTxQueue&) = delete;
+
+  void ThreadRoutine();
+  // Returns false if the batch could not be written in full
+  bool WriteBatch();
+
+  int uart_fd_;
+  std::chrono::microseconds latency_budget_;
+
+  std::mutex mutex_;
+  std::condition_variable queued_cv_;
+  std::condition_variable space_cv_;
+  std::condition_variable written_cv_;
+  std::vector<std::vector<uint8_t>> queue_;
+  // When the oldest packet in queue_ was queued
+  std::chrono::steady_clock::time_point oldest_;
+  // Set when queue_ holds a packet that must not wait for the budget
+  bool urgent_{false};
+  bool stopped_{false};
+  bool write_failed_{false};
+  bool thread_exited_{false};
+  uint64_t queued_sequence_{0};
+  uint64_t written_sequence_{0};
+
+  // Owned by the writer thread between taking a batch and returning its
+  // buffers to spare_
+  std::vector<std::vector<uint8_t>> batch_;
+  std::vector<struct iovec> iov_;
+  // Buffers of written packets, reused to avoid an allocation per packet
+  std::vector<std::vector<uint8_t>> spare_;
+
+  std::atomic<uint64_t> packet_count_{0};
+  std::atomic<uint64_t> write_count_{0};
+
+  std::thread thread_;
+};
+
+}  // namespace hci
+}  // namespace bluetooth
+}  // namespace hardware
+}  // namespace android
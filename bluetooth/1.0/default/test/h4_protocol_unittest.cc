@@ -118,10 +118,6 @@ class H4ProtocolTest : public ::testing::Test {
     preamble[3] = length & 0xFF;
     preamble[4] = (length >> 8) & 0xFF;
 
-    ALOGD("%s writing", __func__);
-    TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
-    TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
-
     ALOGD("%s waiting", __func__);
     std::mutex mutex;
     std::condition_variable done;
@@ -129,6 +125,10 @@ class H4ProtocolTest : public ::testing::Test {
                                              payload)))
         .WillOnce(Notify(&mutex, &done));
 
+    ALOGD("%s writing", __func__);
+    TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
+    TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
+
     // Fail if it takes longer than 100 ms.
     auto timeout_time =
         std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
@@ -143,10 +143,6 @@ class H4ProtocolTest : public ::testing::Test {
     char preamble[4] = {HCI_PACKET_TYPE_SCO_DATA, 20, 17, 0};
     preamble[3] = strlen(payload) & 0xFF;
 
-    ALOGD("%s writing", __func__);
-    TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
-    TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
-
     ALOGD("%s waiting", __func__);
     std::mutex mutex;
     std::condition_variable done;
@@ -154,6 +150,10 @@ class H4ProtocolTest : public ::testing::Test {
                                              payload)))
         .WillOnce(Notify(&mutex, &done));
 
+    ALOGD("%s writing", __func__);
+    TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
+    TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
+
     // Fail if it takes longer than 100 ms.
     auto timeout_time =
         std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
@@ -167,10 +167,6 @@ class H4ProtocolTest : public ::testing::Test {
     // h4 type[1] + event_code[1] + size[1]
     char preamble[3] = {HCI_PACKET_TYPE_EVENT, 9, 0};
     preamble[2] = strlen(payload) & 0xFF;
-    ALOGD("%s writing", __func__);
-    TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
-    TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
-
     ALOGD("%s waiting", __func__);
     std::mutex mutex;
     std::condition_variable done;
@@ -178,9 +174,68 @@ class H4ProtocolTest : public ::testing::Test {
                                                sizeof(preamble) - 1, payload)))
         .WillOnce(Notify(&mutex, &done));
 
+    // Hold the lock while writing so that the notification cannot be missed.
+    std::unique_lock<std::mutex> lock(mutex);
+    ALOGD("%s writing", __func__);
+    TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
+    TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
+
+    done.wait(lock);
+  }
+
+  // Writes an ACL data packet, a SCO data packet and an event with a single
+  // write, so that they reach the packetizer together, and the start of
+  // another event that is completed by a second write.
+  void WriteAndExpectInboundBatch() {
+    char acl_preamble[5] = {HCI_PACKET_TYPE_ACL_DATA, 19, 92, 0, 0};
+    acl_preamble[3] = strlen(acl_data) & 0xFF;
+    char sco_preamble[4] = {HCI_PACKET_TYPE_SCO_DATA, 20, 17, 0};
+    sco_preamble[3] = strlen(sco_data) & 0xFF;
+    char event_preamble[3] = {HCI_PACKET_TYPE_EVENT, 9, 0};
+    event_preamble[2] = strlen(event_data) & 0xFF;
+
+    std::vector<char> stream;
+    stream.insert(stream.end(), acl_preamble,
+                  acl_preamble + sizeof(acl_preamble));
+    stream.insert(stream.end(), acl_data, acl_data + strlen(acl_data));
+    stream.insert(stream.end(), sco_preamble,
+                  sco_preamble + sizeof(sco_preamble));
+    stream.insert(stream.end(), sco_data, sco_data + strlen(sco_data));
+    for (int i = 0; i < 2; i++) {
+      stream.insert(stream.end(), event_preamble,
+                    event_preamble + sizeof(event_preamble));
+      stream.insert(stream.end(), event_data, event_data + strlen(event_data));
+    }
+    size_t first_write = stream.size() - strlen(event_data) / 2;
+
+    std::mutex mutex;
+    std::condition_variable done;
+    {
+      ::testing::InSequence sequence;
+      EXPECT_CALL(acl_cb_, Call(HidlVecMatches(acl_preamble + 1,
+                                               sizeof(acl_preamble) - 1,
+                                               acl_data)));
+      EXPECT_CALL(sco_cb_, Call(HidlVecMatches(sco_preamble + 1,
+                                               sizeof(sco_preamble) - 1,
+                                               sco_data)));
+      EXPECT_CALL(event_cb_, Call(HidlVecMatches(event_preamble + 1,
+                                                 sizeof(event_preamble) - 1,
+                                                 event_data)))
+          .WillOnce(::testing::Return())
+          .WillOnce(Notify(&mutex, &done));
+    }
+
+    ALOGD("%s writing", __func__);
+    TEMP_FAILURE_RETRY(write(fake_uart_, stream.data(), first_write));
+    TEMP_FAILURE_RETRY(write(fake_uart_, stream.data() + first_write,
+                             stream.size() - first_write));
+
+    // Fail if it takes longer than 100 ms.
+    auto timeout_time =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
     {
       std::unique_lock<std::mutex> lock(mutex);
-      done.wait(lock);
+      done.wait_until(lock, timeout_time);
     }
   }
 
@@ -206,6 +261,9 @@ TEST_F(H4ProtocolTest, TestReads) {
   WriteAndExpectInboundEvent(event_data);
 }
 
+// Ensure packets that arrive together, or split across reads, are all parsed
+TEST_F(H4ProtocolTest, TestBatchedReads) { WriteAndExpectInboundBatch(); }
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace bluetooth
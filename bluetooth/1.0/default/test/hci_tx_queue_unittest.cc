@@ -0,0 +1,181 @@
+//
+// Copyright 2018 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#define LOG_TAG "bt_hci_tx_queue_unittest"
+
+#include "hci_tx_queue.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace android {
+namespace hardware {
+namespace bluetooth {
+namespace V1_0 {
+namespace implementation {
+
+using hci::HciTxQueue;
+
+class HciTxQueueTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    int sockfd[2];
+    socketpair(AF_LOCAL, SOCK_STREAM, 0, sockfd);
+    hci_fd_ = sockfd[0];
+    fake_uart_ = sockfd[1];
+  }
+
+  void TearDown() override {
+    close(fake_uart_);
+    close(hci_fd_);
+  }
+
+  // Reads length bytes from the fake UART, or fewer if they do not arrive
+  // within the timeout.
+  std::vector<uint8_t> ReadUart(size_t length, int timeout_ms) {
+    std::vector<uint8_t> data(length);
+    size_t received = 0;
+    while (received < length) {
+      struct pollfd pfd = {fake_uart_, POLLIN, 0};
+      if (TEMP_FAILURE_RETRY(poll(&pfd, 1, timeout_ms)) <= 0) break;
+      ssize_t ret = TEMP_FAILURE_RETRY(
+          read(fake_uart_, data.data() + received, length - received));
+      if (ret <= 0) break;
+      received += ret;
+    }
+    data.resize(received);
+    return data;
+  }
+
+  static std::vector<uint8_t> H4Packet(uint8_t type, size_t length,
+                                       uint8_t fill) {
+    std::vector<uint8_t> packet(length + 1, fill);
+    packet[0] = type;
+    return packet;
+  }
+
+  int hci_fd_;
+  int fake_uart_;
+};
+
+// Packets of every type come out in the order they were sent
+TEST_F(HciTxQueueTest, TestOrdering) {
+  HciTxQueue queue(hci_fd_);
+  const uint8_t types[] = {HCI_PACKET_TYPE_COMMAND, HCI_PACKET_TYPE_ACL_DATA,
+                           HCI_PACKET_TYPE_ACL_DATA, HCI_PACKET_TYPE_SCO_DATA};
+
+  std::vector<uint8_t> expected;
+  for (size_t i = 0; i < 200; i++) {
+    std::vector<uint8_t> packet = H4Packet(types[i % 4], 1 + i % 37, i);
+    queue.Send(packet[0], packet.data() + 1, packet.size() - 1);
+    expected.insert(expected.end(), packet.begin(), packet.end());
+  }
+
+  EXPECT_EQ(expected, ReadUart(expected.size(), 1000));
+  EXPECT_EQ(200u, queue.GetPacketCount());
+}
+
+// ACL packets sent back to back are written together
+TEST_F(HciTxQueueTest, TestCoalescesAclData) {
+  HciTxQueue queue(hci_fd_, std::chrono::seconds(10));
+
+  std::vector<uint8_t> expected;
+  for (size_t i = 0; i < 10; i++) {
+    std::vector<uint8_t> packet = H4Packet(HCI_PACKET_TYPE_ACL_DATA, 27, i);
+    queue.Send(packet[0], packet.data() + 1, packet.size() - 1);
+    expected.insert(expected.end(), packet.begin(), packet.end());
+  }
+  queue.Flush();
+
+  EXPECT_EQ(expected, ReadUart(expected.size(), 1000));
+  EXPECT_EQ(10u, queue.GetPacketCount());
+  EXPECT_EQ(1u, queue.GetWriteCount());
+}
+
+// A command does not wait for the latency budget, and takes the ACL packets
+// queued before it along
+TEST_F(HciTxQueueTest, TestCommandsAreNotDelayed) {
+  HciTxQueue queue(hci_fd_, std::chrono::seconds(10));
+
+  std::vector<uint8_t> acl = H4Packet(HCI_PACKET_TYPE_ACL_DATA, 27, 0xaa);
+  queue.Send(acl[0], acl.data() + 1, acl.size() - 1);
+  std::vector<uint8_t> command = H4Packet(HCI_PACKET_TYPE_COMMAND, 3, 0x01);
+  queue.Send(command[0], command.data() + 1, command.size() - 1);
+
+  std::vector<uint8_t> expected = acl;
+  expected.insert(expected.end(), command.begin(), command.end());
+  EXPECT_EQ(expected, ReadUart(expected.size(), 1000));
+}
+
+// A full queue is written without waiting for the latency budget
+TEST_F(HciTxQueueTest, TestFullQueueIsNotDelayed) {
+  HciTxQueue queue(hci_fd_, std::chrono::seconds(10));
+
+  std::vector<uint8_t> packet = H4Packet(HCI_PACKET_TYPE_ACL_DATA, 27, 0x55);
+  for (size_t i = 0; i < HciTxQueue::kMaxQueuedPackets; i++) {
+    queue.Send(packet[0], packet.data() + 1, packet.size() - 1);
+  }
+
+  size_t length = packet.size() * HciTxQueue::kMaxQueuedPackets;
+  EXPECT_EQ(length, ReadUart(length, 1000).size());
+}
+
+// A failed write is reported by Flush, and later packets are refused
+TEST_F(HciTxQueueTest, TestReportsWriteFailure) {
+  int read_only_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  ASSERT_GE(read_only_fd, 0);
+  {
+    HciTxQueue queue(read_only_fd);
+    std::vector<uint8_t> command = H4Packet(HCI_PACKET_TYPE_COMMAND, 3, 0x01);
+    EXPECT_EQ(command.size(),
+              queue.Send(command[0], command.data() + 1, command.size() - 1));
+    EXPECT_FALSE(queue.Flush());
+    EXPECT_EQ(0u,
+              queue.Send(command[0], command.data() + 1, command.size() - 1));
+  }
+  close(read_only_fd);
+}
+
+// The destructor gives up on a UART that stopped accepting data
+TEST_F(HciTxQueueTest, TestStalledUartDoesNotBlockDestruction) {
+  auto start = std::chrono::steady_clock::now();
+  {
+    HciTxQueue queue(hci_fd_);
+    EXPECT_TRUE(fcntl(hci_fd_, F_GETFL) & O_NONBLOCK);
+    // Nothing reads the fake UART, so the socket buffer fills up
+    std::vector<uint8_t> packet =
+        H4Packet(HCI_PACKET_TYPE_ACL_DATA, 1021, 0x55);
+    for (size_t i = 0; i < 4096; i++) {
+      if (queue.Send(packet[0], packet.data() + 1, packet.size() - 1) == 0) {
+        break;
+      }
+    }
+  }
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+            3 * HciTxQueue::kWriteTimeout);
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace bluetooth
+}  // namespace hardware
+}  // namespace android
@@ -123,11 +123,6 @@ class MctProtocolTest : public ::testing::Test {
     preamble[2] = length & 0xFF;
     preamble[3] = (length >> 8) & 0xFF;
 
-    ALOGD("%s writing", __func__);
-    TEMP_FAILURE_RETRY(
-        write(fake_uart_[CH_ACL_IN], preamble, sizeof(preamble)));
-    TEMP_FAILURE_RETRY(write(fake_uart_[CH_ACL_IN], payload, strlen(payload)));
-
     ALOGD("%s waiting", __func__);
     std::mutex mutex;
     std::condition_variable done;
@@ -135,6 +130,11 @@ class MctProtocolTest : public ::testing::Test {
                 Call(HidlVecMatches(preamble, sizeof(preamble), payload)))
         .WillOnce(Notify(&mutex, &done));
 
+    ALOGD("%s writing", __func__);
+    TEMP_FAILURE_RETRY(
+        write(fake_uart_[CH_ACL_IN], preamble, sizeof(preamble)));
+    TEMP_FAILURE_RETRY(write(fake_uart_[CH_ACL_IN], payload, strlen(payload)));
+
     // Fail if it takes longer than 100 ms.
     auto timeout_time =
         std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
@@ -149,10 +149,6 @@ class MctProtocolTest : public ::testing::Test {
     char preamble[2] = {9, 0};
     preamble[1] = strlen(payload) & 0xFF;
 
-    ALOGD("%s writing", __func__);
-    TEMP_FAILURE_RETRY(write(fake_uart_[CH_EVT], preamble, sizeof(preamble)));
-    TEMP_FAILURE_RETRY(write(fake_uart_[CH_EVT], payload, strlen(payload)));
-
     ALOGD("%s waiting", __func__);
     std::mutex mutex;
     std::condition_variable done;
@@ -160,6 +156,10 @@ class MctProtocolTest : public ::testing::Test {
                 Call(HidlVecMatches(preamble, sizeof(preamble), payload)))
         .WillOnce(Notify(&mutex, &done));
 
+    ALOGD("%s writing", __func__);
+    TEMP_FAILURE_RETRY(write(fake_uart_[CH_EVT], preamble, sizeof(preamble)));
+    TEMP_FAILURE_RETRY(write(fake_uart_[CH_EVT], payload, strlen(payload)));
+
     // Fail if it takes longer than 100 ms.
     auto timeout_time =
         std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
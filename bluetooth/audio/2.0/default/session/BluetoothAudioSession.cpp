@@ -21,6 +21,8 @@
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 
+#include <algorithm>
+
 namespace android {
 namespace bluetooth {
 namespace audio {
@@ -44,14 +46,106 @@ AudioConfiguration BluetoothAudioSession::invalidOffloadAudioConfiguration = {};
 
 static constexpr int kFmqSendTimeoutMs = 1000;  // 1000 ms timeout for sending
 static constexpr int kWritePollMs = 1;          // polled non-blocking interval
+// how long a position reported by the Bluetooth stack is extrapolated before
+// asking the stack again
+static constexpr int64_t kPresentationPositionRefreshNs = 200 * 1000 * 1000;
+
+static inline int64_t timespec_to_ns(const timespec& ts) {
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static inline timespec timespec_from_ns(int64_t ns) {
+  return {.tv_sec = static_cast<long>(ns / 1000000000),
+          .tv_nsec = static_cast<long>(ns % 1000000000)};
+}
 
-static inline timespec timespec_convert_from_hal(const TimeSpec& TS) {
-  return {.tv_sec = static_cast<long>(TS.tvSec),
-          .tv_nsec = static_cast<long>(TS.tvNSec)};
+static inline int64_t monotonic_now_ns() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return timespec_to_ns(now);
+}
+
+static inline int64_t timespec_ns_from_hal(const TimeSpec& TS) {
+  return static_cast<int64_t>(TS.tvSec) * 1000000000 +
+         static_cast<int64_t>(TS.tvNSec);
+}
+
+// The rate at which the Bluetooth stack consumes the PCM data path, or 0 if
+// unknown
+static uint64_t pcm_bytes_per_second(const PcmParameters& pcm_config) {
+  uint64_t sample_rate = 0;
+  switch (pcm_config.sampleRate) {
+    case SampleRate::RATE_16000:
+      sample_rate = 16000;
+      break;
+    case SampleRate::RATE_24000:
+      sample_rate = 24000;
+      break;
+    case SampleRate::RATE_44100:
+      sample_rate = 44100;
+      break;
+    case SampleRate::RATE_48000:
+      sample_rate = 48000;
+      break;
+    case SampleRate::RATE_88200:
+      sample_rate = 88200;
+      break;
+    case SampleRate::RATE_96000:
+      sample_rate = 96000;
+      break;
+    case SampleRate::RATE_176400:
+      sample_rate = 176400;
+      break;
+    case SampleRate::RATE_192000:
+      sample_rate = 192000;
+      break;
+    default:
+      return 0;
+  }
+  uint64_t bytes_per_sample = 0;
+  switch (pcm_config.bitsPerSample) {
+    case BitsPerSample::BITS_16:
+      bytes_per_sample = 2;
+      break;
+    case BitsPerSample::BITS_24:
+      bytes_per_sample = 3;
+      break;
+    case BitsPerSample::BITS_32:
+      bytes_per_sample = 4;
+      break;
+    default:
+      return 0;
+  }
+  uint64_t channel_count = 0;
+  switch (pcm_config.channelMode) {
+    case ChannelMode::MONO:
+      channel_count = 1;
+      break;
+    case ChannelMode::STEREO:
+      channel_count = 2;
+      break;
+    default:
+      return 0;
+  }
+  return sample_rate * bytes_per_sample * channel_count;
 }
 
 BluetoothAudioSession::BluetoothAudioSession(const SessionType& session_type)
-    : session_type_(session_type), stack_iface_(nullptr), mDataMQ(nullptr) {
+    : session_type_(session_type),
+      stack_iface_(nullptr),
+      mDataMQ(nullptr),
+      position_seq_(0),
+      position_generation_snapshot_(0),
+      position_remote_delay_report_ns_(0),
+      position_transmitted_octets_(0),
+      position_timestamp_ns_(0),
+      position_fetched_ns_(0),
+      position_generation_(1),
+      is_streaming_(false),
+      pcm_bytes_per_second_(0),
+      pcm_octets_written_(0),
+      position_epoch_(0),
+      position_returned_({}) {
   invalidSoftwareAudioConfiguration.pcmConfig(kInvalidPcmParameters);
   invalidOffloadAudioConfiguration.codecConfig(kInvalidCodecConfiguration);
 }
@@ -79,6 +173,12 @@ void BluetoothAudioSession::OnSessionStarted(
              : kInvalidSoftwareAudioConfiguration);
   } else {
     stack_iface_ = stack_iface;
+    pcm_bytes_per_second_ =
+        (audio_config.getDiscriminator() ==
+                 AudioConfiguration::hidl_discriminator::pcmConfig
+             ? pcm_bytes_per_second(audio_config.pcmConfig())
+             : 0);
+    UpdateStreamState(false, true);
     LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_)
               << ", AudioConfiguration=" << toString(audio_config);
     ReportSessionStatus();
@@ -98,6 +198,7 @@ void BluetoothAudioSession::OnSessionEnded() {
                        : kInvalidSoftwareAudioConfiguration);
   stack_iface_ = nullptr;
   UpdateDataPath(nullptr);
+  UpdateStreamState(false, true);
 }
 
 // invoking the registered session_changed_cb_
@@ -124,6 +225,9 @@ void BluetoothAudioSession::ReportSessionStatus() {
 void BluetoothAudioSession::ReportControlStatus(
     bool start_resp, const BluetoothAudioStatus& status) {
   std::lock_guard<std::recursive_mutex> guard(mutex_);
+  if (status == BluetoothAudioStatus::SUCCESS) {
+    UpdateStreamState(start_resp, false);
+  }
   if (observers_.empty()) {
     LOG(WARNING) << __func__ << " - SessionType=" << toString(session_type_)
                  << " has NO port state observer";
@@ -287,31 +391,94 @@ void BluetoothAudioSession::StopStream() {
     LOG(WARNING) << __func__ << " - IBluetoothAudioPort SessionType="
                  << toString(session_type_) << " failed";
   }
+  // the transmitted octets are reset by stopStream()
+  UpdateStreamState(false, true);
 }
 
-bool BluetoothAudioSession::GetPresentationPosition(
-    uint64_t* remote_delay_report_ns, uint64_t* total_bytes_readed,
-    timespec* data_position) {
-  std::lock_guard<std::recursive_mutex> guard(mutex_);
-  if (!IsSessionReady()) {
-    LOG(DEBUG) << __func__ << " - SessionType=" << toString(session_type_)
-               << " has NO session";
-    return false;
+void BluetoothAudioSession::UpdateStreamState(bool is_streaming,
+                                              bool reset_octets) {
+  is_streaming_ = is_streaming;
+  if (reset_octets) {
+    pcm_octets_written_ = 0;
+    ++position_epoch_;
+  }
+  ++position_generation_;
+}
+
+bool BluetoothAudioSession::ReadPresentationPosition(
+    PresentationPosition* position) {
+  uint32_t seq;
+  do {
+    seq = position_seq_.load(std::memory_order_acquire);
+    if (seq & 1) {
+      // being written
+      continue;
+    }
+    position->generation =
+        position_generation_snapshot_.load(std::memory_order_relaxed);
+    position->remote_delay_report_ns =
+        position_remote_delay_report_ns_.load(std::memory_order_relaxed);
+    position->transmitted_octets =
+        position_transmitted_octets_.load(std::memory_order_relaxed);
+    position->timestamp_ns =
+        position_timestamp_ns_.load(std::memory_order_relaxed);
+    position->fetched_ns = position_fetched_ns_.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((seq & 1) || seq != position_seq_.load(std::memory_order_relaxed));
+  return position->generation == position_generation_.load() &&
+         monotonic_now_ns() - position->fetched_ns <
+             kPresentationPositionRefreshNs;
+}
+
+void BluetoothAudioSession::WritePresentationPosition(
+    const PresentationPosition& position) {
+  // This is locked already by position_refresh_mutex_
+  uint32_t seq = position_seq_.load(std::memory_order_relaxed);
+  position_seq_.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  position_generation_snapshot_.store(position.generation,
+                                      std::memory_order_relaxed);
+  position_remote_delay_report_ns_.store(position.remote_delay_report_ns,
+                                         std::memory_order_relaxed);
+  position_transmitted_octets_.store(position.transmitted_octets,
+                                     std::memory_order_relaxed);
+  position_timestamp_ns_.store(position.timestamp_ns,
+                               std::memory_order_relaxed);
+  position_fetched_ns_.store(position.fetched_ns, std::memory_order_relaxed);
+  position_seq_.store(seq + 2, std::memory_order_release);
+}
+
+bool BluetoothAudioSession::RefreshPresentationPosition(
+    PresentationPosition* position) {
+  std::lock_guard<std::mutex> refresh_guard(position_refresh_mutex_);
+  // another caller may have refreshed it while this one was waiting
+  if (ReadPresentationPosition(position)) {
+    return true;
+  }
+
+  sp<IBluetoothAudioPort> stack_iface;
+  {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    if (!IsSessionReady()) {
+      LOG(DEBUG) << __func__ << " - SessionType=" << toString(session_type_)
+                 << " has NO session";
+      return false;
+    }
+    stack_iface = stack_iface_;
+    position->generation = position_generation_;
   }
+
   bool retval = false;
-  auto hal_retval = stack_iface_->getPresentationPosition(
-      [&retval, &remote_delay_report_ns, &total_bytes_readed, &data_position](
-          BluetoothAudioStatus status,
-          const uint64_t& remoteDeviceAudioDelayNanos,
-          uint64_t transmittedOctets,
-          const TimeSpec& transmittedOctetsTimeStamp) {
+  auto hal_retval = stack_iface->getPresentationPosition(
+      [&retval, &position](BluetoothAudioStatus status,
+                           const uint64_t& remoteDeviceAudioDelayNanos,
+                           uint64_t transmittedOctets,
+                           const TimeSpec& transmittedOctetsTimeStamp) {
         if (status == BluetoothAudioStatus::SUCCESS) {
-          if (remote_delay_report_ns)
-            *remote_delay_report_ns = remoteDeviceAudioDelayNanos;
-          if (total_bytes_readed) *total_bytes_readed = transmittedOctets;
-          if (data_position)
-            *data_position =
-                timespec_convert_from_hal(transmittedOctetsTimeStamp);
+          position->remote_delay_report_ns = remoteDeviceAudioDelayNanos;
+          position->transmitted_octets = transmittedOctets;
+          position->timestamp_ns =
+              timespec_ns_from_hal(transmittedOctetsTimeStamp);
           retval = true;
         }
       });
@@ -320,9 +487,66 @@ bool BluetoothAudioSession::GetPresentationPosition(
                  << toString(session_type_) << " failed";
     return false;
   }
+  if (retval) {
+    position->fetched_ns = monotonic_now_ns();
+    WritePresentationPosition(*position);
+  }
   return retval;
 }
 
+bool BluetoothAudioSession::GetPresentationPosition(
+    uint64_t* remote_delay_report_ns, uint64_t* total_bytes_readed,
+    timespec* data_position) {
+  uint32_t epoch = position_epoch_;
+  PresentationPosition position;
+  if (!ReadPresentationPosition(&position) &&
+      !RefreshPresentationPosition(&position)) {
+    return false;
+  }
+
+  uint64_t bytes_per_second = pcm_bytes_per_second_;
+  if (is_streaming_ && bytes_per_second > 0 && position.timestamp_ns > 0) {
+    // The stack keeps consuming the data path at the PCM rate, but can not
+    // have sent more than has been written to it.
+    int64_t now_ns = monotonic_now_ns();
+    if (now_ns > position.timestamp_ns) {
+      uint64_t elapsed_octets = static_cast<uint64_t>(
+          (now_ns - position.timestamp_ns) * bytes_per_second / 1000000000);
+      uint64_t octets_written = pcm_octets_written_;
+      position.transmitted_octets = std::max(
+          position.transmitted_octets,
+          std::min(position.transmitted_octets + elapsed_octets,
+                   octets_written));
+      position.timestamp_ns = now_ns;
+    }
+  }
+
+  {
+    // The stack may report less than was extrapolated from its previous
+    // position, so hold the position until it catches up. A position computed
+    // across a restart of the counters is not recorded.
+    std::lock_guard<std::mutex> returned_guard(position_returned_mutex_);
+    if (epoch == position_epoch_) {
+      if (epoch == position_returned_.epoch) {
+        position.transmitted_octets =
+            std::max(position.transmitted_octets,
+                     position_returned_.transmitted_octets);
+        position.timestamp_ns =
+            std::max(position.timestamp_ns, position_returned_.timestamp_ns);
+      }
+      position_returned_ = {.epoch = epoch,
+                            .transmitted_octets = position.transmitted_octets,
+                            .timestamp_ns = position.timestamp_ns};
+    }
+  }
+
+  if (remote_delay_report_ns)
+    *remote_delay_report_ns = position.remote_delay_report_ns;
+  if (total_bytes_readed) *total_bytes_readed = position.transmitted_octets;
+  if (data_position) *data_position = timespec_from_ns(position.timestamp_ns);
+  return true;
+}
+
 void BluetoothAudioSession::UpdateTracksMetadata(
     const struct source_metadata* source_metadata) {
   std::lock_guard<std::recursive_mutex> guard(mutex_);
@@ -387,6 +611,7 @@ size_t BluetoothAudioSession::OutWritePcmData(const void* buffer,
         return totalWritten;
       }
       totalWritten += availableToWrite;
+      pcm_octets_written_ += availableToWrite;
     } else if (ms_timeout >= kWritePollMs) {
       lock.unlock();
       usleep(kWritePollMs * 1000);
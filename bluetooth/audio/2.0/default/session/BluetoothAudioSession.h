@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <mutex>
 #include <unordered_map>
 
@@ -98,10 +99,56 @@ class BluetoothAudioSession {
   std::unordered_map<uint16_t, std::shared_ptr<struct PortStatusCallbacks>>
       observers_;
 
+  // The last presentation position reported by the Bluetooth stack. It is
+  // published with a sequence counter, so position queries read it without
+  // taking mutex_, and only go back to the stack once it is too old.
+  struct PresentationPosition {
+    uint32_t generation;
+    uint64_t remote_delay_report_ns;
+    uint64_t transmitted_octets;
+    int64_t timestamp_ns;  // CLOCK_MONOTONIC
+    int64_t fetched_ns;    // CLOCK_MONOTONIC
+  };
+  std::atomic<uint32_t> position_seq_;
+  std::atomic<uint32_t> position_generation_snapshot_;
+  std::atomic<uint64_t> position_remote_delay_report_ns_;
+  std::atomic<uint64_t> position_transmitted_octets_;
+  std::atomic<int64_t> position_timestamp_ns_;
+  std::atomic<int64_t> position_fetched_ns_;
+  // serializes fetching the position from the Bluetooth stack, which is the
+  // only writer of the snapshot above
+  std::mutex position_refresh_mutex_;
+  // bumped whenever the session or stream state changes, which invalidates
+  // the snapshot
+  std::atomic<uint32_t> position_generation_;
+  // the stream state and the PCM data path, used to extrapolate the snapshot
+  std::atomic<bool> is_streaming_;
+  std::atomic<uint64_t> pcm_bytes_per_second_;
+  std::atomic<uint64_t> pcm_octets_written_;
+  // bumped whenever the octet counters restart from zero
+  std::atomic<uint32_t> position_epoch_;
+  // The last position returned by GetPresentationPosition. Later ones never
+  // go below it, even when the stack reports fewer octets than were
+  // extrapolated before.
+  struct ReturnedPosition {
+    uint32_t epoch;
+    uint64_t transmitted_octets;
+    int64_t timestamp_ns;
+  };
+  std::mutex position_returned_mutex_;
+  ReturnedPosition position_returned_;
+
   bool UpdateDataPath(const DataMQ::Descriptor* dataMQ);
   bool UpdateAudioConfig(const AudioConfiguration& audio_config);
   // invoking the registered session_changed_cb_
   void ReportSessionStatus();
+  // resets the stream state and invalidates the position snapshot
+  void UpdateStreamState(bool is_streaming, bool reset_octets);
+  bool ReadPresentationPosition(PresentationPosition* position);
+  void WritePresentationPosition(const PresentationPosition& position);
+  // fetches the position from the Bluetooth stack, without holding mutex_
+  // during the call
+  bool RefreshPresentationPosition(PresentationPosition* position);
 
  public:
   BluetoothAudioSession(const SessionType& session_type);
@@ -146,6 +193,8 @@ class BluetoothAudioSession {
   bool StartStream();
   bool SuspendStream();
   void StopStream();
+  // The position is the one last reported by the Bluetooth stack, advanced
+  // at the PCM rate while streaming, so most calls do not reach the stack.
   bool GetPresentationPosition(uint64_t* remote_delay_report_ns,
                                uint64_t* total_bytes_readed,
                                timespec* data_position);
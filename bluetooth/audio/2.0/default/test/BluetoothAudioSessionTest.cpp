@@ -0,0 +1,262 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BluetoothAudioSessionTest"
+
+#include "BluetoothAudioSession.h"
+
+#include <gtest/gtest.h>
+#include <time.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::audio::common::V5_0::SourceMetadata;
+using ::android::hardware::bluetooth::audio::V2_0::TimeSpec;
+
+namespace {
+
+constexpr size_t kDataMQSize = 64 * 1024;
+
+// 44.1 kHz, 16 bits, stereo
+constexpr uint64_t kBytesPerSecond = 44100 * 2 * 2;
+
+int64_t MonotonicNowNs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+class FakeBluetoothAudioPort : public IBluetoothAudioPort {
+ public:
+  Return<void> startStream() override { return Void(); }
+  Return<void> suspendStream() override { return Void(); }
+  Return<void> stopStream() override { return Void(); }
+  Return<void> updateMetadata(const SourceMetadata&) override {
+    return Void();
+  }
+
+  Return<void> getPresentationPosition(
+      getPresentationPosition_cb _hidl_cb) override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    calls_++;
+    called_.notify_all();
+    released_.wait(lock, [this] { return !blocked_; });
+    int64_t now_ns = MonotonicNowNs();
+    TimeSpec timestamp = {.tvSec = static_cast<uint64_t>(now_ns / 1000000000),
+                          .tvNSec = static_cast<uint64_t>(now_ns % 1000000000)};
+    uint64_t transmitted_octets =
+        transmitted_octets_ +
+        (now_ns - set_ns_) * octets_per_second_ / 1000000000;
+    _hidl_cb(BluetoothAudioStatus::SUCCESS, 0, transmitted_octets, timestamp);
+    return Void();
+  }
+
+  void SetTransmittedOctets(uint64_t octets) {
+    SetTransmittedOctets(octets, 0);
+  }
+
+  // The reported position then keeps growing at the given rate, as the stack
+  // sends the data
+  void SetTransmittedOctets(uint64_t octets, uint64_t octets_per_second) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    transmitted_octets_ = octets;
+    octets_per_second_ = octets_per_second;
+    set_ns_ = MonotonicNowNs();
+  }
+
+  int Calls() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return calls_;
+  }
+
+  void Block() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    blocked_ = true;
+  }
+
+  void WaitForCall(int calls) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    called_.wait(lock, [this, calls] { return calls_ >= calls; });
+  }
+
+  void Release() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    blocked_ = false;
+    released_.notify_all();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable called_;
+  std::condition_variable released_;
+  bool blocked_ = false;
+  int calls_ = 0;
+  uint64_t transmitted_octets_ = 0;
+  uint64_t octets_per_second_ = 0;
+  int64_t set_ns_ = 0;
+};
+
+}  // namespace
+
+class BluetoothAudioSessionTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    session_ = std::make_unique<BluetoothAudioSession>(
+        SessionType::A2DP_SOFTWARE_ENCODING_DATAPATH);
+    port_ = new FakeBluetoothAudioPort();
+    data_mq_ = std::make_unique<DataMQ>(kDataMQSize, false);
+    ASSERT_TRUE(data_mq_->isValid());
+
+    AudioConfiguration audio_config;
+    audio_config.pcmConfig({.sampleRate = SampleRate::RATE_44100,
+                            .channelMode = ChannelMode::STEREO,
+                            .bitsPerSample = BitsPerSample::BITS_16});
+    session_->OnSessionStarted(port_, data_mq_->getDesc(), audio_config);
+    ASSERT_TRUE(session_->IsSessionReady());
+  }
+
+  void TearDown() override { session_->OnSessionEnded(); }
+
+  size_t Write(size_t bytes) {
+    std::vector<uint8_t> buffer(bytes);
+    return session_->OutWritePcmData(buffer.data(), buffer.size());
+  }
+
+  uint64_t TransmittedOctets(int64_t* timestamp_ns = nullptr) {
+    uint64_t transmitted_octets = 0;
+    timespec data_position;
+    EXPECT_TRUE(session_->GetPresentationPosition(
+        nullptr, &transmitted_octets, &data_position));
+    if (timestamp_ns) {
+      *timestamp_ns =
+          static_cast<int64_t>(data_position.tv_sec) * 1000000000 +
+          data_position.tv_nsec;
+    }
+    return transmitted_octets;
+  }
+
+  std::unique_ptr<BluetoothAudioSession> session_;
+  sp<FakeBluetoothAudioPort> port_;
+  std::unique_ptr<DataMQ> data_mq_;
+};
+
+TEST_F(BluetoothAudioSessionTest, PositionIsCachedBetweenRefreshes) {
+  port_->SetTransmittedOctets(1000);
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ(1000u, TransmittedOctets());
+  }
+  EXPECT_EQ(1, port_->Calls());
+}
+
+TEST_F(BluetoothAudioSessionTest, PositionIsExtrapolatedWhileStreaming) {
+  session_->ReportControlStatus(true, BluetoothAudioStatus::SUCCESS);
+  ASSERT_EQ(kDataMQSize, Write(kDataMQSize));
+  port_->SetTransmittedOctets(1000, kBytesPerSecond);
+
+  uint64_t first = TransmittedOctets();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  uint64_t second = TransmittedOctets();
+
+  // 50 ms at 176400 bytes per second is 8820 bytes
+  EXPECT_GE(second, first + kBytesPerSecond / 20);
+  EXPECT_LE(second, kDataMQSize);
+  EXPECT_EQ(1, port_->Calls());
+}
+
+TEST_F(BluetoothAudioSessionTest, PositionNeverGoesBackwards) {
+  session_->ReportControlStatus(true, BluetoothAudioStatus::SUCCESS);
+  ASSERT_EQ(kDataMQSize, Write(kDataMQSize));
+  // The stack falls behind the PCM rate, so each refresh reports less than
+  // was extrapolated from the previous one
+  port_->SetTransmittedOctets(1000, kBytesPerSecond / 2);
+
+  int64_t last_timestamp_ns = 0;
+  uint64_t last_octets = TransmittedOctets(&last_timestamp_ns);
+  for (int i = 0; i < 50; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    int64_t timestamp_ns = 0;
+    uint64_t octets = TransmittedOctets(&timestamp_ns);
+    EXPECT_GE(octets, last_octets);
+    EXPECT_GE(timestamp_ns, last_timestamp_ns);
+    last_octets = octets;
+    last_timestamp_ns = timestamp_ns;
+  }
+  // 500 ms spans a couple of refreshes
+  EXPECT_GE(port_->Calls(), 3);
+  EXPECT_LE(last_octets, kDataMQSize);
+}
+
+TEST_F(BluetoothAudioSessionTest, PositionIsBoundedByWrittenData) {
+  session_->ReportControlStatus(true, BluetoothAudioStatus::SUCCESS);
+  ASSERT_EQ(100u, Write(100));
+
+  TransmittedOctets();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(100u, TransmittedOctets());
+}
+
+TEST_F(BluetoothAudioSessionTest, PositionIsNotExtrapolatedWhenSuspended) {
+  session_->ReportControlStatus(true, BluetoothAudioStatus::SUCCESS);
+  ASSERT_EQ(kDataMQSize, Write(kDataMQSize));
+  session_->ReportControlStatus(false, BluetoothAudioStatus::SUCCESS);
+
+  port_->SetTransmittedOctets(1000);
+  EXPECT_EQ(1000u, TransmittedOctets());
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(1000u, TransmittedOctets());
+}
+
+TEST_F(BluetoothAudioSessionTest, StreamStateChangeRefreshesPosition) {
+  TransmittedOctets();
+  session_->ReportControlStatus(true, BluetoothAudioStatus::SUCCESS);
+  TransmittedOctets();
+  EXPECT_EQ(2, port_->Calls());
+}
+
+TEST_F(BluetoothAudioSessionTest, NoPositionAfterSessionEnded) {
+  TransmittedOctets();
+  session_->OnSessionEnded();
+  EXPECT_FALSE(session_->GetPresentationPosition(nullptr, nullptr, nullptr));
+}
+
+TEST_F(BluetoothAudioSessionTest, DataPathDoesNotWaitForPositionQuery) {
+  session_->ReportControlStatus(true, BluetoothAudioStatus::SUCCESS);
+  port_->Block();
+  auto query = std::async(std::launch::async, [this] {
+    return session_->GetPresentationPosition(nullptr, nullptr, nullptr);
+  });
+  port_->WaitForCall(1);
+
+  EXPECT_EQ(100u, Write(100));
+
+  port_->Release();
+  EXPECT_TRUE(query.get());
+}
+
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
@@ -46,6 +46,9 @@ static constexpr auto list = 1s;
 
 }  // namespace delay
 
+// Keeps each onProgramListUpdated transaction well below the binder buffer size.
+static constexpr size_t maxProgramListChunkSize = 64;
+
 TunerSession::TunerSession(BroadcastRadio& module, const sp<ITunerCallback>& callback)
     : mCallback(callback), mModule(module) {
     auto&& ranges = module.getAmFmConfig().ranges;
@@ -165,6 +168,8 @@ Return<Result> TunerSession::scan(bool directionUp, bool skipSubChannel) {
 
         lock_guard<mutex> lk(mMut);
         tuneInternalLocked(tuneTo);
+        // The scan went through the band, report what changed on the way.
+        updateProgramListLocked();
     };
     mThread.schedule(task, delay::seek);
 
@@ -234,30 +239,45 @@ Return<Result> TunerSession::startProgramListUpdates(const ProgramFilter& filter
     lock_guard<mutex> lk(mMut);
     if (mIsClosed) return Result::INVALID_STATE;
 
-    auto list = virtualRadio().getProgramList();
-    vector<VirtualProgram> filteredList;
-    auto filterCb = [&filter](const VirtualProgram& program) {
-        return utils::satisfies(filter, program.selector);
-    };
-    std::copy_if(list.begin(), list.end(), std::back_inserter(filteredList), filterCb);
+    // The client drops its list, so the next update sends it in full.
+    mProgramListFilter.emplace(filter);
+    mDeliveredPrograms.clear();
+    mProgramListPurgePending = true;
 
-    auto task = [this, list]() {
+    auto task = [this]() {
         lock_guard<mutex> lk(mMut);
-
-        ProgramListChunk chunk = {};
-        chunk.purge = true;
-        chunk.complete = true;
-        chunk.modified = hidl_vec<ProgramInfo>(list.begin(), list.end());
-
-        mCallback->onProgramListUpdated(chunk);
+        updateProgramListLocked();
     };
     mThread.schedule(task, delay::list);
 
     return Result::OK;
 }
 
+void TunerSession::updateProgramListLocked() {
+    if (!mProgramListFilter) return;
+
+    vector<ProgramInfo> list;
+    for (auto&& program : virtualRadio().getProgramList()) {
+        if (mProgramListFilter->matches(program.selector)) list.push_back(program);
+    }
+
+    auto chunks = utils::diffProgramList(mDeliveredPrograms, list, mProgramListPurgePending,
+                                         maxProgramListChunkSize);
+    mProgramListPurgePending = false;
+
+    LOG(VERBOSE) << "sending " << chunks.size() << " program list chunk(s)";
+    for (auto&& chunk : chunks) {
+        mCallback->onProgramListUpdated(chunk);
+    }
+}
+
 Return<void> TunerSession::stopProgramListUpdates() {
     LOG(DEBUG) << "requested program list updates to stop";
+    lock_guard<mutex> lk(mMut);
+
+    mProgramListFilter.reset();
+    mDeliveredPrograms.clear();
+    mProgramListPurgePending = false;
     return {};
 }
 
@@ -293,6 +313,8 @@ Return<void> TunerSession::close() {
 
     mIsClosed = true;
     mThread.cancelAll();
+    mProgramListFilter.reset();
+    mDeliveredPrograms.clear();
     return {};
 }
 
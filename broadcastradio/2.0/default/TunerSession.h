@@ -20,6 +20,7 @@
 
 #include <android/hardware/broadcastradio/2.0/ITunerCallback.h>
 #include <android/hardware/broadcastradio/2.0/ITunerSession.h>
+#include <broadcastradio-utils-2x/Utils.h>
 #include <broadcastradio-utils/WorkerThread.h>
 
 #include <optional>
@@ -63,8 +64,16 @@ struct TunerSession : public ITunerSession {
     bool mIsTuneCompleted = false;
     ProgramSelector mCurrentProgram = {};
 
+    // Set while program list updates are enabled.
+    std::optional<utils::CompiledProgramFilter> mProgramListFilter;
+    // The list last sent to the client, so that later updates only carry the changes.
+    utils::ProgramInfoSet mDeliveredPrograms;
+    // The client's list was cleared and has to be sent again in full.
+    bool mProgramListPurgePending = false;
+
     void cancelLocked();
     void tuneInternalLocked(const ProgramSelector& sel);
+    void updateProgramListLocked();
     const VirtualRadio& virtualRadio() const;
     const BroadcastRadio& module() const;
 };
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <broadcastradio-utils-2x/Utils.h>
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+namespace {
+
+namespace utils = android::hardware::broadcastradio::utils;
+
+using android::hardware::broadcastradio::V2_0::IdentifierType;
+using android::hardware::broadcastradio::V2_0::ProgramFilter;
+using android::hardware::broadcastradio::V2_0::ProgramIdentifier;
+using android::hardware::broadcastradio::V2_0::ProgramSelector;
+using std::vector;
+
+vector<ProgramSelector> makePrograms() {
+    vector<ProgramSelector> list;
+    for (uint32_t i = 0; i < 32; i++) {
+        list.push_back(utils::make_selector_dab(0xE1C000 + i, 0xCE15 + i / 8));
+        list.push_back(utils::make_selector_amfm(87700 + i * 200));
+    }
+    // A DAB ensemble, which is a category rather than a program
+    ProgramSelector ensemble = {};
+    ensemble.primaryId = utils::make_identifier(IdentifierType::DAB_ENSEMBLE, 0xCE15);
+    list.push_back(ensemble);
+    // A vendor identifier, and one out of any defined range
+    ProgramSelector vendor = {};
+    vendor.primaryId = utils::make_identifier(IdentifierType::VENDOR_START, 1);
+    vendor.secondaryIds = {{0x10000, 2}};
+    list.push_back(vendor);
+    return list;
+}
+
+void expectSameAsSatisfies(const ProgramFilter& filter) {
+    utils::CompiledProgramFilter compiled(filter);
+    for (auto&& sel : makePrograms()) {
+        EXPECT_EQ(utils::satisfies(filter, sel), compiled.matches(sel))
+            << "filter " << toString(filter) << ", selector " << toString(sel);
+    }
+}
+
+TEST(ProgramFilterTest, emptyFilter) {
+    ProgramFilter filter = {};
+    expectSameAsSatisfies(filter);
+    filter.includeCategories = true;
+    expectSameAsSatisfies(filter);
+}
+
+TEST(ProgramFilterTest, identifierTypes) {
+    ProgramFilter filter = {};
+    filter.identifierTypes = {static_cast<uint32_t>(IdentifierType::DAB_ENSEMBLE)};
+    expectSameAsSatisfies(filter);
+    filter.includeCategories = true;
+    expectSameAsSatisfies(filter);
+    filter.identifierTypes = {static_cast<uint32_t>(IdentifierType::VENDOR_END), 0x10000};
+    expectSameAsSatisfies(filter);
+}
+
+TEST(ProgramFilterTest, identifiers) {
+    ProgramFilter filter = {};
+    filter.identifiers = {
+        utils::make_identifier(IdentifierType::DAB_ENSEMBLE, 0xCE16),
+        utils::make_identifier(IdentifierType::AMFM_FREQUENCY, 88100),
+        // Same value, different type
+        utils::make_identifier(IdentifierType::DAB_SID_EXT, 88300),
+    };
+    expectSameAsSatisfies(filter);
+
+    filter.identifiers = {{0x10000, 2}};
+    expectSameAsSatisfies(filter);
+}
+
+TEST(ProgramFilterTest, randomFilters) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> count(0, 4);
+    std::uniform_int_distribution<uint32_t> type(0, 14);
+    std::uniform_int_distribution<uint32_t> index(0, 40);
+
+    auto programs = makePrograms();
+    for (int i = 0; i < 200; i++) {
+        ProgramFilter filter = {};
+        filter.includeCategories = count(rng) > 1;
+
+        vector<uint32_t> types;
+        for (int j = count(rng); j > 0; j--) types.push_back(type(rng));
+        filter.identifierTypes = types;
+
+        vector<ProgramIdentifier> identifiers;
+        for (int j = count(rng); j > 0; j--) {
+            auto& sel = programs[index(rng) % programs.size()];
+            identifiers.push_back(j % 2 ? sel.primaryId : *(begin(sel) + sel.secondaryIds.size()));
+        }
+        filter.identifiers = identifiers;
+
+        expectSameAsSatisfies(filter);
+    }
+}
+
+}  // anonymous namespace
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <broadcastradio-utils-2x/Utils.h>
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+namespace {
+
+namespace utils = android::hardware::broadcastradio::utils;
+
+using android::hardware::broadcastradio::V2_0::MetadataKey;
+using android::hardware::broadcastradio::V2_0::ProgramInfo;
+using android::hardware::broadcastradio::V2_0::ProgramListChunk;
+using std::vector;
+
+static constexpr size_t kChunkSize = 8;
+
+ProgramInfo makeProgram(uint32_t frequency, const std::string& title = "") {
+    ProgramInfo info = {};
+    info.selector = utils::make_selector_amfm(frequency);
+    info.logicallyTunedTo = info.selector.primaryId;
+    info.physicallyTunedTo = info.selector.primaryId;
+    if (!title.empty()) {
+        info.metadata = {utils::make_metadata(MetadataKey::SONG_TITLE, title)};
+    }
+    return info;
+}
+
+vector<ProgramInfo> makeBand(uint32_t count) {
+    vector<ProgramInfo> list;
+    for (uint32_t i = 0; i < count; i++) {
+        list.push_back(makeProgram(87500 + i * 200));
+    }
+    return list;
+}
+
+/**
+ * Applies the chunks the way a client would, checking the chunk invariants on the way.
+ */
+void apply(utils::ProgramInfoSet& clientList, const vector<ProgramListChunk>& chunks) {
+    for (size_t i = 0; i < chunks.size(); i++) {
+        auto& chunk = chunks[i];
+        EXPECT_LE(chunk.modified.size() + chunk.removed.size(), kChunkSize);
+        EXPECT_EQ(i == chunks.size() - 1, chunk.complete);
+        if (chunk.purge) {
+            EXPECT_EQ(0u, i);
+            EXPECT_EQ(0u, chunk.removed.size());
+        }
+        utils::updateProgramList(clientList, chunk);
+    }
+}
+
+/**
+ * Checks the client list holds exactly the full list, including program details.
+ */
+void expectSameList(const vector<ProgramInfo>& expected, const utils::ProgramInfoSet& actual) {
+    utils::ProgramInfoSet expectedSet(expected.begin(), expected.end());
+    ASSERT_EQ(expectedSet.size(), actual.size());
+    for (auto&& info : expectedSet) {
+        auto it = actual.find(info);
+        ASSERT_NE(actual.end(), it) << "missing " << toString(info.selector);
+        EXPECT_TRUE(*it == info) << "stale " << toString(*it);
+    }
+}
+
+size_t countModified(const vector<ProgramListChunk>& chunks) {
+    size_t count = 0;
+    for (auto&& chunk : chunks) count += chunk.modified.size();
+    return count;
+}
+
+TEST(ProgramListTest, purgeSendsWholeListInChunks) {
+    auto band = makeBand(50);
+    utils::ProgramInfoSet delivered;
+    utils::ProgramInfoSet clientList = {makeProgram(108000)};
+
+    auto chunks = utils::diffProgramList(delivered, band, true, kChunkSize);
+
+    ASSERT_EQ(7u, chunks.size());
+    EXPECT_TRUE(chunks[0].purge);
+    apply(clientList, chunks);
+    expectSameList(band, clientList);
+    expectSameList(band, delivered);
+}
+
+TEST(ProgramListTest, purgeOfEmptyListCompletes) {
+    utils::ProgramInfoSet delivered;
+    auto chunks = utils::diffProgramList(delivered, {}, true, kChunkSize);
+
+    ASSERT_EQ(1u, chunks.size());
+    EXPECT_TRUE(chunks[0].purge);
+    EXPECT_TRUE(chunks[0].complete);
+    EXPECT_EQ(0u, chunks[0].modified.size());
+}
+
+TEST(ProgramListTest, unchangedListSendsNothing) {
+    auto band = makeBand(20);
+    utils::ProgramInfoSet delivered;
+    utils::diffProgramList(delivered, band, true, kChunkSize);
+
+    EXPECT_TRUE(utils::diffProgramList(delivered, band, false, kChunkSize).empty());
+}
+
+TEST(ProgramListTest, deltaCarriesOnlyChanges) {
+    auto band = makeBand(20);
+    utils::ProgramInfoSet delivered;
+    utils::ProgramInfoSet clientList;
+    apply(clientList, utils::diffProgramList(delivered, band, true, kChunkSize));
+
+    auto next = band;
+    next.erase(next.begin() + 3);                     // removed
+    next[5] = makeProgram(87500 + 6 * 200, "Title");  // modified
+    next.push_back(makeProgram(107900));              // added
+
+    auto chunks = utils::diffProgramList(delivered, next, false, kChunkSize);
+
+    ASSERT_EQ(1u, chunks.size());
+    EXPECT_FALSE(chunks[0].purge);
+    EXPECT_EQ(2u, chunks[0].modified.size());
+    ASSERT_EQ(1u, chunks[0].removed.size());
+    EXPECT_EQ(band[3].selector.primaryId, chunks[0].removed[0]);
+    apply(clientList, chunks);
+    expectSameList(next, clientList);
+}
+
+// Drives random changes through the delta stream and checks the client ends up with the same
+// list as if it had been sent in full each time.
+TEST(ProgramListTest, deltaStreamMatchesFullList) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<uint32_t> channel(0, 99);
+    std::uniform_int_distribution<int> title(0, 3);
+
+    vector<ProgramInfo> current = makeBand(40);
+    utils::ProgramInfoSet delivered;
+    utils::ProgramInfoSet clientList;
+    apply(clientList, utils::diffProgramList(delivered, current, true, kChunkSize));
+
+    for (int scan = 0; scan < 50; scan++) {
+        utils::ProgramInfoSet fullList(current.begin(), current.end());
+        for (int change = 0; change < 10; change++) {
+            auto program = makeProgram(87500 + channel(rng) * 200,
+                                       "Title " + std::to_string(title(rng)));
+            if (fullList.count(program) > 0 && title(rng) == 0) {
+                fullList.erase(program);
+            } else {
+                fullList.erase(program);
+                fullList.insert(program);
+            }
+        }
+        vector<ProgramInfo> next(fullList.begin(), fullList.end());
+
+        auto chunks = utils::diffProgramList(delivered, next, false, kChunkSize);
+        EXPECT_LE(countModified(chunks), 10u);
+        apply(clientList, chunks);
+        expectSameList(next, clientList);
+
+        current = std::move(next);
+    }
+}
+
+}  // anonymous namespace
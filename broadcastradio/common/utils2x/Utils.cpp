@@ -350,9 +350,7 @@ bool satisfies(const ProgramFilter& filter, const ProgramSelector& sel) {
     return true;
 }
 
-size_t ProgramInfoHasher::operator()(const ProgramInfo& info) const {
-    auto& id = info.selector.primaryId;
-
+size_t ProgramIdentifierHasher::operator()(const ProgramIdentifier& id) const {
     /* This is not the best hash implementation, but good enough for default HAL
      * implementation and tests. */
     auto h = std::hash<uint32_t>{}(id.type);
@@ -362,6 +360,60 @@ size_t ProgramInfoHasher::operator()(const ProgramInfo& info) const {
     return h;
 }
 
+CompiledProgramFilter::CompiledProgramFilter(const ProgramFilter& filter)
+    : mIncludeCategories(filter.includeCategories),
+      mAnyType(filter.identifierTypes.size() == 0),
+      mAnyIdentifier(filter.identifiers.size() == 0) {
+    for (auto type : filter.identifierTypes) {
+        addTypeFlags(type, TYPE_LISTED);
+    }
+    for (auto&& id : filter.identifiers) {
+        addTypeFlags(id.type, TYPE_HAS_IDENTIFIERS);
+        mIdentifiers.insert(id);
+    }
+}
+
+void CompiledProgramFilter::addTypeFlags(uint32_t type, uint8_t flags) {
+    static constexpr uint32_t tableSize = static_cast<uint32_t>(IdentifierType::VENDOR_END) + 1;
+
+    if (type >= tableSize) {
+        mOtherTypeFlags[type] |= flags;
+        return;
+    }
+    if (type >= mTypeFlags.size()) mTypeFlags.resize(type + 1);
+    mTypeFlags[type] |= flags;
+}
+
+uint8_t CompiledProgramFilter::getTypeFlags(uint32_t type) const {
+    if (type < mTypeFlags.size()) return mTypeFlags[type];
+    if (mOtherTypeFlags.empty()) return 0;
+
+    auto it = mOtherTypeFlags.find(type);
+    return it == mOtherTypeFlags.end() ? 0 : it->second;
+}
+
+bool CompiledProgramFilter::matches(const ProgramSelector& sel) const {
+    if (!mIncludeCategories) {
+        if (getType(sel.primaryId) == IdentifierType::DAB_ENSEMBLE) return false;
+    }
+
+    bool typeMatched = mAnyType;
+    bool identifierMatched = mAnyIdentifier;
+    for (auto it = begin(sel); it != end(sel) && !(typeMatched && identifierMatched); ++it) {
+        auto flags = getTypeFlags(it->type);
+        if (flags & TYPE_LISTED) typeMatched = true;
+        if ((flags & TYPE_HAS_IDENTIFIERS) && !identifierMatched) {
+            identifierMatched = mIdentifiers.count(*it) > 0;
+        }
+    }
+
+    return typeMatched && identifierMatched;
+}
+
+size_t ProgramInfoHasher::operator()(const ProgramInfo& info) const {
+    return ProgramIdentifierHasher{}(info.selector.primaryId);
+}
+
 bool ProgramInfoKeyEqual::operator()(const ProgramInfo& info1, const ProgramInfo& info2) const {
     auto& id1 = info1.selector.primaryId;
     auto& id2 = info2.selector.primaryId;
@@ -371,7 +423,11 @@ bool ProgramInfoKeyEqual::operator()(const ProgramInfo& info1, const ProgramInfo
 void updateProgramList(ProgramInfoSet& list, const ProgramListChunk& chunk) {
     if (chunk.purge) list.clear();
 
-    list.insert(chunk.modified.begin(), chunk.modified.end());
+    for (auto&& info : chunk.modified) {
+        // insert() would keep the stale entry with the same primary identifier
+        list.erase(info);
+        list.insert(info);
+    }
 
     for (auto&& id : chunk.removed) {
         ProgramInfo info = {};
@@ -380,6 +436,53 @@ void updateProgramList(ProgramInfoSet& list, const ProgramListChunk& chunk) {
     }
 }
 
+vector<ProgramListChunk> diffProgramList(ProgramInfoSet& delivered,
+                                         const vector<ProgramInfo>& current, bool purge,
+                                         size_t maxChunkSize) {
+    CHECK(maxChunkSize > 0);
+
+    ProgramInfoSet next(current.begin(), current.end());
+    vector<ProgramInfo> modified;
+    vector<ProgramIdentifier> removed;
+    if (purge) {
+        modified.assign(next.begin(), next.end());
+    } else {
+        for (auto&& info : next) {
+            auto it = delivered.find(info);
+            if (it == delivered.end() || !(*it == info)) modified.push_back(info);
+        }
+        for (auto&& info : delivered) {
+            if (next.count(info) == 0) removed.push_back(info.selector.primaryId);
+        }
+    }
+    delivered = std::move(next);
+
+    vector<ProgramListChunk> chunks;
+    if (!purge && modified.empty() && removed.empty()) return chunks;
+
+    auto modifiedIt = modified.begin();
+    auto removedIt = removed.begin();
+    do {
+        ProgramListChunk chunk = {};
+        chunk.purge = purge && chunks.empty();
+
+        size_t removedCount = std::min<size_t>(maxChunkSize, removed.end() - removedIt);
+        chunk.removed = hidl_vec<ProgramIdentifier>(removedIt, removedIt + removedCount);
+        removedIt += removedCount;
+
+        size_t modifiedCount =
+            std::min<size_t>(maxChunkSize - removedCount, modified.end() - modifiedIt);
+        chunk.modified = hidl_vec<ProgramInfo>(std::make_move_iterator(modifiedIt),
+                                               std::make_move_iterator(modifiedIt + modifiedCount));
+        modifiedIt += modifiedCount;
+
+        chunk.complete = modifiedIt == modified.end() && removedIt == removed.end();
+        chunks.push_back(std::move(chunk));
+    } while (!chunks.back().complete);
+
+    return chunks;
+}
+
 std::optional<std::string> getMetadataString(const V2_0::ProgramInfo& info,
                                              const V2_0::MetadataKey key) {
     auto isKey = [key](const V2_0::Metadata& item) {
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <broadcastradio-utils-2x/Utils.h>
+
+#include <vector>
+
+namespace {
+
+namespace utils = android::hardware::broadcastradio::utils;
+
+using android::hardware::hidl_vec;
+using android::hardware::broadcastradio::V2_0::IdentifierType;
+using android::hardware::broadcastradio::V2_0::ProgramFilter;
+using android::hardware::broadcastradio::V2_0::ProgramIdentifier;
+using android::hardware::broadcastradio::V2_0::ProgramSelector;
+using std::vector;
+
+static constexpr size_t kNumPrograms = 20000;
+
+/**
+ * Half DAB services with their ensemble and frequency, half HD Radio subchannels.
+ */
+const vector<ProgramSelector>& getPrograms() {
+    static const vector<ProgramSelector> programs = []() {
+        vector<ProgramSelector> list;
+        for (uint32_t i = 0; i < kNumPrograms / 2; i++) {
+            auto sel = utils::make_selector_dab(0xE1C000 + i, 0xCE15 + i / 16);
+            sel.secondaryIds = hidl_vec<ProgramIdentifier>({
+                sel.secondaryIds[0],
+                utils::make_identifier(IdentifierType::DAB_FREQUENCY, 174928 + (i / 16) * 1712),
+            });
+            list.push_back(sel);
+        }
+        for (uint32_t i = 0; i < kNumPrograms / 2; i++) {
+            uint32_t frequency = 87700 + (i / 4) * 200;
+            auto sel = utils::make_selector_amfm(frequency);
+            sel.primaryId = utils::make_identifier(IdentifierType::HD_STATION_ID_EXT,
+                                                   uint64_t(frequency) << 36 | uint64_t(i % 4) << 32 | i);
+            sel.secondaryIds = hidl_vec<ProgramIdentifier>({
+                utils::make_identifier(IdentifierType::AMFM_FREQUENCY, frequency),
+            });
+            list.push_back(sel);
+        }
+        return list;
+    }();
+    return programs;
+}
+
+/**
+ * A filter for {@code state.range(0)} DAB services, as a client tracking its favourites would set.
+ */
+ProgramFilter makeFilter(const benchmark::State& state) {
+    ProgramFilter filter = {};
+    filter.identifierTypes = hidl_vec<uint32_t>({
+        static_cast<uint32_t>(IdentifierType::DAB_SID_EXT),
+        static_cast<uint32_t>(IdentifierType::HD_STATION_ID_EXT),
+    });
+    vector<ProgramIdentifier> identifiers;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        identifiers.push_back(utils::make_identifier(IdentifierType::DAB_SID_EXT,
+                                                     0xE1C000 + i * 7 % (kNumPrograms / 2)));
+    }
+    filter.identifiers = identifiers;
+    filter.includeCategories = false;
+    return filter;
+}
+
+void BM_Satisfies(benchmark::State& state) {
+    auto& programs = getPrograms();
+    auto filter = makeFilter(state);
+    size_t matched = 0;
+    for (auto _ : state) {
+        for (auto&& sel : programs) {
+            matched += utils::satisfies(filter, sel);
+        }
+    }
+    benchmark::DoNotOptimize(matched);
+    state.SetItemsProcessed(state.iterations() * programs.size());
+}
+BENCHMARK(BM_Satisfies)->Arg(0)->Arg(16)->Arg(256)->Arg(4096);
+
+void BM_CompiledFilter(benchmark::State& state) {
+    auto& programs = getPrograms();
+    utils::CompiledProgramFilter filter(makeFilter(state));
+    size_t matched = 0;
+    for (auto _ : state) {
+        for (auto&& sel : programs) {
+            matched += filter.matches(sel);
+        }
+    }
+    benchmark::DoNotOptimize(matched);
+    state.SetItemsProcessed(state.iterations() * programs.size());
+}
+BENCHMARK(BM_CompiledFilter)->Arg(0)->Arg(16)->Arg(256)->Arg(4096);
+
+// Includes building the filter, as done for each startProgramListUpdates call.
+void BM_CompileFilter(benchmark::State& state) {
+    auto filter = makeFilter(state);
+    for (auto _ : state) {
+        utils::CompiledProgramFilter compiled(filter);
+        benchmark::DoNotOptimize(&compiled);
+    }
+}
+BENCHMARK(BM_CompileFilter)->Arg(16)->Arg(256)->Arg(4096);
+
+}  // anonymous namespace
+
+BENCHMARK_MAIN();
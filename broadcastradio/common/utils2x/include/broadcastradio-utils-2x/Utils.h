@@ -21,6 +21,7 @@
 #include <optional>
 #include <queue>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
 
 namespace android {
@@ -132,6 +133,44 @@ V2_0::Metadata make_metadata(V2_0::MetadataKey key, std::string value);
 
 bool satisfies(const V2_0::ProgramFilter& filter, const V2_0::ProgramSelector& sel);
 
+struct ProgramIdentifierHasher {
+    size_t operator()(const V2_0::ProgramIdentifier& id) const;
+};
+
+/**
+ * A program filter prepared for matching against many selectors.
+ *
+ * It gives the same result as satisfies(), but instead of scanning the filter
+ * for each identifier of the selector, it looks the identifier type up in a table
+ * and the identifier in a hash set. Matching a selector then takes time
+ * proportional to its number of identifiers, whatever the size of the filter.
+ */
+class CompiledProgramFilter {
+   public:
+    explicit CompiledProgramFilter(const V2_0::ProgramFilter& filter);
+
+    bool matches(const V2_0::ProgramSelector& sel) const;
+
+   private:
+    enum TypeFlags : uint8_t {
+        TYPE_LISTED = 1 << 0,           // in filter.identifierTypes
+        TYPE_HAS_IDENTIFIERS = 1 << 1,  // in filter.identifiers
+    };
+
+    void addTypeFlags(uint32_t type, uint8_t flags);
+    uint8_t getTypeFlags(uint32_t type) const;
+
+    bool mIncludeCategories;
+    bool mAnyType;
+    bool mAnyIdentifier;
+
+    // Indexed by identifier type, covering the standard and vendor ranges.
+    std::vector<uint8_t> mTypeFlags;
+    // Types out of the table's range.
+    std::unordered_map<uint32_t, uint8_t> mOtherTypeFlags;
+    std::unordered_set<V2_0::ProgramIdentifier, ProgramIdentifierHasher> mIdentifiers;
+};
+
 struct ProgramInfoHasher {
     size_t operator()(const V2_0::ProgramInfo& info) const;
 };
@@ -145,6 +184,28 @@ typedef std::unordered_set<V2_0::ProgramInfo, ProgramInfoHasher, ProgramInfoKeyE
 
 void updateProgramList(ProgramInfoSet& list, const V2_0::ProgramListChunk& chunk);
 
+/**
+ * Computes the updates that bring a client's program list from {@code delivered}
+ * to {@code current}, and updates {@code delivered} to match.
+ *
+ * Programs are matched by primary identifier. Only programs that are new or differ
+ * from the delivered ones are sent as modified, unless {@code purge} is set, in which
+ * case the whole list is sent.
+ *
+ * The updates are split into chunks of at most {@code maxChunkSize} entries, the last
+ * one being marked complete. If nothing changed and {@code purge} is not set,
+ * no chunks are returned.
+ *
+ * @param delivered The list last delivered to the client.
+ * @param current The list the client should have.
+ * @param purge Whether the client's list has been cleared.
+ * @param maxChunkSize Maximum number of modified and removed entries per chunk.
+ * @return Chunks to send, in order.
+ */
+std::vector<V2_0::ProgramListChunk> diffProgramList(ProgramInfoSet& delivered,
+                                                    const std::vector<V2_0::ProgramInfo>& current,
+                                                    bool purge, size_t maxChunkSize);
+
 std::optional<std::string> getMetadataString(const V2_0::ProgramInfo& info,
                                              const V2_0::MetadataKey key);
 
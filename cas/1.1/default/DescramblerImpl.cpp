@@ -17,10 +17,15 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "android.hardware.cas@1.1-DescramblerImpl"
 
+#include <algorithm>
+#include <fcntl.h>
 #include <hidlmemory/mapping.h>
+#include <linux/kcmp.h>
 #include <media/cas/DescramblerAPI.h>
 #include <media/hardware/CryptoAPI.h>
 #include <media/stagefright/foundation/AUtils.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <utils/Log.h>
 
 #include "DescramblerImpl.h"
@@ -47,6 +52,8 @@ namespace implementation {
 CHECK_SUBSAMPLE_DEF(DescramblerPlugin);
 CHECK_SUBSAMPLE_DEF(CryptoPlugin);
 
+constexpr size_t DescramblerImpl::kMaxHeapMappings;
+
 DescramblerImpl::DescramblerImpl(const sp<SharedLibrary>& library, DescramblerPlugin* plugin)
     : mLibrary(library), mPluginHolder(plugin) {
     ALOGV("CTOR: plugin=%p", mPluginHolder.get());
@@ -77,6 +84,53 @@ Return<bool> DescramblerImpl::requiresSecureDecoderComponent(const hidl_string&
     return holder->requiresSecureDecoderComponent(String8(mime.c_str()));
 }
 
+// Returns 0 if both fds refer to the same open file, a positive value if they don't, and a
+// negative one if the kernel can't tell
+static int compareFiles(int fd1, int fd2) {
+    pid_t pid = getpid();
+    return syscall(SYS_kcmp, pid, pid, KCMP_FILE, fd1, fd2);
+}
+
+sp<IMemory> DescramblerImpl::mapHeap(const hidl_memory& heapBase) {
+    // Every call carries a new duplicate of the heap's fd, and all ashmem fds share the inode of
+    // /dev/ashmem, so tell heaps apart by the open file the fd refers to. A cached mapping keeps a
+    // duplicate of the fd, so that file can't be reused by a new heap.
+    const native_handle_t* handle = heapBase.handle();
+    if (handle == nullptr || handle->numFds < 1) {
+        return mapMemory(heapBase);
+    }
+    int fd = handle->data[0];
+
+    std::lock_guard<std::mutex> lock(mHeapLock);
+    for (auto it = mHeapMappings.begin(); it != mHeapMappings.end(); ++it) {
+        int order = compareFiles(it->fd.get(), fd);
+        if (order < 0) {
+            // Without kcmp, heaps can't be told apart
+            return mapMemory(heapBase);
+        }
+        if (order == 0 && it->size == heapBase.size()) {
+            std::rotate(mHeapMappings.begin(), it, it + 1);
+            return mHeapMappings.front().memory;
+        }
+    }
+
+    sp<IMemory> memory = mapMemory(heapBase);
+    if (memory == NULL) {
+        return NULL;
+    }
+    ::android::base::unique_fd dupFd(fcntl(fd, F_DUPFD_CLOEXEC, 0));
+    if (dupFd < 0) {
+        return memory;
+    }
+    ALOGV("%s: mapped heap of size %llu", __FUNCTION__, heapBase.size());
+    // The least recently used heap is the one the client has most likely switched away from
+    if (mHeapMappings.size() >= kMaxHeapMappings) {
+        mHeapMappings.pop_back();
+    }
+    mHeapMappings.insert(mHeapMappings.begin(), {std::move(dupFd), heapBase.size(), memory});
+    return memory;
+}
+
 static inline bool validateRangeForSize(uint64_t offset, uint64_t length, uint64_t size) {
     return isInRange<uint64_t, uint64_t>(0, size, offset, length);
 }
@@ -98,7 +152,7 @@ Return<void> DescramblerImpl::descramble(ScramblingControl scramblingControl,
         return Void();
     }
 
-    sp<IMemory> srcMem = mapMemory(srcBuffer.heapBase);
+    sp<IMemory> srcMem = mapHeap(srcBuffer.heapBase);
 
     // Validate if the offset and size in the SharedBuffer is consistent with the
     // mapped ashmem, since the offset and size is controlled by client.
@@ -185,6 +239,9 @@ Return<Status> DescramblerImpl::release() {
     std::shared_ptr<DescramblerPlugin> holder(nullptr);
     std::atomic_store(&mPluginHolder, holder);
 
+    std::lock_guard<std::mutex> lock(mHeapLock);
+    mHeapMappings.clear();
+
     return Status::OK;
 }
 
@@ -18,8 +18,13 @@
 #define ANDROID_HARDWARE_CAS_V1_1_DESCRAMBLER_IMPL_H_
 
 #include <android/hardware/cas/native/1.0/IDescrambler.h>
+#include <android-base/unique_fd.h>
+#include <android/hidl/memory/1.0/IMemory.h>
 #include <media/stagefright/foundation/ABase.h>
 
+#include <mutex>
+#include <vector>
+
 namespace android {
 struct DescramblerPlugin;
 using namespace hardware::cas::native::V1_0;
@@ -52,9 +57,25 @@ class DescramblerImpl : public IDescrambler {
     virtual Return<Status> release() override;
 
    private:
+    // Clients descramble from a handful of heaps, so keep them mapped between calls
+    static constexpr size_t kMaxHeapMappings = 4;
+
+    struct HeapMapping {
+        // A duplicate of the heap's fd, which keeps its open file alive to compare against
+        ::android::base::unique_fd fd;
+        uint64_t size;
+        sp<::android::hidl::memory::V1_0::IMemory> memory;
+    };
+
+    sp<::android::hidl::memory::V1_0::IMemory> mapHeap(const hidl_memory& heapBase);
+
     sp<SharedLibrary> mLibrary;
     std::shared_ptr<DescramblerPlugin> mPluginHolder;
 
+    std::mutex mHeapLock;
+    // Most recently used first
+    std::vector<HeapMapping> mHeapMappings;
+
     DISALLOW_EVIL_CONSTRUCTORS(DescramblerImpl);
 };
 
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures descrambling throughput through the CAS HAL with the ClearKey plugin, the way the
+ * media framework drives it: TS packets in shared memory, descrambled in place.
+ */
+
+#include <android/hardware/cas/1.1/ICas.h>
+#include <android/hardware/cas/1.1/ICasListener.h>
+#include <android/hardware/cas/1.1/IMediaCasService.h>
+#include <android/hardware/cas/native/1.0/IDescrambler.h>
+#include <benchmark/benchmark.h>
+#include <binder/MemoryDealer.h>
+#include <hidlmemory/FrameworkUtils.h>
+
+#include <string.h>
+#include <vector>
+
+using ::android::IMemory;
+using ::android::IMemoryHeap;
+using ::android::MemoryDealer;
+using ::android::sp;
+using ::android::hardware::fromHeap;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::HidlMemory;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::cas::native::V1_0::BufferType;
+using ::android::hardware::cas::native::V1_0::DestinationBuffer;
+using ::android::hardware::cas::native::V1_0::IDescrambler;
+using ::android::hardware::cas::native::V1_0::ScramblingControl;
+using ::android::hardware::cas::native::V1_0::SharedBuffer;
+using ::android::hardware::cas::native::V1_0::SubSample;
+using ::android::hardware::cas::V1_0::Status;
+using ::android::hardware::cas::V1_1::ICas;
+using ::android::hardware::cas::V1_1::ICasListener;
+using ::android::hardware::cas::V1_1::IMediaCasService;
+
+namespace {
+
+constexpr int32_t kClearKeySystemId = 0xF6D8;
+constexpr size_t kTsPacketSize = 188;
+constexpr size_t kTsHeaderSize = 4;
+
+// The asset and ECM of the CAS VTS test
+constexpr char kProvisionString[] =
+        "{"
+        "  \"id\": 21140844,"
+        "  \"name\": \"Test Title\","
+        "  \"lowercase_organization_name\": \"Android\","
+        "  \"asset_key\": {"
+        "  \"encryption_key\": \"nezAr3CHFrmBR9R8Tedotw==\""
+        "  },"
+        "  \"cas_type\": 1,"
+        "  \"track_types\": [ ]"
+        "}";
+
+const uint8_t kEcm[] = {
+        0x00, 0x00, 0x01, 0xf0, 0x00, 0x50, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x46, 0x00,
+        0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x27, 0x10, 0x02, 0x00,
+        0x01, 0x77, 0x01, 0x42, 0x95, 0x6c, 0x0e, 0xe3, 0x91, 0xbc, 0xfd, 0x05, 0xb1, 0x60, 0x4f,
+        0x17, 0x82, 0xa4, 0x86, 0x9b, 0x23, 0x56, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+        0x27, 0x10, 0x02, 0x00, 0x01, 0x77, 0x01, 0x42, 0x95, 0x6c, 0xd7, 0x43, 0x62, 0xf8, 0x1c,
+        0x62, 0x19, 0x05, 0xc7, 0x3a, 0x42, 0xcd, 0xfd, 0xd9, 0x13, 0x48,
+};
+
+class NullListener : public ICasListener {
+   public:
+    Return<void> onEvent(int32_t, int32_t, const hidl_vec<uint8_t>&) override { return Void(); }
+    Return<void> onSessionEvent(const hidl_vec<uint8_t>&, int32_t, int32_t,
+                                const hidl_vec<uint8_t>&) override {
+        return Void();
+    }
+};
+
+// A shared heap the way MediaCodec hands one to the HAL
+struct Heap {
+    sp<MemoryDealer> dealer;
+    sp<IMemory> memory;
+    sp<HidlMemory> hidlMemory;
+    SharedBuffer buffer;
+};
+
+class ClearKeyDescrambler {
+   public:
+    bool init() {
+        sp<IMediaCasService> service = IMediaCasService::getService();
+        if (service == nullptr) {
+            return false;
+        }
+        mCas = service->createPluginExt(kClearKeySystemId, new NullListener());
+        sp<::android::hardware::cas::V1_0::IDescramblerBase> base =
+                service->createDescrambler(kClearKeySystemId);
+        if (mCas == nullptr || base == nullptr) {
+            return false;
+        }
+        mDescrambler = IDescrambler::castFrom(base);
+        if (mDescrambler == nullptr) {
+            return false;
+        }
+        if (mCas->provision(hidl_string(kProvisionString)) != Status::OK) {
+            return false;
+        }
+
+        Status sessionStatus = Status::ERROR_CAS_UNKNOWN;
+        hidl_vec<uint8_t> sessionId;
+        mCas->openSession([&](Status status, const hidl_vec<uint8_t>& id) {
+            sessionStatus = status;
+            sessionId = id;
+        });
+        if (sessionStatus != Status::OK) {
+            return false;
+        }
+        hidl_vec<uint8_t> ecm;
+        ecm.setToExternal(const_cast<uint8_t*>(kEcm), sizeof(kEcm));
+        return mCas->processEcm(sessionId, ecm) == Status::OK &&
+               mDescrambler->setMediaCasSession(sessionId) == Status::OK;
+    }
+
+    ~ClearKeyDescrambler() {
+        if (mDescrambler != nullptr) {
+            mDescrambler->release();
+        }
+        if (mCas != nullptr) {
+            mCas->release();
+        }
+    }
+
+    static bool allocateHeap(size_t size, Heap* heap) {
+        heap->dealer = new MemoryDealer(size, "cas-benchmark");
+        heap->memory = heap->dealer->allocate(size);
+        if (heap->memory == nullptr) {
+            return false;
+        }
+        ssize_t offset;
+        size_t heapSize;
+        sp<IMemoryHeap> memoryHeap = heap->memory->getMemory(&offset, &heapSize);
+        if (memoryHeap == nullptr) {
+            return false;
+        }
+        memset(heap->memory->pointer(), 0x5a, size);
+        heap->hidlMemory = fromHeap(memoryHeap);
+        heap->buffer = {.heapBase = *heap->hidlMemory,
+                        .offset = static_cast<uint64_t>(offset),
+                        .size = static_cast<uint64_t>(heapSize)};
+        return true;
+    }
+
+    bool descramble(const Heap& heap, const hidl_vec<SubSample>& subSamples) {
+        DestinationBuffer dstBuffer;
+        dstBuffer.type = BufferType::SHARED_MEMORY;
+        dstBuffer.nonsecureMemory = heap.buffer;
+        Status result = Status::ERROR_CAS_UNKNOWN;
+        Return<void> ret = mDescrambler->descramble(
+                ScramblingControl::EVENKEY, subSamples, heap.buffer, 0, dstBuffer, 0,
+                [&](Status status, uint32_t, const hidl_string&) { result = status; });
+        return ret.isOk() && result == Status::OK;
+    }
+
+   private:
+    sp<ICas> mCas;
+    sp<IDescrambler> mDescrambler;
+};
+
+hidl_vec<SubSample> tsPacketSubSamples(size_t packets) {
+    hidl_vec<SubSample> subSamples;
+    subSamples.resize(packets);
+    for (auto& subSample : subSamples) {
+        subSample = {.numBytesOfClearData = kTsHeaderSize,
+                     .numBytesOfEncryptedData = kTsPacketSize - kTsHeaderSize};
+    }
+    return subSamples;
+}
+
+// Descrambles batches of TS packets out of the same heap, the steady state of playback
+void BM_DescrambleOneHeap(benchmark::State& state) {
+    size_t packets = state.range(0);
+    ClearKeyDescrambler descrambler;
+    Heap heap;
+    if (!descrambler.init() || !ClearKeyDescrambler::allocateHeap(packets * kTsPacketSize, &heap)) {
+        state.SkipWithError("ClearKey CAS plugin unavailable");
+        return;
+    }
+    hidl_vec<SubSample> subSamples = tsPacketSubSamples(packets);
+
+    for (auto _ : state) {
+        if (!descrambler.descramble(heap, subSamples)) {
+            state.SkipWithError("descramble failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * packets * kTsPacketSize);
+}
+BENCHMARK(BM_DescrambleOneHeap)->Arg(1)->Arg(7)->Arg(64)->Arg(512);
+
+// Cycles through several heaps of the same size, like a codec's input buffers: up to the number the
+// HAL keeps mapped, and beyond
+void BM_DescrambleRotatingHeaps(benchmark::State& state) {
+    constexpr size_t kPackets = 7;
+    size_t numHeaps = state.range(0);
+    ClearKeyDescrambler descrambler;
+    std::vector<Heap> heaps(numHeaps);
+    if (!descrambler.init()) {
+        state.SkipWithError("ClearKey CAS plugin unavailable");
+        return;
+    }
+    for (auto& heap : heaps) {
+        if (!ClearKeyDescrambler::allocateHeap(kPackets * kTsPacketSize, &heap)) {
+            state.SkipWithError("couldn't allocate heap");
+            return;
+        }
+    }
+    hidl_vec<SubSample> subSamples = tsPacketSubSamples(kPackets);
+
+    size_t next = 0;
+    for (auto _ : state) {
+        if (!descrambler.descramble(heaps[next], subSamples)) {
+            state.SkipWithError("descramble failed");
+            break;
+        }
+        next = (next + 1) % numHeaps;
+    }
+    state.SetBytesProcessed(state.iterations() * kPackets * kTsPacketSize);
+}
+BENCHMARK(BM_DescrambleRotatingHeaps)->Arg(2)->Arg(4)->Arg(16);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -559,6 +559,54 @@ TEST_F(MediaCasHidlTest, TestClearKeyApisWithSession) {
     EXPECT_EQ(Status::OK, returnStatus);
 }
 
+TEST_F(MediaCasHidlTest, TestClearKeyDescrambleSameSizeHeaps) {
+    description("Test that heaps of the same size are descrambled independently");
+
+    ASSERT_TRUE(createCasPlugin(CLEAR_KEY_SYSTEM_ID));
+
+    auto returnStatus = mMediaCas->provision(hidl_string(PROVISION_STR));
+    EXPECT_TRUE(returnStatus.isOk());
+    EXPECT_EQ(Status::OK, returnStatus);
+
+    std::vector<uint8_t> sessionId;
+    ASSERT_TRUE(openCasSession(&sessionId));
+    returnStatus = mDescramblerBase->setMediaCasSession(sessionId);
+    EXPECT_TRUE(returnStatus.isOk());
+    EXPECT_EQ(Status::OK, returnStatus);
+
+    hidl_vec<uint8_t> hidlEcm;
+    hidlEcm.setToExternal(const_cast<uint8_t*>(kEcmBinaryBuffer), sizeof(kEcmBinaryBuffer));
+    returnStatus = mMediaCas->processEcm(sessionId, hidlEcm);
+    EXPECT_TRUE(returnStatus.isOk());
+    EXPECT_EQ(Status::OK, returnStatus);
+
+    sp<IDescrambler> descrambler = IDescrambler::castFrom(mDescramblerBase);
+    ASSERT_NE(descrambler, nullptr);
+
+    // Each call descrambles in place in a new heap of the same size. If the HAL mixed the heaps
+    // up, the second one would stay scrambled and the first one would be descrambled twice.
+    Status descrambleStatus = Status::OK;
+    sp<IMemory> firstMemory;
+    ASSERT_TRUE(descrambleTestInputBuffer(descrambler, &descrambleStatus, &firstMemory));
+    EXPECT_EQ(Status::OK, descrambleStatus);
+    sp<IMemory> secondMemory;
+    ASSERT_TRUE(descrambleTestInputBuffer(descrambler, &descrambleStatus, &secondMemory));
+    EXPECT_EQ(Status::OK, descrambleStatus);
+
+    for (const sp<IMemory>& memory : {firstMemory, secondMemory}) {
+        ASSERT_NE(nullptr, memory.get());
+        EXPECT_EQ(0, memcmp(memory->pointer(), kOutRefBinaryBuffer, sizeof(kOutRefBinaryBuffer)));
+    }
+
+    returnStatus = mDescramblerBase->release();
+    EXPECT_TRUE(returnStatus.isOk());
+    EXPECT_EQ(Status::OK, returnStatus);
+
+    returnStatus = mMediaCas->release();
+    EXPECT_TRUE(returnStatus.isOk());
+    EXPECT_EQ(Status::OK, returnStatus);
+}
+
 }  // anonymous namespace
 
 int main(int argc, char** argv) {
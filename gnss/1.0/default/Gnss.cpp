@@ -19,6 +19,8 @@
 #include "Gnss.h"
 #include <GnssUtils.h>
 
+#include <inttypes.h>
+
 namespace android {
 namespace hardware {
 namespace gnss {
@@ -66,6 +68,9 @@ Gnss::Gnss(gps_device_t* gnssDevice) :
 Gnss::~Gnss() {
     sInterfaceExists = false;
     sThreadFuncArgsList.clear();
+    // The bridge outlives this object, as the HAL may still call back
+    GnssCallbackBridge::getInstance()->setCallback(nullptr);
+    GnssCallbackBridge::getInstance()->setBatchingCallback(nullptr);
 }
 
 void Gnss::locationCb(GpsLocation* location) {
@@ -79,11 +84,7 @@ void Gnss::locationCb(GpsLocation* location) {
         return;
     }
 
-    android::hardware::gnss::V1_0::GnssLocation gnssLocation = convertToGnssLocation(location);
-    auto ret = sGnssCbIface->gnssLocationCb(gnssLocation);
-    if (!ret.isOk()) {
-        ALOGE("%s: Unable to invoke callback", __func__);
-    }
+    GnssCallbackBridge::getInstance()->postLocation(convertToGnssLocation(location));
 }
 
 void Gnss::statusCb(GpsStatus* gnssStatus) {
@@ -100,10 +101,7 @@ void Gnss::statusCb(GpsStatus* gnssStatus) {
     IGnssCallback::GnssStatusValue status =
             static_cast<IGnssCallback::GnssStatusValue>(gnssStatus->status);
 
-    auto ret = sGnssCbIface->gnssStatusCb(status);
-    if (!ret.isOk()) {
-        ALOGE("%s: Unable to invoke callback", __func__);
-    }
+    GnssCallbackBridge::getInstance()->postStatus(status);
 }
 
 void Gnss::gnssSvStatusCb(GnssSvStatus* status) {
@@ -145,10 +143,7 @@ void Gnss::gnssSvStatusCb(GnssSvStatus* status) {
         svStatus.gnssSvList[i] = gnssSvInfo;
     }
 
-    auto ret = sGnssCbIface->gnssSvStatusCb(svStatus);
-    if (!ret.isOk()) {
-        ALOGE("%s: Unable to invoke callback", __func__);
-    }
+    GnssCallbackBridge::getInstance()->postSvStatus(svStatus);
 }
 
 /*
@@ -248,10 +243,7 @@ void Gnss::gpsSvStatusCb(GpsSvStatus* svInfo) {
         }
     }
 
-    auto ret = sGnssCbIface->gnssSvStatusCb(svStatus);
-    if (!ret.isOk()) {
-        ALOGE("%s: Unable to invoke callback", __func__);
-    }
+    GnssCallbackBridge::getInstance()->postSvStatus(svStatus);
 }
 
 void Gnss::nmeaCb(GpsUtcTime timestamp, const char* nmea, int length) {
@@ -260,12 +252,12 @@ void Gnss::nmeaCb(GpsUtcTime timestamp, const char* nmea, int length) {
         return;
     }
 
-    android::hardware::hidl_string nmeaString;
-    nmeaString.setToExternal(nmea, length);
-    auto ret = sGnssCbIface->gnssNmeaCb(timestamp, nmeaString);
-    if (!ret.isOk()) {
-        ALOGE("%s: Unable to invoke callback", __func__);
+    if (nmea == nullptr || length < 0) {
+        ALOGE("%s: Invalid NMEA from GNSS HAL", __func__);
+        return;
     }
+
+    GnssCallbackBridge::getInstance()->postNmea(timestamp, nmea, length);
 }
 
 void Gnss::setCapabilitiesCb(uint32_t capabilities) {
@@ -327,10 +319,8 @@ void Gnss::updateWakelock() {
             ALOGI("%s: GNSS HAL Wakelock acquired due to gps: %d, fused: %d", __func__,
                     sWakelockHeldGnss, sWakelockHeldFused);
             sWakelockHeld = true;
-            auto ret = sGnssCbIface->gnssAcquireWakelockCb();
-            if (!ret.isOk()) {
-                ALOGE("%s: Unable to invoke callback", __func__);
-            }
+            // Queued behind the events it is held for, to keep them in order
+            GnssCallbackBridge::getInstance()->postWakelock(true);
         }
     } else {
         if (sWakelockHeld) {
@@ -341,10 +331,7 @@ void Gnss::updateWakelock() {
             ALOGW("%s: GNSS HAL Wakelock released, duplicate request", __func__);
         }
         sWakelockHeld = false;
-        auto ret = sGnssCbIface->gnssReleaseWakelockCb();
-        if (!ret.isOk()) {
-            ALOGE("%s: Unable to invoke callback", __func__);
-        }
+        GnssCallbackBridge::getInstance()->postWakelock(false);
     }
 }
 
@@ -407,6 +394,7 @@ Return<bool> Gnss::setCallback(const sp<IGnssCallback>& callback)  {
     }
 
     sGnssCbIface = callback;
+    GnssCallbackBridge::getInstance()->setCallback(callback);
     callback->linkToDeath(mDeathRecipient, 0 /*cookie*/);
 
     // If this was received in the past, send it up again to refresh caller.
@@ -733,6 +721,22 @@ void Gnss::handleHidlDeath() {
      * before HAL processes above messages.
      */
     sGnssCbIface = nullptr;
+    GnssCallbackBridge::getInstance()->setCallback(nullptr);
+}
+
+Return<void> Gnss::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* options */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        ALOGE("%s: debug called with no handle", __func__);
+        return Void();
+    }
+
+    GnssCallbackBridge::Stats stats = GnssCallbackBridge::getInstance()->getStats();
+    dprintf(fd->data[0],
+            "Callback bridge: queue depth %zu (max %zu), delivered %" PRIu64 ", dropped %" PRIu64
+            ", NMEA sentences merged %" PRIu64 "\n",
+            stats.queueDepth, stats.maxQueueDepth, stats.delivered, stats.dropped,
+            stats.nmeaMerged);
+    return Void();
 }
 
 IGnss* HIDL_FETCH_IGnss(const char* /* hal */) {
@@ -20,6 +20,7 @@
 #include <AGnss.h>
 #include <AGnssRil.h>
 #include <GnssBatching.h>
+#include <GnssCallbackBridge.h>
 #include <GnssConfiguration.h>
 #include <GnssDebug.h>
 #include <GnssGeofencing.h>
@@ -42,6 +43,7 @@ namespace implementation {
 
 using ::android::hardware::Return;
 using ::android::hardware::Void;
+using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_vec;
 using ::android::hardware::hidl_string;
 using ::android::sp;
@@ -88,6 +90,11 @@ class Gnss : public IGnss {
     Return<sp<IGnssDebug>> getExtensionGnssDebug() override;
     Return<sp<IGnssBatching>> getExtensionGnssBatching() override;
 
+    /*
+     * Prints the state of the callback bridge.
+     */
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
     /*
      * Callback methods to be passed into the conventional GNSS HAL by the default
      * implementation. These methods are not part of the IGnss base class.
@@ -30,6 +30,7 @@ namespace V1_0 {
 namespace implementation {
 
 sp<IGnssBatchingCallback> GnssBatching::sGnssBatchingCbIface = nullptr;
+std::vector<GnssLocation> GnssBatching::sLocations;
 bool GnssBatching::sFlpSupportsBatching = false;
 
 FlpCallbacks GnssBatching::sFlpCb = {
@@ -87,7 +88,8 @@ void GnssBatching::locationCb(int32_t locationsCount, FlpLocation** locations) {
      * Fortunately, this shouldn't be a major issue in cases where GNSS batching is typically
      * used (e.g. when user is likely in vehicle/bicycle.)
      */
-    std::vector<android::hardware::gnss::V1_0::GnssLocation> gnssLocations;
+    sLocations.clear();
+    sLocations.reserve(MAX_LOCATIONS_PER_BATCH);
     for (int iLocation = 0; iLocation < locationsCount; iLocation++) {
         if (locations[iLocation] == nullptr) {
             ALOGE("%s: Null location at slot: %d of %d, skipping", __func__, iLocation,
@@ -100,13 +102,10 @@ void GnssBatching::locationCb(int32_t locationsCount, FlpLocation** locations) {
                     locations[iLocation]->sources_used, iLocation, locationsCount);
             continue;
         }
-        gnssLocations.push_back(convertToGnssLocation(locations[iLocation]));
+        sLocations.push_back(convertToGnssLocation(locations[iLocation]));
     }
 
-    auto ret = sGnssBatchingCbIface->gnssLocationBatchCb(gnssLocations);
-    if (!ret.isOk()) {
-        ALOGE("%s: Unable to invoke callback", __func__);
-    }
+    GnssCallbackBridge::getInstance()->postLocationBatch(sLocations.data(), sLocations.size());
 }
 
 void GnssBatching::acquireWakelockCb() {
@@ -144,6 +143,7 @@ Return<bool> GnssBatching::init(const sp<IGnssBatchingCallback>& callback) {
     }
 
     sGnssBatchingCbIface = callback;
+    GnssCallbackBridge::getInstance()->setBatchingCallback(callback);
 
     return (mFlpLocationIface->init(&sFlpCb) == 0);
 }
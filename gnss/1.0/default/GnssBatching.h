@@ -1,11 +1,14 @@
 #ifndef ANDROID_HARDWARE_GNSS_V1_0_GNSSBATCHING_H
 #define ANDROID_HARDWARE_GNSS_V1_0_GNSSBATCHING_H
 
+#include <GnssCallbackBridge.h>
 #include <android/hardware/gnss/1.0/IGnssBatching.h>
 #include <hardware/fused_location.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 
+#include <vector>
+
 namespace android {
 namespace hardware {
 namespace gnss {
@@ -53,6 +56,8 @@ struct GnssBatching : public IGnssBatching {
  private:
     const FlpLocationInterface* mFlpLocationIface = nullptr;
     static sp<IGnssBatchingCallback> sGnssBatchingCbIface;
+    // Reused by locationCb to convert each batch without allocating
+    static std::vector<GnssLocation> sLocations;
     static bool sFlpSupportsBatching;
 };
 
@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GnssHAL_GnssCallbackBridge"
+
+#include "GnssCallbackBridge.h"
+
+#include <log/log.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V1_0 {
+namespace implementation {
+
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+
+constexpr size_t GnssCallbackBridge::kMaxNmeaLength;
+constexpr size_t GnssCallbackBridge::kMaxPendingEvents;
+constexpr size_t GnssCallbackBridge::kReservedEvents;
+
+GnssCallbackBridge::GnssCallbackBridge()
+    : mEvents(kMaxPendingEvents),
+      mHead(0),
+      mCount(0),
+      mMaxQueueDepth(0),
+      mDelivered(0),
+      mDropped(0),
+      mNmeaMerged(0),
+      mReleaseDeferred(false),
+      mStopThread(false) {
+    mThread = std::thread([this]() { run(); });
+}
+
+GnssCallbackBridge::~GnssCallbackBridge() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopThread = true;
+    }
+    mEventCV.notify_one();
+    mThread.join();
+}
+
+GnssCallbackBridge* GnssCallbackBridge::getInstance() {
+    static GnssCallbackBridge* instance = new GnssCallbackBridge();
+    return instance;
+}
+
+void GnssCallbackBridge::setCallback(const sp<IGnssCallback>& callback) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mCallback = callback;
+}
+
+void GnssCallbackBridge::setBatchingCallback(const sp<IGnssBatchingCallback>& callback) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mBatchingCallback = callback;
+}
+
+GnssCallbackBridge::Event* GnssCallbackBridge::newEventLocked(EventType type) {
+    queueDeferredReleaseLocked();
+    if (mReleaseDeferred) {
+        if (type == EventType::RELEASE_WAKELOCK) {
+            // Already on its way
+            return nullptr;
+        }
+        mDropped++;
+        ALOGE("%s: Event queue full, dropping event type %d", __func__, static_cast<int>(type));
+        return nullptr;
+    }
+
+    bool reserved = type == EventType::STATUS || type == EventType::ACQUIRE_WAKELOCK ||
+                    type == EventType::RELEASE_WAKELOCK;
+    size_t limit = reserved ? kMaxPendingEvents : kMaxPendingEvents - kReservedEvents;
+    if (mCount >= limit) {
+        if (type == EventType::RELEASE_WAKELOCK) {
+            ALOGW("%s: Event queue full, holding back wake lock release", __func__);
+            mReleaseDeferred = true;
+            return nullptr;
+        }
+        mDropped++;
+        if (reserved) {
+            ALOGE("%s: Event queue full, dropping event type %d", __func__,
+                  static_cast<int>(type));
+        }
+        return nullptr;
+    }
+
+    Event* event = &mEvents[(mHead + mCount) % kMaxPendingEvents];
+    event->type = type;
+    mCount++;
+    mMaxQueueDepth = std::max(mMaxQueueDepth, mCount);
+    mEventCV.notify_one();
+    return event;
+}
+
+void GnssCallbackBridge::queueDeferredReleaseLocked() {
+    if (!mReleaseDeferred || mCount >= kMaxPendingEvents) {
+        return;
+    }
+    mReleaseDeferred = false;
+    newEventLocked(EventType::RELEASE_WAKELOCK);
+}
+
+void GnssCallbackBridge::postLocation(const GnssLocation& location) {
+    std::lock_guard<std::mutex> lock(mLock);
+    Event* event = newEventLocked(EventType::LOCATION);
+    if (event != nullptr) {
+        event->location = location;
+    }
+}
+
+void GnssCallbackBridge::postStatus(IGnssCallback::GnssStatusValue status) {
+    std::lock_guard<std::mutex> lock(mLock);
+    Event* event = newEventLocked(EventType::STATUS);
+    if (event != nullptr) {
+        event->status = status;
+    }
+}
+
+void GnssCallbackBridge::postSvStatus(const IGnssCallback::GnssSvStatus& svStatus) {
+    std::lock_guard<std::mutex> lock(mLock);
+    Event* event = newEventLocked(EventType::SV_STATUS);
+    if (event != nullptr) {
+        event->svStatus = svStatus;
+    }
+}
+
+void GnssCallbackBridge::postNmea(GpsUtcTime timestamp, const char* nmea, size_t length) {
+    if (length > kMaxNmeaLength) {
+        ALOGW("%s: NMEA sentence of %zu bytes truncated to %zu", __func__, length,
+              kMaxNmeaLength);
+        length = kMaxNmeaLength;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    // Append to the sentences of the same epoch if they are still waiting
+    if (mCount > 0) {
+        Event* last = &mEvents[(mHead + mCount - 1) % kMaxPendingEvents];
+        if (last->type == EventType::NMEA && last->nmeaTimestamp == timestamp &&
+            last->nmeaLength + length <= kMaxNmeaLength) {
+            memcpy(last->nmea + last->nmeaLength, nmea, length);
+            last->nmeaLength += length;
+            last->nmea[last->nmeaLength] = '\0';
+            mNmeaMerged++;
+            return;
+        }
+    }
+
+    Event* event = newEventLocked(EventType::NMEA);
+    if (event != nullptr) {
+        event->nmeaTimestamp = timestamp;
+        event->nmeaLength = length;
+        memcpy(event->nmea, nmea, length);
+        event->nmea[length] = '\0';
+    }
+}
+
+void GnssCallbackBridge::postWakelock(bool acquire) {
+    std::lock_guard<std::mutex> lock(mLock);
+    newEventLocked(acquire ? EventType::ACQUIRE_WAKELOCK : EventType::RELEASE_WAKELOCK);
+}
+
+void GnssCallbackBridge::postLocationBatch(const GnssLocation* locations, size_t count) {
+    std::lock_guard<std::mutex> lock(mLock);
+    Event* event = newEventLocked(EventType::LOCATION_BATCH);
+    if (event != nullptr) {
+        event->locations.assign(locations, locations + count);
+    }
+}
+
+GnssCallbackBridge::Stats GnssCallbackBridge::getStats() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return {.queueDepth = mCount,
+            .maxQueueDepth = mMaxQueueDepth,
+            .delivered = mDelivered,
+            .dropped = mDropped,
+            .nmeaMerged = mNmeaMerged};
+}
+
+void GnssCallbackBridge::takeEventLocked(Event* event) {
+    Event& head = mEvents[mHead];
+    event->type = head.type;
+    // Only copy what the event carries
+    switch (head.type) {
+        case EventType::LOCATION:
+            event->location = head.location;
+            break;
+        case EventType::STATUS:
+            event->status = head.status;
+            break;
+        case EventType::SV_STATUS:
+            event->svStatus = head.svStatus;
+            break;
+        case EventType::NMEA:
+            event->nmeaTimestamp = head.nmeaTimestamp;
+            event->nmeaLength = head.nmeaLength;
+            memcpy(event->nmea, head.nmea, head.nmeaLength);
+            event->nmea[head.nmeaLength] = '\0';
+            break;
+        case EventType::LOCATION_BATCH:
+            std::swap(event->locations, head.locations);
+            break;
+        case EventType::ACQUIRE_WAKELOCK:
+        case EventType::RELEASE_WAKELOCK:
+            break;
+    }
+    mHead = (mHead + 1) % kMaxPendingEvents;
+    mCount--;
+}
+
+void GnssCallbackBridge::deliver(const Event& event, const sp<IGnssCallback>& callback,
+                                 const sp<IGnssBatchingCallback>& batchingCallback) {
+    if (event.type == EventType::LOCATION_BATCH) {
+        if (batchingCallback == nullptr) {
+            ALOGE("%s: GNSS Batching Callback Interface configured incorrectly", __func__);
+            return;
+        }
+        hidl_vec<GnssLocation> locations;
+        locations.setToExternal(const_cast<GnssLocation*>(event.locations.data()),
+                                event.locations.size());
+        auto ret = batchingCallback->gnssLocationBatchCb(locations);
+        if (!ret.isOk()) {
+            ALOGE("%s: Unable to invoke callback", __func__);
+        }
+        return;
+    }
+
+    if (callback == nullptr) {
+        ALOGE("%s: GNSS Callback Interface configured incorrectly", __func__);
+        return;
+    }
+
+    Return<void> ret;
+    switch (event.type) {
+        case EventType::LOCATION:
+            ret = callback->gnssLocationCb(event.location);
+            break;
+        case EventType::STATUS:
+            ret = callback->gnssStatusCb(event.status);
+            break;
+        case EventType::SV_STATUS:
+            ret = callback->gnssSvStatusCb(event.svStatus);
+            break;
+        case EventType::NMEA: {
+            hidl_string nmea;
+            nmea.setToExternal(event.nmea, event.nmeaLength);
+            ret = callback->gnssNmeaCb(event.nmeaTimestamp, nmea);
+            break;
+        }
+        case EventType::ACQUIRE_WAKELOCK:
+            ret = callback->gnssAcquireWakelockCb();
+            break;
+        case EventType::RELEASE_WAKELOCK:
+            ret = callback->gnssReleaseWakelockCb();
+            break;
+        case EventType::LOCATION_BATCH:
+            break;
+    }
+    if (!ret.isOk()) {
+        ALOGE("%s: Unable to invoke callback", __func__);
+    }
+}
+
+void GnssCallbackBridge::run() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mEventCV.wait(lock, [this]() { return mStopThread || mCount > 0; });
+        if (mStopThread) {
+            break;
+        }
+
+        takeEventLocked(&mDelivering);
+        queueDeferredReleaseLocked();
+        sp<IGnssCallback> callback = mCallback;
+        sp<IGnssBatchingCallback> batchingCallback = mBatchingCallback;
+
+        lock.unlock();
+        deliver(mDelivering, callback, batchingCallback);
+        callback.clear();
+        batchingCallback.clear();
+        lock.lock();
+
+        mDelivered++;
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
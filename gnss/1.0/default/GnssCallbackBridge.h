@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_gnss_V1_0_GnssCallbackBridge_H_
+#define android_hardware_gnss_V1_0_GnssCallbackBridge_H_
+
+#include <android/hardware/gnss/1.0/IGnssBatchingCallback.h>
+#include <android/hardware/gnss/1.0/IGnssCallback.h>
+#include <hardware/gps.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V1_0 {
+namespace implementation {
+
+using ::android::sp;
+
+/*
+ * Hands the events reported by the conventional GNSS and FLP HALs over to a delivery thread, which
+ * makes the HIDL calls to the framework. The HAL threads only convert the event into a preallocated
+ * slot, so a slow framework client no longer stalls the chipset's callback thread.
+ *
+ * Events are delivered in the order they were posted. NMEA sentences that share a timestamp are
+ * merged into one gnssNmeaCb call while they wait. If the framework falls behind, new location,
+ * SV status and NMEA events are dropped once the queue is nearly full; the remaining slots are kept
+ * for status and wake lock changes, which the framework must not miss. A wake lock release that
+ * still finds the queue full is held back and queued as soon as a slot frees up, so the framework
+ * never keeps a wake lock the HAL has let go of.
+ *
+ * The legacy HALs may call back at any time, so the service uses the process-lifetime instance.
+ */
+class GnssCallbackBridge {
+  public:
+    // Room for about one second of NMEA output from a multi-constellation receiver. Longer
+    // sentences are truncated.
+    static constexpr size_t kMaxNmeaLength = 4096;
+
+    struct Stats {
+        size_t queueDepth;
+        size_t maxQueueDepth;
+        uint64_t delivered;
+        uint64_t dropped;
+        uint64_t nmeaMerged;
+    };
+
+    GnssCallbackBridge();
+    ~GnssCallbackBridge();
+
+    // Never destroyed, so it stays valid for HAL callbacks that race the teardown of Gnss
+    static GnssCallbackBridge* getInstance();
+
+    void setCallback(const sp<IGnssCallback>& callback);
+    void setBatchingCallback(const sp<IGnssBatchingCallback>& callback);
+
+    void postLocation(const GnssLocation& location);
+    void postStatus(IGnssCallback::GnssStatusValue status);
+    void postSvStatus(const IGnssCallback::GnssSvStatus& svStatus);
+    void postNmea(GpsUtcTime timestamp, const char* nmea, size_t length);
+    void postWakelock(bool acquire);
+    void postLocationBatch(const GnssLocation* locations, size_t count);
+
+    Stats getStats();
+
+  private:
+    enum class EventType {
+        LOCATION,
+        STATUS,
+        SV_STATUS,
+        NMEA,
+        ACQUIRE_WAKELOCK,
+        RELEASE_WAKELOCK,
+        LOCATION_BATCH,
+    };
+
+    static constexpr size_t kMaxPendingEvents = 16;
+    // Slots that only status and wake lock events may take
+    static constexpr size_t kReservedEvents = 4;
+
+    struct Event {
+        EventType type;
+        GnssLocation location;
+        IGnssCallback::GnssStatusValue status;
+        IGnssCallback::GnssSvStatus svStatus;
+        GpsUtcTime nmeaTimestamp;
+        size_t nmeaLength;
+        // NUL-terminated, as hidl_string requires
+        char nmea[kMaxNmeaLength + 1];
+        // Keeps its capacity as slots are reused
+        std::vector<GnssLocation> locations;
+    };
+
+    /*
+     * Returns the slot for a new event of the given type, or nullptr if it has to be dropped.
+     */
+    Event* newEventLocked(EventType type);
+    // Queues the held back wake lock release if there is room for it
+    void queueDeferredReleaseLocked();
+    void takeEventLocked(Event* event);
+    void deliver(const Event& event, const sp<IGnssCallback>& callback,
+                 const sp<IGnssBatchingCallback>& batchingCallback);
+    void run();
+
+    std::mutex mLock;
+    std::condition_variable mEventCV;
+    std::vector<Event> mEvents;
+    size_t mHead;
+    size_t mCount;
+    sp<IGnssCallback> mCallback;
+    sp<IGnssBatchingCallback> mBatchingCallback;
+
+    // Owned by the delivery thread
+    Event mDelivering;
+
+    size_t mMaxQueueDepth;
+    uint64_t mDelivered;
+    uint64_t mDropped;
+    uint64_t mNmeaMerged;
+
+    // A wake lock release is waiting for a free slot; later events may not overtake it
+    bool mReleaseDeferred;
+    bool mStopThread;
+    std::thread mThread;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_gnss_V1_0_GnssCallbackBridge_H_
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GnssCallbackBridge.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using ::android::sp;
+using ::android::hardware::hidl_string;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::gnss::V1_0::GnssLocation;
+using ::android::hardware::gnss::V1_0::IGnssCallback;
+using ::android::hardware::gnss::V1_0::implementation::GnssCallbackBridge;
+
+namespace {
+
+/*
+ * Records the callbacks it receives. Status callbacks can be held up to let events pile up in the
+ * bridge, as a slow framework client would.
+ */
+class FakeGnssCallback : public IGnssCallback {
+  public:
+    Return<void> gnssLocationCb(const GnssLocation& /* location */) override {
+        return record("location");
+    }
+    Return<void> gnssStatusCb(IGnssCallback::GnssStatusValue /* status */) override {
+        std::unique_lock<std::mutex> lock(mLock);
+        mWaiting = mBlocked;
+        mBlockedCV.notify_all();
+        mReleaseCV.wait(lock, [this]() { return !mBlocked; });
+        mWaiting = false;
+        mEvents.push_back("status");
+        mEventCV.notify_all();
+        return Void();
+    }
+    Return<void> gnssSvStatusCb(const IGnssCallback::GnssSvStatus& /* svStatus */) override {
+        return record("sv_status");
+    }
+    Return<void> gnssNmeaCb(int64_t /* timestamp */, const hidl_string& nmea) override {
+        // Read up to the terminator, as the parcel does
+        return record("nmea:" + std::string(nmea.c_str()));
+    }
+    Return<void> gnssSetCapabilitesCb(uint32_t /* capabilities */) override { return Void(); }
+    Return<void> gnssAcquireWakelockCb() override { return record("acquire"); }
+    Return<void> gnssReleaseWakelockCb() override { return record("release"); }
+    Return<void> gnssRequestTimeCb() override { return Void(); }
+    Return<void> gnssSetSystemInfoCb(const IGnssCallback::GnssSystemInfo& /* info */) override {
+        return Void();
+    }
+
+    // Holds up the next status callbacks until release()
+    void block() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mBlocked = true;
+    }
+
+    void waitUntilBlocked() {
+        std::unique_lock<std::mutex> lock(mLock);
+        mBlockedCV.wait(lock, [this]() { return mWaiting; });
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mBlocked = false;
+        mReleaseCV.notify_all();
+    }
+
+    std::vector<std::string> waitForEvents(size_t count) {
+        std::unique_lock<std::mutex> lock(mLock);
+        mEventCV.wait_for(lock, std::chrono::seconds(5),
+                          [this, count]() { return mEvents.size() >= count; });
+        return mEvents;
+    }
+
+  private:
+    Return<void> record(const std::string& event) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEvents.push_back(event);
+        mEventCV.notify_all();
+        return Void();
+    }
+
+    std::mutex mLock;
+    std::condition_variable mEventCV;
+    std::condition_variable mBlockedCV;
+    std::condition_variable mReleaseCV;
+    bool mBlocked = false;
+    // A status callback is being held up
+    bool mWaiting = false;
+    std::vector<std::string> mEvents;
+};
+
+}  // namespace
+
+TEST(GnssCallbackBridgeTest, DeliversEventsInOrder) {
+    sp<FakeGnssCallback> callback = new FakeGnssCallback();
+    GnssCallbackBridge bridge;
+    bridge.setCallback(callback);
+
+    bridge.postWakelock(true);
+    bridge.postLocation(GnssLocation());
+    bridge.postSvStatus(IGnssCallback::GnssSvStatus());
+    bridge.postWakelock(false);
+
+    std::vector<std::string> expected = {"acquire", "location", "sv_status", "release"};
+    EXPECT_EQ(expected, callback->waitForEvents(expected.size()));
+}
+
+TEST(GnssCallbackBridgeTest, MergesNmeaOfTheSameEpoch) {
+    sp<FakeGnssCallback> callback = new FakeGnssCallback();
+    GnssCallbackBridge bridge;
+    bridge.setCallback(callback);
+
+    // Hold up the delivery thread so that the sentences wait in the queue
+    callback->block();
+    bridge.postStatus(IGnssCallback::GnssStatusValue::SESSION_BEGIN);
+    callback->waitUntilBlocked();
+    bridge.postNmea(1000, "$GPGGA", 6);
+    bridge.postNmea(1000, "$GPGSA", 6);
+    bridge.postNmea(2000, "$GPRMC", 6);
+    callback->release();
+
+    std::vector<std::string> expected = {"status", "nmea:$GPGGA$GPGSA", "nmea:$GPRMC"};
+    EXPECT_EQ(expected, callback->waitForEvents(expected.size()));
+    EXPECT_EQ(1u, bridge.getStats().nmeaMerged);
+}
+
+TEST(GnssCallbackBridgeTest, TerminatesNmea) {
+    sp<FakeGnssCallback> callback = new FakeGnssCallback();
+    GnssCallbackBridge bridge;
+    bridge.setCallback(callback);
+
+    bridge.postNmea(1000, "$GPGGA,1234", 11);
+    callback->waitForEvents(1);
+    // Delivered from the same buffers as the longer one
+    bridge.postNmea(2000, "$GPRMC", 6);
+    std::string longest(GnssCallbackBridge::kMaxNmeaLength, 'x');
+    bridge.postNmea(3000, longest.c_str(), longest.size());
+
+    std::vector<std::string> expected = {"nmea:$GPGGA,1234", "nmea:$GPRMC", "nmea:" + longest};
+    EXPECT_EQ(expected, callback->waitForEvents(expected.size()));
+}
+
+TEST(GnssCallbackBridgeTest, NeverDropsWakelockRelease) {
+    sp<FakeGnssCallback> callback = new FakeGnssCallback();
+    GnssCallbackBridge bridge;
+    bridge.setCallback(callback);
+
+    callback->block();
+    bridge.postStatus(IGnssCallback::GnssStatusValue::SESSION_BEGIN);
+    callback->waitUntilBlocked();
+    bridge.postWakelock(true);
+    // Fill every slot, including the reserved ones
+    for (int i = 0; i < 32; i++) {
+        bridge.postStatus(IGnssCallback::GnssStatusValue::SESSION_BEGIN);
+    }
+    bridge.postWakelock(false);
+    // Nothing may overtake the held back release
+    bridge.postLocation(GnssLocation());
+    EXPECT_GT(bridge.getStats().dropped, 0u);
+    callback->release();
+
+    std::vector<std::string> events = callback->waitForEvents(18);
+    ASSERT_EQ(18u, events.size());
+    EXPECT_EQ("acquire", events[1]);
+    EXPECT_EQ("release", events.back());
+}
+
+TEST(GnssCallbackBridgeTest, InstanceIsShared) {
+    EXPECT_NE(nullptr, GnssCallbackBridge::getInstance());
+    EXPECT_EQ(GnssCallbackBridge::getInstance(), GnssCallbackBridge::getInstance());
+}
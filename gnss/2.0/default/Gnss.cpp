@@ -18,9 +18,14 @@
 
 #include "Gnss.h"
 
+#include <android-base/parsedouble.h>
+#include <android-base/properties.h>
 #include <log/log.h>
+#include <stdio.h>
 #include <utils/SystemClock.h>
 
+#include <chrono>
+
 #include "AGnss.h"
 #include "AGnssRil.h"
 #include "GnssBatching.h"
@@ -49,7 +54,12 @@ sp<V1_1::IGnssCallback> Gnss::sGnssCallback_1_1 = nullptr;
 
 namespace {
 
-V2_0::GnssLocation getMockLocationV2_0() {
+// Path of a trace recorded with GnssTraceWriter, replayed instead of the mock fixes
+constexpr char kReplayTraceProperty[] = "vendor.gnss.replay.trace";
+// How many times faster than recorded the trace is played
+constexpr char kReplaySpeedupProperty[] = "vendor.gnss.replay.speedup";
+
+ElapsedRealtime getElapsedRealtime() {
     const ElapsedRealtime timestamp = {
             .flags = ElapsedRealtimeFlags::HAS_TIMESTAMP_NS |
                      ElapsedRealtimeFlags::HAS_TIME_UNCERTAINTY_NS,
@@ -58,17 +68,73 @@ V2_0::GnssLocation getMockLocationV2_0() {
             // In an actual implementation provide an estimate of the synchronization uncertainty
             // or don't set the field.
             .timeUncertaintyNs = 1000000};
+    return timestamp;
+}
+
+V2_0::GnssLocation getMockLocationV2_0() {
+    V2_0::GnssLocation location = {.v1_0 = Utils::getMockLocation(),
+                                   .elapsedRealtime = getElapsedRealtime()};
+    return location;
+}
 
-    V2_0::GnssLocation location = {.v1_0 = Utils::getMockLocation(), .elapsedRealtime = timestamp};
+V2_0::GnssLocation getReplayLocation(const trace::TraceLocation& traceLocation) {
+    V1_0::GnssLocation location_1_0 = {
+            .gnssLocationFlags = traceLocation.flags,
+            .latitudeDegrees = traceLocation.latitudeDegrees,
+            .longitudeDegrees = traceLocation.longitudeDegrees,
+            .altitudeMeters = traceLocation.altitudeMeters,
+            .speedMetersPerSec = traceLocation.speedMetersPerSec,
+            .bearingDegrees = traceLocation.bearingDegrees,
+            .horizontalAccuracyMeters = traceLocation.horizontalAccuracyMeters,
+            .verticalAccuracyMeters = traceLocation.verticalAccuracyMeters,
+            .speedAccuracyMetersPerSecond = traceLocation.speedAccuracyMetersPerSecond,
+            .bearingAccuracyDegrees = traceLocation.bearingAccuracyDegrees,
+            // The fix is reported as if it had just been computed
+            .timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch())
+                                 .count()};
+
+    V2_0::GnssLocation location = {.v1_0 = location_1_0, .elapsedRealtime = getElapsedRealtime()};
     return location;
 }
 
 }  // namespace
 
-Gnss::Gnss() : mMinIntervalMs(1000) {}
+Gnss::Gnss() : mMinIntervalMs(1000), mReplaySpeedup(1) {
+    std::string tracePath = android::base::GetProperty(kReplayTraceProperty, "");
+    if (tracePath.empty()) {
+        return;
+    }
+    std::unique_ptr<GnssTrace> trace = GnssTrace::load(tracePath);
+    if (trace == nullptr) {
+        ALOGE("%s: Unable to load %s, reporting mock fixes", __func__, tracePath.c_str());
+        return;
+    }
+
+    std::string speedup = android::base::GetProperty(kReplaySpeedupProperty, "1");
+    if (!android::base::ParseDouble(speedup.c_str(), &mReplaySpeedup, 0.001)) {
+        ALOGW("%s: Invalid %s %s, replaying in real time", __func__, kReplaySpeedupProperty,
+              speedup.c_str());
+        mReplaySpeedup = 1;
+    }
+    ALOGI("%s: Replaying %s at %gx", __func__, tracePath.c_str(), mReplaySpeedup);
+
+    mReplay = std::make_shared<GnssReplayEngine>(std::move(trace));
+    mReplay->setLocationSink([this](const trace::TraceLocation& location) {
+        this->reportLocation(getReplayLocation(location));
+    });
+    mReplay->setSvStatusSink([this](const trace::TraceSvInfo* svs, size_t count) {
+        this->reportSvStatus(svs, count);
+    });
+}
 
 Gnss::~Gnss() {
     stop();
+    if (mReplay != nullptr) {
+        // The measurement extension may outlive this object and keep the engine
+        mReplay->setLocationSink(nullptr);
+        mReplay->setSvStatusSink(nullptr);
+    }
 }
 
 // Methods from V1_0::IGnss follow.
@@ -84,6 +150,10 @@ Return<bool> Gnss::start() {
     }
 
     mIsActive = true;
+    if (mReplay != nullptr) {
+        mReplay->start(mReplaySpeedup, true);
+        return true;
+    }
     mThread = std::thread([this]() {
         while (mIsActive == true) {
             const auto location = getMockLocationV2_0();
@@ -97,6 +167,9 @@ Return<bool> Gnss::start() {
 
 Return<bool> Gnss::stop() {
     mIsActive = false;
+    if (mReplay != nullptr) {
+        mReplay->stop();
+    }
     if (mThread.joinable()) {
         mThread.join();
     }
@@ -224,7 +297,7 @@ Return<sp<V1_1::IGnssConfiguration>> Gnss::getExtensionGnssConfiguration_1_1() {
 
 Return<sp<V1_1::IGnssMeasurement>> Gnss::getExtensionGnssMeasurement_1_1() {
     ALOGD("Gnss::getExtensionGnssMeasurement_1_1");
-    return new GnssMeasurement();
+    return new GnssMeasurement(mReplay);
 }
 
 Return<bool> Gnss::injectBestLocation(const V1_0::GnssLocation&) {
@@ -252,7 +325,7 @@ Return<sp<V2_0::IAGnssRil>> Gnss::getExtensionAGnssRil_2_0() {
 
 Return<sp<V2_0::IGnssMeasurement>> Gnss::getExtensionGnssMeasurement_2_0() {
     ALOGD("Gnss::getExtensionGnssMeasurement_2_0");
-    return new GnssMeasurement();
+    return new GnssMeasurement(mReplay);
 }
 
 Return<sp<measurement_corrections::V1_0::IMeasurementCorrections>>
@@ -313,11 +386,60 @@ Return<void> Gnss::reportLocation(const V2_0::GnssLocation& location) const {
     return Void();
 }
 
+void Gnss::reportSvStatus(const trace::TraceSvInfo* svs, size_t count) {
+    mReplaySvs.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        const trace::TraceSvInfo& sv = svs[i];
+        // IRNSS has no 1.0 value
+        auto constellation_1_0 = sv.constellation <= (uint8_t)GnssConstellationType::GALILEO
+                                         ? static_cast<GnssConstellationType>(sv.constellation)
+                                         : GnssConstellationType::UNKNOWN;
+        mReplaySvs[i] = {.v1_0 = {.svid = sv.svid,
+                                  .constellation = constellation_1_0,
+                                  .cN0Dbhz = sv.cN0Dbhz,
+                                  .elevationDegrees = sv.elevationDegrees,
+                                  .azimuthDegrees = sv.azimuthDegrees,
+                                  .carrierFrequencyHz = sv.carrierFrequencyHz,
+                                  .svFlag = sv.flags},
+                         .constellation = static_cast<V2_0::GnssConstellationType>(
+                                 sv.constellation)};
+    }
+
+    hidl_vec<V2_0::IGnssCallback::GnssSvInfo> svList;
+    svList.setToExternal(mReplaySvs.data(), mReplaySvs.size());
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (sGnssCallback_2_0 == nullptr) {
+        ALOGE("%s: sGnssCallback 2.0 is null.", __func__);
+        return;
+    }
+    auto ret = sGnssCallback_2_0->gnssSvStatusCb_2_0(svList);
+    if (!ret.isOk()) {
+        ALOGE("%s: Unable to invoke callback", __func__);
+    }
+}
+
 Return<bool> Gnss::injectBestLocation_2_0(const V2_0::GnssLocation&) {
     // TODO(b/124012850): Implement function.
     return bool{};
 }
 
+// Methods from ::android::hidl::base::V1_0::IBase follow.
+Return<void> Gnss::debug(const hidl_handle& fd, const hidl_vec<hidl_string>&) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        ALOGE("%s: Missing file descriptor", __func__);
+        return Void();
+    }
+    if (mReplay == nullptr) {
+        dprintf(fd->data[0], "Reporting mock fixes, set %s to replay a trace\n",
+                kReplayTraceProperty);
+        return Void();
+    }
+    dprintf(fd->data[0], "Replay speed-up: %gx\n", mReplaySpeedup);
+    mReplay->dump(fd->data[0]);
+    return Void();
+}
+
 }  // namespace implementation
 }  // namespace V2_0
 }  // namespace gnss
@@ -21,8 +21,12 @@
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 #include <atomic>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
+
+#include "GnssReplay.h"
 
 namespace android {
 namespace hardware {
@@ -32,6 +36,7 @@ namespace implementation {
 
 using ::android::sp;
 using ::android::hardware::hidl_array;
+using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_memory;
 using ::android::hardware::hidl_string;
 using ::android::hardware::hidl_vec;
@@ -95,14 +100,25 @@ struct Gnss : public IGnss {
     Return<sp<V2_0::IGnssBatching>> getExtensionGnssBatching_2_0() override;
     Return<bool> injectBestLocation_2_0(const V2_0::GnssLocation& location) override;
 
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
   private:
     Return<void> reportLocation(const V2_0::GnssLocation&) const;
+    void reportSvStatus(const trace::TraceSvInfo* svs, size_t count);
     static sp<V2_0::IGnssCallback> sGnssCallback_2_0;
     static sp<V1_1::IGnssCallback> sGnssCallback_1_1;
     std::atomic<long> mMinIntervalMs;
     std::atomic<bool> mIsActive;
     std::thread mThread;
     mutable std::mutex mMutex;
+
+    // Set when a recorded session is replayed in place of the mock fixes. It is shared with the
+    // measurement extension, which reports the measurement epochs of the same trace.
+    std::shared_ptr<GnssReplayEngine> mReplay;
+    double mReplaySpeedup;
+    // Reused by the replay thread for each SV status
+    std::vector<V2_0::IGnssCallback::GnssSvInfo> mReplaySvs;
 };
 
 }  // namespace implementation
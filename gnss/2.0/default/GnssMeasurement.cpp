@@ -18,8 +18,11 @@
 #include "GnssMeasurement.h"
 
 #include <log/log.h>
+#include <string.h>
 #include <utils/SystemClock.h>
 
+#include <vector>
+
 namespace android {
 namespace hardware {
 namespace gnss {
@@ -32,7 +35,75 @@ using GnssMeasurementState = V2_0::IGnssMeasurementCallback::GnssMeasurementStat
 
 sp<V2_0::IGnssMeasurementCallback> GnssMeasurement::sCallback = nullptr;
 
-GnssMeasurement::GnssMeasurement() : mMinIntervalMillis(1000) {}
+namespace {
+
+ElapsedRealtime getElapsedRealtime() {
+    ElapsedRealtime timestamp = {
+            .flags = ElapsedRealtimeFlags::HAS_TIMESTAMP_NS |
+                     ElapsedRealtimeFlags::HAS_TIME_UNCERTAINTY_NS,
+            .timestampNs = static_cast<uint64_t>(::android::elapsedRealtimeNano()),
+            // This is an hardcoded value indicating a 1ms of uncertainty between the two clocks.
+            // In an actual implementation provide an estimate of the synchronization uncertainty
+            // or don't set the field.
+            .timeUncertaintyNs = 1000000};
+    return timestamp;
+}
+
+V1_0::IGnssMeasurementCallback::GnssClock getReplayClock(const trace::TraceClock& traceClock) {
+    V1_0::IGnssMeasurementCallback::GnssClock clock = {
+            .gnssClockFlags = traceClock.flags,
+            .leapSecond = traceClock.leapSecond,
+            .timeNs = traceClock.timeNs,
+            .timeUncertaintyNs = traceClock.timeUncertaintyNs,
+            .fullBiasNs = traceClock.fullBiasNs,
+            .biasNs = traceClock.biasNs,
+            .biasUncertaintyNs = traceClock.biasUncertaintyNs,
+            .driftNsps = traceClock.driftNsps,
+            .driftUncertaintyNsps = traceClock.driftUncertaintyNsps,
+            .hwClockDiscontinuityCount = traceClock.hwClockDiscontinuityCount};
+    return clock;
+}
+
+/*
+ * Fills in a measurement that is reused from epoch to epoch, so the code type string is only
+ * reallocated when it changes.
+ */
+void setReplayMeasurement(const trace::TraceMeasurement& traceMeasurement,
+                          V2_0::IGnssMeasurementCallback::GnssMeasurement* measurement) {
+    V1_0::IGnssMeasurementCallback::GnssMeasurement& measurement_1_0 = measurement->v1_1.v1_0;
+    measurement_1_0.flags = traceMeasurement.flags;
+    measurement_1_0.svid = traceMeasurement.svid;
+    measurement_1_0.timeOffsetNs = traceMeasurement.timeOffsetNs;
+    measurement_1_0.receivedSvTimeInNs = traceMeasurement.receivedSvTimeInNs;
+    measurement_1_0.receivedSvTimeUncertaintyInNs = traceMeasurement.receivedSvTimeUncertaintyInNs;
+    measurement_1_0.cN0DbHz = traceMeasurement.cN0DbHz;
+    measurement_1_0.pseudorangeRateMps = traceMeasurement.pseudorangeRateMps;
+    measurement_1_0.pseudorangeRateUncertaintyMps = traceMeasurement.pseudorangeRateUncertaintyMps;
+    measurement_1_0.accumulatedDeltaRangeM = traceMeasurement.accumulatedDeltaRangeM;
+    measurement_1_0.accumulatedDeltaRangeUncertaintyM =
+            traceMeasurement.accumulatedDeltaRangeUncertaintyM;
+    measurement_1_0.carrierFrequencyHz = traceMeasurement.carrierFrequencyHz;
+    measurement_1_0.multipathIndicator =
+            static_cast<V1_0::IGnssMeasurementCallback::GnssMultipathIndicator>(
+                    traceMeasurement.multipathIndicator);
+    // The 1.0 constellation and state are superseded by the 2.0 fields
+    measurement_1_0.constellation = V1_0::GnssConstellationType::UNKNOWN;
+    measurement_1_0.state = 0;
+    measurement->v1_1.accumulatedDeltaRangeState = traceMeasurement.accumulatedDeltaRangeState;
+    measurement->constellation = static_cast<GnssConstellationType>(traceMeasurement.constellation);
+    measurement->state = traceMeasurement.state;
+
+    char codeType[sizeof(traceMeasurement.codeType) + 1] = {};
+    memcpy(codeType, traceMeasurement.codeType, sizeof(traceMeasurement.codeType));
+    if (measurement->codeType != codeType) {
+        measurement->codeType = codeType;
+    }
+}
+
+}  // namespace
+
+GnssMeasurement::GnssMeasurement(std::shared_ptr<GnssReplayEngine> replay)
+    : mMinIntervalMillis(1000), mReplay(std::move(replay)) {}
 
 GnssMeasurement::~GnssMeasurement() {
     stop();
@@ -47,6 +118,9 @@ Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> GnssMeasurement::setCallba
 
 Return<void> GnssMeasurement::close() {
     ALOGD("close");
+    if (mReplay != nullptr) {
+        mReplay->setMeasurementSink(nullptr);
+    }
     std::unique_lock<std::mutex> lock(mMutex);
     stop();
     sCallback = nullptr;
@@ -67,6 +141,12 @@ Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> GnssMeasurement::setCallba
     std::unique_lock<std::mutex> lock(mMutex);
     sCallback = callback;
 
+    if (mReplay != nullptr) {
+        lock.unlock();
+        startReplay(callback);
+        return V1_0::IGnssMeasurement::GnssMeasurementStatus::SUCCESS;
+    }
+
     if (mIsActive) {
         ALOGW("GnssMeasurement callback already set. Resetting the callback...");
         stop();
@@ -89,6 +169,31 @@ void GnssMeasurement::start() {
     });
 }
 
+void GnssMeasurement::startReplay(const sp<V2_0::IGnssMeasurementCallback>& callback) {
+    ALOGD("startReplay");
+    // Epochs are reported while the GNSS session plays the trace. The sink holds its own reference
+    // to the callback and its own buffer, so it doesn't depend on this object, which the framework
+    // may release before the engine.
+    std::vector<IGnssMeasurementCallback::GnssMeasurement> measurements;
+    mReplay->setMeasurementSink([callback, measurements](
+                                        const trace::TraceClock& clock,
+                                        const trace::TraceMeasurement* traceMeasurements,
+                                        size_t count) mutable {
+        measurements.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            setReplayMeasurement(traceMeasurements[i], &measurements[i]);
+        }
+
+        GnssData gnssData = {.clock = getReplayClock(clock),
+                             .elapsedRealtime = getElapsedRealtime()};
+        gnssData.measurements.setToExternal(measurements.data(), measurements.size());
+        auto ret = callback->gnssMeasurementCb_2_0(gnssData);
+        if (!ret.isOk()) {
+            ALOGE("%s: Unable to invoke callback", __func__);
+        }
+    });
+}
+
 void GnssMeasurement::stop() {
     ALOGD("stop");
     mIsActive = false;
@@ -136,17 +241,9 @@ GnssData GnssMeasurement::getMockMeasurement() {
                                                        .driftUncertaintyNsps = 310.64968328491528,
                                                        .hwClockDiscontinuityCount = 1};
 
-    ElapsedRealtime timestamp = {
-            .flags = ElapsedRealtimeFlags::HAS_TIMESTAMP_NS |
-                     ElapsedRealtimeFlags::HAS_TIME_UNCERTAINTY_NS,
-            .timestampNs = static_cast<uint64_t>(::android::elapsedRealtimeNano()),
-            // This is an hardcoded value indicating a 1ms of uncertainty between the two clocks.
-            // In an actual implementation provide an estimate of the synchronization uncertainty
-            // or don't set the field.
-            .timeUncertaintyNs = 1000000};
-
-    GnssData gnssData = {
-            .measurements = measurements, .clock = clock, .elapsedRealtime = timestamp};
+    GnssData gnssData = {.measurements = measurements,
+                         .clock = clock,
+                         .elapsedRealtime = getElapsedRealtime()};
     return gnssData;
 }
 
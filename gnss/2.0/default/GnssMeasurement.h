@@ -21,9 +21,12 @@
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 #include <atomic>
+#include <memory>
 #include <mutex>
 #include <thread>
 
+#include "GnssReplay.h"
+
 namespace android {
 namespace hardware {
 namespace gnss {
@@ -41,7 +44,11 @@ using ::android::hardware::Void;
 using GnssData = V2_0::IGnssMeasurementCallback::GnssData;
 
 struct GnssMeasurement : public IGnssMeasurement {
-    GnssMeasurement();
+    /*
+     * With a replay engine, the measurement epochs of the trace it plays are reported instead of
+     * the mock measurement.
+     */
+    explicit GnssMeasurement(std::shared_ptr<GnssReplayEngine> replay = nullptr);
     ~GnssMeasurement();
     // Methods from V1_0::IGnssMeasurement follow.
     Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> setCallback(
@@ -58,6 +65,7 @@ struct GnssMeasurement : public IGnssMeasurement {
 
    private:
     void start();
+    void startReplay(const sp<V2_0::IGnssMeasurementCallback>& callback);
     void stop();
     GnssData getMockMeasurement();
     void reportMeasurement(const GnssData&);
@@ -67,6 +75,7 @@ struct GnssMeasurement : public IGnssMeasurement {
     std::atomic<bool> mIsActive;
     std::thread mThread;
     mutable std::mutex mMutex;
+    std::shared_ptr<GnssReplayEngine> mReplay;
 };
 
 }  // namespace implementation
@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GnssReplay"
+
+#include "GnssReplay.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <log/log.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_0 {
+namespace implementation {
+
+using trace::RecordType;
+using trace::TraceClock;
+using trace::TraceHeader;
+using trace::TraceLocation;
+using trace::TraceMeasurement;
+using trace::TraceRecordHeader;
+using trace::TraceSvInfo;
+
+namespace {
+
+size_t recordTypeIndex(RecordType type) {
+    return static_cast<size_t>(type) - 1;
+}
+
+const char* recordTypeName(RecordType type) {
+    switch (type) {
+        case RecordType::LOCATION:
+            return "location";
+        case RecordType::SV_STATUS:
+            return "SV status";
+        case RecordType::MEASUREMENT:
+            return "measurement";
+    }
+    return "unknown";
+}
+
+}  // namespace
+
+std::unique_ptr<GnssTrace> GnssTrace::load(const std::string& path) {
+    int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        ALOGE("%s: Unable to open %s: %s", __func__, path.c_str(), strerror(errno));
+        return nullptr;
+    }
+
+    std::vector<uint8_t> data;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data.resize(st.st_size);
+        size_t total = 0;
+        while (total < data.size()) {
+            ssize_t ret = TEMP_FAILURE_RETRY(read(fd, data.data() + total, data.size() - total));
+            if (ret <= 0) {
+                break;
+            }
+            total += ret;
+        }
+        data.resize(total);
+    }
+    close(fd);
+
+    return parse(std::move(data));
+}
+
+std::unique_ptr<GnssTrace> GnssTrace::parse(std::vector<uint8_t> data) {
+    if (data.size() < sizeof(TraceHeader)) {
+        ALOGE("%s: Trace too short", __func__);
+        return nullptr;
+    }
+    const TraceHeader* header = reinterpret_cast<const TraceHeader*>(data.data());
+    if (memcmp(header->magic, trace::kMagic, sizeof(trace::kMagic)) != 0 ||
+        header->version != trace::kVersion) {
+        ALOGE("%s: Not a version %u GNSS trace", __func__, trace::kVersion);
+        return nullptr;
+    }
+
+    // Every record takes at least its header, so a larger count can only come from a corrupt file
+    if (header->recordCount > (data.size() - sizeof(TraceHeader)) / sizeof(TraceRecordHeader)) {
+        ALOGE("%s: Trace claims %u records, more than its %zu bytes can hold", __func__,
+              header->recordCount, data.size());
+        return nullptr;
+    }
+
+    std::unique_ptr<GnssTrace> gnssTrace(new GnssTrace());
+    gnssTrace->mRecords.reserve(header->recordCount);
+
+    size_t offset = sizeof(TraceHeader);
+    int64_t lastTimeNs = INT64_MIN;
+    while (offset < data.size()) {
+        if (data.size() - offset < sizeof(TraceRecordHeader)) {
+            ALOGE("%s: Truncated record at offset %zu", __func__, offset);
+            return nullptr;
+        }
+        const TraceRecordHeader* recordHeader =
+                reinterpret_cast<const TraceRecordHeader*>(data.data() + offset);
+        offset += sizeof(TraceRecordHeader);
+        if (data.size() - offset < recordHeader->size) {
+            ALOGE("%s: Truncated record at offset %zu", __func__, offset);
+            return nullptr;
+        }
+        if (recordHeader->timeNs < lastTimeNs) {
+            ALOGE("%s: Record at offset %zu goes back in time", __func__, offset);
+            return nullptr;
+        }
+        lastTimeNs = recordHeader->timeNs;
+
+        const uint8_t* payload = data.data() + offset;
+        GnssTraceRecord record = {.type = static_cast<RecordType>(recordHeader->type),
+                                  .timeNs = recordHeader->timeNs,
+                                  .count = recordHeader->count,
+                                  .location = nullptr,
+                                  .svs = nullptr,
+                                  .clock = nullptr,
+                                  .measurements = nullptr};
+        size_t expectedSize;
+        switch (record.type) {
+            case RecordType::LOCATION:
+                expectedSize = sizeof(TraceLocation);
+                record.location = reinterpret_cast<const TraceLocation*>(payload);
+                break;
+            case RecordType::SV_STATUS:
+                expectedSize = record.count * sizeof(TraceSvInfo);
+                record.svs = reinterpret_cast<const TraceSvInfo*>(payload);
+                break;
+            case RecordType::MEASUREMENT:
+                expectedSize = sizeof(TraceClock) + record.count * sizeof(TraceMeasurement);
+                record.clock = reinterpret_cast<const TraceClock*>(payload);
+                record.measurements =
+                        reinterpret_cast<const TraceMeasurement*>(payload + sizeof(TraceClock));
+                break;
+            default:
+                ALOGW("%s: Skipping record of unknown type %u", __func__, recordHeader->type);
+                offset += recordHeader->size;
+                continue;
+        }
+        if (recordHeader->size != expectedSize) {
+            ALOGE("%s: %s record at offset %zu has size %u, expected %zu", __func__,
+                  recordTypeName(record.type), offset, recordHeader->size, expectedSize);
+            return nullptr;
+        }
+
+        gnssTrace->mRecords.push_back(record);
+        offset += recordHeader->size;
+    }
+
+    // The records point into the buffer, which moving does not reallocate.
+    gnssTrace->mData = std::move(data);
+    return gnssTrace;
+}
+
+GnssTraceWriter::GnssTraceWriter() : mData(sizeof(TraceHeader)), mRecordCount(0) {
+    TraceHeader header = {};
+    header.version = trace::kVersion;
+    memcpy(header.magic, trace::kMagic, sizeof(trace::kMagic));
+    memcpy(mData.data(), &header, sizeof(header));
+}
+
+bool GnssTraceWriter::addRecord(RecordType type, int64_t timeNs, size_t count,
+                                const void* payload, size_t size, const void* extra,
+                                size_t extraSize) {
+    if (count > UINT16_MAX) {
+        ALOGE("%s: %s record of %zu entries does not fit in a trace", __func__,
+              recordTypeName(type), count);
+        return false;
+    }
+
+    TraceRecordHeader header = {.type = static_cast<uint8_t>(type),
+                                .reserved = 0,
+                                .count = static_cast<uint16_t>(count),
+                                .size = static_cast<uint32_t>(size + extraSize),
+                                .timeNs = timeNs};
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&header);
+    mData.insert(mData.end(), bytes, bytes + sizeof(header));
+    bytes = reinterpret_cast<const uint8_t*>(payload);
+    mData.insert(mData.end(), bytes, bytes + size);
+    if (extraSize > 0) {
+        bytes = reinterpret_cast<const uint8_t*>(extra);
+        mData.insert(mData.end(), bytes, bytes + extraSize);
+    }
+
+    mRecordCount++;
+    memcpy(mData.data() + offsetof(TraceHeader, recordCount), &mRecordCount,
+           sizeof(mRecordCount));
+    return true;
+}
+
+void GnssTraceWriter::addLocation(int64_t timeNs, const TraceLocation& location) {
+    addRecord(RecordType::LOCATION, timeNs, 1, &location, sizeof(location));
+}
+
+bool GnssTraceWriter::addSvStatus(int64_t timeNs, const TraceSvInfo* svs, size_t count) {
+    return addRecord(RecordType::SV_STATUS, timeNs, count, svs, count * sizeof(TraceSvInfo));
+}
+
+bool GnssTraceWriter::addMeasurement(int64_t timeNs, const TraceClock& clock,
+                                     const TraceMeasurement* measurements, size_t count) {
+    return addRecord(RecordType::MEASUREMENT, timeNs, count, &clock, sizeof(clock), measurements,
+              count * sizeof(TraceMeasurement));
+}
+
+bool GnssTraceWriter::writeTo(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "we");
+    if (file == nullptr) {
+        ALOGE("%s: Unable to open %s: %s", __func__, path.c_str(), strerror(errno));
+        return false;
+    }
+    bool success = fwrite(mData.data(), 1, mData.size(), file) == mData.size();
+    return fclose(file) == 0 && success;
+}
+
+GnssReplayEngine::GnssReplayEngine(std::unique_ptr<GnssTrace> trace)
+    : mTrace(std::move(trace)), mStopThread(false), mDone(true) {}
+
+GnssReplayEngine::~GnssReplayEngine() {
+    stop();
+}
+
+void GnssReplayEngine::setLocationSink(LocationSink sink) {
+    std::lock_guard<std::mutex> lock(mSinkLock);
+    mLocationSink = std::move(sink);
+}
+
+void GnssReplayEngine::setSvStatusSink(SvStatusSink sink) {
+    std::lock_guard<std::mutex> lock(mSinkLock);
+    mSvStatusSink = std::move(sink);
+}
+
+void GnssReplayEngine::setMeasurementSink(MeasurementSink sink) {
+    std::lock_guard<std::mutex> lock(mSinkLock);
+    mMeasurementSink = std::move(sink);
+}
+
+void GnssReplayEngine::start(double speedup, bool loop) {
+    stop();
+    if (speedup <= 0) {
+        ALOGW("%s: Invalid speed-up %f, replaying in real time", __func__, speedup);
+        speedup = 1;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mStopThread = false;
+    mDone = false;
+    mThread = std::thread([this, speedup, loop]() { run(speedup, loop); });
+}
+
+void GnssReplayEngine::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopThread = true;
+    }
+    mCV.notify_all();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void GnssReplayEngine::waitUntilDone() {
+    std::unique_lock<std::mutex> lock(mLock);
+    mCV.wait(lock, [this]() { return mDone; });
+}
+
+void GnssReplayEngine::run(double speedup, bool loop) {
+    const std::vector<GnssTraceRecord>& records = mTrace->records();
+    std::unique_lock<std::mutex> lock(mLock);
+    if (!records.empty()) {
+        const int64_t firstTimeNs = records.front().timeNs;
+        // When looping, leave the same gap after the last record as between the first two
+        const int64_t loopGapNs =
+                records.size() > 1 ? records[1].timeNs - firstTimeNs : int64_t(1000000000);
+        Clock::time_point start = Clock::now();
+        do {
+            for (const GnssTraceRecord& record : records) {
+                Clock::time_point due =
+                        start + std::chrono::nanoseconds(static_cast<int64_t>(
+                                        (record.timeNs - firstTimeNs) / speedup));
+                if (mCV.wait_until(lock, due, [this]() { return mStopThread; })) {
+                    break;
+                }
+                lock.unlock();
+                dispatch(record, due);
+                lock.lock();
+            }
+            start += std::chrono::nanoseconds(static_cast<int64_t>(
+                    (records.back().timeNs - firstTimeNs + loopGapNs) / speedup));
+        } while (loop && !mStopThread);
+    }
+    mDone = true;
+    mCV.notify_all();
+}
+
+void GnssReplayEngine::dispatch(const GnssTraceRecord& record, Clock::time_point due) {
+    {
+        std::lock_guard<std::mutex> lock(mSinkLock);
+        switch (record.type) {
+            case RecordType::LOCATION:
+                if (!mLocationSink) return;
+                mLocationSink(*record.location);
+                break;
+            case RecordType::SV_STATUS:
+                if (!mSvStatusSink) return;
+                mSvStatusSink(record.svs, record.count);
+                break;
+            case RecordType::MEASUREMENT:
+                if (!mMeasurementSink) return;
+                mMeasurementSink(*record.clock, record.measurements, record.count);
+                break;
+        }
+    }
+    recordLatency(record.type,
+                  std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - due).count());
+}
+
+void GnssReplayEngine::recordLatency(RecordType type, int64_t latencyNs) {
+    latencyNs = std::max<int64_t>(latencyNs, 0);
+    size_t bucket = 0;
+    for (uint64_t ns = latencyNs; ns != 0 && bucket < kNumBuckets - 1; ns >>= 1) {
+        bucket++;
+    }
+
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    Histogram& histogram = mLatency[recordTypeIndex(type)];
+    histogram.buckets[bucket]++;
+    histogram.count++;
+    histogram.sumNs += latencyNs;
+    histogram.maxNs = std::max(histogram.maxNs, latencyNs);
+}
+
+GnssReplayEngine::LatencyStats GnssReplayEngine::getLatencyStats(RecordType type) const {
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    const Histogram& histogram = mLatency[recordTypeIndex(type)];
+    LatencyStats stats = {.count = histogram.count,
+                          .meanNs = histogram.count ? histogram.sumNs / int64_t(histogram.count)
+                                                    : 0,
+                          .p50Ns = 0,
+                          .p99Ns = 0,
+                          .maxNs = histogram.maxNs};
+
+    // Bucket i holds latencies below 2^i ns
+    uint64_t seen = 0;
+    bool foundP50 = false;
+    for (size_t i = 0; i < kNumBuckets && histogram.count > 0; i++) {
+        seen += histogram.buckets[i];
+        int64_t upperNs = std::min(int64_t(1) << i, histogram.maxNs);
+        if (!foundP50 && seen * 100 >= histogram.count * 50) {
+            stats.p50Ns = upperNs;
+            foundP50 = true;
+        }
+        if (seen * 100 >= histogram.count * 99) {
+            stats.p99Ns = upperNs;
+            break;
+        }
+    }
+    return stats;
+}
+
+void GnssReplayEngine::dump(int fd) const {
+    dprintf(fd, "Trace replay: %zu records\n", mTrace->records().size());
+    for (RecordType type :
+         {RecordType::LOCATION, RecordType::SV_STATUS, RecordType::MEASUREMENT}) {
+        LatencyStats stats = getLatencyStats(type);
+        dprintf(fd,
+                "  %s delivery latency: count %" PRIu64 ", mean %.3f ms, p50 < %.3f ms, "
+                "p99 < %.3f ms, max %.3f ms\n",
+                recordTypeName(type), stats.count, stats.meanNs / 1e6, stats.p50Ns / 1e6,
+                stats.p99Ns / 1e6, stats.maxNs / 1e6);
+    }
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
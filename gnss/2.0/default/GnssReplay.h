@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_GNSS_V2_0_GNSSREPLAY_H
+#define ANDROID_HARDWARE_GNSS_V2_0_GNSSREPLAY_H
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_0 {
+namespace implementation {
+
+/*
+ * On-disk format of a recorded GNSS session, replayed by the mock HAL in place of its hard-coded
+ * fixes. All fields are little-endian and the structures are packed.
+ *
+ * The file starts with a TraceHeader, followed by records in time order. Each record is a
+ * TraceRecordHeader followed by its payload:
+ *  - LOCATION: one TraceLocation,
+ *  - SV_STATUS: count TraceSvInfo,
+ *  - MEASUREMENT: one TraceClock followed by count TraceMeasurement.
+ * The fields mirror those of the HIDL structures they are replayed as.
+ */
+namespace trace {
+
+constexpr char kMagic[8] = {'G', 'N', 'S', 'S', 'T', 'R', 'C', '1'};
+constexpr uint32_t kVersion = 1;
+
+enum class RecordType : uint8_t {
+    LOCATION = 1,
+    SV_STATUS = 2,
+    MEASUREMENT = 3,
+};
+
+struct __attribute__((packed)) TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordCount;
+};
+
+struct __attribute__((packed)) TraceRecordHeader {
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t count;
+    uint32_t size;  // of the payload, in bytes
+    int64_t timeNs;  // since an arbitrary origin, non-decreasing across records
+};
+
+struct __attribute__((packed)) TraceLocation {
+    uint16_t flags;
+    double latitudeDegrees;
+    double longitudeDegrees;
+    double altitudeMeters;
+    float speedMetersPerSec;
+    float bearingDegrees;
+    float horizontalAccuracyMeters;
+    float verticalAccuracyMeters;
+    float speedAccuracyMetersPerSecond;
+    float bearingAccuracyDegrees;
+};
+
+struct __attribute__((packed)) TraceSvInfo {
+    int16_t svid;
+    uint8_t constellation;
+    uint8_t flags;
+    float cN0Dbhz;
+    float elevationDegrees;
+    float azimuthDegrees;
+    float carrierFrequencyHz;
+};
+
+struct __attribute__((packed)) TraceClock {
+    uint16_t flags;
+    int16_t leapSecond;
+    uint32_t hwClockDiscontinuityCount;
+    int64_t timeNs;
+    double timeUncertaintyNs;
+    int64_t fullBiasNs;
+    double biasNs;
+    double biasUncertaintyNs;
+    double driftNsps;
+    double driftUncertaintyNsps;
+};
+
+struct __attribute__((packed)) TraceMeasurement {
+    uint32_t flags;
+    int16_t svid;
+    uint8_t constellation;
+    uint8_t multipathIndicator;
+    uint32_t state;
+    uint16_t accumulatedDeltaRangeState;
+    int64_t receivedSvTimeInNs;
+    int64_t receivedSvTimeUncertaintyInNs;
+    double timeOffsetNs;
+    double cN0DbHz;
+    double pseudorangeRateMps;
+    double pseudorangeRateUncertaintyMps;
+    double accumulatedDeltaRangeM;
+    double accumulatedDeltaRangeUncertaintyM;
+    float carrierFrequencyHz;
+    char codeType[8];  // NUL-padded
+};
+
+}  // namespace trace
+
+/*
+ * A record of a loaded trace. The pointers refer to the trace's buffer.
+ */
+struct GnssTraceRecord {
+    trace::RecordType type;
+    int64_t timeNs;
+    size_t count;
+    const trace::TraceLocation* location;
+    const trace::TraceSvInfo* svs;
+    const trace::TraceClock* clock;
+    const trace::TraceMeasurement* measurements;
+};
+
+/*
+ * A trace loaded into memory and validated, ready to be replayed.
+ */
+class GnssTrace {
+  public:
+    /*
+     * Returns nullptr, after logging why, if the file can't be read or is not a valid trace.
+     */
+    static std::unique_ptr<GnssTrace> load(const std::string& path);
+    static std::unique_ptr<GnssTrace> parse(std::vector<uint8_t> data);
+
+    const std::vector<GnssTraceRecord>& records() const { return mRecords; }
+
+  private:
+    GnssTrace() = default;
+
+    std::vector<uint8_t> mData;
+    std::vector<GnssTraceRecord> mRecords;
+};
+
+/*
+ * Builds a trace, for tests and for tools converting recorded sessions. A record holds at most
+ * UINT16_MAX SVs or measurements; larger ones are rejected and leave the trace unchanged.
+ */
+class GnssTraceWriter {
+  public:
+    GnssTraceWriter();
+
+    void addLocation(int64_t timeNs, const trace::TraceLocation& location);
+    bool addSvStatus(int64_t timeNs, const trace::TraceSvInfo* svs, size_t count);
+    bool addMeasurement(int64_t timeNs, const trace::TraceClock& clock,
+                        const trace::TraceMeasurement* measurements, size_t count);
+
+    const std::vector<uint8_t>& data() const { return mData; }
+    bool writeTo(const std::string& path) const;
+
+  private:
+    bool addRecord(trace::RecordType type, int64_t timeNs, size_t count, const void* payload,
+                   size_t size, const void* extra = nullptr, size_t extraSize = 0);
+
+    std::vector<uint8_t> mData;
+    uint32_t mRecordCount;
+};
+
+/*
+ * Plays a trace back from its own thread, calling the sink registered for each kind of record when
+ * the record is due. A speed-up above 1 compresses the gaps between records, so framework-side
+ * consumers can be loaded at several times the recorded rate.
+ *
+ * For each kind of record, the engine measures the delivery latency: the time from when the record
+ * was due until its sink returned. That covers both scheduling delays and the time the framework
+ * took to handle the callback.
+ */
+class GnssReplayEngine {
+  public:
+    using LocationSink = std::function<void(const trace::TraceLocation&)>;
+    using SvStatusSink = std::function<void(const trace::TraceSvInfo* svs, size_t count)>;
+    using MeasurementSink = std::function<void(const trace::TraceClock& clock,
+                                               const trace::TraceMeasurement* measurements,
+                                               size_t count)>;
+
+    struct LatencyStats {
+        uint64_t count;
+        int64_t meanNs;
+        // Upper bounds of the power-of-two bucket holding the percentile
+        int64_t p50Ns;
+        int64_t p99Ns;
+        int64_t maxNs;
+    };
+
+    explicit GnssReplayEngine(std::unique_ptr<GnssTrace> trace);
+    ~GnssReplayEngine();
+
+    void setLocationSink(LocationSink sink);
+    void setSvStatusSink(SvStatusSink sink);
+    void setMeasurementSink(MeasurementSink sink);
+
+    /*
+     * Starts playing the trace from its beginning, restarting it if it is already playing. If loop
+     * is set, the trace starts over once it has been played.
+     */
+    void start(double speedup, bool loop);
+    void stop();
+
+    /*
+     * Blocks until a trace started without looping has been played in full.
+     */
+    void waitUntilDone();
+
+    LatencyStats getLatencyStats(trace::RecordType type) const;
+    void dump(int fd) const;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t kNumBuckets = 48;
+    static constexpr size_t kNumRecordTypes = 3;
+
+    struct Histogram {
+        std::array<uint64_t, kNumBuckets> buckets{};
+        uint64_t count = 0;
+        int64_t sumNs = 0;
+        int64_t maxNs = 0;
+    };
+
+    void run(double speedup, bool loop);
+    void dispatch(const GnssTraceRecord& record, Clock::time_point due);
+    void recordLatency(trace::RecordType type, int64_t latencyNs);
+
+    std::unique_ptr<GnssTrace> mTrace;
+
+    std::mutex mSinkLock;
+    LocationSink mLocationSink;
+    SvStatusSink mSvStatusSink;
+    MeasurementSink mMeasurementSink;
+
+    std::mutex mLock;
+    std::condition_variable mCV;
+    bool mStopThread;
+    bool mDone;
+    std::thread mThread;
+
+    mutable std::mutex mStatsLock;
+    std::array<Histogram, kNumRecordTypes> mLatency;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_GNSS_V2_0_GNSSREPLAY_H
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GnssReplay.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_0 {
+namespace implementation {
+
+using trace::RecordType;
+using trace::TraceClock;
+using trace::TraceLocation;
+using trace::TraceMeasurement;
+using trace::TraceSvInfo;
+
+namespace {
+
+constexpr int64_t kEpochNs = 100 * 1000 * 1000;  // 10 Hz
+constexpr size_t kEpochs = 50;
+constexpr size_t kSvsPerEpoch = 40;
+constexpr size_t kMeasurementsPerEpoch = 30;
+
+// A session at 10 Hz with a multi-constellation SV status and measurements every epoch
+GnssTraceWriter makeSession() {
+    GnssTraceWriter writer;
+    std::vector<TraceSvInfo> svs(kSvsPerEpoch);
+    std::vector<TraceMeasurement> measurements(kMeasurementsPerEpoch);
+    for (size_t epoch = 0; epoch < kEpochs; epoch++) {
+        int64_t timeNs = epoch * kEpochNs;
+
+        TraceLocation location = {};
+        location.latitudeDegrees = 37.4219999 + epoch * 1e-5;
+        location.longitudeDegrees = -122.0840575;
+        writer.addLocation(timeNs, location);
+
+        for (size_t i = 0; i < svs.size(); i++) {
+            svs[i] = {};
+            svs[i].svid = i + 1;
+            svs[i].constellation = 1 + i % 6;
+            svs[i].cN0Dbhz = 20 + epoch % 20;
+        }
+        writer.addSvStatus(timeNs, svs.data(), svs.size());
+
+        TraceClock clock = {};
+        clock.timeNs = timeNs;
+        for (size_t i = 0; i < measurements.size(); i++) {
+            measurements[i] = {};
+            measurements[i].svid = i + 1;
+            strcpy(measurements[i].codeType, "C");
+        }
+        writer.addMeasurement(timeNs, clock, measurements.data(), measurements.size());
+    }
+    return writer;
+}
+
+}  // namespace
+
+TEST(GnssTraceTest, ParsesWrittenTrace) {
+    std::unique_ptr<GnssTrace> trace = GnssTrace::parse(makeSession().data());
+    ASSERT_NE(nullptr, trace);
+    ASSERT_EQ(3 * kEpochs, trace->records().size());
+
+    const GnssTraceRecord& location = trace->records()[3];
+    EXPECT_EQ(RecordType::LOCATION, location.type);
+    EXPECT_EQ(kEpochNs, location.timeNs);
+    EXPECT_DOUBLE_EQ(37.4219999 + 1e-5, location.location->latitudeDegrees);
+
+    const GnssTraceRecord& svStatus = trace->records()[4];
+    EXPECT_EQ(RecordType::SV_STATUS, svStatus.type);
+    ASSERT_EQ(kSvsPerEpoch, svStatus.count);
+    EXPECT_EQ(kSvsPerEpoch, static_cast<size_t>(svStatus.svs[kSvsPerEpoch - 1].svid));
+
+    const GnssTraceRecord& measurement = trace->records()[5];
+    EXPECT_EQ(RecordType::MEASUREMENT, measurement.type);
+    EXPECT_EQ(kEpochNs, measurement.clock->timeNs);
+    ASSERT_EQ(kMeasurementsPerEpoch, measurement.count);
+    EXPECT_STREQ("C", measurement.measurements[0].codeType);
+}
+
+TEST(GnssTraceTest, RejectsCorruptTraces) {
+    std::vector<uint8_t> data = makeSession().data();
+
+    std::vector<uint8_t> truncated(data.begin(), data.end() - 1);
+    EXPECT_EQ(nullptr, GnssTrace::parse(truncated));
+
+    std::vector<uint8_t> badMagic = data;
+    badMagic[0] = 'X';
+    EXPECT_EQ(nullptr, GnssTrace::parse(badMagic));
+
+    GnssTraceWriter backwards;
+    backwards.addLocation(2, TraceLocation{});
+    backwards.addLocation(1, TraceLocation{});
+    EXPECT_EQ(nullptr, GnssTrace::parse(backwards.data()));
+
+    // A record count the data can not hold
+    std::vector<uint8_t> tooManyRecords = data;
+    uint32_t recordCount = UINT32_MAX;
+    memcpy(tooManyRecords.data() + offsetof(trace::TraceHeader, recordCount), &recordCount,
+           sizeof(recordCount));
+    EXPECT_EQ(nullptr, GnssTrace::parse(tooManyRecords));
+}
+
+TEST(GnssTraceTest, RejectsOversizedRecords) {
+    GnssTraceWriter writer;
+    std::vector<TraceSvInfo> svs(UINT16_MAX + 1);
+    EXPECT_FALSE(writer.addSvStatus(0, svs.data(), svs.size()));
+    EXPECT_TRUE(writer.addSvStatus(0, svs.data(), UINT16_MAX));
+
+    std::unique_ptr<GnssTrace> trace = GnssTrace::parse(writer.data());
+    ASSERT_NE(nullptr, trace);
+    ASSERT_EQ(1u, trace->records().size());
+    EXPECT_EQ(size_t{UINT16_MAX}, trace->records()[0].count);
+}
+
+TEST(GnssTraceTest, LoadsFromFile) {
+    std::string path = ::testing::TempDir() + "gnss_replay_test.trace";
+    ASSERT_TRUE(makeSession().writeTo(path));
+    std::unique_ptr<GnssTrace> trace = GnssTrace::load(path);
+    ASSERT_NE(nullptr, trace);
+    EXPECT_EQ(3 * kEpochs, trace->records().size());
+    unlink(path.c_str());
+}
+
+// Replays five seconds of 10 Hz data at 50x and checks that every record reaches its sink, in
+// order, and within the compressed time.
+TEST(GnssReplayEngineTest, ReplaysAtSpeedup) {
+    GnssReplayEngine engine(GnssTrace::parse(makeSession().data()));
+
+    std::vector<RecordType> delivered;
+    size_t svs = 0;
+    size_t measurements = 0;
+    engine.setLocationSink(
+            [&](const TraceLocation&) { delivered.push_back(RecordType::LOCATION); });
+    engine.setSvStatusSink([&](const TraceSvInfo*, size_t count) {
+        delivered.push_back(RecordType::SV_STATUS);
+        svs += count;
+    });
+    engine.setMeasurementSink([&](const TraceClock&, const TraceMeasurement*, size_t count) {
+        delivered.push_back(RecordType::MEASUREMENT);
+        measurements += count;
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    engine.start(50, false);
+    engine.waitUntilDone();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    ASSERT_EQ(3 * kEpochs, delivered.size());
+    for (size_t i = 0; i < delivered.size(); i += 3) {
+        EXPECT_EQ(RecordType::LOCATION, delivered[i]);
+        EXPECT_EQ(RecordType::SV_STATUS, delivered[i + 1]);
+        EXPECT_EQ(RecordType::MEASUREMENT, delivered[i + 2]);
+    }
+    EXPECT_EQ(kEpochs * kSvsPerEpoch, svs);
+    EXPECT_EQ(kEpochs * kMeasurementsPerEpoch, measurements);
+
+    // The last epoch is due 49 * 100 ms / 50 = 98 ms in
+    EXPECT_GE(elapsed, std::chrono::milliseconds(98));
+    EXPECT_LT(elapsed, std::chrono::seconds(2));
+}
+
+// A slow consumer shows up in the delivery latency of its kind of callback only
+TEST(GnssReplayEngineTest, ReportsDeliveryLatency) {
+    GnssReplayEngine engine(GnssTrace::parse(makeSession().data()));
+    engine.setLocationSink([](const TraceLocation&) {});
+    engine.setMeasurementSink([](const TraceClock&, const TraceMeasurement*, size_t) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    });
+
+    engine.start(100, false);
+    engine.waitUntilDone();
+
+    GnssReplayEngine::LatencyStats location = engine.getLatencyStats(RecordType::LOCATION);
+    GnssReplayEngine::LatencyStats svStatus = engine.getLatencyStats(RecordType::SV_STATUS);
+    GnssReplayEngine::LatencyStats measurement = engine.getLatencyStats(RecordType::MEASUREMENT);
+
+    EXPECT_EQ(kEpochs, location.count);
+    EXPECT_EQ(0u, svStatus.count);
+    EXPECT_EQ(kEpochs, measurement.count);
+    EXPECT_GE(measurement.meanNs, 1000000);
+    EXPECT_GE(measurement.p50Ns, 1000000);
+    EXPECT_GE(measurement.maxNs, measurement.p99Ns);
+    EXPECT_LE(location.p50Ns, measurement.p50Ns);
+}
+
+TEST(GnssReplayEngineTest, LoopsUntilStopped) {
+    GnssReplayEngine engine(GnssTrace::parse(makeSession().data()));
+    std::atomic<size_t> locations{0};
+    engine.setLocationSink([&](const TraceLocation&) { locations++; });
+
+    engine.start(1000, true);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (locations < 2 * kEpochs && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    engine.stop();
+
+    EXPECT_GE(locations, 2 * kEpochs);
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
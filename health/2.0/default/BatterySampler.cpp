@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "android.hardware.health@2.0-impl"
+#include <android-base/logging.h>
+
+#include <android-base/file.h>
+#include <android-base/strings.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <health2/BatterySampler.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <memory>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace implementation {
+
+namespace {
+
+// Values of V1_0::BatteryStatus
+constexpr int32_t kStatusUnknown = 1;
+constexpr int32_t kStatusCharging = 2;
+constexpr int32_t kStatusDischarging = 3;
+constexpr int32_t kStatusNotCharging = 4;
+constexpr int32_t kStatusFull = 5;
+
+// Values of V1_0::BatteryHealth
+constexpr int32_t kHealthUnknown = 1;
+constexpr int32_t kHealthGood = 2;
+constexpr int32_t kHealthOverheat = 3;
+constexpr int32_t kHealthDead = 4;
+constexpr int32_t kHealthOverVoltage = 5;
+constexpr int32_t kHealthUnspecifiedFailure = 6;
+constexpr int32_t kHealthCold = 7;
+
+enum class SupplyType { UNKNOWN, AC, USB, WIRELESS, BATTERY };
+
+template <typename T>
+struct Mapping {
+    const char* name;
+    T value;
+};
+
+// The same mappings as BatteryMonitor
+constexpr Mapping<int32_t> kStatusMap[] = {
+        {"Unknown", kStatusUnknown},           {"Charging", kStatusCharging},
+        {"Discharging", kStatusDischarging},   {"Not charging", kStatusNotCharging},
+        {"Full", kStatusFull},
+};
+
+constexpr Mapping<int32_t> kHealthMap[] = {
+        {"Unknown", kHealthUnknown},
+        {"Good", kHealthGood},
+        {"Overheat", kHealthOverheat},
+        {"Dead", kHealthDead},
+        {"Over voltage", kHealthOverVoltage},
+        {"Unspecified failure", kHealthUnspecifiedFailure},
+        {"Cold", kHealthCold},
+        // JEITA battery temperature zones
+        {"Warm", kHealthGood},
+        {"Cool", kHealthGood},
+        {"Hot", kHealthOverheat},
+};
+
+constexpr Mapping<SupplyType> kSupplyTypeMap[] = {
+        {"Unknown", SupplyType::UNKNOWN},  {"Battery", SupplyType::BATTERY},
+        {"UPS", SupplyType::AC},           {"Mains", SupplyType::AC},
+        {"USB", SupplyType::USB},          {"USB_DCP", SupplyType::AC},
+        {"USB_HVDCP", SupplyType::AC},     {"USB_CDP", SupplyType::AC},
+        {"USB_ACA", SupplyType::AC},       {"USB_C", SupplyType::AC},
+        {"USB_PD", SupplyType::AC},        {"USB_PD_DRP", SupplyType::USB},
+        {"Wireless", SupplyType::WIRELESS},
+};
+
+template <typename T, size_t N>
+T lookup(const Mapping<T> (&map)[N], std::string_view name, T defaultValue) {
+    for (const auto& entry : map) {
+        if (name == entry.name) {
+            return entry.value;
+        }
+    }
+    return defaultValue;
+}
+
+bool exceeds(int32_t last, int32_t now, int32_t threshold) {
+    int64_t delta = static_cast<int64_t>(now) - last;
+    return (delta < 0 ? -delta : delta) > threshold;
+}
+
+}  // namespace
+
+bool batteryChanged(const BatterySample& last, const BatterySample& now,
+                    const BatteryChangeThresholds& thresholds) {
+    return last.chargerAcOnline != now.chargerAcOnline ||
+           last.chargerUsbOnline != now.chargerUsbOnline ||
+           last.chargerWirelessOnline != now.chargerWirelessOnline ||
+           last.status != now.status || last.health != now.health ||
+           last.present != now.present || last.level != now.level ||
+           exceeds(last.voltageMv, now.voltageMv, thresholds.voltageMv) ||
+           exceeds(last.temperature, now.temperature, thresholds.temperature) ||
+           exceeds(last.currentUa, now.currentUa, thresholds.currentUa) ||
+           exceeds(last.chargeCounterUah, now.chargeCounterUah, thresholds.chargeCounterUah);
+}
+
+BatterySampler::BatterySampler(const std::string& powerSupplyRoot,
+                               const PathOverrides& overrides)
+    : has_battery_(false) {
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(powerSupplyRoot.c_str()), closedir);
+    if (dir == nullptr) {
+        PLOG(ERROR) << "Could not open " << powerSupplyRoot;
+        return;
+    }
+
+    PathOverrides paths;
+    while (struct dirent* entry = readdir(dir.get())) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        std::string supply = powerSupplyRoot + "/" + entry->d_name;
+        std::string type;
+        if (!android::base::ReadFileToString(supply + "/type", &type)) {
+            continue;
+        }
+        type = android::base::Trim(type);
+        SupplyType supplyType = lookup(kSupplyTypeMap, type, SupplyType::UNKNOWN);
+        if (supplyType == SupplyType::BATTERY) {
+            if (paths.capacity.empty()) {
+                paths.status = supply + "/status";
+                paths.health = supply + "/health";
+                paths.present = supply + "/present";
+                paths.capacity = supply + "/capacity";
+                paths.voltage = supply + "/voltage_now";
+                paths.temperature = supply + "/temp";
+                paths.currentNow = supply + "/current_now";
+                paths.chargeCounter = supply + "/charge_counter";
+            }
+        } else if (supplyType != SupplyType::UNKNOWN) {
+            // The type of USB supplies changes with what is plugged in
+            Charger charger{openAttribute(supply + "/type"), openAttribute(supply + "/online")};
+            if (charger.type.fd != -1 && charger.online.fd != -1) {
+                chargers_.push_back(std::move(charger));
+            }
+        }
+    }
+
+    auto pick = [](const std::string& override, const std::string& found) {
+        return openAttribute(override.empty() ? found : override);
+    };
+    status_ = pick(overrides.status, paths.status);
+    health_ = pick(overrides.health, paths.health);
+    present_ = pick(overrides.present, paths.present);
+    capacity_ = pick(overrides.capacity, paths.capacity);
+    voltage_ = pick(overrides.voltage, paths.voltage);
+    temperature_ = pick(overrides.temperature, paths.temperature);
+    current_now_ = pick(overrides.currentNow, paths.currentNow);
+    charge_counter_ = pick(overrides.chargeCounter, paths.chargeCounter);
+    has_battery_ = capacity_.fd != -1;
+}
+
+BatterySampler::Attribute BatterySampler::openAttribute(const std::string& path) {
+    Attribute attribute;
+    attribute.path = path;
+    if (!path.empty()) {
+        attribute.fd.reset(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+    }
+    return attribute;
+}
+
+bool BatterySampler::read(const Attribute& attribute, std::string_view* value) {
+    ssize_t n = TEMP_FAILURE_RETRY(pread(attribute.fd.get(), buf_, sizeof(buf_) - 1, 0));
+    if (n < 0) {
+        PLOG(DEBUG) << "Could not read " << attribute.path;
+        return false;
+    }
+    while (n > 0 && (buf_[n - 1] == '\n' || buf_[n - 1] == ' ')) {
+        n--;
+    }
+    buf_[n] = '\0';
+    *value = std::string_view(buf_, n);
+    return true;
+}
+
+bool BatterySampler::readInt(const Attribute& attribute, int32_t* value) {
+    std::string_view text;
+    if (!read(attribute, &text)) {
+        return false;
+    }
+    char* end;
+    long parsed = strtol(buf_, &end, 10);
+    if (end == buf_) {
+        LOG(DEBUG) << "Could not parse " << attribute.path << ": " << text;
+        return false;
+    }
+    *value = static_cast<int32_t>(parsed);
+    return true;
+}
+
+bool BatterySampler::sample(BatterySample* sample) {
+    if (!has_battery_) {
+        return false;
+    }
+
+    // Attributes the battery doesn't have are reported the way BatteryMonitor reports them
+    BatterySample s;
+    std::string_view text;
+    int32_t value;
+    if (!readInt(capacity_, &s.level)) {
+        return false;
+    }
+    if (voltage_.fd != -1) {
+        if (!readInt(voltage_, &value)) return false;
+        s.voltageMv = value / 1000;
+    }
+    if (temperature_.fd != -1 && !readInt(temperature_, &s.temperature)) {
+        return false;
+    }
+    if (current_now_.fd != -1 && !readInt(current_now_, &s.currentUa)) {
+        return false;
+    }
+    if (charge_counter_.fd != -1 && !readInt(charge_counter_, &s.chargeCounterUah)) {
+        return false;
+    }
+    s.present = true;
+    if (present_.fd != -1) {
+        if (!readInt(present_, &value)) return false;
+        s.present = value != 0;
+    }
+    if (status_.fd != -1) {
+        if (!read(status_, &text)) return false;
+        s.status = lookup(kStatusMap, text, kStatusUnknown);
+    }
+    if (health_.fd != -1) {
+        if (!read(health_, &text)) return false;
+        s.health = lookup(kHealthMap, text, kHealthUnknown);
+    }
+
+    for (const auto& charger : chargers_) {
+        if (!readInt(charger.online, &value)) {
+            return false;
+        }
+        if (value == 0) {
+            continue;
+        }
+        if (!read(charger.type, &text)) {
+            return false;
+        }
+        switch (lookup(kSupplyTypeMap, text, SupplyType::UNKNOWN)) {
+            case SupplyType::AC:
+                s.chargerAcOnline = true;
+                break;
+            case SupplyType::USB:
+                s.chargerUsbOnline = true;
+                break;
+            case SupplyType::WIRELESS:
+                s.chargerWirelessOnline = true;
+                break;
+            default:
+                break;
+        }
+    }
+
+    *sample = s;
+    return true;
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
@@ -17,7 +17,9 @@
 #include <android-base/logging.h>
 
 #include <android-base/file.h>
+#include <android-base/stringprintf.h>
 #include <health2/Health.h>
+#include <inttypes.h>
 
 #include <hal_conversion.h>
 #include <hidl/HidlTransportSupport.h>
@@ -31,12 +33,41 @@ namespace V2_0 {
 namespace implementation {
 
 sp<Health> Health::instance_;
+thread_local Health::NotifyPolicy Health::notify_policy_ = Health::NotifyPolicy::ALWAYS;
 
 Health::Health(struct healthd_config* c) {
     // TODO(b/69268160): remove when libhealthd is removed.
     healthd_board_init(c);
     battery_monitor_ = std::make_unique<BatteryMonitor>();
     battery_monitor_->init(c);
+
+    // BatteryMonitor::init fills in the paths it found, so both sample the same attributes.
+    BatterySampler::PathOverrides paths;
+    paths.status = c->batteryStatusPath.string();
+    paths.health = c->batteryHealthPath.string();
+    paths.present = c->batteryPresentPath.string();
+    paths.capacity = c->batteryCapacityPath.string();
+    paths.voltage = c->batteryVoltagePath.string();
+    paths.temperature = c->batteryTemperaturePath.string();
+    paths.currentNow = c->batteryCurrentNowPath.string();
+    paths.chargeCounter = c->batteryChargeCounterPath.string();
+    battery_sampler_ = std::make_unique<BatterySampler>(BatterySampler::kPowerSupplyRoot, paths);
+}
+
+static BatterySample toBatterySample(const V1_0::HealthInfo& info) {
+    BatterySample sample;
+    sample.chargerAcOnline = info.chargerAcOnline;
+    sample.chargerUsbOnline = info.chargerUsbOnline;
+    sample.chargerWirelessOnline = info.chargerWirelessOnline;
+    sample.status = static_cast<int32_t>(info.batteryStatus);
+    sample.health = static_cast<int32_t>(info.batteryHealth);
+    sample.present = info.batteryPresent;
+    sample.level = info.batteryLevel;
+    sample.voltageMv = info.batteryVoltage;
+    sample.temperature = info.batteryTemperature;
+    sample.currentUa = info.batteryCurrent;
+    sample.chargeCounterUah = info.batteryChargeCounter;
+    return sample;
 }
 
 // Methods from IHealth follow.
@@ -140,6 +171,18 @@ Return<void> Health::getChargeStatus(getChargeStatus_cb _hidl_cb) {
 }
 
 Return<Result> Health::update() {
+    return updateWithPolicy(NotifyPolicy::ALWAYS);
+}
+
+Return<Result> Health::updateWithPolicy(NotifyPolicy policy) {
+    NotifyPolicy storedPolicy = notify_policy_;
+    notify_policy_ = policy;
+    Return<Result> result = updateInternal();
+    notify_policy_ = storedPolicy;
+    return result;
+}
+
+Return<Result> Health::updateInternal() {
     if (!healthd_mode_ops || !healthd_mode_ops->battery_update) {
         LOG(WARNING) << "health@2.0: update: not initialized. "
                      << "update() should not be called in charger";
@@ -163,18 +206,43 @@ Return<Result> Health::updateAndNotify(const sp<IHealthInfoCallback>& callback)
     if (callback != nullptr) {
         callbacks_.push_back(callback);
     }
-    Return<Result> result = update();
+    Return<Result> result = updateWithPolicy(NotifyPolicy::UNRECORDED);
     callbacks_ = std::move(storedCallbacks);
     return result;
 }
 
-void Health::notifyListeners(HealthInfo* healthInfo) {
-    std::vector<StorageInfo> info;
-    get_storage_info(info);
+void Health::periodicUpdate() {
+    BatterySample sample;
+    if (battery_sampler_->sample(&sample)) {
+        bool changed;
+        {
+            std::lock_guard<decltype(notify_lock_)> lock(notify_lock_);
+            changed = !has_notified_ || batteryChanged(toBatterySample(last_notified_.legacy),
+                                                       sample, change_thresholds_);
+            if (!changed) {
+                skipped_updates_++;
+            }
+        }
+        if (!changed) {
+            // adjust uevent / wakealarm periods, as an update would
+            healthd_battery_update_internal(sample.chargerAcOnline || sample.chargerUsbOnline ||
+                                            sample.chargerWirelessOnline);
+            return;
+        }
+    }
+    updateWithPolicy(NotifyPolicy::ON_CHANGE);
+}
 
-    std::vector<DiskStats> stats;
-    get_disk_stats(stats);
+void Health::ueventUpdate() {
+    updateWithPolicy(NotifyPolicy::ON_CHANGE);
+}
+
+void Health::setChangeThresholds(const BatteryChangeThresholds& thresholds) {
+    std::lock_guard<decltype(notify_lock_)> lock(notify_lock_);
+    change_thresholds_ = thresholds;
+}
 
+void Health::notifyListeners(HealthInfo* healthInfo) {
     int32_t currentAvg = 0;
 
     struct BatteryProperty prop;
@@ -184,6 +252,28 @@ void Health::notifyListeners(HealthInfo* healthInfo) {
     }
 
     healthInfo->batteryCurrentAverage = currentAvg;
+
+    {
+        std::lock_guard<decltype(notify_lock_)> lock(notify_lock_);
+        if (notify_policy_ == NotifyPolicy::ON_CHANGE && has_notified_ &&
+            healthInfo->legacy == last_notified_.legacy &&
+            healthInfo->batteryCurrentAverage == last_notified_.batteryCurrentAverage) {
+            suppressed_notifications_++;
+            return;
+        }
+        if (notify_policy_ != NotifyPolicy::UNRECORDED) {
+            last_notified_.legacy = healthInfo->legacy;
+            last_notified_.batteryCurrentAverage = healthInfo->batteryCurrentAverage;
+            has_notified_ = true;
+        }
+    }
+
+    std::vector<StorageInfo> info;
+    get_storage_info(info);
+
+    std::vector<DiskStats> stats;
+    get_disk_stats(stats);
+
     healthInfo->diskStats = stats;
     healthInfo->storageInfos = info;
 
@@ -203,6 +293,16 @@ Return<void> Health::debug(const hidl_handle& handle, const hidl_vec<hidl_string
         int fd = handle->data[0];
         battery_monitor_->dumpState(fd);
 
+        {
+            std::lock_guard<decltype(notify_lock_)> lock(notify_lock_);
+            android::base::WriteStringToFd(
+                    android::base::StringPrintf(
+                            "\nskipped periodic updates: %" PRIu64
+                            "\nsuppressed notifications: %" PRIu64 "\n",
+                            skipped_updates_, suppressed_notifications_),
+                    fd);
+        }
+
         getHealthInfo([fd](auto res, const auto& info) {
             android::base::WriteStringToFd("\ngetHealthInfo -> ", fd);
             if (res == Result::SUCCESS) {
@@ -136,12 +136,8 @@ void healthd_battery_update_internal(bool charger_online) {
                                   : healthd_config.periodic_chores_interval_fast * 1000;
 }
 
-static void healthd_battery_update(void) {
-    Health::getImplementation()->update();
-}
-
 static void periodic_chores() {
-    healthd_battery_update();
+    Health::getImplementation()->periodicUpdate();
 }
 
 #define UEVENT_MSG_LEN 2048
@@ -161,7 +157,7 @@ static void uevent_event(uint32_t /*epevents*/) {
 
     while (*cp) {
         if (!strcmp(cp, "SUBSYSTEM=" POWER_SUPPLY_SUBSYSTEM)) {
-            healthd_battery_update();
+            Health::getImplementation()->ueventUpdate();
             break;
         }
 
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_HEALTH_V2_0_BATTERY_SAMPLER_H
+#define ANDROID_HARDWARE_HEALTH_V2_0_BATTERY_SAMPLER_H
+
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace implementation {
+
+// The parts of HealthInfo that health callbacks are notified of changes to.
+struct BatterySample {
+    bool chargerAcOnline = false;
+    bool chargerUsbOnline = false;
+    bool chargerWirelessOnline = false;
+    // Values of V1_0::BatteryStatus and V1_0::BatteryHealth
+    int32_t status = 1;
+    int32_t health = 1;
+    bool present = false;
+    int32_t level = 0;
+    int32_t voltageMv = 0;
+    // In tenths of a degree Celsius
+    int32_t temperature = 0;
+    int32_t currentUa = 0;
+    int32_t chargeCounterUah = 0;
+};
+
+// How much each noisy value must move away from what callbacks were last told before a periodic
+// poll updates them. Charger, status, health, presence and level changes are always reported.
+struct BatteryChangeThresholds {
+    int32_t voltageMv = 0;
+    // In tenths of a degree Celsius
+    int32_t temperature = 0;
+    // Current follows the load from one poll to the next. A swing of less than 100 mA alone is left
+    // for the next update to report; set this to 0 to report every change.
+    int32_t currentUa = 100000;
+    int32_t chargeCounterUah = 0;
+};
+
+bool batteryChanged(const BatterySample& last, const BatterySample& now,
+                    const BatteryChangeThresholds& thresholds);
+
+// Reads the battery state from the power_supply class in sysfs. Every attribute is opened once and
+// read with pread, which is a fraction of the cost of the open/read/close that BatteryMonitor does
+// for each attribute on every update.
+class BatterySampler {
+   public:
+    static constexpr const char* kPowerSupplyRoot = "/sys/class/power_supply";
+
+    // Attributes configured in healthd_config, used instead of the ones of the battery supply
+    struct PathOverrides {
+        std::string status;
+        std::string health;
+        std::string present;
+        std::string capacity;
+        std::string voltage;
+        std::string temperature;
+        std::string currentNow;
+        std::string chargeCounter;
+    };
+
+    explicit BatterySampler(const std::string& powerSupplyRoot = kPowerSupplyRoot,
+                            const PathOverrides& overrides = PathOverrides());
+
+    // Returns false if there is no battery or one of its attributes can't be read.
+    bool sample(BatterySample* sample);
+
+   private:
+    struct Attribute {
+        std::string path;
+        android::base::unique_fd fd;
+    };
+
+    struct Charger {
+        Attribute type;
+        Attribute online;
+    };
+
+    static Attribute openAttribute(const std::string& path);
+    // Reads the attribute into buf_, without the trailing newline
+    bool read(const Attribute& attribute, std::string_view* value);
+    bool readInt(const Attribute& attribute, int32_t* value);
+
+    Attribute status_;
+    Attribute health_;
+    Attribute present_;
+    Attribute capacity_;
+    Attribute voltage_;
+    Attribute temperature_;
+    Attribute current_now_;
+    Attribute charge_counter_;
+    std::vector<Charger> chargers_;
+    bool has_battery_;
+    char buf_[128];
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_HEALTH_V2_0_BATTERY_SAMPLER_H
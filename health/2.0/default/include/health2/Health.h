@@ -2,10 +2,12 @@
 #define ANDROID_HARDWARE_HEALTH_V2_0_HEALTH_H
 
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <android/hardware/health/1.0/types.h>
 #include <android/hardware/health/2.0/IHealth.h>
+#include <health2/BatterySampler.h>
 #include <healthd/BatteryMonitor.h>
 #include <hidl/Status.h>
 
@@ -37,6 +39,15 @@ struct Health : public IHealth, hidl_death_recipient {
 
     void notifyListeners(HealthInfo* info);
 
+    // Called by the healthd loop on each periodic chore. Skips the update when a sample of the
+    // battery shows no charger, status, health, presence or level change, and the noisy values
+    // moved less than the thresholds.
+    void periodicUpdate();
+    // Called by the healthd loop on power_supply uevents. Only notifies callbacks if any of the
+    // battery information changed.
+    void ueventUpdate();
+    void setChangeThresholds(const BatteryChangeThresholds& thresholds);
+
     // Methods from IHealth follow.
     Return<Result> registerCallback(const sp<IHealthInfoCallback>& callback) override;
     Return<Result> unregisterCallback(const sp<IHealthInfoCallback>& callback) override;
@@ -57,14 +68,41 @@ struct Health : public IHealth, hidl_death_recipient {
     void serviceDied(uint64_t cookie, const wp<IBase>& /* who */) override;
 
    private:
+    enum class NotifyPolicy {
+        // Notify callbacks and remember what they were told
+        ALWAYS,
+        // Only notify callbacks if the battery information differs from what they were last told
+        ON_CHANGE,
+        // Notify without remembering, as only some of the callbacks are notified
+        UNRECORDED,
+    };
+
     static sp<Health> instance_;
 
     std::recursive_mutex callbacks_lock_;
     std::vector<sp<IHealthInfoCallback>> callbacks_;
     std::unique_ptr<BatteryMonitor> battery_monitor_;
 
+    // Only used on the healthd loop thread.
+    std::unique_ptr<BatterySampler> battery_sampler_;
+
+    // Policy of the update running on this thread
+    static thread_local NotifyPolicy notify_policy_;
+
+    // Guards the following. Never held while calling out of this class.
+    std::mutex notify_lock_;
+    BatteryChangeThresholds change_thresholds_;
+    // What callbacks were last told, without storage information and disk stats
+    HealthInfo last_notified_;
+    bool has_notified_ = false;
+    uint64_t skipped_updates_ = 0;
+    uint64_t suppressed_notifications_ = 0;
+
     bool unregisterCallbackInternal(const sp<IBase>& cb);
 
+    Return<Result> updateWithPolicy(NotifyPolicy policy);
+    Return<Result> updateInternal();
+
     // update() and only notify the given callback, but none of the other callbacks.
     // If cb is null, do not notify any callback at all.
     Return<Result> updateAndNotify(const sp<IHealthInfoCallback>& cb);
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <health2/BatterySampler.h>
+#include <sys/stat.h>
+
+#include <limits>
+#include <string>
+
+using android::base::WriteStringToFile;
+using android::hardware::health::V2_0::implementation::BatteryChangeThresholds;
+using android::hardware::health::V2_0::implementation::BatterySample;
+using android::hardware::health::V2_0::implementation::BatterySampler;
+using android::hardware::health::V2_0::implementation::batteryChanged;
+
+class BatterySamplerTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        addSupply("battery", "Battery");
+        setAttribute("battery", "capacity", "50");
+        setAttribute("battery", "voltage_now", "3800000");
+        setAttribute("battery", "temp", "250");
+        setAttribute("battery", "current_now", "-500000");
+        setAttribute("battery", "charge_counter", "2000000");
+        setAttribute("battery", "status", "Discharging");
+        setAttribute("battery", "health", "Good");
+        setAttribute("battery", "present", "1");
+        addSupply("usb", "USB");
+        setAttribute("usb", "online", "0");
+        addSupply("wireless", "Wireless");
+        setAttribute("wireless", "online", "0");
+    }
+
+    std::string root() const { return std::string(dir_.path); }
+
+    void addSupply(const std::string& name, const std::string& type) {
+        ASSERT_EQ(0, mkdir((root() + "/" + name).c_str(), 0700));
+        setAttribute(name, "type", type);
+    }
+
+    // Rewrites the file in place, as the opened fds must see the new value
+    void setAttribute(const std::string& supply, const std::string& name,
+                      const std::string& value) {
+        ASSERT_TRUE(WriteStringToFile(value + "\n", root() + "/" + supply + "/" + name));
+    }
+
+    TemporaryDir dir_;
+};
+
+TEST_F(BatterySamplerTest, ReadsBattery) {
+    BatterySampler sampler(root());
+    BatterySample sample;
+    ASSERT_TRUE(sampler.sample(&sample));
+    EXPECT_EQ(50, sample.level);
+    EXPECT_EQ(3800, sample.voltageMv);
+    EXPECT_EQ(250, sample.temperature);
+    EXPECT_EQ(-500000, sample.currentUa);
+    EXPECT_EQ(2000000, sample.chargeCounterUah);
+    EXPECT_EQ(3, sample.status);  // DISCHARGING
+    EXPECT_EQ(2, sample.health);  // GOOD
+    EXPECT_TRUE(sample.present);
+    EXPECT_FALSE(sample.chargerAcOnline);
+    EXPECT_FALSE(sample.chargerUsbOnline);
+    EXPECT_FALSE(sample.chargerWirelessOnline);
+}
+
+TEST_F(BatterySamplerTest, SeesUpdatesThroughOpenFds) {
+    BatterySampler sampler(root());
+    BatterySample sample;
+    ASSERT_TRUE(sampler.sample(&sample));
+
+    setAttribute("battery", "capacity", "100");
+    setAttribute("battery", "status", "Full");
+    setAttribute("battery", "health", "Hot");
+    setAttribute("usb", "online", "1");
+    setAttribute("wireless", "online", "1");
+    ASSERT_TRUE(sampler.sample(&sample));
+    EXPECT_EQ(100, sample.level);
+    EXPECT_EQ(5, sample.status);  // FULL
+    EXPECT_EQ(3, sample.health);  // OVERHEAT
+    EXPECT_TRUE(sample.chargerUsbOnline);
+    EXPECT_TRUE(sample.chargerWirelessOnline);
+    EXPECT_FALSE(sample.chargerAcOnline);
+}
+
+TEST_F(BatterySamplerTest, ReadsTypeOfOnlineCharger) {
+    BatterySampler sampler(root());
+    // A USB port that negotiated a dedicated charger
+    setAttribute("usb", "type", "USB_DCP");
+    setAttribute("usb", "online", "1");
+    BatterySample sample;
+    ASSERT_TRUE(sampler.sample(&sample));
+    EXPECT_TRUE(sample.chargerAcOnline);
+    EXPECT_FALSE(sample.chargerUsbOnline);
+}
+
+TEST_F(BatterySamplerTest, UsesPathOverrides) {
+    addSupply("fuelgauge", "Unknown");
+    setAttribute("fuelgauge", "capacity", "42");
+    BatterySampler::PathOverrides overrides;
+    overrides.capacity = root() + "/fuelgauge/capacity";
+    BatterySampler sampler(root(), overrides);
+    BatterySample sample;
+    ASSERT_TRUE(sampler.sample(&sample));
+    EXPECT_EQ(42, sample.level);
+    EXPECT_EQ(3800, sample.voltageMv);
+}
+
+TEST_F(BatterySamplerTest, MissingOptionalAttributes) {
+    ASSERT_EQ(0, unlink((root() + "/battery/present").c_str()));
+    ASSERT_EQ(0, unlink((root() + "/battery/current_now").c_str()));
+    BatterySampler sampler(root());
+    BatterySample sample;
+    ASSERT_TRUE(sampler.sample(&sample));
+    EXPECT_TRUE(sample.present);
+    EXPECT_EQ(0, sample.currentUa);
+}
+
+TEST_F(BatterySamplerTest, NoBattery) {
+    ASSERT_EQ(0, unlink((root() + "/battery/capacity").c_str()));
+    BatterySampler sampler(root());
+    BatterySample sample;
+    EXPECT_FALSE(sampler.sample(&sample));
+}
+
+TEST_F(BatterySamplerTest, UnparsableValue) {
+    BatterySampler sampler(root());
+    setAttribute("battery", "capacity", "");
+    BatterySample sample;
+    EXPECT_FALSE(sampler.sample(&sample));
+}
+
+TEST(BatteryChangedTest, Thresholds) {
+    BatteryChangeThresholds thresholds;
+    thresholds.voltageMv = 20;
+    BatterySample last;
+    last.level = 50;
+    last.voltageMv = 3800;
+
+    BatterySample now = last;
+    EXPECT_FALSE(batteryChanged(last, now, thresholds));
+    now.voltageMv = 3780;
+    EXPECT_FALSE(batteryChanged(last, now, thresholds));
+    now.voltageMv = 3779;
+    EXPECT_TRUE(batteryChanged(last, now, thresholds));
+
+    // Small swings of current alone are not reported by default, large ones are
+    now = last;
+    now.currentUa = -50000;
+    EXPECT_FALSE(batteryChanged(last, now, thresholds));
+    now.currentUa = -1000000;
+    EXPECT_TRUE(batteryChanged(last, now, thresholds));
+}
+
+TEST(BatteryChangedTest, DiscreteChanges) {
+    BatteryChangeThresholds thresholds;
+    thresholds.voltageMv = 1000;
+    BatterySample last;
+
+    BatterySample now = last;
+    now.chargerUsbOnline = true;
+    EXPECT_TRUE(batteryChanged(last, now, thresholds));
+    now = last;
+    now.status = 2;
+    EXPECT_TRUE(batteryChanged(last, now, thresholds));
+    now = last;
+    now.health = 3;
+    EXPECT_TRUE(batteryChanged(last, now, thresholds));
+    now = last;
+    now.present = !last.present;
+    EXPECT_TRUE(batteryChanged(last, now, thresholds));
+    now = last;
+    now.level = last.level + 1;
+    EXPECT_TRUE(batteryChanged(last, now, thresholds));
+}
+
+TEST(BatteryChangedTest, NoOverflow) {
+    BatteryChangeThresholds thresholds;
+    thresholds.chargeCounterUah = 1;
+    BatterySample last;
+    last.chargeCounterUah = std::numeric_limits<int32_t>::min();
+    BatterySample now;
+    now.chargeCounterUah = std::numeric_limits<int32_t>::max();
+    EXPECT_TRUE(batteryChanged(last, now, thresholds));
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "include/StorageStatsCollector.h"
+
+using android::hardware::health::V2_0::DiskStats;
+using android::hardware::health::V2_0::StorageInfo;
+using android::hardware::health::V2_0::StorageStatsCollector;
+
+static StorageStatsCollector& collector() {
+    static StorageStatsCollector instance;
+    return instance;
+}
+
+void get_storage_info(std::vector<struct StorageInfo>& info) {
+    info = collector().getSnapshot().storageInfos;
+}
+
+void get_disk_stats(std::vector<struct DiskStats>& stats) {
+    stats = collector().getSnapshot().diskStats;
+}
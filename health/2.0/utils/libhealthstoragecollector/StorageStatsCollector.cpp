@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "libhealthstoragedefault"
+
+#include "include/StorageStatsCollector.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <memory>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+
+constexpr std::chrono::milliseconds StorageStatsCollector::kDefaultMaxAge;
+
+namespace {
+
+// /proc/diskstats always counts 512-byte sectors
+constexpr double kSectorSize = 512;
+// How far up from a SCSI disk to look for the UFS host controller
+constexpr int kMaxUfsSearchDepth = 8;
+
+bool isDirectory(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool readAttribute(const std::string& path, std::string* value) {
+    if (!android::base::ReadFileToString(path, value)) {
+        return false;
+    }
+    *value = android::base::Trim(*value);
+    return true;
+}
+
+// Health attributes are hexadecimal bytes such as "0x01"
+bool readHealthValues(const std::string& path, uint16_t* first, uint16_t* second = nullptr) {
+    std::string value;
+    if (!readAttribute(path, &value)) {
+        return false;
+    }
+    const char* start = value.c_str();
+    char* end;
+    *first = static_cast<uint16_t>(strtoul(start, &end, 0));
+    if (end == start) {
+        return false;
+    }
+    if (second != nullptr) {
+        start = end;
+        *second = static_cast<uint16_t>(strtoul(start, &end, 0));
+    }
+    return end != start;
+}
+
+double perSecond(uint64_t last, uint64_t now, double seconds) {
+    // Counters go back to zero when a removable device is reinserted
+    return now >= last ? (now - last) / seconds : 0;
+}
+
+}  // namespace
+
+StorageStatsCollector::StorageStatsCollector(const std::string& sysfsRoot,
+                                             const std::string& procRoot,
+                                             std::chrono::milliseconds maxAge)
+    : sysfs_root_(sysfsRoot),
+      proc_root_(procRoot),
+      max_age_(maxAge),
+      has_snapshot_(false),
+      refresh_count_(0) {
+    discoverDevices();
+}
+
+void StorageStatsCollector::discoverDevices() {
+    std::string blockDir = sysfs_root_ + "/block";
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(blockDir.c_str()), closedir);
+    if (dir == nullptr) {
+        PLOG(ERROR) << "Could not open " << blockDir;
+        return;
+    }
+
+    while (struct dirent* entry = readdir(dir.get())) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        std::string deviceDir = blockDir + "/" + entry->d_name + "/device";
+        // Loop, ram, zram and device mapper devices have no device behind them
+        if (!isDirectory(deviceDir)) {
+            continue;
+        }
+
+        Device device{entry->d_name, true, "", false};
+        std::string removable;
+        if (readAttribute(blockDir + "/" + entry->d_name + "/removable", &removable)) {
+            device.isInternal = removable == "0";
+        }
+
+        if (access((deviceDir + "/pre_eol_info").c_str(), R_OK) == 0) {
+            device.healthDir = deviceDir;
+        } else {
+            char resolved[PATH_MAX];
+            if (realpath(deviceDir.c_str(), resolved) != nullptr) {
+                std::string dir = resolved;
+                for (int i = 0; i < kMaxUfsSearchDepth && dir.size() > sysfs_root_.size(); i++) {
+                    if (isDirectory(dir + "/health_descriptor")) {
+                        device.healthDir = dir + "/health_descriptor";
+                        device.isUfs = true;
+                        break;
+                    }
+                    dir = android::base::Dirname(dir);
+                }
+            }
+        }
+        devices_.push_back(std::move(device));
+    }
+}
+
+StorageStatsCollector::Snapshot StorageStatsCollector::getSnapshot() {
+    return getSnapshot(Clock::now());
+}
+
+StorageStatsCollector::Snapshot StorageStatsCollector::getSnapshot(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!has_snapshot_ || now - snapshot_.time >= max_age_) {
+        refreshLocked(now);
+    }
+    return snapshot_;
+}
+
+uint64_t StorageStatsCollector::refreshCount() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return refresh_count_;
+}
+
+void StorageStatsCollector::refreshLocked(Clock::time_point now) {
+    Snapshot snapshot;
+    snapshot.time = now;
+
+    for (const auto& device : devices_) {
+        StorageInfo info;
+        if (readStorageInfo(device, &info)) {
+            snapshot.storageInfos.push_back(std::move(info));
+        }
+    }
+
+    if (readDiskStats(&snapshot.diskStats) && has_snapshot_) {
+        double seconds = std::chrono::duration<double>(now - snapshot_.time).count();
+        for (const auto& stats : snapshot.diskStats) {
+            for (const auto& last : snapshot_.diskStats) {
+                if (last.attr.name != stats.attr.name) {
+                    continue;
+                }
+                DiskRates rates;
+                rates.name = stats.attr.name;
+                rates.readIops = perSecond(last.reads, stats.reads, seconds);
+                rates.writeIops = perSecond(last.writes, stats.writes, seconds);
+                rates.readBytesPerSec =
+                        perSecond(last.readSectors, stats.readSectors, seconds) * kSectorSize;
+                rates.writeBytesPerSec =
+                        perSecond(last.writeSectors, stats.writeSectors, seconds) * kSectorSize;
+                // ioTicks is in milliseconds
+                rates.utilization = perSecond(last.ioTicks, stats.ioTicks, seconds) / 1000;
+                snapshot.diskRates.push_back(std::move(rates));
+                break;
+            }
+        }
+    }
+
+    snapshot_ = std::move(snapshot);
+    has_snapshot_ = true;
+    refresh_count_++;
+}
+
+bool StorageStatsCollector::readDiskStats(std::vector<DiskStats>* stats) {
+    std::string path = proc_root_ + "/diskstats";
+    if (!android::base::ReadFileToString(path, &diskstats_buffer_)) {
+        PLOG(ERROR) << "Could not read " << path;
+        return false;
+    }
+
+    const char* line = diskstats_buffer_.c_str();
+    while (*line != '\0') {
+        char name[64];
+        DiskStats s = {};
+        int n = sscanf(line,
+                       "%*u %*u %63s %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+                       " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+                       name, &s.reads, &s.readMerges, &s.readSectors, &s.readTicks, &s.writes,
+                       &s.writeMerges, &s.writeSectors, &s.writeTicks, &s.ioInFlight,
+                       &s.ioTicks, &s.ioInQueue);
+        if (n == 12) {
+            for (const auto& device : devices_) {
+                if (device.name == name) {
+                    s.attr.isInternal = device.isInternal;
+                    s.attr.isBootDevice = false;
+                    s.attr.name = device.name;
+                    stats->push_back(std::move(s));
+                    break;
+                }
+            }
+        }
+
+        const char* next = strchr(line, '\n');
+        if (next == nullptr) {
+            break;
+        }
+        line = next + 1;
+    }
+    return true;
+}
+
+bool StorageStatsCollector::readStorageInfo(const Device& device, StorageInfo* info) {
+    if (device.healthDir.empty()) {
+        return false;
+    }
+
+    bool ok;
+    if (device.isUfs) {
+        ok = readHealthValues(device.healthDir + "/eol_info", &info->eol) &&
+             readHealthValues(device.healthDir + "/life_time_estimation_a", &info->lifetimeA) &&
+             readHealthValues(device.healthDir + "/life_time_estimation_b", &info->lifetimeB);
+    } else {
+        ok = readHealthValues(device.healthDir + "/pre_eol_info", &info->eol) &&
+             readHealthValues(device.healthDir + "/life_time", &info->lifetimeA,
+                              &info->lifetimeB);
+    }
+    if (!ok) {
+        LOG(DEBUG) << "Could not read the health of " << device.name;
+        return false;
+    }
+
+    std::string version;
+    readAttribute(sysfs_root_ + "/block/" + device.name + "/device/rev", &version);
+    info->version = version;
+    info->attr.isInternal = device.isInternal;
+    info->attr.isBootDevice = false;
+    info->attr.name = device.name;
+    return true;
+}
+
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ANDROID_HARDWARE_HEALTH_V2_0_STORAGE_STATS_COLLECTOR_H
+#define ANDROID_HARDWARE_HEALTH_V2_0_STORAGE_STATS_COLLECTOR_H
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <android/hardware/health/2.0/types.h>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+
+/*
+ * I/O rates of a block device, averaged since the previous snapshot.
+ */
+struct DiskRates {
+    std::string name;
+    double readIops;
+    double writeIops;
+    double readBytesPerSec;
+    double writeBytesPerSec;
+    // Fraction of the time the device was busy, from 0 to 1
+    double utilization;
+};
+
+/*
+ * Collects the storage health and disk statistics of the physical block devices.
+ *
+ * The statistics of every device are parsed from a single read of /proc/diskstats, and the result
+ * is kept for maxAge, so that callers polling getStorageInfo() and getDiskStats() back to back, or
+ * faster than the statistics are useful, share one pass over sysfs.
+ *
+ * Storage health is read from the eMMC attributes of the device (pre_eol_info, life_time) or from
+ * the health_descriptor of the UFS host controller.
+ */
+class StorageStatsCollector {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Snapshot {
+        Clock::time_point time;
+        std::vector<StorageInfo> storageInfos;
+        std::vector<DiskStats> diskStats;
+        // Empty in the first snapshot
+        std::vector<DiskRates> diskRates;
+    };
+
+    static constexpr std::chrono::milliseconds kDefaultMaxAge{1000};
+
+    explicit StorageStatsCollector(const std::string& sysfsRoot = "/sys",
+                                   const std::string& procRoot = "/proc",
+                                   std::chrono::milliseconds maxAge = kDefaultMaxAge);
+
+    /*
+     * Returns the last snapshot, refreshing it first if it is older than maxAge.
+     */
+    Snapshot getSnapshot();
+    Snapshot getSnapshot(Clock::time_point now);
+
+    uint64_t refreshCount();
+
+   private:
+    struct Device {
+        std::string name;
+        bool isInternal;
+        // Where pre_eol_info, life_time or their UFS counterparts are, if anywhere
+        std::string healthDir;
+        bool isUfs;
+    };
+
+    void discoverDevices();
+    void refreshLocked(Clock::time_point now);
+    bool readDiskStats(std::vector<DiskStats>* stats);
+    bool readStorageInfo(const Device& device, StorageInfo* info);
+
+    const std::string sysfs_root_;
+    const std::string proc_root_;
+    const std::chrono::milliseconds max_age_;
+    std::vector<Device> devices_;
+
+    std::mutex lock_;
+    bool has_snapshot_;
+    Snapshot snapshot_;
+    uint64_t refresh_count_;
+    // Kept between refreshes so the file isn't reallocated on every parse
+    std::string diskstats_buffer_;
+};
+
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_HEALTH_V2_0_STORAGE_STATS_COLLECTOR_H
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <android-base/strings.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "StorageStatsCollector.h"
+
+using android::base::WriteStringToFile;
+using android::hardware::health::V2_0::DiskRates;
+using android::hardware::health::V2_0::DiskStats;
+using android::hardware::health::V2_0::StorageInfo;
+using android::hardware::health::V2_0::StorageStatsCollector;
+using namespace std::chrono_literals;
+
+namespace {
+
+// major minor name, then the 11 counters of each device
+constexpr char kDiskStats[] =
+        "   7       0 loop0 10 0 80 1 0 0 0 0 0 1 1\n"
+        " 179       0 mmcblk0 100 5 800 50 200 10 1600 70 0 300 120\n"
+        " 179       1 mmcblk0p1 90 5 700 40 150 10 1200 60 0 250 100\n"
+        "   8       0 sda 1000 0 8000 500 2000 0 16000 700 1 3000 1200 0 0 0 0\n"
+        "   8      16 sdb 1 0 8 1 0 0 0 0 0 1 1\n";
+
+constexpr char kDiskStatsLater[] =
+        "   7       0 loop0 20 0 160 2 0 0 0 0 0 2 2\n"
+        " 179       0 mmcblk0 300 5 2400 150 200 10 1600 70 0 800 220\n"
+        " 179       1 mmcblk0p1 290 5 2300 140 150 10 1200 60 0 750 200\n"
+        "   8       0 sda 1000 0 8000 500 4000 0 32000 900 0 3000 1400 0 0 0 0\n";
+
+}  // namespace
+
+class StorageStatsCollectorTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        // An eMMC card with its health attributes on the device
+        write("sys/block/mmcblk0/removable", "0");
+        write("sys/block/mmcblk0/device/pre_eol_info", "0x01");
+        write("sys/block/mmcblk0/device/life_time", "0x02 0x03");
+        write("sys/block/mmcblk0/device/rev", "0x8");
+
+        // A UFS LUN, whose health is reported by the host controller
+        std::string lun = "sys/devices/platform/ufs/host0/target0:0:0/0:0:0:0";
+        write(lun + "/rev", "0300");
+        write("sys/devices/platform/ufs/health_descriptor/eol_info", "0x02");
+        write("sys/devices/platform/ufs/health_descriptor/life_time_estimation_a", "0x04");
+        write("sys/devices/platform/ufs/health_descriptor/life_time_estimation_b", "0x05");
+        write("sys/block/sda/removable", "0");
+        ASSERT_EQ(0, symlink((root() + "/" + lun).c_str(),
+                             (root() + "/sys/block/sda/device").c_str()));
+
+        // A removable disk without health attributes
+        write("sys/block/sdb/removable", "1");
+        mkdirs("sys/block/sdb/device");
+
+        // A virtual device
+        write("sys/block/loop0/removable", "0");
+
+        write("proc/diskstats", kDiskStats);
+    }
+
+    std::string root() const { return std::string(dir_.path); }
+
+    void mkdirs(const std::string& path) {
+        std::string current = root();
+        for (const auto& part : android::base::Split(path, "/")) {
+            current += "/" + part;
+            mkdir(current.c_str(), 0700);
+        }
+    }
+
+    void write(const std::string& path, const std::string& value) {
+        mkdirs(android::base::Dirname(path));
+        ASSERT_TRUE(WriteStringToFile(value + "\n", root() + "/" + path));
+    }
+
+    StorageStatsCollector makeCollector() {
+        return StorageStatsCollector(root() + "/sys", root() + "/proc", 1s);
+    }
+
+    TemporaryDir dir_;
+};
+
+static const DiskStats* findStats(const StorageStatsCollector::Snapshot& snapshot,
+                                  const std::string& name) {
+    for (const auto& stats : snapshot.diskStats) {
+        if (stats.attr.name == name) return &stats;
+    }
+    return nullptr;
+}
+
+static const StorageInfo* findInfo(const StorageStatsCollector::Snapshot& snapshot,
+                                   const std::string& name) {
+    for (const auto& info : snapshot.storageInfos) {
+        if (info.attr.name == name) return &info;
+    }
+    return nullptr;
+}
+
+static const DiskRates* findRates(const StorageStatsCollector::Snapshot& snapshot,
+                                  const std::string& name) {
+    for (const auto& rates : snapshot.diskRates) {
+        if (rates.name == name) return &rates;
+    }
+    return nullptr;
+}
+
+TEST_F(StorageStatsCollectorTest, ReadsPhysicalDevices) {
+    StorageStatsCollector collector = makeCollector();
+    auto snapshot = collector.getSnapshot(StorageStatsCollector::Clock::time_point());
+
+    ASSERT_EQ(3u, snapshot.diskStats.size());
+    EXPECT_EQ(nullptr, findStats(snapshot, "loop0"));
+    EXPECT_EQ(nullptr, findStats(snapshot, "mmcblk0p1"));
+
+    const DiskStats* mmc = findStats(snapshot, "mmcblk0");
+    ASSERT_NE(nullptr, mmc);
+    EXPECT_EQ(100u, mmc->reads);
+    EXPECT_EQ(5u, mmc->readMerges);
+    EXPECT_EQ(800u, mmc->readSectors);
+    EXPECT_EQ(50u, mmc->readTicks);
+    EXPECT_EQ(200u, mmc->writes);
+    EXPECT_EQ(10u, mmc->writeMerges);
+    EXPECT_EQ(1600u, mmc->writeSectors);
+    EXPECT_EQ(70u, mmc->writeTicks);
+    EXPECT_EQ(0u, mmc->ioInFlight);
+    EXPECT_EQ(300u, mmc->ioTicks);
+    EXPECT_EQ(120u, mmc->ioInQueue);
+    EXPECT_TRUE(mmc->attr.isInternal);
+
+    // Newer kernels add more counters at the end of the line
+    const DiskStats* sda = findStats(snapshot, "sda");
+    ASSERT_NE(nullptr, sda);
+    EXPECT_EQ(1200u, sda->ioInQueue);
+
+    const DiskStats* sdb = findStats(snapshot, "sdb");
+    ASSERT_NE(nullptr, sdb);
+    EXPECT_FALSE(sdb->attr.isInternal);
+
+    EXPECT_TRUE(snapshot.diskRates.empty());
+}
+
+TEST_F(StorageStatsCollectorTest, ReadsStorageHealth) {
+    StorageStatsCollector collector = makeCollector();
+    auto snapshot = collector.getSnapshot(StorageStatsCollector::Clock::time_point());
+
+    ASSERT_EQ(2u, snapshot.storageInfos.size());
+    const StorageInfo* mmc = findInfo(snapshot, "mmcblk0");
+    ASSERT_NE(nullptr, mmc);
+    EXPECT_EQ(1, mmc->eol);
+    EXPECT_EQ(2, mmc->lifetimeA);
+    EXPECT_EQ(3, mmc->lifetimeB);
+    EXPECT_EQ("0x8", mmc->version);
+
+    const StorageInfo* ufs = findInfo(snapshot, "sda");
+    ASSERT_NE(nullptr, ufs);
+    EXPECT_EQ(2, ufs->eol);
+    EXPECT_EQ(4, ufs->lifetimeA);
+    EXPECT_EQ(5, ufs->lifetimeB);
+    EXPECT_EQ("0300", ufs->version);
+}
+
+TEST_F(StorageStatsCollectorTest, CachesSnapshot) {
+    StorageStatsCollector collector = makeCollector();
+    StorageStatsCollector::Clock::time_point start;
+    collector.getSnapshot(start);
+    write("proc/diskstats", kDiskStatsLater);
+
+    auto snapshot = collector.getSnapshot(start + 500ms);
+    EXPECT_EQ(1u, collector.refreshCount());
+    EXPECT_EQ(100u, findStats(snapshot, "mmcblk0")->reads);
+
+    snapshot = collector.getSnapshot(start + 1s);
+    EXPECT_EQ(2u, collector.refreshCount());
+    EXPECT_EQ(300u, findStats(snapshot, "mmcblk0")->reads);
+}
+
+TEST_F(StorageStatsCollectorTest, ComputesRates) {
+    StorageStatsCollector collector = makeCollector();
+    StorageStatsCollector::Clock::time_point start;
+    collector.getSnapshot(start);
+    write("proc/diskstats", kDiskStatsLater);
+    auto snapshot = collector.getSnapshot(start + 2s);
+
+    const DiskRates* mmc = findRates(snapshot, "mmcblk0");
+    ASSERT_NE(nullptr, mmc);
+    EXPECT_DOUBLE_EQ(100, mmc->readIops);
+    EXPECT_DOUBLE_EQ(0, mmc->writeIops);
+    EXPECT_DOUBLE_EQ(800 * 512, mmc->readBytesPerSec);
+    EXPECT_DOUBLE_EQ(0, mmc->writeBytesPerSec);
+    EXPECT_DOUBLE_EQ(0.25, mmc->utilization);
+
+    const DiskRates* sda = findRates(snapshot, "sda");
+    ASSERT_NE(nullptr, sda);
+    EXPECT_DOUBLE_EQ(1000, sda->writeIops);
+    EXPECT_DOUBLE_EQ(8000 * 512, sda->writeBytesPerSec);
+
+    // sdb was removed
+    EXPECT_EQ(nullptr, findRates(snapshot, "sdb"));
+}
+
+TEST_F(StorageStatsCollectorTest, CountersReset) {
+    StorageStatsCollector collector = makeCollector();
+    StorageStatsCollector::Clock::time_point start;
+    collector.getSnapshot(start);
+    write("proc/diskstats", " 8 16 sdb 0 0 0 0 0 0 0 0 0 0 0\n");
+    auto snapshot = collector.getSnapshot(start + 1s);
+
+    const DiskRates* sdb = findRates(snapshot, "sdb");
+    ASSERT_NE(nullptr, sdb);
+    EXPECT_DOUBLE_EQ(0, sdb->readIops);
+    EXPECT_DOUBLE_EQ(0, sdb->utilization);
+}
@@ -14,9 +14,12 @@
  ** limitations under the License.
  */
 
+#define ATRACE_TAG ATRACE_TAG_HAL
+
 #include <keymasterV4_0/Keymaster.h>
 
 #include <iomanip>
+#include <thread>
 
 #include <android-base/logging.h>
 #include <android/hidl/manager/1.0/IServiceManager.h>
@@ -24,6 +27,7 @@
 #include <keymasterV4_0/Keymaster4.h>
 #include <keymasterV4_0/key_param_output.h>
 #include <keymasterV4_0/keymaster_utils.h>
+#include <utils/Trace.h>
 
 namespace android {
 namespace hardware {
@@ -140,20 +144,43 @@ Keymaster::KeymasterSet Keymaster::enumerateAvailableDevices() {
     return result;
 }
 
+/**
+ * Calls fn(keymaster, i) for the i-th Keymaster 4 instance in keymasters, concurrently for all of
+ * them, and returns once every call has returned.  The first instance is handled on the calling
+ * thread.
+ */
+template <typename Fn>
+static size_t forEachKeymaster4Concurrently(const Keymaster::KeymasterSet& keymasters, Fn fn) {
+    std::vector<Keymaster*> km4s;
+    for (auto& keymaster : keymasters) {
+        if (keymaster->halVersion().majorVersion >= 4) km4s.push_back(keymaster.get());
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < km4s.size(); ++i) {
+        threads.emplace_back([&fn, &km4s, i] { fn(*km4s[i], i); });
+    }
+    if (!km4s.empty()) fn(*km4s[0], 0);
+    for (auto& thread : threads) thread.join();
+
+    return km4s.size();
+}
+
 static hidl_vec<HmacSharingParameters> getHmacParameters(
     const Keymaster::KeymasterSet& keymasters) {
-    std::vector<HmacSharingParameters> params_vec;
-    params_vec.reserve(keymasters.size());
-    for (auto& keymaster : keymasters) {
-        if (keymaster->halVersion().majorVersion < 4) continue;
-        auto rc = keymaster->getHmacSharingParameters([&](auto error, auto& params) {
+    ATRACE_CALL();
+    std::vector<HmacSharingParameters> params_vec(keymasters.size());
+    size_t count = forEachKeymaster4Concurrently(keymasters, [&](Keymaster& keymaster, size_t i) {
+        ATRACE_NAME("getHmacSharingParameters");
+        auto rc = keymaster.getHmacSharingParameters([&](auto error, auto& params) {
             CHECK(error == ErrorCode::OK)
-                << "Failed to get HMAC parameters from " << *keymaster << " error " << error;
-            params_vec.push_back(params);
+                << "Failed to get HMAC parameters from " << keymaster << " error " << error;
+            params_vec[i] = params;
         });
-        CHECK(rc.isOk()) << "Failed to communicate with " << *keymaster
+        CHECK(rc.isOk()) << "Failed to communicate with " << keymaster
                          << " error: " << rc.description();
-    }
+    });
+    params_vec.resize(count);
     std::sort(params_vec.begin(), params_vec.end());
 
     return params_vec;
@@ -163,31 +190,36 @@ static void computeHmac(const Keymaster::KeymasterSet& keymasters,
                         const hidl_vec<HmacSharingParameters>& params) {
     if (!params.size()) return;
 
-    hidl_vec<uint8_t> sharingCheck;
-    bool firstKeymaster = true;
+    ATRACE_CALL();
     LOG(DEBUG) << "Computing HMAC with params " << params;
-    for (auto& keymaster : keymasters) {
-        if (keymaster->halVersion().majorVersion < 4) continue;
-        LOG(DEBUG) << "Computing HMAC for " << *keymaster;
-        auto rc = keymaster->computeSharedHmac(
+    std::vector<Keymaster*> computed(keymasters.size());
+    std::vector<hidl_vec<uint8_t>> sharingChecks(keymasters.size());
+    size_t count = forEachKeymaster4Concurrently(keymasters, [&](Keymaster& keymaster, size_t i) {
+        ATRACE_NAME("computeSharedHmac");
+        LOG(DEBUG) << "Computing HMAC for " << keymaster;
+        auto rc = keymaster.computeSharedHmac(
             params, [&](ErrorCode error, const hidl_vec<uint8_t>& curSharingCheck) {
                 CHECK(error == ErrorCode::OK)
-                    << "Failed to get HMAC parameters from " << *keymaster << " error " << error;
-                if (firstKeymaster) {
-                    sharingCheck = curSharingCheck;
-                    firstKeymaster = false;
-                }
-                if (curSharingCheck != sharingCheck)
-                    LOG(WARNING) << "HMAC computation failed for " << *keymaster  //
-                                 << " Expected: " << sharingCheck                 //
-                                 << " got: " << curSharingCheck;
+                    << "Failed to get HMAC parameters from " << keymaster << " error " << error;
+                computed[i] = &keymaster;
+                sharingChecks[i] = curSharingCheck;
             });
-        CHECK(rc.isOk()) << "Failed to communicate with " << *keymaster
+        CHECK(rc.isOk()) << "Failed to communicate with " << keymaster
                          << " error: " << rc.description();
+    });
+
+    // Compare against the first instance, in the same order as the calls used to be made.
+    for (size_t i = 1; i < count; ++i) {
+        if (sharingChecks[i] != sharingChecks[0])
+            LOG(WARNING) << "HMAC computation failed for " << *computed[i]  //
+                         << " Expected: " << sharingChecks[0]               //
+                         << " got: " << sharingChecks[i];
     }
 }
 
 void Keymaster::performHmacKeyAgreement(const KeymasterSet& keymasters) {
+    ATRACE_CALL();
+    // Every instance must have returned its parameters before any is asked to compute the key.
     computeHmac(keymasters, getHmacParameters(keymasters));
 }
 
@@ -0,0 +1,231 @@
+/*
+ ** Copyright 2018, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include <keymasterV4_0/KeymasterOperationStream.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <android-base/logging.h>
+#include <keymasterV4_0/key_param_output.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace support {
+
+constexpr size_t KeymasterOperationStream::kDefaultChunkSize;
+constexpr size_t KeymasterOperationStream::kStrongBoxChunkSize;
+
+static size_t defaultChunkSize(const Keymaster& keymaster) {
+    if (keymaster.halVersion().securityLevel == SecurityLevel::STRONGBOX) {
+        return KeymasterOperationStream::kStrongBoxChunkSize;
+    }
+    return KeymasterOperationStream::kDefaultChunkSize;
+}
+
+KeymasterOperationStream::KeymasterOperationStream(Keymaster& keymaster, size_t chunkSize)
+    : keymaster_(keymaster),
+      chunkSize_(chunkSize ? chunkSize : defaultChunkSize(keymaster)),
+      operationHandle_(0),
+      operationActive_(false) {}
+
+KeymasterOperationStream::~KeymasterOperationStream() {
+    abort();
+}
+
+ErrorCode KeymasterOperationStream::begin(KeyPurpose purpose, const hidl_vec<uint8_t>& keyBlob,
+                                          const AuthorizationSet& inParams,
+                                          const HardwareAuthToken& authToken,
+                                          AuthorizationSet* outParams) {
+    abort();
+
+    ErrorCode error = ErrorCode::UNKNOWN_ERROR;
+    auto rc = keymaster_.begin(
+        purpose, keyBlob, inParams.hidl_data(), authToken,
+        [&](ErrorCode hidlError, const hidl_vec<KeyParameter>& hidlOutParams,
+            uint64_t operationHandle) {
+            error = hidlError;
+            if (error != ErrorCode::OK) return;
+            operationHandle_ = operationHandle;
+            operationActive_ = true;
+            if (outParams) *outParams = AuthorizationSet(hidlOutParams);
+        });
+    if (!rc.isOk()) {
+        LOG(ERROR) << "Failed to communicate with " << keymaster_ << " error: " << rc.description();
+        return ErrorCode::SECURE_HW_COMMUNICATION_FAILED;
+    }
+    return error;
+}
+
+void KeymasterOperationStream::setOperationTokens(const HardwareAuthToken& authToken,
+                                                  const VerificationToken& verificationToken) {
+    authToken_ = authToken;
+    verificationToken_ = verificationToken;
+}
+
+ErrorCode KeymasterOperationStream::run(const Source& source, const Sink& sink,
+                                        const hidl_vec<uint8_t>& signature,
+                                        AuthorizationSet* outParams) {
+    if (!operationActive_) return ErrorCode::INVALID_OPERATION_HANDLE;
+
+    // ready[i] is set by the producer once chunks_[i] is filled, and cleared by this thread once
+    // it has been sent.
+    std::mutex lock;
+    std::condition_variable cv;
+    bool ready[2] = {false, false};
+    bool stop = false;
+    bool sourceOverrun = false;
+
+    std::thread producer([&] {
+        for (size_t i = 0;; i ^= 1) {
+            {
+                std::unique_lock<std::mutex> lk(lock);
+                cv.wait(lk, [&] { return stop || !ready[i]; });
+                if (stop) return;
+            }
+            Chunk& chunk = chunks_[i];
+            size_t size = chunkSize_;
+            if (chunk.data.size() < size) chunk.data.resize(size);
+            size_t produced = source(chunk.data.data(), size);
+            bool overrun = produced > size;
+            if (overrun) {
+                // Never send more than the buffer holds; end the input and fail the operation.
+                LOG(ERROR) << "Source returned " << produced << " bytes for a " << size
+                           << " byte buffer";
+                produced = 0;
+            }
+            chunk.size = produced;
+            {
+                std::lock_guard<std::mutex> lk(lock);
+                ready[i] = true;
+                sourceOverrun = overrun;
+            }
+            cv.notify_all();
+            if (chunk.size == 0) return;
+        }
+    });
+
+    ErrorCode error = ErrorCode::OK;
+    for (size_t i = 0; error == ErrorCode::OK; i ^= 1) {
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            cv.wait(lk, [&] { return ready[i]; });
+        }
+        const Chunk& chunk = chunks_[i];
+        if (chunk.size == 0) break;
+        error = update(chunk.data.data(), chunk.size, sink);
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            ready[i] = false;
+        }
+        cv.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        stop = true;
+    }
+    cv.notify_all();
+    producer.join();
+
+    if (error == ErrorCode::OK && sourceOverrun) error = ErrorCode::INVALID_INPUT_LENGTH;
+    if (error != ErrorCode::OK) {
+        abort();
+        return error;
+    }
+    return finish(signature, sink, outParams);
+}
+
+ErrorCode KeymasterOperationStream::update(const uint8_t* data, size_t size, const Sink& sink) {
+    hidl_vec<uint8_t> input;
+    while (size > 0) {
+        input.setToExternal(const_cast<uint8_t*>(data), size);
+        ErrorCode error = ErrorCode::UNKNOWN_ERROR;
+        uint32_t inputConsumed = 0;
+        auto rc = keymaster_.update(
+            operationHandle_, hidl_vec<KeyParameter>(), input, authToken_, verificationToken_,
+            [&](ErrorCode hidlError, uint32_t hidlInputConsumed, const hidl_vec<KeyParameter>&,
+                const hidl_vec<uint8_t>& output) {
+                error = hidlError;
+                if (error != ErrorCode::OK) return;
+                inputConsumed = hidlInputConsumed;
+                if (output.size()) sink(output);
+            });
+        if (!rc.isOk()) {
+            LOG(ERROR) << "Failed to communicate with " << keymaster_
+                       << " error: " << rc.description();
+            return ErrorCode::SECURE_HW_COMMUNICATION_FAILED;
+        }
+        if (error != ErrorCode::OK) {
+            // Any error from update() implicitly aborts the operation.
+            operationActive_ = false;
+            return error;
+        }
+        if (inputConsumed == 0 || inputConsumed > size) {
+            LOG(ERROR) << keymaster_ << " consumed " << inputConsumed << " of " << size
+                       << " bytes of input";
+            return ErrorCode::INVALID_INPUT_LENGTH;
+        }
+        if (inputConsumed < size && inputConsumed < chunkSize_) {
+            // The device takes no more than this per call; stop preparing larger chunks.
+            chunkSize_ = inputConsumed;
+        }
+        data += inputConsumed;
+        size -= inputConsumed;
+    }
+    return ErrorCode::OK;
+}
+
+ErrorCode KeymasterOperationStream::finish(const hidl_vec<uint8_t>& signature, const Sink& sink,
+                                           AuthorizationSet* outParams) {
+    ErrorCode error = ErrorCode::UNKNOWN_ERROR;
+    auto rc = keymaster_.finish(
+        operationHandle_, hidl_vec<KeyParameter>(), hidl_vec<uint8_t>(), signature, authToken_,
+        verificationToken_,
+        [&](ErrorCode hidlError, const hidl_vec<KeyParameter>& hidlOutParams,
+            const hidl_vec<uint8_t>& output) {
+            error = hidlError;
+            if (error != ErrorCode::OK) return;
+            if (outParams) *outParams = AuthorizationSet(hidlOutParams);
+            if (output.size()) sink(output);
+        });
+    if (!rc.isOk()) {
+        LOG(ERROR) << "Failed to communicate with " << keymaster_ << " error: " << rc.description();
+        abort();
+        return ErrorCode::SECURE_HW_COMMUNICATION_FAILED;
+    }
+    // The operation is over whether or not finish() succeeded.
+    operationActive_ = false;
+    return error;
+}
+
+void KeymasterOperationStream::abort() {
+    if (!operationActive_) return;
+    operationActive_ = false;
+    auto rc = keymaster_.abort(operationHandle_);
+    if (!rc.isOk()) {
+        LOG(ERROR) << "Failed to communicate with " << keymaster_ << " error: " << rc.description();
+    }
+}
+
+}  // namespace support
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
@@ -19,13 +19,9 @@
 #include <android-base/logging.h>
 #include <assert.h>
 
-#include <openssl/asn1t.h>
-#include <openssl/bn.h>
-#include <openssl/evp.h>
-#include <openssl/x509.h>
+#include <openssl/bytestring.h>
 
 #include <keymasterV4_0/authorization_set.h>
-#include <keymasterV4_0/openssl_utils.h>
 
 #define AT __FILE__ ":" << __LINE__
 
@@ -34,243 +30,262 @@ namespace hardware {
 namespace keymaster {
 namespace V4_0 {
 
-struct stack_st_ASN1_TYPE_Delete {
-    void operator()(stack_st_ASN1_TYPE* p) { sk_ASN1_TYPE_free(p); }
-};
+/**
+ * The attestation record is read with BoringSSL's CBS, which walks the DER encoding in place.
+ * Nothing is allocated besides the values stored in the outputs.
+ *
+ * KeyDescription ::= SEQUENCE {
+ *     attestationVersion         INTEGER,
+ *     attestationSecurityLevel   SecurityLevel,
+ *     keymasterVersion           INTEGER,
+ *     keymasterSecurityLevel     SecurityLevel,
+ *     attestationChallenge       OCTET_STRING,
+ *     uniqueId                   OCTET_STRING,
+ *     softwareEnforced           AuthorizationList,
+ *     teeEnforced                AuthorizationList,
+ * }
+ *
+ * AuthorizationList is a SEQUENCE of optional entries, each explicitly tagged with the number of
+ * the Tag it holds and containing a SET OF INTEGER (for repeatable tags), an INTEGER, a NULL (for
+ * boolean tags), an OCTET_STRING or, for Tag::ROOT_OF_TRUST, a RootOfTrust:
+ *
+ * RootOfTrust ::= SEQUENCE {
+ *     verifiedBootKey            OCTET_STRING,
+ *     deviceLocked               BOOLEAN,
+ *     verifiedBootState          VerifiedBootState,
+ *     verifiedBootHash           OCTET_STRING,
+ * }
+ */
 
-struct ASN1_STRING_Delete {
-    void operator()(ASN1_STRING* p) { ASN1_STRING_free(p); }
-};
+// Reads a non-negative INTEGER or ENUMERATED with the given tag.
+static bool getUint64(CBS* cbs, unsigned asn1_tag, uint64_t* value) {
+    CBS content;
+    if (!CBS_get_asn1(cbs, &content, asn1_tag)) return false;
+    size_t len = CBS_len(&content);
+    const uint8_t* data = CBS_data(&content);
+    // Negative values, and values that do not fit, are rejected.
+    if (len == 0 || (data[0] & 0x80)) return false;
+    if (data[0] == 0 && len > 1) {
+        // DER only allows a leading zero byte in front of a byte with its high bit set.
+        if (!(data[1] & 0x80)) return false;
+        ++data;
+        --len;
+    }
+    if (len > sizeof(uint64_t)) return false;
+    *value = 0;
+    for (size_t i = 0; i < len; ++i) *value = (*value << 8) | data[i];
+    return true;
+}
 
-struct ASN1_TYPE_Delete {
-    void operator()(ASN1_TYPE* p) { ASN1_TYPE_free(p); }
-};
+static bool getUint32(CBS* cbs, unsigned asn1_tag, uint32_t* value) {
+    uint64_t value64;
+    if (!getUint64(cbs, asn1_tag, &value64) || value64 > UINT32_MAX) return false;
+    *value = value64;
+    return true;
+}
 
-#define ASN1_INTEGER_SET STACK_OF(ASN1_INTEGER)
-
-typedef struct km_root_of_trust {
-    ASN1_OCTET_STRING* verified_boot_key;
-    ASN1_BOOLEAN* device_locked;
-    ASN1_ENUMERATED* verified_boot_state;
-    ASN1_OCTET_STRING* verified_boot_hash;
-} KM_ROOT_OF_TRUST;
-
-ASN1_SEQUENCE(KM_ROOT_OF_TRUST) = {
-    ASN1_SIMPLE(KM_ROOT_OF_TRUST, verified_boot_key, ASN1_OCTET_STRING),
-    ASN1_SIMPLE(KM_ROOT_OF_TRUST, device_locked, ASN1_BOOLEAN),
-    ASN1_SIMPLE(KM_ROOT_OF_TRUST, verified_boot_state, ASN1_ENUMERATED),
-    ASN1_SIMPLE(KM_ROOT_OF_TRUST, verified_boot_hash, ASN1_OCTET_STRING),
-} ASN1_SEQUENCE_END(KM_ROOT_OF_TRUST);
-IMPLEMENT_ASN1_FUNCTIONS(KM_ROOT_OF_TRUST);
-
-typedef struct km_auth_list {
-    ASN1_INTEGER_SET* purpose;
-    ASN1_INTEGER* algorithm;
-    ASN1_INTEGER* key_size;
-    ASN1_INTEGER_SET* digest;
-    ASN1_INTEGER_SET* padding;
-    ASN1_INTEGER* ec_curve;
-    ASN1_INTEGER* rsa_public_exponent;
-    ASN1_INTEGER* active_date_time;
-    ASN1_INTEGER* origination_expire_date_time;
-    ASN1_INTEGER* usage_expire_date_time;
-    ASN1_NULL* no_auth_required;
-    ASN1_INTEGER* user_auth_type;
-    ASN1_INTEGER* auth_timeout;
-    ASN1_NULL* allow_while_on_body;
-    ASN1_NULL* all_applications;
-    ASN1_OCTET_STRING* application_id;
-    ASN1_INTEGER* creation_date_time;
-    ASN1_INTEGER* origin;
-    ASN1_NULL* rollback_resistance;
-    KM_ROOT_OF_TRUST* root_of_trust;
-    ASN1_INTEGER* os_version;
-    ASN1_INTEGER* os_patchlevel;
-    ASN1_OCTET_STRING* attestation_application_id;
-    ASN1_NULL* trusted_user_presence_required;
-    ASN1_NULL* trusted_confirmation_required;
-    ASN1_NULL* unlocked_device_required;
-    ASN1_INTEGER* vendor_patchlevel;
-    ASN1_INTEGER* boot_patchlevel;
-} KM_AUTH_LIST;
-
-ASN1_SEQUENCE(KM_AUTH_LIST) = {
-    ASN1_EXP_SET_OF_OPT(KM_AUTH_LIST, purpose, ASN1_INTEGER, TAG_PURPOSE.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, algorithm, ASN1_INTEGER, TAG_ALGORITHM.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, key_size, ASN1_INTEGER, TAG_KEY_SIZE.maskedTag()),
-    ASN1_EXP_SET_OF_OPT(KM_AUTH_LIST, digest, ASN1_INTEGER, TAG_DIGEST.maskedTag()),
-    ASN1_EXP_SET_OF_OPT(KM_AUTH_LIST, padding, ASN1_INTEGER, TAG_PADDING.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, ec_curve, ASN1_INTEGER, TAG_EC_CURVE.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, rsa_public_exponent, ASN1_INTEGER,
-                 TAG_RSA_PUBLIC_EXPONENT.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, rollback_resistance, ASN1_NULL, TAG_ROLLBACK_RESISTANCE.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, active_date_time, ASN1_INTEGER, TAG_ACTIVE_DATETIME.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, origination_expire_date_time, ASN1_INTEGER,
-                 TAG_ORIGINATION_EXPIRE_DATETIME.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, usage_expire_date_time, ASN1_INTEGER,
-                 TAG_USAGE_EXPIRE_DATETIME.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, no_auth_required, ASN1_NULL, TAG_NO_AUTH_REQUIRED.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, user_auth_type, ASN1_INTEGER, TAG_USER_AUTH_TYPE.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, auth_timeout, ASN1_INTEGER, TAG_AUTH_TIMEOUT.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, allow_while_on_body, ASN1_NULL, TAG_ALLOW_WHILE_ON_BODY.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, trusted_user_presence_required, ASN1_NULL,
-                 TAG_TRUSTED_USER_PRESENCE_REQUIRED.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, trusted_confirmation_required, ASN1_NULL,
-                 TAG_TRUSTED_CONFIRMATION_REQUIRED.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, unlocked_device_required, ASN1_NULL,
-                 TAG_UNLOCKED_DEVICE_REQUIRED.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, creation_date_time, ASN1_INTEGER, TAG_CREATION_DATETIME.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, origin, ASN1_INTEGER, TAG_ORIGIN.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, root_of_trust, KM_ROOT_OF_TRUST, TAG_ROOT_OF_TRUST.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, os_version, ASN1_INTEGER, TAG_OS_VERSION.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, os_patchlevel, ASN1_INTEGER, TAG_OS_PATCHLEVEL.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, vendor_patchlevel, ASN1_INTEGER, TAG_VENDOR_PATCHLEVEL.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, boot_patchlevel, ASN1_INTEGER, TAG_BOOT_PATCHLEVEL.maskedTag()),
-    ASN1_EXP_OPT(KM_AUTH_LIST, attestation_application_id, ASN1_OCTET_STRING,
-                 TAG_ATTESTATION_APPLICATION_ID.maskedTag()),
-} ASN1_SEQUENCE_END(KM_AUTH_LIST);
-IMPLEMENT_ASN1_FUNCTIONS(KM_AUTH_LIST);
-
-typedef struct km_key_description {
-    ASN1_INTEGER* attestation_version;
-    ASN1_ENUMERATED* attestation_security_level;
-    ASN1_INTEGER* keymaster_version;
-    ASN1_ENUMERATED* keymaster_security_level;
-    ASN1_OCTET_STRING* attestation_challenge;
-    KM_AUTH_LIST* software_enforced;
-    KM_AUTH_LIST* tee_enforced;
-    ASN1_INTEGER* unique_id;
-} KM_KEY_DESCRIPTION;
-
-ASN1_SEQUENCE(KM_KEY_DESCRIPTION) = {
-    ASN1_SIMPLE(KM_KEY_DESCRIPTION, attestation_version, ASN1_INTEGER),
-    ASN1_SIMPLE(KM_KEY_DESCRIPTION, attestation_security_level, ASN1_ENUMERATED),
-    ASN1_SIMPLE(KM_KEY_DESCRIPTION, keymaster_version, ASN1_INTEGER),
-    ASN1_SIMPLE(KM_KEY_DESCRIPTION, keymaster_security_level, ASN1_ENUMERATED),
-    ASN1_SIMPLE(KM_KEY_DESCRIPTION, attestation_challenge, ASN1_OCTET_STRING),
-    ASN1_SIMPLE(KM_KEY_DESCRIPTION, unique_id, ASN1_OCTET_STRING),
-    ASN1_SIMPLE(KM_KEY_DESCRIPTION, software_enforced, KM_AUTH_LIST),
-    ASN1_SIMPLE(KM_KEY_DESCRIPTION, tee_enforced, KM_AUTH_LIST),
-} ASN1_SEQUENCE_END(KM_KEY_DESCRIPTION);
-IMPLEMENT_ASN1_FUNCTIONS(KM_KEY_DESCRIPTION);
+static bool getOctetString(CBS* cbs, hidl_vec<uint8_t>* value) {
+    CBS content;
+    if (!CBS_get_asn1(cbs, &content, CBS_ASN1_OCTETSTRING)) return false;
+    value->resize(CBS_len(&content));
+    if (CBS_len(&content)) memcpy(value->data(), CBS_data(&content), CBS_len(&content));
+    return true;
+}
+
+// The parsers below read the content of an explicitly tagged AuthorizationList entry and add it
+// to auth_list. They fail unless the content holds exactly one value of the expected type.
 
 template <Tag tag>
-void copyAuthTag(const stack_st_ASN1_INTEGER* stack, TypedTag<TagType::ENUM_REP, tag> ttag,
-                 AuthorizationSet* auth_list) {
+bool parseAuthTag(CBS* content, TypedTag<TagType::ENUM_REP, tag> ttag,
+                  AuthorizationSet* auth_list) {
     typedef typename TypedTag2ValueType<decltype(ttag)>::type ValueT;
-    for (size_t i = 0; i < sk_ASN1_INTEGER_num(stack); ++i) {
-        auth_list->push_back(
-            ttag, static_cast<ValueT>(ASN1_INTEGER_get(sk_ASN1_INTEGER_value(stack, i))));
+    CBS set;
+    if (!CBS_get_asn1(content, &set, CBS_ASN1_SET)) return false;
+    while (CBS_len(&set)) {
+        uint32_t value;
+        if (!getUint32(&set, CBS_ASN1_INTEGER, &value)) return false;
+        auth_list->push_back(ttag, static_cast<ValueT>(value));
     }
+    return true;
 }
 
 template <Tag tag>
-void copyAuthTag(const ASN1_INTEGER* asn1_int, TypedTag<TagType::ENUM, tag> ttag,
-                 AuthorizationSet* auth_list) {
+bool parseAuthTag(CBS* content, TypedTag<TagType::ENUM, tag> ttag, AuthorizationSet* auth_list) {
     typedef typename TypedTag2ValueType<decltype(ttag)>::type ValueT;
-    if (!asn1_int) return;
-    auth_list->push_back(ttag, static_cast<ValueT>(ASN1_INTEGER_get(asn1_int)));
+    uint32_t value;
+    if (!getUint32(content, CBS_ASN1_INTEGER, &value)) return false;
+    auth_list->push_back(ttag, static_cast<ValueT>(value));
+    return true;
 }
 
 template <Tag tag>
-void copyAuthTag(const ASN1_INTEGER* asn1_int, TypedTag<TagType::UINT, tag> ttag,
-                 AuthorizationSet* auth_list) {
-    if (!asn1_int) return;
-    auth_list->push_back(ttag, ASN1_INTEGER_get(asn1_int));
-}
-
-BIGNUM* construct_uint_max() {
-    BIGNUM* value = BN_new();
-    BIGNUM_Ptr one(BN_new());
-    BN_one(one.get());
-    BN_lshift(value, one.get(), 32);
-    return value;
-}
-
-uint64_t BignumToUint64(BIGNUM* num) {
-    static_assert((sizeof(BN_ULONG) == sizeof(uint32_t)) || (sizeof(BN_ULONG) == sizeof(uint64_t)),
-                  "This implementation only supports 32 and 64-bit BN_ULONG");
-    if (sizeof(BN_ULONG) == sizeof(uint32_t)) {
-        BIGNUM_Ptr uint_max(construct_uint_max());
-        BIGNUM_Ptr hi(BN_new()), lo(BN_new());
-        BN_CTX_Ptr ctx(BN_CTX_new());
-        BN_div(hi.get(), lo.get(), num, uint_max.get(), ctx.get());
-        return static_cast<uint64_t>(BN_get_word(hi.get())) << 32 | BN_get_word(lo.get());
-    } else if (sizeof(BN_ULONG) == sizeof(uint64_t)) {
-        return BN_get_word(num);
-    } else {
-        return 0;
-    }
+bool parseAuthTag(CBS* content, TypedTag<TagType::UINT, tag> ttag, AuthorizationSet* auth_list) {
+    uint32_t value;
+    if (!getUint32(content, CBS_ASN1_INTEGER, &value)) return false;
+    auth_list->push_back(ttag, value);
+    return true;
 }
 
 template <Tag tag>
-void copyAuthTag(const ASN1_INTEGER* asn1_int, TypedTag<TagType::ULONG, tag> ttag,
-                 AuthorizationSet* auth_list) {
-    if (!asn1_int) return;
-    BIGNUM_Ptr num(ASN1_INTEGER_to_BN(asn1_int, nullptr));
-    auth_list->push_back(ttag, BignumToUint64(num.get()));
+bool parseAuthTag(CBS* content, TypedTag<TagType::ULONG, tag> ttag, AuthorizationSet* auth_list) {
+    uint64_t value;
+    if (!getUint64(content, CBS_ASN1_INTEGER, &value)) return false;
+    auth_list->push_back(ttag, value);
+    return true;
 }
 
 template <Tag tag>
-void copyAuthTag(const ASN1_INTEGER* asn1_int, TypedTag<TagType::DATE, tag> ttag,
-                 AuthorizationSet* auth_list) {
-    if (!asn1_int) return;
-    BIGNUM_Ptr num(ASN1_INTEGER_to_BN(asn1_int, nullptr));
-    auth_list->push_back(ttag, BignumToUint64(num.get()));
+bool parseAuthTag(CBS* content, TypedTag<TagType::DATE, tag> ttag, AuthorizationSet* auth_list) {
+    uint64_t value;
+    if (!getUint64(content, CBS_ASN1_INTEGER, &value)) return false;
+    auth_list->push_back(ttag, value);
+    return true;
 }
 
 template <Tag tag>
-void copyAuthTag(const ASN1_NULL* asn1_null, TypedTag<TagType::BOOL, tag> ttag,
-                 AuthorizationSet* auth_list) {
-    if (!asn1_null) return;
+bool parseAuthTag(CBS* content, TypedTag<TagType::BOOL, tag> ttag, AuthorizationSet* auth_list) {
+    CBS null;
+    if (!CBS_get_asn1(content, &null, CBS_ASN1_NULL) || CBS_len(&null)) return false;
     auth_list->push_back(ttag);
+    return true;
 }
 
 template <Tag tag>
-void copyAuthTag(const ASN1_OCTET_STRING* asn1_string, TypedTag<TagType::BYTES, tag> ttag,
-                 AuthorizationSet* auth_list) {
-    if (!asn1_string) return;
+bool parseAuthTag(CBS* content, TypedTag<TagType::BYTES, tag> ttag, AuthorizationSet* auth_list) {
+    CBS value;
+    if (!CBS_get_asn1(content, &value, CBS_ASN1_OCTETSTRING)) return false;
     hidl_vec<uint8_t> buf;
-    buf.setToExternal(asn1_string->data, asn1_string->length);
+    buf.setToExternal(const_cast<uint8_t*>(CBS_data(&value)), CBS_len(&value));
+    // push_back copies the blob out of the record.
     auth_list->push_back(ttag, buf);
+    return true;
 }
 
-// Extract the values from the specified ASN.1 record and place them in auth_list.
-static ErrorCode extract_auth_list(const KM_AUTH_LIST* record, AuthorizationSet* auth_list) {
-    if (!record) return ErrorCode::OK;
-
-    copyAuthTag(record->active_date_time, TAG_ACTIVE_DATETIME, auth_list);
-    copyAuthTag(record->algorithm, TAG_ALGORITHM, auth_list);
-    copyAuthTag(record->application_id, TAG_APPLICATION_ID, auth_list);
-    copyAuthTag(record->auth_timeout, TAG_AUTH_TIMEOUT, auth_list);
-    copyAuthTag(record->creation_date_time, TAG_CREATION_DATETIME, auth_list);
-    copyAuthTag(record->digest, TAG_DIGEST, auth_list);
-    copyAuthTag(record->ec_curve, TAG_EC_CURVE, auth_list);
-    copyAuthTag(record->key_size, TAG_KEY_SIZE, auth_list);
-    copyAuthTag(record->no_auth_required, TAG_NO_AUTH_REQUIRED, auth_list);
-    copyAuthTag(record->origin, TAG_ORIGIN, auth_list);
-    copyAuthTag(record->origination_expire_date_time, TAG_ORIGINATION_EXPIRE_DATETIME, auth_list);
-    copyAuthTag(record->os_patchlevel, TAG_OS_PATCHLEVEL, auth_list);
-    copyAuthTag(record->os_version, TAG_OS_VERSION, auth_list);
-    copyAuthTag(record->padding, TAG_PADDING, auth_list);
-    copyAuthTag(record->purpose, TAG_PURPOSE, auth_list);
-    copyAuthTag(record->rollback_resistance, TAG_ROLLBACK_RESISTANCE, auth_list);
-    copyAuthTag(record->rsa_public_exponent, TAG_RSA_PUBLIC_EXPONENT, auth_list);
-    copyAuthTag(record->usage_expire_date_time, TAG_USAGE_EXPIRE_DATETIME, auth_list);
-    copyAuthTag(record->user_auth_type, TAG_USER_AUTH_TYPE, auth_list);
-    copyAuthTag(record->attestation_application_id, TAG_ATTESTATION_APPLICATION_ID, auth_list);
-    copyAuthTag(record->vendor_patchlevel, TAG_VENDOR_PATCHLEVEL, auth_list);
-    copyAuthTag(record->boot_patchlevel, TAG_BOOT_PATCHLEVEL, auth_list);
-    copyAuthTag(record->trusted_user_presence_required, TAG_TRUSTED_USER_PRESENCE_REQUIRED,
-                auth_list);
-    copyAuthTag(record->trusted_confirmation_required, TAG_TRUSTED_CONFIRMATION_REQUIRED,
-                auth_list);
-    copyAuthTag(record->unlocked_device_required, TAG_UNLOCKED_DEVICE_REQUIRED, auth_list);
+// The root of trust is not added to the authorization list; parse_root_of_trust reports it.
+static bool parseAuthTag(CBS* content, TAG_ROOT_OF_TRUST_t, AuthorizationSet*) {
+    CBS root_of_trust;
+    return CBS_get_asn1(content, &root_of_trust, CBS_ASN1_SEQUENCE);
+}
 
-    return ErrorCode::OK;
+template <typename... T>
+struct choose_auth_parser;
+template <typename... Tags>
+struct choose_auth_parser<MetaList<Tags...>> {
+    static bool parse(uint32_t tag_number, CBS* content, AuthorizationSet* auth_list) {
+        return choose_auth_parser<Tags...>::parse(tag_number, content, auth_list);
+    }
+};
+template <>
+struct choose_auth_parser<> {
+    static bool parse(uint32_t tag_number, CBS*, AuthorizationSet*) {
+        // Entries this version of the schema does not know about are skipped.
+        LOG(DEBUG) << AT << "Skipping unknown authorization list tag " << tag_number;
+        return true;
+    }
+};
+template <TagType tag_type, Tag tag, typename... Tail>
+struct choose_auth_parser<TypedTag<tag_type, tag>, Tail...> {
+    static bool parse(uint32_t tag_number, CBS* content, AuthorizationSet* auth_list) {
+        if (tag_number == (static_cast<uint32_t>(tag) & 0x0FFFFFFF)) {
+            return parseAuthTag(content, TypedTag<tag_type, tag>(), auth_list) &&
+                   CBS_len(content) == 0;
+        } else {
+            return choose_auth_parser<Tail...>::parse(tag_number, content, auth_list);
+        }
+    }
+};
+
+// The tags an AuthorizationList in an attestation record may hold.
+using attestation_tags_t =
+    MetaList<TAG_PURPOSE_t, TAG_ALGORITHM_t, TAG_KEY_SIZE_t, TAG_DIGEST_t, TAG_PADDING_t,
+             TAG_EC_CURVE_t, TAG_RSA_PUBLIC_EXPONENT_t, TAG_ROLLBACK_RESISTANCE_t,
+             TAG_ACTIVE_DATETIME_t, TAG_ORIGINATION_EXPIRE_DATETIME_t, TAG_USAGE_EXPIRE_DATETIME_t,
+             TAG_NO_AUTH_REQUIRED_t, TAG_USER_AUTH_TYPE_t, TAG_AUTH_TIMEOUT_t,
+             TAG_ALLOW_WHILE_ON_BODY_t, TAG_TRUSTED_USER_PRESENCE_REQUIRED_t,
+             TAG_TRUSTED_CONFIRMATION_REQUIRED_t, TAG_UNLOCKED_DEVICE_REQUIRED_t,
+             TAG_CREATION_DATETIME_t, TAG_ORIGIN_t, TAG_ROOT_OF_TRUST_t, TAG_OS_VERSION_t,
+             TAG_OS_PATCHLEVEL_t, TAG_VENDOR_PATCHLEVEL_t, TAG_BOOT_PATCHLEVEL_t,
+             TAG_ATTESTATION_APPLICATION_ID_t>;
+
+/**
+ * Walks the entries of an AuthorizationList. For each entry, calls fn with its tag number and a
+ * CBS over its content, stopping if fn returns false. Returns false if the list is malformed or fn
+ * failed. As the entries are the optional fields of a SEQUENCE, their tag numbers must be strictly
+ * ascending.
+ */
+template <typename Fn>
+static bool forEachAuthEntry(CBS* auth_list, Fn fn) {
+    bool first = true;
+    uint32_t last_tag_number = 0;
+    while (CBS_len(auth_list)) {
+        CBS entry;
+        unsigned asn1_tag;
+        size_t header_len;
+        if (!CBS_get_any_asn1_element(auth_list, &entry, &asn1_tag, &header_len) ||
+            !CBS_skip(&entry, header_len)) {
+            return false;
+        }
+        if ((asn1_tag & ~CBS_ASN1_TAG_NUMBER_MASK) !=
+            (CBS_ASN1_CONTEXT_SPECIFIC | CBS_ASN1_CONSTRUCTED)) {
+            return false;
+        }
+        uint32_t tag_number = asn1_tag & CBS_ASN1_TAG_NUMBER_MASK;
+        if (!first && tag_number <= last_tag_number) return false;
+        first = false;
+        last_tag_number = tag_number;
+        if (!fn(tag_number, &entry)) return false;
+    }
+    return true;
 }
 
-MAKE_OPENSSL_PTR_TYPE(KM_KEY_DESCRIPTION)
+static bool parseAuthList(CBS* record, AuthorizationSet* auth_list) {
+    CBS list;
+    if (!CBS_get_asn1(record, &list, CBS_ASN1_SEQUENCE)) return false;
+    return forEachAuthEntry(&list, [&](uint32_t tag_number, CBS* content) {
+        return choose_auth_parser<attestation_tags_t>::parse(tag_number, content, auth_list);
+    });
+}
+
+/**
+ * Reads the fields of the KeyDescription up to the AuthorizationLists. Any of the outputs may be
+ * null to skip the value.
+ */
+static bool parseKeyDescriptionHeader(CBS* record, uint32_t* attestation_version,
+                                      SecurityLevel* attestation_security_level,
+                                      uint32_t* keymaster_version,
+                                      SecurityLevel* keymaster_security_level,
+                                      hidl_vec<uint8_t>* attestation_challenge,
+                                      hidl_vec<uint8_t>* unique_id) {
+    uint32_t version, security_level, km_version, km_security_level;
+    CBS challenge, uid;
+    if (!getUint32(record, CBS_ASN1_INTEGER, &version) ||
+        !getUint32(record, CBS_ASN1_ENUMERATED, &security_level) ||
+        !getUint32(record, CBS_ASN1_INTEGER, &km_version) ||
+        !getUint32(record, CBS_ASN1_ENUMERATED, &km_security_level) ||
+        !CBS_get_asn1(record, &challenge, CBS_ASN1_OCTETSTRING) ||
+        !CBS_get_asn1(record, &uid, CBS_ASN1_OCTETSTRING)) {
+        return false;
+    }
+    if (attestation_version) *attestation_version = version;
+    if (attestation_security_level) {
+        *attestation_security_level = static_cast<SecurityLevel>(security_level);
+    }
+    if (keymaster_version) *keymaster_version = km_version;
+    if (keymaster_security_level) {
+        *keymaster_security_level = static_cast<SecurityLevel>(km_security_level);
+    }
+    if (attestation_challenge) {
+        attestation_challenge->resize(CBS_len(&challenge));
+        if (CBS_len(&challenge)) {
+            memcpy(attestation_challenge->data(), CBS_data(&challenge), CBS_len(&challenge));
+        }
+    }
+    if (unique_id) {
+        unique_id->resize(CBS_len(&uid));
+        if (CBS_len(&uid)) memcpy(unique_id->data(), CBS_data(&uid), CBS_len(&uid));
+    }
+    return true;
+}
 
 // Parse the DER-encoded attestation record, placing the results in keymaster_version,
 // attestation_challenge, software_enforced, tee_enforced and unique_id.
@@ -283,28 +298,17 @@ ErrorCode parse_attestation_record(const uint8_t* asn1_key_desc, size_t asn1_key
                                    AuthorizationSet* software_enforced,
                                    AuthorizationSet* tee_enforced,  //
                                    hidl_vec<uint8_t>* unique_id) {
-    const uint8_t* p = asn1_key_desc;
-    KM_KEY_DESCRIPTION_Ptr record(d2i_KM_KEY_DESCRIPTION(nullptr, &p, asn1_key_desc_len));
-    if (!record.get()) return ErrorCode::UNKNOWN_ERROR;
-
-    *attestation_version = ASN1_INTEGER_get(record->attestation_version);
-    *attestation_security_level =
-        static_cast<SecurityLevel>(ASN1_ENUMERATED_get(record->attestation_security_level));
-    *keymaster_version = ASN1_INTEGER_get(record->keymaster_version);
-    *keymaster_security_level =
-        static_cast<SecurityLevel>(ASN1_ENUMERATED_get(record->keymaster_security_level));
-
-    auto& chall = record->attestation_challenge;
-    attestation_challenge->resize(chall->length);
-    memcpy(attestation_challenge->data(), chall->data, chall->length);
-    auto& uid = record->unique_id;
-    unique_id->resize(uid->length);
-    memcpy(unique_id->data(), uid->data, uid->length);
-
-    ErrorCode error = extract_auth_list(record->software_enforced, software_enforced);
-    if (error != ErrorCode::OK) return error;
-
-    return extract_auth_list(record->tee_enforced, tee_enforced);
+    CBS input, record;
+    CBS_init(&input, asn1_key_desc, asn1_key_desc_len);
+    if (!CBS_get_asn1(&input, &record, CBS_ASN1_SEQUENCE) ||
+        !parseKeyDescriptionHeader(&record, attestation_version, attestation_security_level,
+                                   keymaster_version, keymaster_security_level,
+                                   attestation_challenge, unique_id) ||
+        !parseAuthList(&record, software_enforced) || !parseAuthList(&record, tee_enforced) ||
+        CBS_len(&record) != 0 || CBS_len(&input) != 0) {
+        return ErrorCode::UNKNOWN_ERROR;
+    }
+    return ErrorCode::OK;
 }
 
 ErrorCode parse_root_of_trust(const uint8_t* asn1_key_desc, size_t asn1_key_desc_len,
@@ -315,50 +319,61 @@ ErrorCode parse_root_of_trust(const uint8_t* asn1_key_desc, size_t asn1_key_desc
         LOG(ERROR) << AT << "null pointer input(s)";
         return ErrorCode::INVALID_ARGUMENT;
     }
-    const uint8_t* p = asn1_key_desc;
-    KM_KEY_DESCRIPTION_Ptr record(d2i_KM_KEY_DESCRIPTION(nullptr, &p, asn1_key_desc_len));
-    if (!record.get()) {
+    CBS input, record, software_enforced, tee_enforced;
+    CBS_init(&input, asn1_key_desc, asn1_key_desc_len);
+    if (!CBS_get_asn1(&input, &record, CBS_ASN1_SEQUENCE) ||
+        !parseKeyDescriptionHeader(&record, nullptr, nullptr, nullptr, nullptr, nullptr,
+                                   nullptr) ||
+        !CBS_get_asn1(&record, &software_enforced, CBS_ASN1_SEQUENCE)) {
         LOG(ERROR) << AT << "Failed record parsing";
         return ErrorCode::UNKNOWN_ERROR;
     }
-    if (!record->tee_enforced) {
+    if (!CBS_get_asn1(&record, &tee_enforced, CBS_ASN1_SEQUENCE)) {
         LOG(ERROR) << AT << "Failed hardware characteristic parsing";
         return ErrorCode::INVALID_ARGUMENT;
     }
-    if (!record->tee_enforced->root_of_trust) {
-        LOG(ERROR) << AT << "Failed root of trust parsing";
+    if (CBS_len(&record) != 0 || CBS_len(&input) != 0) {
+        LOG(ERROR) << AT << "Trailing data after the record";
+        return ErrorCode::UNKNOWN_ERROR;
+    }
+
+    CBS root_of_trust;
+    bool found = false;
+    uint32_t root_of_trust_tag = static_cast<uint32_t>(Tag::ROOT_OF_TRUST) & 0x0FFFFFFF;
+    bool well_formed = forEachAuthEntry(&tee_enforced, [&](uint32_t tag_number, CBS* content) {
+        if (tag_number != root_of_trust_tag) return true;
+        found = CBS_get_asn1(content, &root_of_trust, CBS_ASN1_SEQUENCE);
+        return false;
+    });
+    if (!found) {
+        LOG(ERROR) << AT << (well_formed ? "Failed root of trust parsing"
+                                         : "Failed hardware characteristic parsing");
         return ErrorCode::INVALID_ARGUMENT;
     }
-    if (!record->tee_enforced->root_of_trust->verified_boot_key) {
+
+    if (!getOctetString(&root_of_trust, verified_boot_key)) {
         LOG(ERROR) << AT << "Failed verified boot key parsing";
         return ErrorCode::INVALID_ARGUMENT;
     }
-    KM_ROOT_OF_TRUST* root_of_trust = record->tee_enforced->root_of_trust;
-
-    auto& vb_key = root_of_trust->verified_boot_key;
-    verified_boot_key->resize(vb_key->length);
-    memcpy(verified_boot_key->data(), vb_key->data, vb_key->length);
 
-    *verified_boot_state = static_cast<keymaster_verified_boot_t>(
-            ASN1_ENUMERATED_get(root_of_trust->verified_boot_state));
-    if (!verified_boot_state) {
-        LOG(ERROR) << AT << "Failed verified boot state parsing";
+    CBS locked;
+    if (!CBS_get_asn1(&root_of_trust, &locked, CBS_ASN1_BOOLEAN) || CBS_len(&locked) != 1) {
+        LOG(ERROR) << AT << "Failed device locked parsing";
         return ErrorCode::INVALID_ARGUMENT;
     }
+    *device_locked = CBS_data(&locked)[0] != 0;
 
-    *device_locked = root_of_trust->device_locked;
-    if (!device_locked) {
-        LOG(ERROR) << AT << "Failed device locked parsing";
+    uint32_t state;
+    if (!getUint32(&root_of_trust, CBS_ASN1_ENUMERATED, &state)) {
+        LOG(ERROR) << AT << "Failed verified boot state parsing";
         return ErrorCode::INVALID_ARGUMENT;
     }
+    *verified_boot_state = static_cast<keymaster_verified_boot_t>(state);
 
-    auto& vb_hash = root_of_trust->verified_boot_hash;
-    if (!vb_hash) {
+    if (!getOctetString(&root_of_trust, verified_boot_hash)) {
         LOG(ERROR) << AT << "Failed verified boot hash parsing";
         return ErrorCode::INVALID_ARGUMENT;
     }
-    verified_boot_hash->resize(vb_hash->length);
-    memcpy(verified_boot_hash->data(), vb_hash->data, vb_hash->length);
     return ErrorCode::OK;  // KM_ERROR_OK;
 }
 
@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "attestation_record_test_utils.h"
+
+#include <keymasterV4_0/key_param_output.h>
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace test {
+
+namespace {
+
+struct ParsedRecord {
+    uint32_t attestation_version = 0;
+    SecurityLevel attestation_security_level = SecurityLevel::SOFTWARE;
+    uint32_t keymaster_version = 0;
+    SecurityLevel keymaster_security_level = SecurityLevel::SOFTWARE;
+    hidl_vec<uint8_t> attestation_challenge;
+    AuthorizationSet software_enforced;
+    AuthorizationSet tee_enforced;
+    hidl_vec<uint8_t> unique_id;
+};
+
+ErrorCode parse(const std::vector<uint8_t>& der, size_t len, ParsedRecord* record) {
+    return parse_attestation_record(der.data(), len, &record->attestation_version,
+                                    &record->attestation_security_level,
+                                    &record->keymaster_version,
+                                    &record->keymaster_security_level,
+                                    &record->attestation_challenge, &record->software_enforced,
+                                    &record->tee_enforced, &record->unique_id);
+}
+
+AuthorizationSet sorted(AuthorizationSet set) {
+    set.Sort();
+    return set;
+}
+
+// Wraps content, shorter than 128 bytes, in a SEQUENCE.
+std::vector<uint8_t> sequence(const std::vector<uint8_t>& content) {
+    std::vector<uint8_t> result = {0x30, static_cast<uint8_t>(content.size())};
+    result.insert(result.end(), content.begin(), content.end());
+    return result;
+}
+
+std::vector<uint8_t> concat(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+    std::vector<uint8_t> result = a;
+    result.insert(result.end(), b.begin(), b.end());
+    return result;
+}
+
+void expectSameParams(const AuthorizationSet& expected, const AuthorizationSet& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i], actual[i]) << "param " << i;
+    }
+}
+
+class AttestationRecordTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        AttestationRecordEncoder::typicalAuthLists(&software_enforced_, &tee_enforced_);
+        challenge_ = hidl_vec<uint8_t>({'c', 'h', 'a', 'l', 'l', 'e', 'n', 'g', 'e'});
+        der_ = AttestationRecordEncoder::encode(challenge_, software_enforced_, tee_enforced_);
+        ASSERT_FALSE(der_.empty());
+    }
+
+    hidl_vec<uint8_t> challenge_;
+    AuthorizationSet software_enforced_;
+    AuthorizationSet tee_enforced_;
+    std::vector<uint8_t> der_;
+};
+
+}  // namespace
+
+TEST_F(AttestationRecordTest, ParsesRecord) {
+    ParsedRecord record;
+    ASSERT_EQ(ErrorCode::OK, parse(der_, der_.size(), &record));
+    EXPECT_EQ(3U, record.attestation_version);
+    EXPECT_EQ(SecurityLevel::TRUSTED_ENVIRONMENT, record.attestation_security_level);
+    EXPECT_EQ(4U, record.keymaster_version);
+    EXPECT_EQ(SecurityLevel::TRUSTED_ENVIRONMENT, record.keymaster_security_level);
+    EXPECT_EQ(challenge_, record.attestation_challenge);
+    EXPECT_EQ(0U, record.unique_id.size());
+    expectSameParams(sorted(software_enforced_), sorted(record.software_enforced));
+    expectSameParams(sorted(tee_enforced_), sorted(record.tee_enforced));
+}
+
+TEST_F(AttestationRecordTest, OutputsOwnTheirData) {
+    ParsedRecord record;
+    ASSERT_EQ(ErrorCode::OK, parse(der_, der_.size(), &record));
+    der_.assign(der_.size(), 0);
+    expectSameParams(sorted(software_enforced_), sorted(record.software_enforced));
+}
+
+TEST_F(AttestationRecordTest, ParsesRootOfTrust) {
+    hidl_vec<uint8_t> verified_boot_key;
+    keymaster_verified_boot_t verified_boot_state = KM_VERIFIED_BOOT_FAILED;
+    bool device_locked = false;
+    hidl_vec<uint8_t> verified_boot_hash;
+    ASSERT_EQ(ErrorCode::OK,
+              parse_root_of_trust(der_.data(), der_.size(), &verified_boot_key,
+                                  &verified_boot_state, &device_locked, &verified_boot_hash));
+    EXPECT_EQ(32U, verified_boot_key.size());
+    EXPECT_EQ(0xab, verified_boot_key[0]);
+    EXPECT_EQ(KM_VERIFIED_BOOT_VERIFIED, verified_boot_state);
+    EXPECT_TRUE(device_locked);
+    EXPECT_EQ(32U, verified_boot_hash.size());
+    EXPECT_EQ(0xcd, verified_boot_hash[0]);
+}
+
+TEST_F(AttestationRecordTest, SkipsUnknownTags) {
+    // Attestation ID tags are not part of the schema the parser knows about.
+    AuthorizationSet with_unknown = software_enforced_;
+    KeyParameter brand;
+    brand.tag = Tag::ATTESTATION_ID_BRAND;
+    brand.blob = hidl_vec<uint8_t>({'b', 'r', 'a', 'n', 'd'});
+    with_unknown.push_back(brand);
+    std::vector<uint8_t> der =
+        AttestationRecordEncoder::encode(challenge_, with_unknown, tee_enforced_);
+    ASSERT_FALSE(der.empty());
+
+    ParsedRecord record;
+    ASSERT_EQ(ErrorCode::OK, parse(der, der.size(), &record));
+    expectSameParams(sorted(software_enforced_), sorted(record.software_enforced));
+}
+
+TEST_F(AttestationRecordTest, RejectsTruncatedRecords) {
+    for (size_t len = 0; len < der_.size(); ++len) {
+        ParsedRecord record;
+        EXPECT_NE(ErrorCode::OK, parse(der_, len, &record)) << "length " << len;
+    }
+}
+
+TEST_F(AttestationRecordTest, RejectsNegativeIntegers) {
+    AuthorizationSet tee_enforced =
+        AuthorizationSetBuilder().Authorization(TAG_KEY_SIZE, 0x80000000u);
+    std::vector<uint8_t> der =
+        AttestationRecordEncoder::encode(challenge_, software_enforced_, tee_enforced);
+    ParsedRecord record;
+    ASSERT_EQ(ErrorCode::OK, parse(der, der.size(), &record));
+
+    // 0x80000000 is encoded as 02 05 00 80 00 00 00. Replacing the leading zero makes it negative.
+    static const uint8_t kKeySize[] = {0x02, 0x05, 0x00, 0x80, 0x00, 0x00, 0x00};
+    auto pos = std::search(der.begin(), der.end(), std::begin(kKeySize), std::end(kKeySize));
+    ASSERT_NE(der.end(), pos);
+    pos[2] = 0xff;
+    ParsedRecord negative;
+    EXPECT_NE(ErrorCode::OK, parse(der, der.size(), &negative));
+}
+
+// Feeds randomly mutated records to both entry points. Run under ASan/HWASan this exercises the
+// bounds checking of the reader; the seed is fixed so failures reproduce.
+TEST_F(AttestationRecordTest, RejectsOutOfOrderTags) {
+    std::vector<uint8_t> creation = AttestationRecordEncoder::encodeEntries(
+        AuthorizationSetBuilder().Authorization(TAG_CREATION_DATETIME, 1536000000000ull));
+    std::vector<uint8_t> os_version = AttestationRecordEncoder::encodeEntries(
+        AuthorizationSetBuilder().Authorization(TAG_OS_VERSION, 90000u));
+    ASSERT_FALSE(creation.empty());
+    ASSERT_FALSE(os_version.empty());
+
+    ParsedRecord record;
+    std::vector<uint8_t> der = AttestationRecordEncoder::encode(
+        challenge_, concat(sequence(concat(creation, os_version)), sequence({})));
+    ASSERT_EQ(ErrorCode::OK, parse(der, der.size(), &record));
+
+    der = AttestationRecordEncoder::encode(
+        challenge_, concat(sequence(concat(os_version, creation)), sequence({})));
+    EXPECT_NE(ErrorCode::OK, parse(der, der.size(), &record));
+}
+
+TEST_F(AttestationRecordTest, RejectsDuplicateTags) {
+    std::vector<uint8_t> creation = AttestationRecordEncoder::encodeEntries(
+        AuthorizationSetBuilder().Authorization(TAG_CREATION_DATETIME, 1536000000000ull));
+    ASSERT_FALSE(creation.empty());
+
+    std::vector<uint8_t> der = AttestationRecordEncoder::encode(
+        challenge_, concat(sequence({}), sequence(concat(creation, creation))));
+    ParsedRecord record;
+    EXPECT_NE(ErrorCode::OK, parse(der, der.size(), &record));
+}
+
+TEST_F(AttestationRecordTest, RejectsTrailingData) {
+    static const std::vector<uint8_t> kNull = {0x05, 0x00};
+    hidl_vec<uint8_t> verified_boot_key;
+    keymaster_verified_boot_t verified_boot_state;
+    bool device_locked;
+    hidl_vec<uint8_t> verified_boot_hash;
+
+    // After the KeyDescription
+    std::vector<uint8_t> der = concat(der_, kNull);
+    ParsedRecord record;
+    EXPECT_NE(ErrorCode::OK, parse(der, der.size(), &record));
+    EXPECT_NE(ErrorCode::OK,
+              parse_root_of_trust(der.data(), der.size(), &verified_boot_key,
+                                  &verified_boot_state, &device_locked, &verified_boot_hash));
+
+    // Inside the KeyDescription, after the AuthorizationLists
+    der = AttestationRecordEncoder::encode(challenge_,
+                                           concat(concat(sequence({}), sequence({})), kNull));
+    EXPECT_NE(ErrorCode::OK, parse(der, der.size(), &record));
+}
+
+TEST_F(AttestationRecordTest, RejectsNonMinimalIntegers) {
+    // [3] EXPLICIT INTEGER holding a key size of 2048
+    static const std::vector<uint8_t> kKeySize = {0xa3, 0x04, 0x02, 0x02, 0x08, 0x00};
+    static const std::vector<uint8_t> kPaddedKeySize = {0xa3, 0x05, 0x02, 0x03, 0x00, 0x08, 0x00};
+
+    ParsedRecord record;
+    std::vector<uint8_t> der =
+        AttestationRecordEncoder::encode(challenge_, concat(sequence({}), sequence(kKeySize)));
+    ASSERT_EQ(ErrorCode::OK, parse(der, der.size(), &record));
+    EXPECT_EQ(2048U, record.tee_enforced.GetTagValue(TAG_KEY_SIZE).value());
+
+    der = AttestationRecordEncoder::encode(challenge_,
+                                           concat(sequence({}), sequence(kPaddedKeySize)));
+    EXPECT_NE(ErrorCode::OK, parse(der, der.size(), &record));
+}
+
+TEST_F(AttestationRecordTest, SurvivesMutatedRecords) {
+    std::mt19937 rng(0x4b4d3430);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (int iteration = 0; iteration < 20000; ++iteration) {
+        std::vector<uint8_t> der = der_;
+        int mutations = 1 + iteration % 4;
+        for (int m = 0; m < mutations; ++m) {
+            size_t pos = std::uniform_int_distribution<size_t>(0, der.size() - 1)(rng);
+            switch (byte(rng) % 4) {
+                case 0:
+                    der[pos] = byte(rng);
+                    break;
+                case 1:
+                    der[pos] ^= 1 << (byte(rng) % 8);
+                    break;
+                case 2:
+                    der.insert(der.begin() + pos, byte(rng));
+                    break;
+                case 3:
+                    if (der.size() > 1) der.erase(der.begin() + pos);
+                    break;
+            }
+        }
+
+        ParsedRecord record;
+        parse(der, der.size(), &record);
+
+        hidl_vec<uint8_t> verified_boot_key;
+        keymaster_verified_boot_t verified_boot_state;
+        bool device_locked;
+        hidl_vec<uint8_t> verified_boot_hash;
+        parse_root_of_trust(der.data(), der.size(), &verified_boot_key, &verified_boot_state,
+                            &device_locked, &verified_boot_hash);
+    }
+}
+
+}  // namespace test
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HARDWARE_INTERFACES_KEYMASTER_4_0_SUPPORT_ATTESTATION_RECORD_TEST_UTILS_H_
+#define HARDWARE_INTERFACES_KEYMASTER_4_0_SUPPORT_ATTESTATION_RECORD_TEST_UTILS_H_
+
+#include <keymasterV4_0/attestation_record.h>
+#include <keymasterV4_0/authorization_set.h>
+
+#include <openssl/bytestring.h>
+#include <openssl/mem.h>
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace test {
+
+/**
+ * Encodes attestation records for the parser tests and benchmarks, following the schema in
+ * attestation_record.cpp.
+ */
+class AttestationRecordEncoder {
+   public:
+    static bool addAuthList(CBB* record, const AuthorizationSet& auth_list,
+                            bool with_root_of_trust) {
+        // The entries are the optional fields of a SEQUENCE, so they are in tag number order.
+        auto tagNumber = [](Tag tag) { return static_cast<uint32_t>(tag) & 0x0FFFFFFF; };
+        std::vector<Tag> tags;
+        for (size_t i = 0; i < auth_list.size(); ++i) {
+            if (auth_list[i].tag != Tag::ROOT_OF_TRUST) tags.push_back(auth_list[i].tag);
+        }
+        if (with_root_of_trust) tags.push_back(Tag::ROOT_OF_TRUST);
+        std::sort(tags.begin(), tags.end(),
+                  [&](Tag a, Tag b) { return tagNumber(a) < tagNumber(b); });
+        tags.erase(std::unique(tags.begin(), tags.end()), tags.end());
+
+        CBB list;
+        if (!CBB_add_asn1(record, &list, CBS_ASN1_SEQUENCE)) return false;
+        for (Tag tag : tags) {
+            if (tag == Tag::ROOT_OF_TRUST) {
+                if (!addRootOfTrust(&list)) return false;
+            } else if (!addEntry(&list, auth_list, auth_list.find(tag))) {
+                return false;
+            }
+        }
+        return CBB_flush(record);
+    }
+
+    // Adds the entry for the parameter at pos, including any repetitions of its tag.
+    static bool addEntry(CBB* list, const AuthorizationSet& auth_list, int pos) {
+        const KeyParameter& param = auth_list[pos];
+        CBB entry;
+        uint32_t tag_number = static_cast<uint32_t>(param.tag) & 0x0FFFFFFF;
+        if (!CBB_add_asn1(list, &entry,
+                          CBS_ASN1_CONTEXT_SPECIFIC | CBS_ASN1_CONSTRUCTED | tag_number)) {
+            return false;
+        }
+        switch (typeFromTag(param.tag)) {
+            case TagType::ENUM_REP: {
+                // Repeated tags are encoded once, as a SET OF INTEGER holding every value.
+                CBB set;
+                if (!CBB_add_asn1(&entry, &set, CBS_ASN1_SET)) return false;
+                for (; pos != -1; pos = auth_list.find(param.tag, pos)) {
+                    if (!CBB_add_asn1_uint64(&set, auth_list[pos].f.integer)) return false;
+                }
+                break;
+            }
+            case TagType::ENUM:
+            case TagType::UINT:
+                if (!CBB_add_asn1_uint64(&entry, param.f.integer)) return false;
+                break;
+            case TagType::ULONG:
+            case TagType::DATE:
+                if (!CBB_add_asn1_uint64(&entry, param.f.longInteger)) return false;
+                break;
+            case TagType::BOOL: {
+                CBB null;
+                if (!CBB_add_asn1(&entry, &null, CBS_ASN1_NULL)) return false;
+                break;
+            }
+            case TagType::BYTES: {
+                CBB value;
+                if (!CBB_add_asn1(&entry, &value, CBS_ASN1_OCTETSTRING) ||
+                    !CBB_add_bytes(&value, param.blob.data(), param.blob.size())) {
+                    return false;
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+        return CBB_flush(list);
+    }
+
+    static bool addRootOfTrust(CBB* list) {
+        static const uint8_t kVerifiedBootKey[32] = {0xab};
+        static const uint8_t kVerifiedBootHash[32] = {0xcd};
+        CBB entry, root_of_trust, key, locked, state, hash;
+        uint32_t tag_number = static_cast<uint32_t>(Tag::ROOT_OF_TRUST) & 0x0FFFFFFF;
+        return CBB_add_asn1(list, &entry,
+                            CBS_ASN1_CONTEXT_SPECIFIC | CBS_ASN1_CONSTRUCTED | tag_number) &&
+               CBB_add_asn1(&entry, &root_of_trust, CBS_ASN1_SEQUENCE) &&
+               CBB_add_asn1(&root_of_trust, &key, CBS_ASN1_OCTETSTRING) &&
+               CBB_add_bytes(&key, kVerifiedBootKey, sizeof(kVerifiedBootKey)) &&
+               CBB_add_asn1(&root_of_trust, &locked, CBS_ASN1_BOOLEAN) &&
+               CBB_add_u8(&locked, 0xff) &&
+               CBB_add_asn1(&root_of_trust, &state, CBS_ASN1_ENUMERATED) &&
+               CBB_add_u8(&state, KM_VERIFIED_BOOT_VERIFIED) &&
+               CBB_add_asn1(&root_of_trust, &hash, CBS_ASN1_OCTETSTRING) &&
+               CBB_add_bytes(&hash, kVerifiedBootHash, sizeof(kVerifiedBootHash)) &&
+               CBB_flush(list);
+    }
+
+    /**
+     * Returns the DER encoding of a KeyDescription, or an empty vector on failure. The TEE list
+     * gets a root of trust.
+     */
+    static std::vector<uint8_t> encode(const hidl_vec<uint8_t>& challenge,
+                                       const AuthorizationSet& software_enforced,
+                                       const AuthorizationSet& tee_enforced) {
+        return encodeRecord(challenge, [&](CBB* record) {
+            return addAuthList(record, software_enforced, false /* with_root_of_trust */) &&
+                   addAuthList(record, tee_enforced, true /* with_root_of_trust */);
+        });
+    }
+
+    /**
+     * Returns the DER encoding of a KeyDescription whose fields after the unique id are the
+     * given bytes, for records that encode() can't produce.
+     */
+    static std::vector<uint8_t> encode(const hidl_vec<uint8_t>& challenge,
+                                       const std::vector<uint8_t>& auth_lists) {
+        return encodeRecord(challenge, [&](CBB* record) {
+            return CBB_add_bytes(record, auth_lists.data(), auth_lists.size());
+        });
+    }
+
+    /**
+     * Returns the DER encoding of the entries of an AuthorizationList holding auth_list, without
+     * the enclosing SEQUENCE, or an empty vector on failure.
+     */
+    static std::vector<uint8_t> encodeEntries(const AuthorizationSet& auth_list) {
+        bssl::ScopedCBB cbb;
+        uint8_t* der = nullptr;
+        size_t der_len = 0;
+        if (!CBB_init(cbb.get(), 256) ||
+            !addAuthList(cbb.get(), auth_list, false /* with_root_of_trust */) ||
+            !CBB_finish(cbb.get(), &der, &der_len)) {
+            return {};
+        }
+        CBS cbs, entries;
+        CBS_init(&cbs, der, der_len);
+        std::vector<uint8_t> result;
+        if (CBS_get_asn1(&cbs, &entries, CBS_ASN1_SEQUENCE)) {
+            result.assign(CBS_data(&entries), CBS_data(&entries) + CBS_len(&entries));
+        }
+        OPENSSL_free(der);
+        return result;
+    }
+
+    /**
+     * The authorization lists of a typical attestation record.
+     */
+    static void typicalAuthLists(AuthorizationSet* software_enforced,
+                                 AuthorizationSet* tee_enforced) {
+        static const uint8_t kApplicationId[] = "com.android.example.app";
+        *software_enforced = AuthorizationSetBuilder()
+                                 .Authorization(TAG_CREATION_DATETIME, 1536000000000ull)
+                                 .Authorization(TAG_ATTESTATION_APPLICATION_ID, kApplicationId,
+                                                sizeof(kApplicationId) - 1);
+        *tee_enforced = AuthorizationSetBuilder()
+                            .RsaSigningKey(2048, 65537)
+                            .Digest(Digest::SHA_2_256, Digest::SHA_2_512)
+                            .Padding(PaddingMode::RSA_PSS, PaddingMode::RSA_PKCS1_1_5_SIGN)
+                            .Authorization(TAG_NO_AUTH_REQUIRED)
+                            .Authorization(TAG_ORIGIN, KeyOrigin::GENERATED)
+                            .Authorization(TAG_OS_VERSION, 90000u)
+                            .Authorization(TAG_OS_PATCHLEVEL, 201809u)
+                            .Authorization(TAG_VENDOR_PATCHLEVEL, 20180905u)
+                            .Authorization(TAG_BOOT_PATCHLEVEL, 20180905u);
+    }
+
+   private:
+    template <typename AddAuthLists>
+    static std::vector<uint8_t> encodeRecord(const hidl_vec<uint8_t>& challenge,
+                                             AddAuthLists add_auth_lists) {
+        bssl::ScopedCBB cbb;
+        CBB record, security_level, km_security_level, octets;
+        uint8_t* der = nullptr;
+        size_t der_len = 0;
+        if (!CBB_init(cbb.get(), 512) ||
+            !CBB_add_asn1(cbb.get(), &record, CBS_ASN1_SEQUENCE) ||
+            !CBB_add_asn1_uint64(&record, 3) ||
+            !CBB_add_asn1(&record, &security_level, CBS_ASN1_ENUMERATED) ||
+            !CBB_add_u8(&security_level,
+                        static_cast<uint8_t>(SecurityLevel::TRUSTED_ENVIRONMENT)) ||
+            !CBB_add_asn1_uint64(&record, 4) ||
+            !CBB_add_asn1(&record, &km_security_level, CBS_ASN1_ENUMERATED) ||
+            !CBB_add_u8(&km_security_level,
+                        static_cast<uint8_t>(SecurityLevel::TRUSTED_ENVIRONMENT)) ||
+            !CBB_add_asn1(&record, &octets, CBS_ASN1_OCTETSTRING) ||
+            !CBB_add_bytes(&octets, challenge.data(), challenge.size()) ||
+            !CBB_add_asn1(&record, &octets, CBS_ASN1_OCTETSTRING) ||  // empty unique id
+            !add_auth_lists(&record) || !CBB_finish(cbb.get(), &der, &der_len)) {
+            return {};
+        }
+        std::vector<uint8_t> result(der, der + der_len);
+        OPENSSL_free(der);
+        return result;
+    }
+};
+
+}  // namespace test
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
+
+#endif  // HARDWARE_INTERFACES_KEYMASTER_4_0_SUPPORT_ATTESTATION_RECORD_TEST_UTILS_H_
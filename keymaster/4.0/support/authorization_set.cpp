@@ -18,6 +18,11 @@
 
 #include <assert.h>
 
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+
 #include <android-base/logging.h>
 
 namespace android {
@@ -85,48 +90,80 @@ inline bool keyParamEqual(const KeyParameter& a, const KeyParameter& b) {
 
 void AuthorizationSet::Sort() {
     std::sort(data_.begin(), data_.end(), keyParamLess);
+    RebuildIndex();
 }
 
 void AuthorizationSet::Deduplicate() {
     if (data_.empty()) return;
 
-    Sort();
-    std::vector<KeyParameter> result;
+    // Sets built by Union and earlier calls are already sorted.
+    if (!std::is_sorted(data_.begin(), data_.end(), keyParamLess)) {
+        std::sort(data_.begin(), data_.end(), keyParamLess);
+    }
 
+    // Compact in place. Of each run of equal entries the last one is kept, and INVALID entries are
+    // dropped unless one sorts last.
+    auto out = data_.begin();
     auto curr = data_.begin();
     auto prev = curr++;
     for (; curr != data_.end(); ++prev, ++curr) {
         if (prev->tag == Tag::INVALID) continue;
 
         if (!keyParamEqual(*prev, *curr)) {
-            result.push_back(std::move(*prev));
+            if (out != prev) *out = std::move(*prev);
+            ++out;
         }
     }
-    result.push_back(std::move(*prev));
+    if (out != prev) *out = std::move(*prev);
+    ++out;
+    data_.erase(out, data_.end());
 
-    std::swap(data_, result);
+    RebuildIndex();
 }
 
 void AuthorizationSet::Union(const AuthorizationSet& other) {
+    auto middle = data_.size();
     data_.insert(data_.end(), other.data_.begin(), other.data_.end());
+    if (std::is_sorted(data_.begin(), data_.begin() + middle, keyParamLess) &&
+        std::is_sorted(data_.begin() + middle, data_.end(), keyParamLess)) {
+        // Two sorted sets, typically the result of earlier calls, only need to be merged, after
+        // which Deduplicate skips sorting.
+        std::inplace_merge(data_.begin(), data_.begin() + middle, data_.end(), keyParamLess);
+    }
     Deduplicate();
 }
 
 void AuthorizationSet::Subtract(const AuthorizationSet& other) {
     Deduplicate();
+    if (data_.empty() || other.empty()) return;
+
+    // Walk both sets in sorted order, removing each element of this set that is matched by an
+    // element of the other. Every element of the other set removes at most one entry, as the
+    // previous implementation did.
+    std::vector<const KeyParameter*> others;
+    others.reserve(other.size());
+    for (const auto& param : other.data_) others.push_back(&param);
+    auto ptrLess = [](const KeyParameter* a, const KeyParameter* b) {
+        return keyParamLess(*a, *b);
+    };
+    if (!std::is_sorted(others.begin(), others.end(), ptrLess)) {
+        std::stable_sort(others.begin(), others.end(), ptrLess);
+    }
 
-    auto i = other.begin();
-    while (i != other.end()) {
-        int pos = -1;
-        do {
-            pos = find(i->tag, pos);
-            if (pos != -1 && keyParamEqual(*i, data_[pos])) {
-                data_.erase(data_.begin() + pos);
-                break;
-            }
-        } while (pos != -1);
-        ++i;
+    auto out = data_.begin();
+    auto io = others.begin();
+    for (auto curr = data_.begin(); curr != data_.end(); ++curr) {
+        while (io != others.end() && keyParamLess(**io, *curr)) ++io;
+        if (io != others.end() && keyParamEqual(**io, *curr)) {
+            ++io;
+            continue;
+        }
+        if (out != curr) *out = std::move(*curr);
+        ++out;
     }
+    data_.erase(out, data_.end());
+
+    RebuildIndex();
 }
 
 void AuthorizationSet::Filter(std::function<bool(const KeyParameter&)> doKeep) {
@@ -137,9 +174,12 @@ void AuthorizationSet::Filter(std::function<bool(const KeyParameter&)> doKeep) {
         }
     }
     std::swap(data_, result);
+    RebuildIndex();
 }
 
 KeyParameter& AuthorizationSet::operator[](int at) {
+    // The caller may change the tag through the reference at any later time.
+    index_stale_ = true;
     return data_[at];
 }
 
@@ -149,20 +189,74 @@ const KeyParameter& AuthorizationSet::operator[](int at) const {
 
 void AuthorizationSet::Clear() {
     data_.clear();
+    index_.clear();
+    tag_bits_.reset();
+    index_stale_ = false;
+}
+
+void AuthorizationSet::IndexLastElement() {
+    if (index_stale_) {
+        RebuildIndex();
+        return;
+    }
+    Tag tag = data_.back().tag;
+    uint32_t pos = data_.size() - 1;
+    // The new position is the largest, so it goes after all existing entries with the same tag.
+    auto insertAt = std::upper_bound(index_.begin(), index_.end(), tag,
+                                     [this](Tag t, uint32_t i) { return t < data_[i].tag; });
+    index_.insert(insertAt, pos);
+    tag_bits_.set(TagBit(tag));
+}
+
+void AuthorizationSet::RebuildIndex() {
+    index_.resize(data_.size());
+    tag_bits_.reset();
+    for (uint32_t i = 0; i < data_.size(); ++i) {
+        index_[i] = i;
+        tag_bits_.set(TagBit(data_[i].tag));
+    }
+    // Stable, so that entries with equal tags stay in position order.
+    std::stable_sort(index_.begin(), index_.end(),
+                     [this](uint32_t a, uint32_t b) { return data_[a].tag < data_[b].tag; });
+    index_stale_ = false;
+}
+
+std::pair<std::vector<uint32_t>::const_iterator, std::vector<uint32_t>::const_iterator>
+AuthorizationSet::IndexRange(Tag tag) const {
+    if (!tag_bits_.test(TagBit(tag))) return {index_.end(), index_.end()};
+    auto first = std::lower_bound(index_.begin(), index_.end(), tag,
+                                  [this](uint32_t i, Tag t) { return data_[i].tag < t; });
+    auto last = std::upper_bound(first, index_.end(), tag,
+                                 [this](Tag t, uint32_t i) { return t < data_[i].tag; });
+    return {first, last};
 }
 
 size_t AuthorizationSet::GetTagCount(Tag tag) const {
-    size_t count = 0;
-    for (int pos = -1; (pos = find(tag, pos)) != -1;) ++count;
-    return count;
+    if (index_stale_) {
+        size_t count = 0;
+        for (const auto& param : data_) {
+            if (param.tag == tag) ++count;
+        }
+        return count;
+    }
+    auto range = IndexRange(tag);
+    return range.second - range.first;
 }
 
 int AuthorizationSet::find(Tag tag, int begin) const {
-    auto iter = data_.begin() + (1 + begin);
+    if (index_stale_) {
+        auto iter = data_.begin() + (1 + begin);
 
-    while (iter != data_.end() && iter->tag != tag) ++iter;
+        while (iter != data_.end() && iter->tag != tag) ++iter;
 
-    if (iter != data_.end()) return iter - data_.begin();
+        if (iter != data_.end()) return iter - data_.begin();
+        return -1;
+    }
+
+    auto range = IndexRange(tag);
+    auto iter = std::lower_bound(range.first, range.second, begin + 1,
+                                 [](uint32_t pos, int b) { return static_cast<int>(pos) < b; });
+    if (iter != range.second) return *iter;
     return -1;
 }
 
@@ -170,6 +264,19 @@ bool AuthorizationSet::erase(int index) {
     auto pos = data_.begin() + index;
     if (pos != data_.end()) {
         data_.erase(pos);
+        if (index_stale_) {
+            RebuildIndex();
+            return true;
+        }
+        // Drop the erased position and shift the ones after it. The relative order of the
+        // remaining positions is unchanged.
+        auto out = index_.begin();
+        for (auto i = index_.begin(); i != index_.end(); ++i) {
+            if (*i == static_cast<uint32_t>(index)) continue;
+            *out++ = *i > static_cast<uint32_t>(index) ? *i - 1 : *i;
+        }
+        index_.erase(out, index_.end());
+        // tag_bits_ may now have a stale bit set, which only costs a lookup in IndexRange.
         return true;
     }
     return false;
@@ -450,6 +557,243 @@ void AuthorizationSet::Serialize(std::ostream* out) const {
 
 void AuthorizationSet::Deserialize(std::istream* in) {
     deserialize(*in, &data_);
+    RebuildIndex();
+}
+
+/**
+ * The flat serializer below writes the same format as the stream serializer, straight into a
+ * caller provided buffer. Values are written in host byte order, as the streams do.
+ */
+
+template <TagType... tag_types, Tag... tags>
+bool isKnownTag(MetaList<TypedTag<tag_types, tags>...>, Tag tag) {
+    static const auto kSortedTags = [] {
+        std::array<Tag, sizeof...(tags)> sorted = {{tags...}};
+        std::sort(sorted.begin(), sorted.end());
+        return sorted;
+    }();
+    return std::binary_search(kSortedTags.begin(), kSortedTags.end(), tag);
+}
+
+bool isKnownTag(Tag tag) {
+    return isKnownTag(all_tags_t(), tag);
+}
+
+// Returns the number of bytes following the tag of an entry in the elements section.
+size_t flatValueSize(Tag tag) {
+    switch (typeFromTag(tag)) {
+        case TagType::INVALID:
+            return 0;
+        case TagType::BOOL:
+            return sizeof(bool);
+        case TagType::ENUM:
+        case TagType::ENUM_REP:
+        case TagType::UINT:
+        case TagType::UINT_REP:
+            return sizeof(uint32_t);
+        case TagType::ULONG:
+        case TagType::ULONG_REP:
+        case TagType::DATE:
+            return sizeof(uint64_t);
+        case TagType::BIGNUM:
+        case TagType::BYTES:
+            return 2 * sizeof(uint32_t);  // blob_length, indirect_offset
+    }
+    return 0;
+}
+
+bool isBlobTag(Tag tag) {
+    return typeFromTag(tag) == TagType::BIGNUM || typeFromTag(tag) == TagType::BYTES;
+}
+
+// INVALID and unknown tags are skipped by the serializer.
+bool isSerializedTag(Tag tag) {
+    return tag != Tag::INVALID && isKnownTag(tag);
+}
+
+struct FlatLayout {
+    size_t indirect_size;
+    size_t elements_size;
+    size_t element_count;
+
+    size_t total() const { return 3 * sizeof(uint32_t) + indirect_size + elements_size; }
+};
+
+FlatLayout flatLayout(const std::vector<KeyParameter>& params) {
+    FlatLayout layout = {0, 0, 0};
+    for (const auto& param : params) {
+        if (!isSerializedTag(param.tag)) continue;
+        layout.elements_size += sizeof(uint32_t) + flatValueSize(param.tag);
+        if (isBlobTag(param.tag)) layout.indirect_size += param.blob.size();
+        ++layout.element_count;
+    }
+    return layout;
+}
+
+template <typename T>
+uint8_t* appendFlat(uint8_t* buf, const T& value) {
+    memcpy(buf, &value, sizeof(T));
+    return buf + sizeof(T);
+}
+
+template <typename T>
+bool readFlat(const uint8_t** buf_ptr, const uint8_t* end, T* value) {
+    if (end - *buf_ptr < static_cast<ptrdiff_t>(sizeof(T))) return false;
+    memcpy(value, *buf_ptr, sizeof(T));
+    *buf_ptr += sizeof(T);
+    return true;
+}
+
+size_t AuthorizationSet::SerializedSize() const {
+    return flatLayout(data_).total();
+}
+
+uint8_t* AuthorizationSet::Serialize(uint8_t* buf, const uint8_t* end) const {
+    FlatLayout layout = flatLayout(data_);
+    if (layout.indirect_size > std::numeric_limits<uint32_t>::max() ||
+        layout.elements_size > std::numeric_limits<uint32_t>::max() ||
+        layout.total() > std::numeric_limits<uint32_t>::max()) {
+        return nullptr;
+    }
+    if (buf == nullptr || end < buf || static_cast<size_t>(end - buf) < layout.total()) {
+        return nullptr;
+    }
+
+    uint8_t* indirect = appendFlat(buf, static_cast<uint32_t>(layout.indirect_size));
+    uint8_t* elements = indirect + layout.indirect_size;
+    elements = appendFlat(elements, static_cast<uint32_t>(layout.element_count));
+    elements = appendFlat(elements, static_cast<uint32_t>(layout.elements_size));
+
+    uint32_t indirect_offset = 0;
+    for (const auto& param : data_) {
+        if (!isSerializedTag(param.tag)) continue;
+        elements = appendFlat(elements, param.tag);
+        switch (typeFromTag(param.tag)) {
+            case TagType::INVALID:
+                break;
+            case TagType::BOOL:
+                elements = appendFlat(elements, param.f.boolValue);
+                break;
+            case TagType::ENUM:
+            case TagType::ENUM_REP:
+            case TagType::UINT:
+            case TagType::UINT_REP:
+                elements = appendFlat(elements, param.f.integer);
+                break;
+            case TagType::ULONG:
+            case TagType::ULONG_REP:
+                elements = appendFlat(elements, param.f.longInteger);
+                break;
+            case TagType::DATE:
+                elements = appendFlat(elements, param.f.dateTime);
+                break;
+            case TagType::BIGNUM:
+            case TagType::BYTES:
+                elements = appendFlat(elements, static_cast<uint32_t>(param.blob.size()));
+                elements = appendFlat(elements, indirect_offset);
+                if (param.blob.size()) {
+                    memcpy(indirect + indirect_offset, &param.blob[0], param.blob.size());
+                }
+                indirect_offset += param.blob.size();
+                break;
+        }
+    }
+    return elements;
+}
+
+bool AuthorizationSet::Deserialize(const uint8_t** buf_ptr, const uint8_t* end) {
+    AuthorizationSetView view;
+    if (!view.Deserialize(buf_ptr, end)) return false;
+    // Copying the parameters makes deep copies of the blobs referencing the buffer.
+    data_.assign(view.begin(), view.end());
+    RebuildIndex();
+    return true;
+}
+
+bool AuthorizationSetView::Deserialize(const uint8_t** buf_ptr, const uint8_t* end) {
+    params_.clear();
+
+    const uint8_t* buf = *buf_ptr;
+    uint32_t indirect_size = 0;
+    if (!readFlat(&buf, end, &indirect_size)) return false;
+    if (static_cast<size_t>(end - buf) < indirect_size) return false;
+    const uint8_t* indirect = buf;
+    buf += indirect_size;
+
+    uint32_t element_count = 0;
+    uint32_t elements_size = 0;
+    if (!readFlat(&buf, end, &element_count) || !readFlat(&buf, end, &elements_size)) {
+        return false;
+    }
+    if (static_cast<size_t>(end - buf) < elements_size) return false;
+    const uint8_t* elements_end = buf + elements_size;
+
+    // Every entry takes at least the size of its tag, which bounds the reservation.
+    params_.reserve(std::min<size_t>(element_count, elements_size / sizeof(uint32_t)));
+    auto fail = [this] {
+        params_.clear();
+        return false;
+    };
+    for (uint32_t i = 0; i < element_count; ++i) {
+        Tag tag;
+        if (!readFlat(&buf, elements_end, &tag)) return fail();
+        // There are legacy blobs which have invalid tags in them due to a bug during
+        // serialization. They carry no value and are dropped.
+        if (tag == Tag::INVALID) continue;
+        // An unknown tag fails parsing, as its value size is unknown.
+        if (!isKnownTag(tag)) return fail();
+
+        params_.emplace_back();
+        KeyParameter& param = params_.back();
+        param.tag = tag;
+        param.f.longInteger = 0;
+        bool ok = false;
+        switch (typeFromTag(tag)) {
+            case TagType::INVALID:
+                break;
+            case TagType::BOOL:
+                ok = readFlat(&buf, elements_end, &param.f.boolValue);
+                break;
+            case TagType::ENUM:
+            case TagType::ENUM_REP:
+            case TagType::UINT:
+            case TagType::UINT_REP:
+                ok = readFlat(&buf, elements_end, &param.f.integer);
+                break;
+            case TagType::ULONG:
+            case TagType::ULONG_REP:
+                ok = readFlat(&buf, elements_end, &param.f.longInteger);
+                break;
+            case TagType::DATE:
+                ok = readFlat(&buf, elements_end, &param.f.dateTime);
+                break;
+            case TagType::BIGNUM:
+            case TagType::BYTES: {
+                uint32_t blob_length = 0;
+                uint32_t offset = 0;
+                ok = readFlat(&buf, elements_end, &blob_length) &&
+                     readFlat(&buf, elements_end, &offset) && offset <= indirect_size &&
+                     blob_length <= indirect_size - offset;
+                if (ok) {
+                    param.blob.setToExternal(const_cast<uint8_t*>(indirect + offset), blob_length);
+                }
+                break;
+            }
+        }
+        if (!ok) return fail();
+    }
+    // element_count must account for all of the elements.
+    if (buf != elements_end) return fail();
+
+    *buf_ptr = elements_end;
+    return true;
+}
+
+int AuthorizationSetView::find(Tag tag, int begin) const {
+    for (size_t i = begin + 1; i < params_.size(); ++i) {
+        if (params_[i].tag == tag) return i;
+    }
+    return -1;
 }
 
 AuthorizationSetBuilder& AuthorizationSetBuilder::RsaKey(uint32_t key_size,
@@ -0,0 +1,469 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <keymasterV4_0/authorization_set.h>
+#include <keymasterV4_0/key_param_output.h>
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace test {
+
+namespace {
+
+hidl_vec<uint8_t> bytes(const std::string& str) {
+    return hidl_vec<uint8_t>(str.begin(), str.end());
+}
+
+// A set with a parameter of every serialized type, repeated tags, and an empty blob.
+AuthorizationSet makeSet() {
+    return AuthorizationSetBuilder()
+        .RsaSigningKey(2048, 65537)
+        .Digest(Digest::SHA_2_256, Digest::NONE)
+        .Padding(PaddingMode::RSA_PSS)
+        .Authorization(TAG_NO_AUTH_REQUIRED)
+        .Authorization(TAG_USER_SECURE_ID, 0x1122334455667788ull)
+        .Authorization(TAG_USER_SECURE_ID, 42ull)
+        .Authorization(TAG_ACTIVE_DATETIME, 1536000000000ull)
+        .Authorization(TAG_APPLICATION_ID, bytes("client id"))
+        .Authorization(TAG_APPLICATION_DATA, bytes(""))
+        .Authorization(TAG_ATTESTATION_CHALLENGE, bytes("challenge"));
+}
+
+std::vector<uint8_t> streamSerialize(const AuthorizationSet& set) {
+    std::stringstream stream;
+    set.Serialize(&stream);
+    std::string str = stream.str();
+    return std::vector<uint8_t>(str.begin(), str.end());
+}
+
+std::vector<uint8_t> flatSerialize(const AuthorizationSet& set) {
+    std::vector<uint8_t> buf(set.SerializedSize());
+    EXPECT_EQ(buf.data() + buf.size(), set.Serialize(buf.data(), buf.data() + buf.size()));
+    return buf;
+}
+
+template <typename Set>
+void expectSameParams(const AuthorizationSet& expected, const Set& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i], actual[i]) << "param " << i;
+    }
+}
+
+// The linear implementations that the sorted and merge-based ones replaced, as a reference to
+// compare them against.
+namespace reference {
+
+bool keyParamLess(const KeyParameter& a, const KeyParameter& b) {
+    if (a.tag != b.tag) return a.tag < b.tag;
+    int retval;
+    switch (typeFromTag(a.tag)) {
+        case TagType::INVALID:
+        case TagType::BOOL:
+            return false;
+        case TagType::ENUM:
+        case TagType::ENUM_REP:
+        case TagType::UINT:
+        case TagType::UINT_REP:
+            return a.f.integer < b.f.integer;
+        case TagType::ULONG:
+        case TagType::ULONG_REP:
+            return a.f.longInteger < b.f.longInteger;
+        case TagType::DATE:
+            return a.f.dateTime < b.f.dateTime;
+        case TagType::BIGNUM:
+        case TagType::BYTES:
+            if (a.blob.size() == 0) return b.blob.size() != 0;
+            if (b.blob.size() == 0) return false;
+            retval = memcmp(&a.blob[0], &b.blob[0], std::min(a.blob.size(), b.blob.size()));
+            if (retval == 0) return a.blob.size() < b.blob.size();
+            return retval < 0;
+    }
+    return false;
+}
+
+bool keyParamEqual(const KeyParameter& a, const KeyParameter& b) {
+    return !keyParamLess(a, b) && !keyParamLess(b, a);
+}
+
+int find(const std::vector<KeyParameter>& data, Tag tag, int begin = -1) {
+    auto iter = data.begin() + (1 + begin);
+    while (iter != data.end() && iter->tag != tag) ++iter;
+    if (iter != data.end()) return iter - data.begin();
+    return -1;
+}
+
+void Deduplicate(std::vector<KeyParameter>* data) {
+    if (data->empty()) return;
+
+    std::sort(data->begin(), data->end(), keyParamLess);
+    std::vector<KeyParameter> result;
+
+    auto curr = data->begin();
+    auto prev = curr++;
+    for (; curr != data->end(); ++prev, ++curr) {
+        if (prev->tag == Tag::INVALID) continue;
+
+        if (!keyParamEqual(*prev, *curr)) {
+            result.push_back(std::move(*prev));
+        }
+    }
+    result.push_back(std::move(*prev));
+
+    std::swap(*data, result);
+}
+
+void Union(std::vector<KeyParameter>* data, const std::vector<KeyParameter>& other) {
+    data->insert(data->end(), other.begin(), other.end());
+    Deduplicate(data);
+}
+
+void Subtract(std::vector<KeyParameter>* data, const std::vector<KeyParameter>& other) {
+    Deduplicate(data);
+
+    for (const auto& param : other) {
+        int pos = -1;
+        do {
+            pos = find(*data, param.tag, pos);
+            if (pos != -1 && keyParamEqual(param, (*data)[pos])) {
+                data->erase(data->begin() + pos);
+                break;
+            }
+        } while (pos != -1);
+    }
+}
+
+}  // namespace reference
+
+// Tags of every kind of value, repeatable or not
+const Tag kRandomTags[] = {
+        Tag::INVALID,        Tag::PURPOSE,          Tag::ALGORITHM,      Tag::KEY_SIZE,
+        Tag::USER_SECURE_ID, Tag::NO_AUTH_REQUIRED, Tag::ACTIVE_DATETIME, Tag::APPLICATION_ID,
+};
+
+// Parameters drawn from few values, so that sets hold repeated tags, the same tag with different
+// values, and exact duplicates.
+std::vector<KeyParameter> randomParams(std::mt19937* rng) {
+    std::uniform_int_distribution<size_t> sizeDist(0, 12);
+    std::uniform_int_distribution<size_t> tagDist(0, std::size(kRandomTags) - 1);
+    std::uniform_int_distribution<uint32_t> valueDist(0, 2);
+
+    std::vector<KeyParameter> params(sizeDist(*rng));
+    for (auto& param : params) {
+        param.tag = kRandomTags[tagDist(*rng)];
+        uint32_t value = valueDist(*rng);
+        switch (typeFromTag(param.tag)) {
+            case TagType::BOOL:
+                param.f.boolValue = true;
+                break;
+            case TagType::ULONG_REP:
+                param.f.longInteger = value;
+                break;
+            case TagType::DATE:
+                param.f.dateTime = value;
+                break;
+            case TagType::BYTES:
+                param.blob = bytes(std::string(value, 'a'));
+                break;
+            default:
+                param.f.integer = value;
+                break;
+        }
+    }
+    return params;
+}
+
+AuthorizationSet toSet(const std::vector<KeyParameter>& params) {
+    AuthorizationSet set;
+    for (const auto& param : params) set.push_back(param);
+    return set;
+}
+
+void expectEquivalent(const std::vector<KeyParameter>& expected, const AuthorizationSet& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i], actual[i]) << "param " << i;
+    }
+    for (Tag tag : kRandomTags) {
+        size_t count = 0;
+        int pos = -1;
+        do {
+            int next = reference::find(expected, tag, pos);
+            EXPECT_EQ(next, actual.find(tag, pos)) << "tag " << tag << " after " << pos;
+            pos = next;
+            if (pos != -1) ++count;
+        } while (pos != -1);
+        EXPECT_EQ(count, actual.GetTagCount(tag)) << "tag " << tag;
+        EXPECT_EQ(count != 0, actual.Contains(tag)) << "tag " << tag;
+    }
+}
+
+}  // namespace
+
+TEST(AuthorizationSetSerializationTest, FlatMatchesStream) {
+    AuthorizationSet set = makeSet();
+    std::vector<uint8_t> stream = streamSerialize(set);
+    EXPECT_EQ(stream.size(), set.SerializedSize());
+    EXPECT_EQ(stream, flatSerialize(set));
+
+    AuthorizationSet empty;
+    EXPECT_EQ(streamSerialize(empty), flatSerialize(empty));
+}
+
+TEST(AuthorizationSetSerializationTest, FlatSkipsInvalidTags) {
+    AuthorizationSet set = makeSet();
+    KeyParameter invalid;
+    invalid.tag = Tag::INVALID;
+    set.push_back(invalid);
+    EXPECT_EQ(streamSerialize(set), flatSerialize(set));
+}
+
+TEST(AuthorizationSetSerializationTest, FlatRejectsShortBuffer) {
+    AuthorizationSet set = makeSet();
+    std::vector<uint8_t> buf(set.SerializedSize() - 1);
+    EXPECT_EQ(nullptr, set.Serialize(buf.data(), buf.data() + buf.size()));
+}
+
+TEST(AuthorizationSetSerializationTest, StreamReadsFlat) {
+    AuthorizationSet set = makeSet();
+    std::vector<uint8_t> buf = flatSerialize(set);
+    std::stringstream stream(std::string(buf.begin(), buf.end()));
+    AuthorizationSet deserialized;
+    deserialized.Deserialize(&stream);
+    EXPECT_FALSE(stream.bad());
+    expectSameParams(set, deserialized);
+}
+
+TEST(AuthorizationSetSerializationTest, ViewReadsStream) {
+    AuthorizationSet set = makeSet();
+    std::vector<uint8_t> buf = streamSerialize(set);
+    const uint8_t* pos = buf.data();
+    AuthorizationSetView view;
+    ASSERT_TRUE(view.Deserialize(&pos, buf.data() + buf.size()));
+    EXPECT_EQ(buf.data() + buf.size(), pos);
+    expectSameParams(set, view);
+
+    // Blobs reference the input buffer instead of copies of it.
+    auto appId = view.GetTagValue(TAG_APPLICATION_ID);
+    ASSERT_TRUE(appId.isOk());
+    EXPECT_GE(appId.value().data(), buf.data());
+    EXPECT_LT(appId.value().data(), buf.data() + buf.size());
+
+    // Copies own their blobs.
+    AuthorizationSet copy(view.hidl_data());
+    buf.assign(buf.size(), 0);
+    expectSameParams(set, copy);
+}
+
+TEST(AuthorizationSetSerializationTest, DeserializeFlat) {
+    AuthorizationSet set = makeSet();
+    std::vector<uint8_t> buf = flatSerialize(set);
+    const uint8_t* pos = buf.data();
+    AuthorizationSet deserialized;
+    ASSERT_TRUE(deserialized.Deserialize(&pos, buf.data() + buf.size()));
+    buf.assign(buf.size(), 0);
+    expectSameParams(set, deserialized);
+    EXPECT_EQ(2U, deserialized.GetTagCount(Tag::USER_SECURE_ID));
+}
+
+TEST(AuthorizationSetSerializationTest, ViewDropsLegacyInvalidTags) {
+    // Two entries, the first of them INVALID, with no indirect data.
+    std::vector<uint8_t> buf;
+    auto append = [&buf](uint32_t value) {
+        auto bytes = reinterpret_cast<const uint8_t*>(&value);
+        buf.insert(buf.end(), bytes, bytes + sizeof(value));
+    };
+    append(0);  // indirect_size
+    append(2);  // element_count
+    append(3 * sizeof(uint32_t));  // elements_size
+    append(static_cast<uint32_t>(Tag::INVALID));
+    append(static_cast<uint32_t>(Tag::KEY_SIZE));
+    append(256);
+
+    const uint8_t* pos = buf.data();
+    AuthorizationSetView view;
+    ASSERT_TRUE(view.Deserialize(&pos, buf.data() + buf.size()));
+    ASSERT_EQ(1U, view.size());
+    auto keySize = view.GetTagValue(TAG_KEY_SIZE);
+    ASSERT_TRUE(keySize.isOk());
+    EXPECT_EQ(256U, keySize.value());
+}
+
+TEST(AuthorizationSetSerializationTest, ViewRejectsTruncatedInput) {
+    AuthorizationSet set = makeSet();
+    std::vector<uint8_t> buf = flatSerialize(set);
+    for (size_t size = 0; size < buf.size(); ++size) {
+        const uint8_t* pos = buf.data();
+        AuthorizationSetView view;
+        EXPECT_FALSE(view.Deserialize(&pos, buf.data() + size)) << "size " << size;
+        EXPECT_EQ(buf.data(), pos);
+        EXPECT_TRUE(view.empty());
+    }
+}
+
+TEST(AuthorizationSetSerializationTest, ViewRejectsBlobOutsideIndirectData) {
+    AuthorizationSet set = AuthorizationSetBuilder().Authorization(TAG_APPLICATION_ID, bytes("id"));
+    std::vector<uint8_t> buf = flatSerialize(set);
+    // The indirect_offset of the only entry is the last word of the buffer.
+    uint32_t offset = 1;
+    memcpy(buf.data() + buf.size() - sizeof(offset), &offset, sizeof(offset));
+    const uint8_t* pos = buf.data();
+    AuthorizationSetView view;
+    EXPECT_FALSE(view.Deserialize(&pos, buf.data() + buf.size()));
+}
+
+TEST(AuthorizationSetIndexTest, LookupsSeeTagsChangedThroughIndexing) {
+    AuthorizationSet set = makeSet();
+    ASSERT_EQ(2u, set.GetTagCount(Tag::DIGEST));
+    int pos = set.find(Tag::PADDING);
+    ASSERT_NE(-1, pos);
+
+    set[pos].tag = Tag::DIGEST;
+    EXPECT_EQ(3u, set.GetTagCount(Tag::DIGEST));
+    EXPECT_EQ(-1, set.find(Tag::PADDING));
+
+    // The next modification rebuilds the index
+    set.push_back(TAG_PADDING, PaddingMode::NONE);
+    EXPECT_EQ(3u, set.GetTagCount(Tag::DIGEST));
+    EXPECT_EQ(static_cast<int>(set.size()) - 1, set.find(Tag::PADDING));
+    EXPECT_TRUE(set.erase(set.find(Tag::PADDING)));
+    EXPECT_EQ(-1, set.find(Tag::PADDING));
+    EXPECT_EQ(3u, set.GetTagCount(Tag::DIGEST));
+}
+
+TEST(AuthorizationSetIndexTest, ReadingThroughIndexingKeepsLookupsCorrect) {
+    AuthorizationSet set = makeSet();
+    size_t secureIds = 0;
+    for (size_t i = 0; i < set.size(); ++i) {
+        KeyParameter& param = set[i];
+        if (param.tag == Tag::USER_SECURE_ID) ++secureIds;
+    }
+    EXPECT_EQ(2u, secureIds);
+    EXPECT_EQ(2u, set.GetTagCount(Tag::USER_SECURE_ID));
+    EXPECT_TRUE(set.Contains(Tag::APPLICATION_ID));
+    EXPECT_FALSE(set.Contains(Tag::NONCE));
+}
+
+TEST(AuthorizationSetIndexTest, UnionOfSortedSets) {
+    AuthorizationSet first =
+            AuthorizationSetBuilder().Authorization(TAG_NO_AUTH_REQUIRED).Digest(Digest::SHA_2_256);
+    first.Sort();
+    AuthorizationSet second = AuthorizationSetBuilder().Digest(Digest::NONE, Digest::SHA_2_256);
+    second.Sort();
+
+    first.Union(second);
+    EXPECT_EQ(3u, first.size());
+    EXPECT_EQ(2u, first.GetTagCount(Tag::DIGEST));
+    EXPECT_EQ(1u, first.GetTagCount(Tag::NO_AUTH_REQUIRED));
+    EXPECT_TRUE(first.Contains(TAG_DIGEST, Digest::NONE));
+}
+
+TEST(AuthorizationSetIndexTest, LookupsSeeTagsChangedAfterManyReferences) {
+    AuthorizationSet set = makeSet();
+    int pos = set.find(Tag::ATTESTATION_CHALLENGE);
+    ASSERT_EQ(static_cast<int>(set.size()) - 1, pos);
+
+    // Take a reference to the challenge first, then to every other element
+    std::vector<KeyParameter*> refs;
+    for (int i = pos; i >= 0; --i) refs.push_back(&set[i]);
+    ASSERT_GT(refs.size(), 8u);
+    refs.front()->tag = Tag::APPLICATION_ID;
+    EXPECT_EQ(-1, set.find(Tag::ATTESTATION_CHALLENGE));
+    EXPECT_FALSE(set.Contains(Tag::ATTESTATION_CHALLENGE));
+    EXPECT_EQ(2u, set.GetTagCount(Tag::APPLICATION_ID));
+    EXPECT_EQ(pos, set.find(Tag::APPLICATION_ID, set.find(Tag::APPLICATION_ID)));
+
+    // Erasing rebuilds the index from the changed tags
+    EXPECT_TRUE(set.erase(0));
+    EXPECT_EQ(2u, set.GetTagCount(Tag::APPLICATION_ID));
+    EXPECT_EQ(pos - 1, set.find(Tag::APPLICATION_ID, set.find(Tag::APPLICATION_ID)));
+    EXPECT_FALSE(set.Contains(Tag::ATTESTATION_CHALLENGE));
+}
+
+TEST(AuthorizationSetEquivalenceTest, Deduplicate) {
+    std::mt19937 rng(1);
+    for (int i = 0; i < 1000; ++i) {
+        std::vector<KeyParameter> params = randomParams(&rng);
+        AuthorizationSet set = toSet(params);
+        reference::Deduplicate(&params);
+        set.Deduplicate();
+        expectEquivalent(params, set);
+    }
+}
+
+TEST(AuthorizationSetEquivalenceTest, Union) {
+    std::mt19937 rng(2);
+    for (int i = 0; i < 1000; ++i) {
+        std::vector<KeyParameter> params = randomParams(&rng);
+        std::vector<KeyParameter> other = randomParams(&rng);
+        AuthorizationSet set = toSet(params);
+        AuthorizationSet otherSet = toSet(other);
+        // Half of the time, both are sorted as they would be after earlier calls
+        if (i % 2) {
+            set.Sort();
+            otherSet.Sort();
+        }
+        reference::Union(&params, other);
+        set.Union(otherSet);
+        expectEquivalent(params, set);
+    }
+}
+
+TEST(AuthorizationSetEquivalenceTest, Subtract) {
+    std::mt19937 rng(3);
+    for (int i = 0; i < 1000; ++i) {
+        std::vector<KeyParameter> params = randomParams(&rng);
+        std::vector<KeyParameter> other = randomParams(&rng);
+        // Make some of the other set match
+        if (i % 2 && !params.empty()) other.push_back(params[i % params.size()]);
+        AuthorizationSet set = toSet(params);
+        reference::Subtract(&params, other);
+        set.Subtract(toSet(other));
+        expectEquivalent(params, set);
+    }
+}
+
+TEST(AuthorizationSetEquivalenceTest, Erase) {
+    std::mt19937 rng(4);
+    for (int i = 0; i < 1000; ++i) {
+        std::vector<KeyParameter> params = randomParams(&rng);
+        AuthorizationSet set = toSet(params);
+        while (!params.empty()) {
+            size_t pos = rng() % params.size();
+            params.erase(params.begin() + pos);
+            EXPECT_TRUE(set.erase(pos));
+            expectEquivalent(params, set);
+        }
+        EXPECT_FALSE(set.erase(0));
+    }
+}
+
+}  // namespace test
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
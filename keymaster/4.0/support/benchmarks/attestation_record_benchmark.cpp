@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "attestation_record_test_utils.h"
+
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+
+using namespace ::android::hardware::keymaster::V4_0;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::keymaster::V4_0::test::AttestationRecordEncoder;
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace legacy {
+
+// The previous, ASN.1 template based, implementation in legacy_attestation_record.cpp.
+ErrorCode parse_attestation_record(const uint8_t* asn1_key_desc, size_t asn1_key_desc_len,
+                                   uint32_t* attestation_version,
+                                   SecurityLevel* attestation_security_level,
+                                   uint32_t* keymaster_version,
+                                   SecurityLevel* keymaster_security_level,
+                                   hidl_vec<uint8_t>* attestation_challenge,
+                                   AuthorizationSet* software_enforced,
+                                   AuthorizationSet* tee_enforced, hidl_vec<uint8_t>* unique_id);
+
+}  // namespace legacy
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
+
+namespace {
+
+typedef ErrorCode (*ParseFn)(const uint8_t*, size_t, uint32_t*, SecurityLevel*, uint32_t*,
+                             SecurityLevel*, hidl_vec<uint8_t>*, AuthorizationSet*,
+                             AuthorizationSet*, hidl_vec<uint8_t>*);
+
+std::vector<uint8_t> typicalRecord() {
+    AuthorizationSet software_enforced, tee_enforced;
+    AttestationRecordEncoder::typicalAuthLists(&software_enforced, &tee_enforced);
+    hidl_vec<uint8_t> challenge(32);
+    return AttestationRecordEncoder::encode(challenge, software_enforced, tee_enforced);
+}
+
+// Parses the record and returns the number of parameters found, or -1 on failure.
+int parseWith(ParseFn parse, const std::vector<uint8_t>& der, AuthorizationSet* software_enforced,
+              AuthorizationSet* tee_enforced) {
+    uint32_t attestation_version, keymaster_version;
+    SecurityLevel attestation_security_level, keymaster_security_level;
+    hidl_vec<uint8_t> attestation_challenge, unique_id;
+    ErrorCode error = parse(der.data(), der.size(), &attestation_version,
+                            &attestation_security_level, &keymaster_version,
+                            &keymaster_security_level, &attestation_challenge, software_enforced,
+                            tee_enforced, &unique_id);
+    if (error != ErrorCode::OK) return -1;
+    return software_enforced->size() + tee_enforced->size();
+}
+
+bool sameParams(AuthorizationSet a, AuthorizationSet b) {
+    a.Sort();
+    b.Sort();
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (!(a[i] == b[i])) return false;
+    }
+    return true;
+}
+
+void parseRecords(benchmark::State& state, ParseFn parse) {
+    std::vector<uint8_t> der = typicalRecord();
+
+    // Both parsers must agree on the record before they are compared.
+    AuthorizationSet sw, tee, legacy_sw, legacy_tee;
+    CHECK(parseWith(parse, der, &sw, &tee) >= 0);
+    CHECK(parseWith(legacy::parse_attestation_record, der, &legacy_sw, &legacy_tee) >= 0);
+    CHECK(sameParams(sw, legacy_sw) && sameParams(tee, legacy_tee));
+
+    for (auto _ : state) {
+        AuthorizationSet software_enforced, tee_enforced;
+        benchmark::DoNotOptimize(parseWith(parse, der, &software_enforced, &tee_enforced));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * der.size());
+}
+
+}  // namespace
+
+static void BM_ParseAsn1Templates(benchmark::State& state) {
+    parseRecords(state, legacy::parse_attestation_record);
+}
+BENCHMARK(BM_ParseAsn1Templates);
+
+static void BM_ParseCbs(benchmark::State& state) {
+    parseRecords(state, parse_attestation_record);
+}
+BENCHMARK(BM_ParseCbs);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <keymasterV4_0/authorization_set.h>
+
+#include <benchmark/benchmark.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace ::android::hardware::keymaster::V4_0;
+
+namespace {
+
+// Builds a key characteristics sized set with the mix of tags a key description usually carries:
+// a few scalar authorizations followed by repeated purposes, digests, paddings and block modes.
+AuthorizationSet makeSet(int size) {
+    AuthorizationSetBuilder builder;
+    builder.RsaSigningKey(2048, 65537)
+        .Authorization(TAG_NO_AUTH_REQUIRED)
+        .Authorization(TAG_OS_VERSION, 90000u)
+        .Authorization(TAG_OS_PATCHLEVEL, 201809u)
+        .Authorization(TAG_CREATION_DATETIME, 1536000000000ull)
+        .Authorization(TAG_ORIGIN, KeyOrigin::GENERATED);
+    static const Digest kDigests[] = {Digest::NONE,      Digest::MD5,       Digest::SHA1,
+                                      Digest::SHA_2_224, Digest::SHA_2_256, Digest::SHA_2_384,
+                                      Digest::SHA_2_512};
+    static const PaddingMode kPaddings[] = {PaddingMode::NONE, PaddingMode::RSA_OAEP,
+                                            PaddingMode::RSA_PSS,
+                                            PaddingMode::RSA_PKCS1_1_5_ENCRYPT,
+                                            PaddingMode::RSA_PKCS1_1_5_SIGN, PaddingMode::PKCS7};
+    for (int i = 0; static_cast<int>(builder.size()) < size; ++i) {
+        switch (i % 3) {
+            case 0:
+                builder.Authorization(TAG_DIGEST, kDigests[(i / 3) % 7]);
+                break;
+            case 1:
+                builder.Authorization(TAG_PADDING, kPaddings[(i / 3) % 6]);
+                break;
+            case 2:
+                builder.Authorization(TAG_USER_SECURE_ID, static_cast<uint64_t>(i));
+                break;
+        }
+    }
+    // Put the scalar tags looked up below at the end, where a linear scan finds them last.
+    builder.Authorization(TAG_USAGE_EXPIRE_DATETIME, 1636000000000ull);
+    return std::move(builder);
+}
+
+// The lookups done when a keymaster client checks a key's characteristics. The last one is absent.
+template <typename LookupFn>
+void lookupAll(const AuthorizationSet& set, LookupFn lookup) {
+    benchmark::DoNotOptimize(lookup(set, Tag::ALGORITHM));
+    benchmark::DoNotOptimize(lookup(set, Tag::KEY_SIZE));
+    benchmark::DoNotOptimize(lookup(set, Tag::ORIGIN));
+    benchmark::DoNotOptimize(lookup(set, Tag::USAGE_EXPIRE_DATETIME));
+    benchmark::DoNotOptimize(lookup(set, Tag::ROLLBACK_RESISTANCE));
+}
+
+// The lookup the set did before it was indexed.
+int linearFind(const AuthorizationSet& set, Tag tag) {
+    for (size_t i = 0; i < set.size(); ++i) {
+        if (set[i].tag == tag) return i;
+    }
+    return -1;
+}
+
+}  // namespace
+
+static void BM_FindLinear(benchmark::State& state) {
+    AuthorizationSet set = makeSet(state.range(0));
+    for (auto _ : state) {
+        lookupAll(set, linearFind);
+    }
+    state.SetItemsProcessed(state.iterations() * 5);
+}
+BENCHMARK(BM_FindLinear)->Arg(20)->Arg(40)->Arg(60);
+
+static void BM_FindIndexed(benchmark::State& state) {
+    AuthorizationSet set = makeSet(state.range(0));
+    for (auto _ : state) {
+        lookupAll(set, [](const AuthorizationSet& s, Tag tag) { return s.find(tag); });
+    }
+    state.SetItemsProcessed(state.iterations() * 5);
+}
+BENCHMARK(BM_FindIndexed)->Arg(20)->Arg(40)->Arg(60);
+
+static void BM_GetTagCount(benchmark::State& state) {
+    AuthorizationSet set = makeSet(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(set.GetTagCount(Tag::DIGEST));
+        benchmark::DoNotOptimize(set.GetTagCount(Tag::USER_SECURE_ID));
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_GetTagCount)->Arg(20)->Arg(40)->Arg(60);
+
+static void BM_Contains(benchmark::State& state) {
+    AuthorizationSet set = makeSet(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(set.Contains(TAG_PURPOSE, KeyPurpose::VERIFY));
+        benchmark::DoNotOptimize(set.Contains(TAG_PADDING, PaddingMode::PKCS7));
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_Contains)->Arg(20)->Arg(40)->Arg(60);
+
+static void BM_Build(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(makeSet(state.range(0)));
+    }
+}
+BENCHMARK(BM_Build)->Arg(20)->Arg(40)->Arg(60);
+
+static void BM_Subtract(benchmark::State& state) {
+    AuthorizationSet base = makeSet(state.range(0));
+    AuthorizationSet other = makeSet(state.range(0) / 2);
+    for (auto _ : state) {
+        AuthorizationSet set = base;
+        set.Subtract(other);
+        benchmark::DoNotOptimize(set.size());
+    }
+}
+BENCHMARK(BM_Subtract)->Arg(20)->Arg(40)->Arg(60);
+
+static void BM_Union(benchmark::State& state) {
+    AuthorizationSet base = makeSet(state.range(0));
+    base.Deduplicate();
+    AuthorizationSet other = makeSet(state.range(0) / 2);
+    other.Deduplicate();
+    for (auto _ : state) {
+        AuthorizationSet set = base;
+        set.Union(other);
+        benchmark::DoNotOptimize(set.size());
+    }
+}
+BENCHMARK(BM_Union)->Arg(20)->Arg(40)->Arg(60);
+
+// A key characteristics sized set with the blobs a key carries, used to measure serialization.
+static AuthorizationSet makeSerializationSet(int size) {
+    static const std::string kApplicationId(64, 'i');
+    static const std::string kApplicationData(256, 'd');
+    AuthorizationSet set = makeSet(size - 2);
+    set.push_back(AuthorizationSetBuilder()
+                      .Authorization(TAG_APPLICATION_ID, kApplicationId.data(),
+                                     kApplicationId.size())
+                      .Authorization(TAG_APPLICATION_DATA, kApplicationData.data(),
+                                     kApplicationData.size()));
+    return set;
+}
+
+static void BM_SerializeStream(benchmark::State& state) {
+    AuthorizationSet set = makeSerializationSet(state.range(0));
+    size_t bytes = 0;
+    for (auto _ : state) {
+        std::stringstream stream;
+        set.Serialize(&stream);
+        bytes += stream.tellp();
+    }
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_SerializeStream)->Arg(20)->Arg(40)->Arg(60);
+
+static void BM_SerializeFlat(benchmark::State& state) {
+    AuthorizationSet set = makeSerializationSet(state.range(0));
+    std::vector<uint8_t> buf;
+    size_t bytes = 0;
+    for (auto _ : state) {
+        buf.resize(set.SerializedSize());
+        benchmark::DoNotOptimize(set.Serialize(buf.data(), buf.data() + buf.size()));
+        bytes += buf.size();
+    }
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_SerializeFlat)->Arg(20)->Arg(40)->Arg(60);
+
+static void BM_DeserializeStream(benchmark::State& state) {
+    std::stringstream serialized;
+    makeSerializationSet(state.range(0)).Serialize(&serialized);
+    std::string buf = serialized.str();
+    for (auto _ : state) {
+        std::stringstream stream(buf);
+        AuthorizationSet set;
+        set.Deserialize(&stream);
+        benchmark::DoNotOptimize(set.size());
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_DeserializeStream)->Arg(20)->Arg(40)->Arg(60);
+
+static void BM_DeserializeFlat(benchmark::State& state) {
+    AuthorizationSet source = makeSerializationSet(state.range(0));
+    std::vector<uint8_t> buf(source.SerializedSize());
+    source.Serialize(buf.data(), buf.data() + buf.size());
+    for (auto _ : state) {
+        const uint8_t* pos = buf.data();
+        AuthorizationSet set;
+        benchmark::DoNotOptimize(set.Deserialize(&pos, buf.data() + buf.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_DeserializeFlat)->Arg(20)->Arg(40)->Arg(60);
+
+static void BM_DeserializeView(benchmark::State& state) {
+    AuthorizationSet source = makeSerializationSet(state.range(0));
+    std::vector<uint8_t> buf(source.SerializedSize());
+    source.Serialize(buf.data(), buf.data() + buf.size());
+    AuthorizationSetView view;
+    for (auto _ : state) {
+        const uint8_t* pos = buf.data();
+        benchmark::DoNotOptimize(view.Deserialize(&pos, buf.data() + buf.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_DeserializeView)->Arg(20)->Arg(40)->Arg(60);
+
+BENCHMARK_MAIN();
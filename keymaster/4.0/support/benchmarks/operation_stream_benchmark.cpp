@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <keymasterV4_0/Keymaster4.h>
+#include <keymasterV4_0/KeymasterOperationStream.h>
+
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace ::android::hardware::keymaster::V4_0;
+using ::android::sp;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::keymaster::V4_0::support::Keymaster4;
+using ::android::hardware::keymaster::V4_0::support::KeymasterOperationStream;
+
+namespace {
+
+constexpr size_t kPayloadSize = 4 * 1024 * 1024;
+
+// Stands in for a software keymaster behind binder: every call costs a fixed round trip, and the
+// "cipher" is a byte-wise XOR, so the throughput measured is dominated by how the client drives
+// the operation rather than by the cryptography.
+class SoftKeymasterDevice : public IKeymasterDevice {
+   public:
+    static constexpr auto kRoundTrip = std::chrono::microseconds(100);
+
+    Return<void> getHardwareInfo(getHardwareInfo_cb _hidl_cb) override {
+        _hidl_cb(SecurityLevel::SOFTWARE, "SoftKeymasterDevice", "Benchmark");
+        return Void();
+    }
+    Return<void> getHmacSharingParameters(getHmacSharingParameters_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, HmacSharingParameters());
+        return Void();
+    }
+    Return<void> computeSharedHmac(const hidl_vec<HmacSharingParameters>&,
+                                   computeSharedHmac_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, hidl_vec<uint8_t>());
+        return Void();
+    }
+    Return<void> verifyAuthorization(uint64_t, const hidl_vec<KeyParameter>&,
+                                     const HardwareAuthToken&,
+                                     verifyAuthorization_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, VerificationToken());
+        return Void();
+    }
+    Return<ErrorCode> addRngEntropy(const hidl_vec<uint8_t>&) override {
+        return ErrorCode::UNIMPLEMENTED;
+    }
+    Return<void> generateKey(const hidl_vec<KeyParameter>&, generateKey_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, hidl_vec<uint8_t>(), KeyCharacteristics());
+        return Void();
+    }
+    Return<void> getKeyCharacteristics(const hidl_vec<uint8_t>&, const hidl_vec<uint8_t>&,
+                                       const hidl_vec<uint8_t>&,
+                                       getKeyCharacteristics_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, KeyCharacteristics());
+        return Void();
+    }
+    Return<void> importKey(const hidl_vec<KeyParameter>&, KeyFormat, const hidl_vec<uint8_t>&,
+                           importKey_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, hidl_vec<uint8_t>(), KeyCharacteristics());
+        return Void();
+    }
+    Return<void> importWrappedKey(const hidl_vec<uint8_t>&, const hidl_vec<uint8_t>&,
+                                  const hidl_vec<uint8_t>&, const hidl_vec<KeyParameter>&,
+                                  uint64_t, uint64_t, importWrappedKey_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, hidl_vec<uint8_t>(), KeyCharacteristics());
+        return Void();
+    }
+    Return<void> exportKey(KeyFormat, const hidl_vec<uint8_t>&, const hidl_vec<uint8_t>&,
+                           const hidl_vec<uint8_t>&, exportKey_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, hidl_vec<uint8_t>());
+        return Void();
+    }
+    Return<void> attestKey(const hidl_vec<uint8_t>&, const hidl_vec<KeyParameter>&,
+                           attestKey_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, hidl_vec<hidl_vec<uint8_t>>());
+        return Void();
+    }
+    Return<void> upgradeKey(const hidl_vec<uint8_t>&, const hidl_vec<KeyParameter>&,
+                            upgradeKey_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, hidl_vec<uint8_t>());
+        return Void();
+    }
+    Return<ErrorCode> deleteKey(const hidl_vec<uint8_t>&) override {
+        return ErrorCode::UNIMPLEMENTED;
+    }
+    Return<ErrorCode> deleteAllKeys() override { return ErrorCode::UNIMPLEMENTED; }
+    Return<ErrorCode> destroyAttestationIds() override { return ErrorCode::UNIMPLEMENTED; }
+
+    Return<void> begin(KeyPurpose, const hidl_vec<uint8_t>& key, const hidl_vec<KeyParameter>&,
+                       const HardwareAuthToken&, begin_cb _hidl_cb) override {
+        std::this_thread::sleep_for(kRoundTrip);
+        key_ = key.size() ? key[0] : 0;
+        _hidl_cb(ErrorCode::OK, hidl_vec<KeyParameter>(), ++operationHandle_);
+        return Void();
+    }
+    Return<void> update(uint64_t, const hidl_vec<KeyParameter>&, const hidl_vec<uint8_t>& input,
+                        const HardwareAuthToken&, const VerificationToken&,
+                        update_cb _hidl_cb) override {
+        std::this_thread::sleep_for(kRoundTrip);
+        output_.resize(input.size());
+        for (size_t i = 0; i < input.size(); ++i) output_[i] = input[i] ^ key_;
+        _hidl_cb(ErrorCode::OK, input.size(), hidl_vec<KeyParameter>(), output_);
+        return Void();
+    }
+    Return<void> finish(uint64_t, const hidl_vec<KeyParameter>&, const hidl_vec<uint8_t>& input,
+                        const hidl_vec<uint8_t>&, const HardwareAuthToken&,
+                        const VerificationToken&, finish_cb _hidl_cb) override {
+        std::this_thread::sleep_for(kRoundTrip);
+        output_.resize(input.size());
+        for (size_t i = 0; i < input.size(); ++i) output_[i] = input[i] ^ key_;
+        _hidl_cb(ErrorCode::OK, hidl_vec<KeyParameter>(), output_);
+        return Void();
+    }
+    Return<ErrorCode> abort(uint64_t) override { return ErrorCode::OK; }
+
+   private:
+    uint8_t key_ = 0;
+    uint64_t operationHandle_ = 0;
+    hidl_vec<uint8_t> output_;
+};
+
+// Prepares input the way a client reading and framing a file would: a copy plus a pass over the
+// data.
+size_t prepareInput(const std::vector<uint8_t>& payload, size_t* offset, uint8_t* buffer,
+                    size_t size) {
+    size = std::min(size, payload.size() - *offset);
+    memcpy(buffer, payload.data() + *offset, size);
+    uint32_t checksum = 0;
+    for (size_t i = 0; i < size; ++i) checksum = checksum * 31 + buffer[i];
+    benchmark::DoNotOptimize(checksum);
+    *offset += size;
+    return size;
+}
+
+AuthorizationSet operationParams() {
+    return AuthorizationSetBuilder().BlockMode(BlockMode::CTR).Padding(PaddingMode::NONE);
+}
+
+}  // namespace
+
+// The way clients drive an operation without the helper: prepare a chunk, send it, wait for the
+// result, and repeat, with a freshly allocated input buffer and the auth token on every call.
+static void BM_SequentialUpdates(benchmark::State& state) {
+    sp<Keymaster4> keymasterRef = new Keymaster4(new SoftKeymasterDevice(), "default");
+    Keymaster4& keymaster = *keymasterRef;
+    std::vector<uint8_t> payload(kPayloadSize, 0x5a);
+    hidl_vec<uint8_t> keyBlob = {0x42};
+    HardwareAuthToken authToken;
+    size_t chunkSize = state.range(0);
+
+    for (auto _ : state) {
+        uint64_t handle = 0;
+        keymaster.begin(KeyPurpose::ENCRYPT, keyBlob, operationParams().hidl_data(), authToken,
+                        [&](ErrorCode, const hidl_vec<KeyParameter>&, uint64_t h) { handle = h; });
+        size_t offset = 0;
+        size_t outputSize = 0;
+        while (offset < payload.size()) {
+            hidl_vec<uint8_t> input(chunkSize);
+            input.resize(prepareInput(payload, &offset, input.data(), chunkSize));
+            keymaster.update(handle, hidl_vec<KeyParameter>(), input, authToken,
+                             VerificationToken(),
+                             [&](ErrorCode, uint32_t, const hidl_vec<KeyParameter>&,
+                                 const hidl_vec<uint8_t>& output) { outputSize += output.size(); });
+        }
+        keymaster.finish(handle, hidl_vec<KeyParameter>(), hidl_vec<uint8_t>(),
+                         hidl_vec<uint8_t>(), authToken, VerificationToken(),
+                         [&](ErrorCode, const hidl_vec<KeyParameter>&,
+                             const hidl_vec<uint8_t>& output) { outputSize += output.size(); });
+        benchmark::DoNotOptimize(outputSize);
+    }
+    state.SetBytesProcessed(state.iterations() * kPayloadSize);
+}
+BENCHMARK(BM_SequentialUpdates)
+    ->Arg(4 * 1024)
+    ->Arg(16 * 1024)
+    ->Arg(64 * 1024)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+static void streamPayload(benchmark::State& state, KeyPurpose purpose) {
+    sp<Keymaster4> keymasterRef = new Keymaster4(new SoftKeymasterDevice(), "default");
+    Keymaster4& keymaster = *keymasterRef;
+    std::vector<uint8_t> payload(kPayloadSize, 0x5a);
+    hidl_vec<uint8_t> keyBlob = {0x42};
+    KeymasterOperationStream stream(keymaster, state.range(0));
+
+    for (auto _ : state) {
+        stream.begin(purpose, keyBlob, operationParams(), HardwareAuthToken());
+        size_t offset = 0;
+        size_t outputSize = 0;
+        ErrorCode error = stream.run(
+            [&](uint8_t* buffer, size_t size) {
+                return prepareInput(payload, &offset, buffer, size);
+            },
+            [&](const hidl_vec<uint8_t>& output) { outputSize += output.size(); });
+        if (error != ErrorCode::OK) {
+            state.SkipWithError("Operation failed");
+            break;
+        }
+        benchmark::DoNotOptimize(outputSize);
+    }
+    state.SetBytesProcessed(state.iterations() * kPayloadSize);
+}
+
+static void BM_StreamEncrypt(benchmark::State& state) {
+    streamPayload(state, KeyPurpose::ENCRYPT);
+}
+BENCHMARK(BM_StreamEncrypt)
+    ->Arg(4 * 1024)
+    ->Arg(16 * 1024)
+    ->Arg(64 * 1024)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_StreamDecrypt(benchmark::State& state) {
+    streamPayload(state, KeyPurpose::DECRYPT);
+}
+BENCHMARK(BM_StreamDecrypt)
+    ->Arg(4 * 1024)
+    ->Arg(16 * 1024)
+    ->Arg(64 * 1024)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
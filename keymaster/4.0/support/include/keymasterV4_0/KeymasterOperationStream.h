@@ -0,0 +1,138 @@
+/*
+ ** Copyright 2018, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#ifndef HARDWARE_INTERFACES_KEYMASTER_40_SUPPORT_KEYMASTER_OPERATION_STREAM_H_
+#define HARDWARE_INTERFACES_KEYMASTER_40_SUPPORT_KEYMASTER_OPERATION_STREAM_H_
+
+#include <keymasterV4_0/Keymaster.h>
+#include <keymasterV4_0/authorization_set.h>
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace support {
+
+/**
+ * KeymasterOperationStream runs one begin()/update()/finish() operation over input that is too
+ * large to send in a single call.
+ *
+ * The input is produced in chunks by a Source running on a helper thread, so that the next chunk
+ * is prepared while the previous one is in flight in update(). Two chunk buffers are reused for
+ * the whole operation and handed to the HAL without copying. The chunk size starts from a default
+ * for the security level of the device and shrinks to whatever the device reports consuming, if
+ * it consumes less than it is given.
+ */
+class KeymasterOperationStream {
+   public:
+    /**
+     * Writes up to size bytes of input into buffer and returns the number written. Returning 0
+     * ends the input; returning more than size fails the operation with INVALID_INPUT_LENGTH.
+     * Called on the stream's helper thread.
+     */
+    using Source = std::function<size_t(uint8_t* buffer, size_t size)>;
+
+    /**
+     * Receives the output of each update() and of finish(), in order. Called on the thread
+     * running the stream.
+     */
+    using Sink = std::function<void(const hidl_vec<uint8_t>& output)>;
+
+    // Default chunk sizes for TEE and software devices, and for StrongBox devices.
+    static constexpr size_t kDefaultChunkSize = 64 * 1024;
+    static constexpr size_t kStrongBoxChunkSize = 4 * 1024;
+
+    /**
+     * Creates a stream for operations on keymaster. A chunkSize of 0 selects the default for the
+     * security level of the device.
+     */
+    explicit KeymasterOperationStream(Keymaster& keymaster, size_t chunkSize = 0);
+
+    /**
+     * Aborts the operation if it was begun and not finished.
+     */
+    ~KeymasterOperationStream();
+
+    /**
+     * Begins the operation. authToken is only sent with begin(); see setOperationTokens() for keys
+     * that require authorization on every call.
+     */
+    ErrorCode begin(KeyPurpose purpose, const hidl_vec<uint8_t>& keyBlob,
+                    const AuthorizationSet& inParams, const HardwareAuthToken& authToken,
+                    AuthorizationSet* outParams = nullptr);
+
+    /**
+     * Sets the tokens sent with every update() and finish() call. They are only needed for keys
+     * bound to per-operation authorization, or for StrongBox operations that need a
+     * VerificationToken. By default empty tokens are sent.
+     */
+    void setOperationTokens(const HardwareAuthToken& authToken,
+                            const VerificationToken& verificationToken);
+
+    /**
+     * Feeds the input produced by source through update() until source returns 0, then calls
+     * finish() with signature. Output is passed to sink. On any error the operation is aborted.
+     */
+    ErrorCode run(const Source& source, const Sink& sink,
+                  const hidl_vec<uint8_t>& signature = hidl_vec<uint8_t>(),
+                  AuthorizationSet* outParams = nullptr);
+
+    /**
+     * Aborts the operation, if any.
+     */
+    void abort();
+
+    /**
+     * The size of the chunks currently handed to the device.
+     */
+    size_t chunkSize() const { return chunkSize_; }
+
+   private:
+    struct Chunk {
+        std::vector<uint8_t> data;
+        size_t size;
+    };
+
+    /**
+     * Sends size bytes at data through update(), repeating the call until the device has
+     * consumed all of it.
+     */
+    ErrorCode update(const uint8_t* data, size_t size, const Sink& sink);
+    ErrorCode finish(const hidl_vec<uint8_t>& signature, const Sink& sink,
+                     AuthorizationSet* outParams);
+
+    Keymaster& keymaster_;
+    std::atomic<size_t> chunkSize_;
+    uint64_t operationHandle_;
+    bool operationActive_;
+    HardwareAuthToken authToken_;
+    VerificationToken verificationToken_;
+
+    // One chunk is filled by the Source while the other is being sent.
+    Chunk chunks_[2];
+};
+
+}  // namespace support
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
+
+#endif  // HARDWARE_INTERFACES_KEYMASTER_40_SUPPORT_KEYMASTER_OPERATION_STREAM_H_
@@ -17,6 +17,8 @@
 #ifndef SYSTEM_SECURITY_KEYSTORE_KM4_AUTHORIZATION_SET_H_
 #define SYSTEM_SECURITY_KEYSTORE_KM4_AUTHORIZATION_SET_H_
 
+#include <bitset>
+#include <utility>
 #include <vector>
 
 #include <keymasterV4_0/keymaster_tags.h>
@@ -32,6 +34,9 @@ class AuthorizationSetBuilder;
  * An ordered collection of KeyParameters. It provides memory ownership and some convenient
  * functionality for sorting, deduplicating, joining, and subtracting sets of KeyParameters.
  * For serialization, wrap the backing store of this structure in a hidl_vec<KeyParameter>.
+ *
+ * Elements keep their insertion order. Alongside them the set maintains an index of element
+ * positions sorted by tag and a bitmap of the tags present, so that tag lookups are O(log n).
  */
 class AuthorizationSet {
    public:
@@ -43,10 +48,20 @@ class AuthorizationSet {
     AuthorizationSet(){};
 
     // Copy constructor.
-    AuthorizationSet(const AuthorizationSet& other) : data_(other.data_) {}
+    AuthorizationSet(const AuthorizationSet& other)
+        : data_(other.data_),
+          index_(other.index_),
+          tag_bits_(other.tag_bits_),
+          index_stale_(other.index_stale_) {}
 
     // Move constructor.
-    AuthorizationSet(AuthorizationSet&& other) noexcept : data_(std::move(other.data_)) {}
+    AuthorizationSet(AuthorizationSet&& other) noexcept
+        : data_(std::move(other.data_)),
+          index_(std::move(other.index_)),
+          tag_bits_(other.tag_bits_),
+          index_stale_(other.index_stale_) {
+        other.Clear();
+    }
 
     // Constructor from hidl_vec<KeyParameter>
     AuthorizationSet(const hidl_vec<KeyParameter>& other) { *this = other; }
@@ -54,12 +69,19 @@ class AuthorizationSet {
     // Copy assignment.
     AuthorizationSet& operator=(const AuthorizationSet& other) {
         data_ = other.data_;
+        index_ = other.index_;
+        tag_bits_ = other.tag_bits_;
+        index_stale_ = other.index_stale_;
         return *this;
     }
 
     // Move assignment.
     AuthorizationSet& operator=(AuthorizationSet&& other) noexcept {
         data_ = std::move(other.data_);
+        index_ = std::move(other.index_);
+        tag_bits_ = other.tag_bits_;
+        index_stale_ = other.index_stale_;
+        other.Clear();
         return *this;
     }
 
@@ -71,6 +93,7 @@ class AuthorizationSet {
                  * See assignment operator/copy constructor of hidl_vec.*/
                 data_[i] = other[i];
             }
+            RebuildIndex();
         }
         return *this;
     }
@@ -150,6 +173,8 @@ class AuthorizationSet {
      * Returns the nth element of the set.
      * Like for std::vector::operator[] there is no range check performed. Use of out of range
      * indices is undefined.
+     * The tag of the returned element may be changed, so tag lookups fall back to linear scans
+     * until the set is next modified through one of its other methods.
      */
     KeyParameter& operator[](int n);
 
@@ -167,8 +192,8 @@ class AuthorizationSet {
 
     template <TagType tag_type, Tag tag, typename ValueT>
     bool Contains(TypedTag<tag_type, tag> ttag, const ValueT& value) const {
-        for (const auto& param : data_) {
-            auto entry = authorizationValue(ttag, param);
+        for (int pos = find(tag); pos != -1; pos = find(tag, pos)) {
+            auto entry = authorizationValue(ttag, data_[pos]);
             if (entry.isOk() && static_cast<ValueT>(entry.value()) == value) return true;
         }
         return false;
@@ -185,8 +210,14 @@ class AuthorizationSet {
         return {};
     }
 
-    void push_back(const KeyParameter& param) { data_.push_back(param); }
-    void push_back(KeyParameter&& param) { data_.push_back(std::move(param)); }
+    void push_back(const KeyParameter& param) {
+        data_.push_back(param);
+        IndexLastElement();
+    }
+    void push_back(KeyParameter&& param) {
+        data_.push_back(std::move(param));
+        IndexLastElement();
+    }
     void push_back(const AuthorizationSet& set) {
         for (auto& entry : set) {
             push_back(entry);
@@ -222,10 +253,61 @@ class AuthorizationSet {
     void Serialize(std::ostream* out) const;
     void Deserialize(std::istream* in);
 
+    /**
+     * Returns the number of bytes Serialize(uint8_t*, const uint8_t*) writes. The format is the
+     * same one written by Serialize(std::ostream*).
+     */
+    size_t SerializedSize() const;
+
+    /**
+     * Serializes the set into [buf, end) in a single pass and returns the position after the last
+     * byte written, or nullptr if the buffer is smaller than SerializedSize() or the set is too
+     * large for the format.
+     */
+    uint8_t* Serialize(uint8_t* buf, const uint8_t* end) const;
+
+    /**
+     * Replaces the contents of the set with the parameters serialized at *buf_ptr, reading no
+     * further than end. On success *buf_ptr is advanced past the serialized set and true is
+     * returned.
+     */
+    bool Deserialize(const uint8_t** buf_ptr, const uint8_t* end);
+
    private:
     NullOr<const KeyParameter&> GetEntry(Tag tag) const;
 
+    /**
+     * Adds the last element of data_ to the index.
+     */
+    void IndexLastElement();
+
+    /**
+     * Recomputes the index and tag bitmap from data_.
+     */
+    void RebuildIndex();
+
+    /**
+     * Returns the range of index_ holding the positions of the entries with \p tag.
+     */
+    std::pair<std::vector<uint32_t>::const_iterator, std::vector<uint32_t>::const_iterator>
+    IndexRange(Tag tag) const;
+
+    // Number of bits in tag_bits_. Tags are hashed by their tag number, which is below this for
+    // all of the tags defined by the HAL.
+    static constexpr size_t kTagBitmapSize = 1024;
+    static size_t TagBit(Tag tag) { return static_cast<uint32_t>(tag) & (kTagBitmapSize - 1); }
+
     std::vector<KeyParameter> data_;
+
+    // Positions in data_, ordered by tag and then by position.
+    std::vector<uint32_t> index_;
+
+    // A clear bit means that no entry with a tag hashing to that bit is present.
+    std::bitset<kTagBitmapSize> tag_bits_;
+
+    // Set once the non-const operator[] has handed out a reference, through which any tag may have
+    // changed. Lookups ignore the index while it is set, and the next modification rebuilds it.
+    bool index_stale_ = false;
 };
 
 class AuthorizationSetBuilder : public AuthorizationSet {
@@ -305,6 +387,63 @@ class AuthorizationSetBuilder : public AuthorizationSet {
     }
 };
 
+/**
+ * A read-only view of a serialized AuthorizationSet. Deserializing into the view does not copy
+ * blobs: the BYTES and BIGNUM parameters reference the input buffer, which must outlive the view
+ * or the next call to Deserialize(). Copy the parameters into an AuthorizationSet to keep them.
+ */
+class AuthorizationSetView {
+   public:
+    AuthorizationSetView() {}
+
+    // The parameters reference memory the view does not own.
+    AuthorizationSetView(const AuthorizationSetView&) = delete;
+    AuthorizationSetView& operator=(const AuthorizationSetView&) = delete;
+
+    /**
+     * Parses the set serialized at *buf_ptr, reading no further than end. The format is the one
+     * written by AuthorizationSet::Serialize. Legacy INVALID entries are dropped. On success
+     * *buf_ptr is advanced past the serialized set and true is returned. On failure the view is
+     * empty.
+     */
+    bool Deserialize(const uint8_t** buf_ptr, const uint8_t* end);
+
+    size_t size() const { return params_.size(); }
+    bool empty() const { return params_.empty(); }
+
+    const KeyParameter& operator[](int n) const { return params_[n]; }
+    std::vector<KeyParameter>::const_iterator begin() const { return params_.begin(); }
+    std::vector<KeyParameter>::const_iterator end() const { return params_.end(); }
+
+    /**
+     * Returns the offset of the next entry that matches \p tag, starting from the element after \p
+     * begin.  If not found, returns -1.
+     */
+    int find(Tag tag, int begin = -1) const;
+
+    bool Contains(Tag tag) const { return find(tag) != -1; }
+
+    template <typename T>
+    inline NullOr<const typename TypedTag2ValueType<T>::type&> GetTagValue(T tag) const {
+        int pos = find(tag);
+        if (pos != -1) return authorizationValue(tag, params_[pos]);
+        return {};
+    }
+
+    /**
+     * Returns a hidl_vec referencing the parameters of the view, for passing them to a HAL
+     * without copying.
+     */
+    hidl_vec<KeyParameter> hidl_data() const {
+        hidl_vec<KeyParameter> result;
+        result.setToExternal(const_cast<KeyParameter*>(params_.data()), params_.size());
+        return result;
+    }
+
+   private:
+    std::vector<KeyParameter> params_;
+};
+
 }  // namespace V4_0
 }  // namespace keymaster
 }  // namespace hardware
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <keymasterV4_0/Keymaster4.h>
+#include <keymasterV4_0/KeymasterOperationStream.h>
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace test {
+
+using support::Keymaster4;
+using support::KeymasterOperationStream;
+
+namespace {
+
+constexpr uint64_t kOperationHandle = 42;
+
+// Echoes the input it consumes as output, and records how it was driven.
+class FakeKeymasterDevice : public IKeymasterDevice {
+   public:
+    // How much of each update() input to consume. 0 consumes all of it.
+    size_t maxConsume = 0;
+    // If set, reported as inputConsumed regardless of the input size.
+    bool overrideConsumed = false;
+    uint32_t consumed = 0;
+    ErrorCode updateError = ErrorCode::OK;
+    ErrorCode finishError = ErrorCode::OK;
+
+    std::vector<size_t> updateSizes;
+    size_t finishCalls = 0;
+    size_t abortCalls = 0;
+
+    Return<void> getHardwareInfo(getHardwareInfo_cb _hidl_cb) override {
+        _hidl_cb(SecurityLevel::TRUSTED_ENVIRONMENT, "FakeKeymasterDevice", "Test");
+        return Void();
+    }
+    Return<void> getHmacSharingParameters(getHmacSharingParameters_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, HmacSharingParameters());
+        return Void();
+    }
+    Return<void> computeSharedHmac(const hidl_vec<HmacSharingParameters>&,
+                                   computeSharedHmac_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, hidl_vec<uint8_t>());
+        return Void();
+    }
+    Return<void> verifyAuthorization(uint64_t, const hidl_vec<KeyParameter>&,
+                                     const HardwareAuthToken&,
+                                     verifyAuthorization_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, VerificationToken());
+        return Void();
+    }
+    Return<ErrorCode> addRngEntropy(const hidl_vec<uint8_t>&) override {
+        return ErrorCode::UNIMPLEMENTED;
+    }
+    Return<void> generateKey(const hidl_vec<KeyParameter>&, generateKey_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, hidl_vec<uint8_t>(), KeyCharacteristics());
+        return Void();
+    }
+    Return<void> getKeyCharacteristics(const hidl_vec<uint8_t>&, const hidl_vec<uint8_t>&,
+                                       const hidl_vec<uint8_t>&,
+                                       getKeyCharacteristics_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, KeyCharacteristics());
+        return Void();
+    }
+    Return<void> importKey(const hidl_vec<KeyParameter>&, KeyFormat, const hidl_vec<uint8_t>&,
+                           importKey_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, hidl_vec<uint8_t>(), KeyCharacteristics());
+        return Void();
+    }
+    Return<void> importWrappedKey(const hidl_vec<uint8_t>&, const hidl_vec<uint8_t>&,
+                                  const hidl_vec<uint8_t>&, const hidl_vec<KeyParameter>&,
+                                  uint64_t, uint64_t, importWrappedKey_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, hidl_vec<uint8_t>(), KeyCharacteristics());
+        return Void();
+    }
+    Return<void> exportKey(KeyFormat, const hidl_vec<uint8_t>&, const hidl_vec<uint8_t>&,
+                           const hidl_vec<uint8_t>&, exportKey_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, hidl_vec<uint8_t>());
+        return Void();
+    }
+    Return<void> attestKey(const hidl_vec<uint8_t>&, const hidl_vec<KeyParameter>&,
+                           attestKey_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, hidl_vec<hidl_vec<uint8_t>>());
+        return Void();
+    }
+    Return<void> upgradeKey(const hidl_vec<uint8_t>&, const hidl_vec<KeyParameter>&,
+                            upgradeKey_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::UNIMPLEMENTED, hidl_vec<uint8_t>());
+        return Void();
+    }
+    Return<ErrorCode> deleteKey(const hidl_vec<uint8_t>&) override {
+        return ErrorCode::UNIMPLEMENTED;
+    }
+    Return<ErrorCode> deleteAllKeys() override { return ErrorCode::UNIMPLEMENTED; }
+    Return<ErrorCode> destroyAttestationIds() override { return ErrorCode::UNIMPLEMENTED; }
+
+    Return<void> begin(KeyPurpose, const hidl_vec<uint8_t>&, const hidl_vec<KeyParameter>&,
+                       const HardwareAuthToken&, begin_cb _hidl_cb) override {
+        _hidl_cb(ErrorCode::OK, hidl_vec<KeyParameter>(), kOperationHandle);
+        return Void();
+    }
+    Return<void> update(uint64_t operationHandle, const hidl_vec<KeyParameter>&,
+                        const hidl_vec<uint8_t>& input, const HardwareAuthToken&,
+                        const VerificationToken&, update_cb _hidl_cb) override {
+        EXPECT_EQ(kOperationHandle, operationHandle);
+        updateSizes.push_back(input.size());
+        if (updateError != ErrorCode::OK) {
+            _hidl_cb(updateError, 0, hidl_vec<KeyParameter>(), hidl_vec<uint8_t>());
+            return Void();
+        }
+        size_t size = input.size();
+        if (maxConsume) size = std::min(size, maxConsume);
+        hidl_vec<uint8_t> output(input.data(), input.data() + size);
+        _hidl_cb(ErrorCode::OK, overrideConsumed ? consumed : size, hidl_vec<KeyParameter>(),
+                 output);
+        return Void();
+    }
+    Return<void> finish(uint64_t operationHandle, const hidl_vec<KeyParameter>&,
+                        const hidl_vec<uint8_t>&, const hidl_vec<uint8_t>&,
+                        const HardwareAuthToken&, const VerificationToken&,
+                        finish_cb _hidl_cb) override {
+        EXPECT_EQ(kOperationHandle, operationHandle);
+        ++finishCalls;
+        _hidl_cb(finishError, hidl_vec<KeyParameter>(), hidl_vec<uint8_t>());
+        return Void();
+    }
+    Return<ErrorCode> abort(uint64_t operationHandle) override {
+        EXPECT_EQ(kOperationHandle, operationHandle);
+        ++abortCalls;
+        return ErrorCode::OK;
+    }
+};
+
+class KeymasterOperationStreamTest : public ::testing::Test {
+   protected:
+    KeymasterOperationStreamTest()
+        : device_(new FakeKeymasterDevice()), keymaster_(new Keymaster4(device_, "default")) {
+        for (size_t i = 0; i < 10000; ++i) input_.push_back(static_cast<uint8_t>(i * 7));
+    }
+
+    ErrorCode begin(KeymasterOperationStream* stream) {
+        return stream->begin(KeyPurpose::ENCRYPT, hidl_vec<uint8_t>{0x42}, AuthorizationSet(),
+                             HardwareAuthToken());
+    }
+
+    KeymasterOperationStream::Source source() {
+        offset_ = 0;
+        return [this](uint8_t* buffer, size_t size) {
+            size = std::min(size, input_.size() - offset_);
+            memcpy(buffer, input_.data() + offset_, size);
+            offset_ += size;
+            return size;
+        };
+    }
+
+    KeymasterOperationStream::Sink sink() {
+        return [this](const hidl_vec<uint8_t>& output) {
+            output_.insert(output_.end(), output.begin(), output.end());
+        };
+    }
+
+    sp<FakeKeymasterDevice> device_;
+    sp<Keymaster4> keymaster_;
+    std::vector<uint8_t> input_;
+    std::vector<uint8_t> output_;
+    size_t offset_ = 0;
+};
+
+}  // namespace
+
+TEST_F(KeymasterOperationStreamTest, StreamsAllInputInChunks) {
+    KeymasterOperationStream stream(*keymaster_, 1024);
+    ASSERT_EQ(ErrorCode::OK, begin(&stream));
+
+    EXPECT_EQ(ErrorCode::OK, stream.run(source(), sink()));
+    EXPECT_EQ(input_, output_);
+    EXPECT_EQ(10U, device_->updateSizes.size());
+    for (size_t size : device_->updateSizes) EXPECT_LE(size, 1024U);
+    EXPECT_EQ(1U, device_->finishCalls);
+    EXPECT_EQ(0U, device_->abortCalls);
+}
+
+TEST_F(KeymasterOperationStreamTest, RunWithoutBeginFails) {
+    KeymasterOperationStream stream(*keymaster_, 1024);
+    EXPECT_EQ(ErrorCode::INVALID_OPERATION_HANDLE, stream.run(source(), sink()));
+    EXPECT_TRUE(device_->updateSizes.empty());
+}
+
+TEST_F(KeymasterOperationStreamTest, DestructorAbortsUnfinishedOperation) {
+    {
+        KeymasterOperationStream stream(*keymaster_, 1024);
+        ASSERT_EQ(ErrorCode::OK, begin(&stream));
+    }
+    EXPECT_EQ(1U, device_->abortCalls);
+}
+
+TEST_F(KeymasterOperationStreamTest, UpdateErrorEndsOperation) {
+    device_->updateError = ErrorCode::INVALID_ARGUMENT;
+    KeymasterOperationStream stream(*keymaster_, 1024);
+    ASSERT_EQ(ErrorCode::OK, begin(&stream));
+
+    EXPECT_EQ(ErrorCode::INVALID_ARGUMENT, stream.run(source(), sink()));
+    EXPECT_EQ(1U, device_->updateSizes.size());
+    EXPECT_EQ(0U, device_->finishCalls);
+    // An error from update() aborts the operation in the device, so it is not aborted again.
+    EXPECT_EQ(0U, device_->abortCalls);
+    EXPECT_EQ(ErrorCode::INVALID_OPERATION_HANDLE, stream.run(source(), sink()));
+}
+
+TEST_F(KeymasterOperationStreamTest, FinishErrorEndsOperation) {
+    device_->finishError = ErrorCode::VERIFICATION_FAILED;
+    KeymasterOperationStream stream(*keymaster_, 1024);
+    ASSERT_EQ(ErrorCode::OK, begin(&stream));
+
+    EXPECT_EQ(ErrorCode::VERIFICATION_FAILED, stream.run(source(), sink()));
+    EXPECT_EQ(1U, device_->finishCalls);
+    EXPECT_EQ(0U, device_->abortCalls);
+    EXPECT_EQ(ErrorCode::INVALID_OPERATION_HANDLE, stream.run(source(), sink()));
+}
+
+TEST_F(KeymasterOperationStreamTest, ShrinksChunksToWhatTheDeviceConsumes) {
+    device_->maxConsume = 300;
+    KeymasterOperationStream stream(*keymaster_, 1024);
+    ASSERT_EQ(ErrorCode::OK, begin(&stream));
+
+    EXPECT_EQ(ErrorCode::OK, stream.run(source(), sink()));
+    EXPECT_EQ(300U, stream.chunkSize());
+    EXPECT_EQ(input_, output_);
+    // The two chunks prepared before the first update() returned take four calls each; every
+    // later call is given no more than the device consumed.
+    ASSERT_GT(device_->updateSizes.size(), 8U);
+    for (size_t i = 8; i < device_->updateSizes.size(); ++i) {
+        EXPECT_LE(device_->updateSizes[i], 300U);
+    }
+}
+
+TEST_F(KeymasterOperationStreamTest, RejectsZeroInputConsumed) {
+    device_->overrideConsumed = true;
+    device_->consumed = 0;
+    KeymasterOperationStream stream(*keymaster_, 1024);
+    ASSERT_EQ(ErrorCode::OK, begin(&stream));
+
+    EXPECT_EQ(ErrorCode::INVALID_INPUT_LENGTH, stream.run(source(), sink()));
+    EXPECT_EQ(1U, device_->updateSizes.size());
+    EXPECT_EQ(0U, device_->finishCalls);
+    EXPECT_EQ(1U, device_->abortCalls);
+}
+
+TEST_F(KeymasterOperationStreamTest, RejectsInputConsumedBeyondChunk) {
+    device_->overrideConsumed = true;
+    device_->consumed = 1025;
+    KeymasterOperationStream stream(*keymaster_, 1024);
+    ASSERT_EQ(ErrorCode::OK, begin(&stream));
+
+    EXPECT_EQ(ErrorCode::INVALID_INPUT_LENGTH, stream.run(source(), sink()));
+    EXPECT_EQ(1U, device_->updateSizes.size());
+    EXPECT_EQ(0U, device_->finishCalls);
+    EXPECT_EQ(1U, device_->abortCalls);
+}
+
+TEST_F(KeymasterOperationStreamTest, RejectsSourceOverrun) {
+    KeymasterOperationStream stream(*keymaster_, 1024);
+    ASSERT_EQ(ErrorCode::OK, begin(&stream));
+
+    EXPECT_EQ(ErrorCode::INVALID_INPUT_LENGTH,
+              stream.run([](uint8_t*, size_t size) { return size + 1; }, sink()));
+    EXPECT_TRUE(device_->updateSizes.empty());
+    EXPECT_EQ(0U, device_->finishCalls);
+    EXPECT_EQ(1U, device_->abortCalls);
+}
+
+}  // namespace test
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.power.stats@1.0-service-mock"
+
+#include "EnergyStreamer.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <inttypes.h>
+#include <log/log.h>
+
+#include <algorithm>
+
+namespace android {
+namespace hardware {
+namespace power {
+namespace stats {
+namespace V1_0 {
+namespace implementation {
+
+// The bit MessageQueue::readBlocking() waits on when the queue owns its event flag word
+constexpr uint32_t kFmqNotEmpty = 1 << 0;
+
+constexpr size_t EnergyStreamer::kMaxStreams;
+constexpr size_t EnergyStreamer::kQueueSize;
+constexpr uint32_t EnergyStreamer::kMaxWakeRate;
+
+EnergyStreamer::EnergyStreamer(size_t railsPerSample, SampleSource source)
+    : mRailsPerSample(railsPerSample),
+      mSource(std::move(source)),
+      mStreamsChanged(false),
+      mStopThread(false),
+      mSample(railsPerSample),
+      mStats() {
+    mThread = std::thread([this]() { run(); });
+}
+
+EnergyStreamer::~EnergyStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopThread = true;
+    }
+    mCV.notify_one();
+    mThread.join();
+    for (auto& stream : mStreams) {
+        EventFlag::deleteEventFlag(&stream.eventFlag);
+    }
+}
+
+Status EnergyStreamer::startStream(uint32_t samplingRate, uint32_t numSamples,
+                                   std::shared_ptr<MessageQueueSync>* queue) {
+    if (mRailsPerSample == 0 || mRailsPerSample > kQueueSize) {
+        return Status::NOT_SUPPORTED;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mStreams.size() >= kMaxStreams) {
+        return Status::INSUFFICIENT_RESOURCES;
+    }
+
+    auto newQueue = std::make_shared<MessageQueueSync>(kQueueSize, true);
+    if (!newQueue->isValid()) {
+        ALOGE("Failed to create energy data queue");
+        return Status::INSUFFICIENT_RESOURCES;
+    }
+    *queue = newQueue;
+    mStats.streams++;
+    if (numSamples == 0 || samplingRate == 0) {
+        return Status::SUCCESS;
+    }
+
+    EventFlag* eventFlag = nullptr;
+    if (EventFlag::createEventFlag(newQueue->getEventFlagWord(), &eventFlag) != OK) {
+        ALOGE("Failed to create energy data queue event flag");
+        queue->reset();
+        return Status::INSUFFICIENT_RESOURCES;
+    }
+
+    size_t maxSamples = kQueueSize / mRailsPerSample;
+    Stream stream;
+    stream.queue = std::move(newQueue);
+    stream.eventFlag = eventFlag;
+    stream.period = std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) /
+                    samplingRate;
+    stream.nextSample = Clock::now();
+    stream.samplesLeft = numSamples;
+    stream.batchSize = std::min<size_t>(std::max<uint32_t>(samplingRate / kMaxWakeRate, 1),
+                                        maxSamples);
+    // What the queue holds again, so a reader catching up finds no gap
+    stream.maxPending = maxSamples * mRailsPerSample;
+    stream.pending.reserve(stream.batchSize * mRailsPerSample);
+    mStreams.push_back(std::move(stream));
+    mStreamsChanged = true;
+    mCV.notify_one();
+    return Status::SUCCESS;
+}
+
+EnergyStreamer::Stats EnergyStreamer::getStats() {
+    std::lock_guard<std::mutex> lock(mLock);
+    Stats stats = mStats;
+    stats.activeStreams = mStreams.size();
+    return stats;
+}
+
+void EnergyStreamer::dump(int fd) {
+    Stats stats = getStats();
+    std::string dump = android::base::StringPrintf(
+            "\n========== PowerStats HAL 1.0 energy streaming ==========\n"
+            "  Active streams: %zu\n"
+            "  Streams started: %" PRIu64 "\n"
+            "  Source reads: %" PRIu64 "\n"
+            "  Samples written: %" PRIu64 " in %" PRIu64 " batches\n"
+            "  Missed ticks: %" PRIu64 " (max lateness %" PRId64 " us)\n"
+            "  Samples dropped: %" PRIu64 "\n"
+            "========== End of PowerStats HAL 1.0 energy streaming ==========\n",
+            stats.activeStreams, stats.streams, stats.reads, stats.samplesWritten,
+            stats.batchesWritten, stats.missedTicks,
+            static_cast<int64_t>(
+                    std::chrono::duration_cast<std::chrono::microseconds>(stats.maxLateness)
+                            .count()),
+            stats.samplesDropped);
+    if (!android::base::WriteStringToFd(dump, fd)) {
+        ALOGE("Failed to dump energy streaming stats");
+    }
+}
+
+EnergyStreamer::Clock::time_point EnergyStreamer::nextWakeLocked(Clock::time_point now) const {
+    Clock::time_point wake = Clock::time_point::max();
+    for (const auto& stream : mStreams) {
+        if (stream.samplesLeft > 0) {
+            wake = std::min(wake, stream.nextSample);
+        } else {
+            // Waiting for the reader to make room for the last batch
+            wake = std::min(wake, now + kDrainRetryInterval);
+        }
+    }
+    return wake;
+}
+
+void EnergyStreamer::sampleLocked(Clock::time_point now) {
+    // Streams due within a quarter of their period share this read
+    bool due = false;
+    for (const auto& stream : mStreams) {
+        if (stream.samplesLeft > 0 && stream.nextSample <= now + stream.period / 4) {
+            due = true;
+            break;
+        }
+    }
+    if (!due) {
+        return;
+    }
+
+    Status ret = mSource(&mSample);
+    mStats.reads++;
+    if (ret != Status::SUCCESS || mSample.size() != mRailsPerSample) {
+        ALOGE("Failed to read energy data, ending %zu streams", mStreams.size());
+        for (auto& stream : mStreams) {
+            // Let the reader have what was read so far
+            stream.samplesLeft = 0;
+            stream.drainDeadline = now + kDrainTimeout;
+        }
+        return;
+    }
+
+    for (auto& stream : mStreams) {
+        if (stream.samplesLeft == 0 || stream.nextSample > now + stream.period / 4) {
+            continue;
+        }
+        if (stream.pending.size() + mRailsPerSample > stream.maxPending) {
+            stream.pending.erase(stream.pending.begin(),
+                                 stream.pending.begin() + mRailsPerSample);
+            mStats.samplesDropped++;
+        }
+        stream.pending.insert(stream.pending.end(), mSample.begin(), mSample.end());
+        if (--stream.samplesLeft == 0) {
+            stream.drainDeadline = now + kDrainTimeout;
+        }
+
+        // Keep to the schedule the stream started with. When more than a period late, skip the
+        // ticks that were missed instead of sampling back to back to catch up.
+        Clock::duration lateness = now - stream.nextSample;
+        if (lateness > Clock::duration::zero()) {
+            mStats.maxLateness = std::max(
+                    mStats.maxLateness,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(lateness));
+        }
+        stream.nextSample += stream.period;
+        if (stream.nextSample <= now) {
+            auto missed = (now - stream.nextSample) / stream.period + 1;
+            stream.nextSample += missed * stream.period;
+            mStats.missedTicks += missed;
+        }
+    }
+}
+
+bool EnergyStreamer::flushLocked(Stream& stream, Clock::time_point now) {
+    bool finished = stream.samplesLeft == 0;
+    size_t batch = stream.batchSize * mRailsPerSample;
+    if (!stream.pending.empty() && (finished || stream.pending.size() >= batch)) {
+        // Only whole samples, so the reader never sees part of one
+        size_t room = stream.queue->availableToWrite() / mRailsPerSample * mRailsPerSample;
+        size_t count = std::min(room, stream.pending.size());
+        if (count > 0 && stream.queue->write(stream.pending.data(), count)) {
+            stream.eventFlag->wake(kFmqNotEmpty);
+            stream.pending.erase(stream.pending.begin(), stream.pending.begin() + count);
+            mStats.samplesWritten += count / mRailsPerSample;
+            mStats.batchesWritten++;
+        }
+    }
+
+    if (!finished) {
+        return false;
+    }
+    if (stream.pending.empty()) {
+        return true;
+    }
+    if (now >= stream.drainDeadline) {
+        mStats.samplesDropped += stream.pending.size() / mRailsPerSample;
+        return true;
+    }
+    return false;
+}
+
+void EnergyStreamer::run() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mCV.wait(lock, [this]() { return mStopThread || !mStreams.empty(); });
+        if (mStopThread) {
+            break;
+        }
+
+        mStreamsChanged = false;
+        Clock::time_point wake = nextWakeLocked(Clock::now());
+        if (mCV.wait_until(lock, wake, [this]() { return mStopThread || mStreamsChanged; })) {
+            // Reschedule around the new stream, or stop
+            continue;
+        }
+
+        Clock::time_point now = Clock::now();
+        sampleLocked(now);
+        for (auto it = mStreams.begin(); it != mStreams.end();) {
+            if (flushLocked(*it, now)) {
+                EventFlag::deleteEventFlag(&it->eventFlag);
+                it = mStreams.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace stats
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
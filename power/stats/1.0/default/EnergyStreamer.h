@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_POWERSTATS_V1_0_ENERGYSTREAMER_H
+#define ANDROID_HARDWARE_POWERSTATS_V1_0_ENERGYSTREAMER_H
+
+#include <android/hardware/power/stats/1.0/types.h>
+#include <fmq/EventFlag.h>
+#include <fmq/MessageQueue.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace power {
+namespace stats {
+namespace V1_0 {
+namespace implementation {
+
+/*
+ * Serves the energy streams requested through IPowerStats::streamEnergyData.
+ *
+ * A single sampler thread serves every stream. It wakes up on an absolute
+ * schedule for each stream, so lateness doesn't accumulate. Streams that are due
+ * at about the same time share one read of the power monitors. Samples are
+ * written to each stream's FMQ in batches, with one EventFlag wake per batch
+ * rather than per sample. Samples wait while a reader falls behind, up to a
+ * bound, and are dropped after that; the sampler never blocks on a queue.
+ */
+class EnergyStreamer {
+   public:
+    typedef MessageQueue<EnergyData, kSynchronizedReadWrite> MessageQueueSync;
+
+    // Fills in one sample, holding the energy of every rail
+    using SampleSource = std::function<Status(std::vector<EnergyData>* sample)>;
+
+    struct Stats {
+        size_t activeStreams;
+        uint64_t streams;
+        // Reads from the source, each serving one or more streams
+        uint64_t reads;
+        uint64_t samplesWritten;
+        uint64_t batchesWritten;
+        // Sampling ticks skipped because the sampler ran more than a period late
+        uint64_t missedTicks;
+        // Samples dropped because the reader fell behind
+        uint64_t samplesDropped;
+        std::chrono::nanoseconds maxLateness;
+    };
+
+    static constexpr size_t kMaxStreams = 4;
+    static constexpr size_t kQueueSize = 8192;  // in EnergyData records
+
+    EnergyStreamer(size_t railsPerSample, SampleSource source);
+    ~EnergyStreamer();
+
+    /*
+     * Starts streaming numSamples samples at samplingRate into a new queue.
+     * Returns INSUFFICIENT_RESOURCES if too many streams are running or the
+     * queue can't be created.
+     */
+    Status startStream(uint32_t samplingRate, uint32_t numSamples,
+                       std::shared_ptr<MessageQueueSync>* queue);
+
+    Stats getStats();
+    void dump(int fd);
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    // How often a reader is woken up at most, which sets the batch size
+    static constexpr uint32_t kMaxWakeRate = 100;
+    // How long a finished stream waits for its reader to make room
+    static constexpr auto kDrainTimeout = std::chrono::seconds(1);
+    static constexpr auto kDrainRetryInterval = std::chrono::milliseconds(10);
+
+    struct Stream {
+        std::shared_ptr<MessageQueueSync> queue;
+        EventFlag* eventFlag;
+        Clock::duration period;
+        Clock::time_point nextSample;
+        uint32_t samplesLeft;
+        // In samples
+        size_t batchSize;
+        size_t maxPending;
+        // Records not written to the queue yet
+        std::vector<EnergyData> pending;
+        Clock::time_point drainDeadline;
+    };
+
+    void run();
+    Clock::time_point nextWakeLocked(Clock::time_point now) const;
+    void sampleLocked(Clock::time_point now);
+    // Returns true when the stream is done with
+    bool flushLocked(Stream& stream, Clock::time_point now);
+
+    const size_t mRailsPerSample;
+    const SampleSource mSource;
+
+    std::mutex mLock;
+    std::condition_variable mCV;
+    std::list<Stream> mStreams;
+    bool mStreamsChanged;
+    bool mStopThread;
+    std::vector<EnergyData> mSample;
+    Stats mStats;
+    std::thread mThread;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace stats
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_POWERSTATS_V1_0_ENERGYSTREAMER_H
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.power.stats@1.0-service-mock"
+
+#include "IioEnergyMeterReader.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <log/log.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string_view>
+
+namespace android {
+namespace hardware {
+namespace power {
+namespace stats {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+/*
+ * Parses a decimal number from [p, end) the way strtoull does: leading blanks
+ * are skipped, parsing stops at the first non-digit and overflow saturates to
+ * ULLONG_MAX.
+ */
+uint64_t parseUint64(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+
+    uint64_t value = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        uint64_t digit = *p - '0';
+        if (value > (ULLONG_MAX - digit) / 10) return ULLONG_MAX;
+        value = value * 10 + digit;
+    }
+    return value;
+}
+
+}  // namespace
+
+IioEnergyMeterReader::IioEnergyMeterReader(const std::vector<std::string>& devicePaths,
+                                           RailIndices railIndices)
+    : mRailIndices(std::move(railIndices)) {
+    for (const auto& devicePath : devicePaths) {
+        Node node;
+        node.path = devicePath + "/energy_value";
+        node.fd.reset(TEMP_FAILURE_RETRY(open(node.path.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (node.fd < 0) {
+            ALOGE("Error opening file: %s", node.path.c_str());
+        }
+        mNodes.push_back(std::move(node));
+    }
+}
+
+Status IioEnergyMeterReader::readEnergy(std::vector<EnergyData>* readings) {
+    for (const auto& node : mNodes) {
+        // sysfs regenerates the contents on each read from offset 0
+        ssize_t size = TEMP_FAILURE_RETRY(pread(node.fd, mBuffer, sizeof(mBuffer), 0));
+        if (size < 0) {
+            ALOGE("Error reading file: %s", node.path.c_str());
+            return Status::FILESYSTEM_ERROR;
+        }
+        if (static_cast<size_t>(size) == sizeof(mBuffer)) {
+            ALOGE("File larger than %zu bytes: %s", sizeof(mBuffer), node.path.c_str());
+            return Status::FILESYSTEM_ERROR;
+        }
+        if (!parseEnergyValue(node, mBuffer, size, readings)) {
+            return Status::FILESYSTEM_ERROR;
+        }
+    }
+    return Status::SUCCESS;
+}
+
+bool IioEnergyMeterReader::parseEnergyValue(const Node& node, const char* data, size_t size,
+                                            std::vector<EnergyData>* readings) const {
+    const char* end = data + size;
+    uint64_t timestamp = 0;
+    bool timestampRead = false;
+    for (const char* line = data; line < end;) {
+        const char* eol = static_cast<const char*>(memchr(line, '\n', end - line));
+        if (eol == nullptr) eol = end;
+        const char* comma = static_cast<const char*>(memchr(line, ',', eol - line));
+
+        if (!timestampRead) {
+            // Anything before the timestamp is skipped
+            if (comma == nullptr) {
+                timestamp = parseUint64(line, eol);
+                if (timestamp == 0 || timestamp == ULLONG_MAX) {
+                    ALOGW("Potentially wrong timestamp: %" PRIu64, timestamp);
+                }
+                timestampRead = true;
+            }
+        } else if (comma != nullptr && memchr(comma + 1, ',', eol - comma - 1) == nullptr) {
+            auto rail = mRailIndices.find(std::string_view(line, comma - line));
+            if (rail != mRailIndices.end() && rail->second < readings->size()) {
+                EnergyData& reading = (*readings)[rail->second];
+                reading.timestamp = timestamp;
+                reading.energy = parseUint64(comma + 1, eol);
+                if (reading.energy == ULLONG_MAX) {
+                    ALOGW("Potentially wrong energy value: %" PRIu64, reading.energy);
+                }
+            }
+        } else {
+            ALOGW("Unexpected format in file: %s", node.path.c_str());
+            return false;
+        }
+        line = eol + 1;
+    }
+    return true;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace stats
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_POWERSTATS_V1_0_IIOENERGYMETERREADER_H
+#define ANDROID_HARDWARE_POWERSTATS_V1_0_IIOENERGYMETERREADER_H
+
+#include <android-base/unique_fd.h>
+#include <android/hardware/power/stats/1.0/types.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace power {
+namespace stats {
+namespace V1_0 {
+namespace implementation {
+
+/*
+ * Reads the energy_value nodes of the on-device power monitors.
+ *
+ * The nodes are opened once and read with pread into a fixed buffer, which is
+ * parsed in place. Each read updates the readings of the rails it reports, so
+ * sampling allocates nothing.
+ *
+ * An energy_value node holds a timestamp line followed by one
+ * "<rail name>,<energy>" line per enabled rail.
+ */
+class IioEnergyMeterReader {
+   public:
+    // Index of each rail in the readings, by rail name
+    using RailIndices = std::map<std::string, uint32_t, std::less<>>;
+
+    IioEnergyMeterReader(const std::vector<std::string>& devicePaths, RailIndices railIndices);
+
+    /*
+     * Reads all the nodes into readings, indexed as given by the rail indices.
+     * Readings of rails that are not reported are left unchanged. Fails if a
+     * node couldn't be opened or read, or is malformed.
+     */
+    Status readEnergy(std::vector<EnergyData>* readings);
+
+   private:
+    // The node for a handful of rails is a few hundred bytes
+    static constexpr size_t kBufferSize = 4096;
+
+    struct Node {
+        std::string path;
+        android::base::unique_fd fd;
+    };
+
+    bool parseEnergyValue(const Node& node, const char* data, size_t size,
+                          std::vector<EnergyData>* readings) const;
+
+    std::vector<Node> mNodes;
+    const RailIndices mRailIndices;
+    char mBuffer[kBufferSize];
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace stats
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_POWERSTATS_V1_0_IIOENERGYMETERREADER_H
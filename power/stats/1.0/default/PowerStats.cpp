@@ -26,7 +26,6 @@
 #include <stdlib.h>
 #include <algorithm>
 #include <exception>
-#include <thread>
 
 namespace android {
 namespace hardware {
@@ -37,22 +36,20 @@ namespace implementation {
 
 #define MAX_FILE_PATH_LEN 128
 #define MAX_DEVICE_NAME_LEN 64
-#define MAX_QUEUE_SIZE 8192
 
 constexpr char kIioDirRoot[] = "/sys/bus/iio/devices/";
 constexpr char kDeviceName[] = "pm_device_name";
 constexpr char kDeviceType[] = "iio:device";
-constexpr uint32_t MAX_SAMPLING_RATE = 10;
-constexpr uint64_t WRITE_TIMEOUT_NS = 1000000000;
+constexpr uint32_t MAX_SAMPLING_RATE = 1000;
 
-void PowerStats::findIioPowerMonitorNodes() {
+void PowerStats::findIioPowerMonitorNodes(const std::string& iioDirRoot) {
     struct dirent* ent;
     int fd;
     char devName[MAX_DEVICE_NAME_LEN];
     char filePath[MAX_FILE_PATH_LEN];
-    DIR* iioDir = opendir(kIioDirRoot);
+    DIR* iioDir = opendir(iioDirRoot.c_str());
     if (!iioDir) {
-        ALOGE("Error opening directory: %s", kIioDirRoot);
+        ALOGE("Error opening directory: %s", iioDirRoot.c_str());
         return;
     }
     while (ent = readdir(iioDir), ent) {
@@ -72,7 +69,7 @@ void PowerStats::findIioPowerMonitorNodes() {
             }
 
             if (strncmp(devName, kDeviceName, strlen(kDeviceName)) == 0) {
-                snprintf(filePath, MAX_FILE_PATH_LEN, "%s/%s", kIioDirRoot, ent->d_name);
+                snprintf(filePath, MAX_FILE_PATH_LEN, "%s/%s", iioDirRoot.c_str(), ent->d_name);
                 mPm.devicePaths.push_back(filePath);
             }
             close(fd);
@@ -122,73 +119,42 @@ size_t PowerStats::parsePowerRails() {
     return index;
 }
 
-int PowerStats::parseIioEnergyNode(std::string devName) {
-    int ret = 0;
-    std::string data;
-    std::string fileName = devName + "/energy_value";
-    if (!android::base::ReadFileToString(fileName, &data)) {
-        ALOGE("Error reading file: %s", fileName.c_str());
-        return -1;
-    }
-
-    std::istringstream energyData(data);
-    std::string line;
-    uint64_t timestamp = 0;
-    bool timestampRead = false;
-    while (std::getline(energyData, line)) {
-        std::vector<std::string> words = android::base::Split(line, ",");
-        if (timestampRead == false) {
-            if (words.size() == 1) {
-                timestamp = strtoull(words[0].c_str(), NULL, 10);
-                if (timestamp == 0 || timestamp == ULLONG_MAX) {
-                    ALOGW("Potentially wrong timestamp: %" PRIu64, timestamp);
-                }
-                timestampRead = true;
-            }
-        } else if (words.size() == 2) {
-            std::string railName = words[0];
-            if (mPm.railsInfo.count(railName) != 0) {
-                size_t index = mPm.railsInfo[railName].index;
-                mPm.reading[index].index = index;
-                mPm.reading[index].timestamp = timestamp;
-                mPm.reading[index].energy = strtoull(words[1].c_str(), NULL, 10);
-                if (mPm.reading[index].energy == ULLONG_MAX) {
-                    ALOGW("Potentially wrong energy value: %" PRIu64, mPm.reading[index].energy);
-                }
-            }
-        } else {
-            ALOGW("Unexpected format in file: %s", fileName.c_str());
-            ret = -1;
-            break;
-        }
-    }
-    return ret;
-}
-
 Status PowerStats::parseIioEnergyNodes() {
-    Status ret = Status::SUCCESS;
     if (mPm.hwEnabled == false) {
         return Status::NOT_SUPPORTED;
     }
 
-    for (const auto& devicePath : mPm.devicePaths) {
-        if (parseIioEnergyNode(devicePath) < 0) {
-            ALOGE("Error in parsing power stats");
-            ret = Status::FILESYSTEM_ERROR;
-            break;
-        }
+    Status ret = mPm.energyReader->readEnergy(&mPm.reading);
+    if (ret != Status::SUCCESS) {
+        ALOGE("Error in parsing power stats");
     }
     return ret;
 }
 
-PowerStats::PowerStats() {
-    findIioPowerMonitorNodes();
+PowerStats::PowerStats() : PowerStats(kIioDirRoot) {}
+
+PowerStats::PowerStats(const std::string& iioDirRoot) {
+    findIioPowerMonitorNodes(iioDirRoot);
     size_t numRails = parsePowerRails();
     if (mPm.devicePaths.empty() || numRails == 0) {
         mPm.hwEnabled = false;
     } else {
         mPm.hwEnabled = true;
         mPm.reading.resize(numRails);
+        IioEnergyMeterReader::RailIndices railIndices;
+        for (const auto& railData : mPm.railsInfo) {
+            mPm.reading[railData.second.index].index = railData.second.index;
+            railIndices.emplace(railData.first, railData.second.index);
+        }
+        mPm.energyReader.reset(new IioEnergyMeterReader(mPm.devicePaths, std::move(railIndices)));
+        mPm.streamer.reset(new EnergyStreamer(numRails, [this](std::vector<EnergyData>* sample) {
+            std::lock_guard<std::mutex> _lock(mPm.mLock);
+            Status ret = parseIioEnergyNodes();
+            if (ret == Status::SUCCESS) {
+                *sample = mPm.reading;
+            }
+            return ret;
+        }));
     }
 }
 
@@ -247,45 +213,21 @@ Return<void> PowerStats::getEnergyData(const hidl_vec<uint32_t>& railIndices,
 
 Return<void> PowerStats::streamEnergyData(uint32_t timeMs, uint32_t samplingRate,
                                           streamEnergyData_cb _hidl_cb) {
-    std::lock_guard<std::mutex> _lock(mPm.mLock);
-    if (mPm.fmqSynchronized != nullptr) {
-        _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, Status::INSUFFICIENT_RESOURCES);
+    if (mPm.hwEnabled == false) {
+        _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, Status::NOT_SUPPORTED);
         return Void();
     }
     uint32_t sps = std::min(samplingRate, MAX_SAMPLING_RATE);
-    uint32_t numSamples = timeMs * sps / 1000;
-    mPm.fmqSynchronized.reset(new (std::nothrow) MessageQueueSync(MAX_QUEUE_SIZE, true));
-    if (mPm.fmqSynchronized == nullptr || mPm.fmqSynchronized->isValid() == false) {
-        mPm.fmqSynchronized = nullptr;
-        _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, Status::INSUFFICIENT_RESOURCES);
+    uint32_t numSamples = static_cast<uint64_t>(timeMs) * sps / 1000;
+    std::shared_ptr<MessageQueueSync> queue;
+    Status ret = mPm.streamer->startStream(sps, numSamples, &queue);
+    if (ret != Status::SUCCESS) {
+        _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, ret);
         return Void();
     }
-    std::thread pollThread = std::thread([this, sps, numSamples]() {
-        uint64_t sleepTimeUs = 1000000 / sps;
-        uint32_t currSamples = 0;
-        while (currSamples < numSamples) {
-            mPm.mLock.lock();
-            if (parseIioEnergyNodes() == Status::SUCCESS) {
-                mPm.fmqSynchronized->writeBlocking(&mPm.reading[0], mPm.reading.size(),
-                                                   WRITE_TIMEOUT_NS);
-                mPm.mLock.unlock();
-                currSamples++;
-                if (usleep(sleepTimeUs) < 0) {
-                    ALOGW("Sleep interrupted");
-                    break;
-                }
-            } else {
-                mPm.mLock.unlock();
-                break;
-            }
-        }
-        mPm.mLock.lock();
-        mPm.fmqSynchronized = nullptr;
-        mPm.mLock.unlock();
-        return;
-    });
-    pollThread.detach();
-    _hidl_cb(*(mPm.fmqSynchronized)->getDesc(), numSamples, mPm.reading.size(), Status::SUCCESS);
+    // The streamer lets go of the queue once the last sample is written, so hold on to it until
+    // the descriptor has been sent
+    _hidl_cb(*queue->getDesc(), numSamples, mPm.reading.size(), Status::SUCCESS);
     return Void();
 }
 
@@ -458,6 +400,10 @@ Return<void> PowerStats::debug(const hidl_handle& handle, const hidl_vec<hidl_st
     }
 
     int fd = handle->data[0];
+    if (mPm.streamer != nullptr) {
+        mPm.streamer->dump(fd);
+    }
+
     Status status;
     hidl_vec<PowerEntityInfo> infos;
 
@@ -21,8 +21,13 @@
 #include <fmq/MessageQueue.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <map>
+#include <memory>
 #include <unordered_map>
 
+#include "EnergyStreamer.h"
+#include "IioEnergyMeterReader.h"
+
 namespace android {
 namespace hardware {
 namespace power {
@@ -58,7 +63,8 @@ struct OnDeviceMmt {
     std::vector<std::string> devicePaths;
     std::map<std::string, RailData> railsInfo;
     std::vector<EnergyData> reading;
-    std::unique_ptr<MessageQueueSync> fmqSynchronized;
+    std::unique_ptr<IioEnergyMeterReader> energyReader;
+    std::unique_ptr<EnergyStreamer> streamer;
 };
 
 class IStateResidencyDataProvider {
@@ -72,6 +78,8 @@ class IStateResidencyDataProvider {
 struct PowerStats : public IPowerStats {
    public:
     PowerStats();
+    // Looks for the power monitors under the given IIO devices directory
+    explicit PowerStats(const std::string& iioDirRoot);
     uint32_t addPowerEntity(const std::string& name, PowerEntityType type);
     void addStateResidencyDataProvider(std::shared_ptr<IStateResidencyDataProvider> p);
     // Methods from ::android::hardware::power::stats::V1_0::IPowerStats follow.
@@ -92,9 +100,8 @@ struct PowerStats : public IPowerStats {
 
    private:
     OnDeviceMmt mPm;
-    void findIioPowerMonitorNodes();
+    void findIioPowerMonitorNodes(const std::string& iioDirRoot);
     size_t parsePowerRails();
-    int parseIioEnergyNode(std::string devName);
     Status parseIioEnergyNodes();
     std::vector<PowerEntityInfo> mPowerEntityInfos;
     std::unordered_map<uint32_t, PowerEntityStateSpace> mPowerEntityStateSpaces;
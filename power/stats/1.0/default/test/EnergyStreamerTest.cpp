@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "EnergyStreamer.h"
+
+using ::android::hardware::power::stats::V1_0::EnergyData;
+using ::android::hardware::power::stats::V1_0::Status;
+using ::android::hardware::power::stats::V1_0::implementation::EnergyStreamer;
+
+using MessageQueueSync = EnergyStreamer::MessageQueueSync;
+
+constexpr size_t kRails = 3;
+constexpr int64_t kReadTimeoutNs = 2000000000;
+
+// Counts its reads, so each sample carries the number of the read it came from
+class EnergyStreamerTest : public ::testing::Test {
+   protected:
+    EnergyStreamerTest()
+        : mReads(0),
+          mStreamer(kRails, [this](std::vector<EnergyData>* sample) {
+              uint64_t read = ++mReads;
+              {
+                  std::lock_guard<std::mutex> lock(mLock);
+                  mThreads.insert(std::this_thread::get_id());
+              }
+              for (size_t i = 0; i < kRails; i++) {
+                  (*sample)[i] = {.index = static_cast<uint32_t>(i),
+                                  .timestamp = read,
+                                  .energy = read * 10 + i};
+              }
+              return Status::SUCCESS;
+          }) {}
+
+    // Reads the stream the way a client does, through its own mapping of the queue
+    static std::vector<uint64_t> readSamples(const std::shared_ptr<MessageQueueSync>& queue,
+                                             size_t numSamples) {
+        MessageQueueSync reader(*queue->getDesc());
+        EXPECT_TRUE(reader.isValid());
+        std::vector<uint64_t> reads;
+        std::vector<EnergyData> sample(kRails);
+        for (size_t i = 0; i < numSamples; i++) {
+            if (!reader.readBlocking(sample.data(), kRails, kReadTimeoutNs)) {
+                ADD_FAILURE() << "Timed out waiting for sample " << i;
+                break;
+            }
+            for (size_t rail = 0; rail < kRails; rail++) {
+                EXPECT_EQ(rail, sample[rail].index);
+                EXPECT_EQ(sample[0].timestamp, sample[rail].timestamp);
+                EXPECT_EQ(sample[rail].timestamp * 10 + rail, sample[rail].energy);
+            }
+            reads.push_back(sample[0].timestamp);
+        }
+        return reads;
+    }
+
+    void waitForStreamsToEnd() {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (mStreamer.getStats().activeStreams > 0 &&
+               std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        EXPECT_EQ(0u, mStreamer.getStats().activeStreams);
+    }
+
+    std::atomic<uint64_t> mReads;
+    std::mutex mLock;
+    std::set<std::thread::id> mThreads;
+    EnergyStreamer mStreamer;
+};
+
+TEST_F(EnergyStreamerTest, StreamsAtRequestedRate) {
+    constexpr uint32_t kRate = 200;
+    constexpr uint32_t kSamples = 40;
+    std::shared_ptr<MessageQueueSync> queue;
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(Status::SUCCESS, mStreamer.startStream(kRate, kSamples, &queue));
+
+    std::vector<uint64_t> reads = readSamples(queue, kSamples);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_EQ(kSamples, reads.size());
+    for (size_t i = 1; i < reads.size(); i++) {
+        EXPECT_EQ(reads[i - 1] + 1, reads[i]);
+    }
+    // The first sample is taken right away
+    EXPECT_GE(elapsed, std::chrono::milliseconds(1000 * (kSamples - 1) / kRate));
+
+    waitForStreamsToEnd();
+    EnergyStreamer::Stats stats = mStreamer.getStats();
+    EXPECT_EQ(kSamples, stats.samplesWritten);
+    EXPECT_EQ(0u, stats.samplesDropped);
+}
+
+TEST_F(EnergyStreamerTest, BatchesHighRateStreams) {
+    constexpr uint32_t kSamples = 100;
+    std::shared_ptr<MessageQueueSync> queue;
+    ASSERT_EQ(Status::SUCCESS, mStreamer.startStream(1000, kSamples, &queue));
+    EXPECT_EQ(kSamples, readSamples(queue, kSamples).size());
+
+    waitForStreamsToEnd();
+    EnergyStreamer::Stats stats = mStreamer.getStats();
+    EXPECT_EQ(kSamples, stats.samplesWritten);
+    // 10 samples per batch at 1 kHz, plus any batches split by a lagging reader
+    EXPECT_LT(stats.batchesWritten, kSamples / 2);
+}
+
+TEST_F(EnergyStreamerTest, ConcurrentStreamsShareSampler) {
+    constexpr uint32_t kSamples = 50;
+    std::shared_ptr<MessageQueueSync> fast;
+    std::shared_ptr<MessageQueueSync> slow;
+    ASSERT_EQ(Status::SUCCESS, mStreamer.startStream(100, kSamples, &fast));
+    ASSERT_EQ(Status::SUCCESS, mStreamer.startStream(50, kSamples / 2, &slow));
+
+    std::vector<uint64_t> slowReads;
+    std::thread slowReader([&]() { slowReads = readSamples(slow, kSamples / 2); });
+    std::vector<uint64_t> fastReads = readSamples(fast, kSamples);
+    slowReader.join();
+    ASSERT_EQ(kSamples, fastReads.size());
+    ASSERT_EQ(kSamples / 2, slowReads.size());
+
+    // The slower stream is served by every other read of the faster one
+    std::set<uint64_t> fastSet(fastReads.begin(), fastReads.end());
+    for (uint64_t read : slowReads) {
+        EXPECT_EQ(1u, fastSet.count(read)) << "read " << read;
+    }
+
+    waitForStreamsToEnd();
+    EXPECT_LE(mStreamer.getStats().reads, kSamples + 2);
+    std::lock_guard<std::mutex> lock(mLock);
+    EXPECT_EQ(1u, mThreads.size());
+}
+
+TEST_F(EnergyStreamerTest, LimitsConcurrentStreams) {
+    std::vector<std::shared_ptr<MessageQueueSync>> queues(EnergyStreamer::kMaxStreams);
+    for (auto& queue : queues) {
+        ASSERT_EQ(Status::SUCCESS, mStreamer.startStream(10, 100, &queue));
+    }
+    std::shared_ptr<MessageQueueSync> queue;
+    EXPECT_EQ(Status::INSUFFICIENT_RESOURCES, mStreamer.startStream(10, 100, &queue));
+    EXPECT_EQ(nullptr, queue);
+    EXPECT_EQ(EnergyStreamer::kMaxStreams, mStreamer.getStats().activeStreams);
+}
+
+TEST_F(EnergyStreamerTest, EmptyStream) {
+    std::shared_ptr<MessageQueueSync> queue;
+    ASSERT_EQ(Status::SUCCESS, mStreamer.startStream(0, 10, &queue));
+    ASSERT_NE(nullptr, queue);
+    EXPECT_TRUE(queue->isValid());
+    EXPECT_EQ(0u, mStreamer.getStats().activeStreams);
+}
+
+TEST_F(EnergyStreamerTest, DropsSamplesReaderDoesNotTake) {
+    // More samples than the queue holds, and nobody reading them
+    constexpr uint32_t kQueueSamples = EnergyStreamer::kQueueSize / kRails;
+    constexpr uint32_t kSamples = kQueueSamples + 20;
+    std::shared_ptr<MessageQueueSync> queue;
+    ASSERT_EQ(Status::SUCCESS, mStreamer.startStream(1000, kSamples, &queue));
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+    while (mStreamer.getStats().activeStreams > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    EnergyStreamer::Stats stats = mStreamer.getStats();
+    EXPECT_EQ(0u, stats.activeStreams);
+    EXPECT_EQ(kQueueSamples, stats.samplesWritten);
+    EXPECT_EQ(kSamples - kQueueSamples, stats.samplesDropped);
+
+    // What was written is the start of the stream
+    std::vector<uint64_t> reads = readSamples(queue, 1);
+    ASSERT_EQ(1u, reads.size());
+    EXPECT_EQ(1u, reads[0]);
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include "PowerStats.h"
+
+using ::android::sp;
+using ::android::base::TemporaryDir;
+using ::android::base::WriteStringToFile;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::power::stats::V1_0::EnergyData;
+using ::android::hardware::power::stats::V1_0::RailInfo;
+using ::android::hardware::power::stats::V1_0::Status;
+using ::android::hardware::power::stats::V1_0::implementation::PowerStats;
+
+// Lays out fake IIO power monitors the way the kernel driver exposes them in sysfs
+class PowerStatsTest : public ::testing::Test {
+   protected:
+    void addDevice(const std::string& device, const std::string& name,
+                   const std::string& enabledRails = "", const std::string& energyValue = "") {
+        std::string path = deviceDir(device);
+        ASSERT_EQ(0, mkdir(path.c_str(), 0755));
+        ASSERT_TRUE(WriteStringToFile(name, path + "/name"));
+        ASSERT_TRUE(WriteStringToFile("1000\n", path + "/sampling_rate"));
+        ASSERT_TRUE(WriteStringToFile(enabledRails, path + "/enabled_rails"));
+        ASSERT_TRUE(WriteStringToFile(energyValue, path + "/energy_value"));
+    }
+
+    // Rewrites the node in place, as the open file descriptor must see the new contents
+    void setEnergyValue(const std::string& device, const std::string& energyValue) {
+        ASSERT_TRUE(WriteStringToFile(energyValue, deviceDir(device) + "/energy_value"));
+    }
+
+    std::string deviceDir(const std::string& device) {
+        return std::string(mIioDir.path) + "/" + device;
+    }
+
+    sp<PowerStats> createPowerStats() { return new PowerStats(std::string(mIioDir.path) + "/"); }
+
+    static Status getEnergyData(const sp<PowerStats>& powerStats, const hidl_vec<uint32_t>& rails,
+                                std::vector<EnergyData>* data) {
+        Status status = Status::NOT_SUPPORTED;
+        powerStats->getEnergyData(rails, [&](const hidl_vec<EnergyData>& rData, Status rStatus) {
+            *data = rData;
+            status = rStatus;
+        });
+        return status;
+    }
+
+    TemporaryDir mIioDir;
+};
+
+TEST_F(PowerStatsTest, NoPowerMonitor) {
+    addDevice("iio:device0", "accelerometer\n");
+    sp<PowerStats> powerStats = createPowerStats();
+
+    std::vector<EnergyData> data;
+    EXPECT_EQ(Status::NOT_SUPPORTED, getEnergyData(powerStats, {}, &data));
+}
+
+TEST_F(PowerStatsTest, ReadsRails) {
+    addDevice("iio:device0", "pm_device_name\n", "RAIL_B:SUBSYS_B\nRAIL_A:SUBSYS_A\n",
+              "1000\nRAIL_B,200\nRAIL_A,100\n");
+    sp<PowerStats> powerStats = createPowerStats();
+
+    hidl_vec<RailInfo> rails;
+    powerStats->getRailInfo([&](const hidl_vec<RailInfo>& rInfo, Status status) {
+        EXPECT_EQ(Status::SUCCESS, status);
+        rails = rInfo;
+    });
+    ASSERT_EQ(2u, rails.size());
+    EXPECT_EQ("RAIL_B", rails[0].railName);
+    EXPECT_EQ("SUBSYS_B", rails[0].subsysName);
+    EXPECT_EQ(1000u, rails[0].samplingRate);
+    EXPECT_EQ("RAIL_A", rails[1].railName);
+
+    std::vector<EnergyData> data;
+    ASSERT_EQ(Status::SUCCESS, getEnergyData(powerStats, {}, &data));
+    ASSERT_EQ(2u, data.size());
+    EXPECT_EQ(0u, data[0].index);
+    EXPECT_EQ(1000u, data[0].timestamp);
+    EXPECT_EQ(200u, data[0].energy);
+    EXPECT_EQ(1u, data[1].index);
+    EXPECT_EQ(100u, data[1].energy);
+
+    ASSERT_EQ(Status::SUCCESS, getEnergyData(powerStats, {1}, &data));
+    ASSERT_EQ(1u, data.size());
+    EXPECT_EQ(1u, data[0].index);
+    EXPECT_EQ(100u, data[0].energy);
+
+    EXPECT_EQ(Status::INVALID_INPUT, getEnergyData(powerStats, {2}, &data));
+}
+
+TEST_F(PowerStatsTest, RereadsOpenNodes) {
+    addDevice("iio:device0", "pm_device_name\n", "RAIL_A:SUBSYS_A\n", "1000\nRAIL_A,100\n");
+    sp<PowerStats> powerStats = createPowerStats();
+
+    std::vector<EnergyData> data;
+    ASSERT_EQ(Status::SUCCESS, getEnergyData(powerStats, {}, &data));
+    EXPECT_EQ(100u, data[0].energy);
+
+    // Shorter contents than before, to check the reader doesn't pick up stale bytes
+    setEnergyValue("iio:device0", "2000\nRAIL_A,9\n");
+    ASSERT_EQ(Status::SUCCESS, getEnergyData(powerStats, {}, &data));
+    EXPECT_EQ(2000u, data[0].timestamp);
+    EXPECT_EQ(9u, data[0].energy);
+
+    setEnergyValue("iio:device0", "3000\nRAIL_A, 18446744073709551615\n");
+    ASSERT_EQ(Status::SUCCESS, getEnergyData(powerStats, {}, &data));
+    EXPECT_EQ(18446744073709551615u, data[0].energy);
+}
+
+TEST_F(PowerStatsTest, ReadsAllMonitors) {
+    addDevice("iio:device0", "pm_device_name\n", "RAIL_A:SUBSYS_A\n", "1000\nRAIL_A,100\n");
+    addDevice("iio:device1", "accelerometer\n");
+    addDevice("iio:device2", "pm_device_name\n", "RAIL_C:SUBSYS_C\n",
+              "1001\nRAIL_UNKNOWN,5\nRAIL_C,300\n");
+    sp<PowerStats> powerStats = createPowerStats();
+
+    std::vector<EnergyData> data;
+    ASSERT_EQ(Status::SUCCESS, getEnergyData(powerStats, {}, &data));
+    ASSERT_EQ(2u, data.size());
+    uint64_t total = 0;
+    for (const auto& reading : data) total += reading.energy;
+    EXPECT_EQ(400u, total);
+}
+
+TEST_F(PowerStatsTest, RejectsMalformedNode) {
+    addDevice("iio:device0", "pm_device_name\n", "RAIL_A:SUBSYS_A\n", "1000\nRAIL_A,100\n");
+    sp<PowerStats> powerStats = createPowerStats();
+
+    std::vector<EnergyData> data;
+    setEnergyValue("iio:device0", "1000\nRAIL_A,100,7\n");
+    EXPECT_EQ(Status::FILESYSTEM_ERROR, getEnergyData(powerStats, {}, &data));
+
+    setEnergyValue("iio:device0", "1000\n\nRAIL_A,100\n");
+    EXPECT_EQ(Status::FILESYSTEM_ERROR, getEnergyData(powerStats, {}, &data));
+
+    setEnergyValue("iio:device0", "1000\nRAIL_A,100\n");
+    EXPECT_EQ(Status::SUCCESS, getEnergyData(powerStats, {}, &data));
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares the two ways a client can upload bulk data into an Allocation:
+ *  - allocation[12]DWrite, passing the data as a hidl_vec over the client's buffer,
+ *  - copying straight into the memory returned by allocationGetPointer.
+ * Run it with debug.rs.default-CPU-driver set to 1 to measure the CPU reference driver on a device
+ * that has a vendor driver.
+ */
+
+#include <android/hardware/renderscript/1.0/IContext.h>
+#include <android/hardware/renderscript/1.0/IDevice.h>
+#include <benchmark/benchmark.h>
+
+#include <string.h>
+#include <vector>
+
+using ::android::sp;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::renderscript::V1_0::Allocation;
+using ::android::hardware::renderscript::V1_0::AllocationCubemapFace;
+using ::android::hardware::renderscript::V1_0::AllocationMipmapControl;
+using ::android::hardware::renderscript::V1_0::AllocationUsageType;
+using ::android::hardware::renderscript::V1_0::ContextType;
+using ::android::hardware::renderscript::V1_0::DataKind;
+using ::android::hardware::renderscript::V1_0::DataType;
+using ::android::hardware::renderscript::V1_0::Element;
+using ::android::hardware::renderscript::V1_0::IContext;
+using ::android::hardware::renderscript::V1_0::IDevice;
+using ::android::hardware::renderscript::V1_0::Ptr;
+using ::android::hardware::renderscript::V1_0::Size;
+using ::android::hardware::renderscript::V1_0::Type;
+using ::android::hardware::renderscript::V1_0::YuvFormat;
+
+namespace {
+
+constexpr uint32_t kRowBytes = 4096;
+
+class RsContext {
+   public:
+    bool init() {
+        sp<IDevice> device = IDevice::getService();
+        if (device == nullptr) {
+            return false;
+        }
+        mContext = device->contextCreate(0, ContextType::NORMAL, 0);
+        return mContext != nullptr;
+    }
+
+    ~RsContext() {
+        if (mContext != nullptr) {
+            mContext->contextFinish();
+            mContext->contextDestroy();
+        }
+    }
+
+    // A U8 allocation of dimX x dimY bytes, dimY 0 for a 1D one
+    Allocation createAllocation(uint32_t dimX, uint32_t dimY) {
+        Element element = mContext->elementCreate(DataType::UNSIGNED_8, DataKind::USER, false, 1);
+        Type type = mContext->typeCreate(element, dimX, dimY, 0, false, false,
+                                         YuvFormat::YUV_NONE);
+        return mContext->allocationCreateTyped(type, AllocationMipmapControl::NONE,
+                                               (int)AllocationUsageType::SCRIPT, (Ptr)nullptr);
+    }
+
+    uint8_t* getPointer(Allocation allocation, Size* stride) {
+        uint8_t* pointer = nullptr;
+        mContext->allocationGetPointer(allocation, 0, AllocationCubemapFace::POSITIVE_X, 0,
+                                       [&](Ptr dataPtr, Size dataStride) {
+                                           pointer = static_cast<uint8_t*>(dataPtr);
+                                           *stride = dataStride;
+                                       });
+        return pointer;
+    }
+
+    const sp<IContext>& context() { return mContext; }
+
+   private:
+    sp<IContext> mContext;
+};
+
+void BM_Allocation1DWrite(benchmark::State& state) {
+    uint32_t size = state.range(0);
+    RsContext rs;
+    if (!rs.init()) {
+        state.SkipWithError("RenderScript HAL unavailable");
+        return;
+    }
+    Allocation allocation = rs.createAllocation(size, 0);
+    std::vector<uint8_t> source(size, 0x5a);
+    hidl_vec<uint8_t> data;
+    data.setToExternal(source.data(), source.size());
+
+    for (auto _ : state) {
+        rs.context()->allocation1DWrite(allocation, 0, 0, size, data);
+        rs.context()->contextFinish();
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_Allocation1DWrite)->Range(4 << 10, 16 << 20);
+
+void BM_Allocation1DPointerCopy(benchmark::State& state) {
+    uint32_t size = state.range(0);
+    RsContext rs;
+    if (!rs.init()) {
+        state.SkipWithError("RenderScript HAL unavailable");
+        return;
+    }
+    Allocation allocation = rs.createAllocation(size, 0);
+    std::vector<uint8_t> source(size, 0x5a);
+
+    for (auto _ : state) {
+        Size stride = 0;
+        uint8_t* pointer = rs.getPointer(allocation, &stride);
+        if (pointer == nullptr) {
+            state.SkipWithError("allocationGetPointer failed");
+            break;
+        }
+        memcpy(pointer, source.data(), size);
+        rs.context()->contextFinish();
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_Allocation1DPointerCopy)->Range(4 << 10, 16 << 20);
+
+void BM_Allocation2DWrite(benchmark::State& state) {
+    uint32_t rows = state.range(0);
+    RsContext rs;
+    if (!rs.init()) {
+        state.SkipWithError("RenderScript HAL unavailable");
+        return;
+    }
+    Allocation allocation = rs.createAllocation(kRowBytes, rows);
+    std::vector<uint8_t> source(kRowBytes * rows, 0x5a);
+    hidl_vec<uint8_t> data;
+    data.setToExternal(source.data(), source.size());
+
+    for (auto _ : state) {
+        rs.context()->allocation2DWrite(allocation, 0, 0, 0, AllocationCubemapFace::POSITIVE_X,
+                                        kRowBytes, rows, data, kRowBytes);
+        rs.context()->contextFinish();
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_Allocation2DWrite)->Range(16, 4096);
+
+// Row by row, as the driver may pad rows beyond what the client asked for
+void BM_Allocation2DPointerCopy(benchmark::State& state) {
+    uint32_t rows = state.range(0);
+    RsContext rs;
+    if (!rs.init()) {
+        state.SkipWithError("RenderScript HAL unavailable");
+        return;
+    }
+    Allocation allocation = rs.createAllocation(kRowBytes, rows);
+    std::vector<uint8_t> source(kRowBytes * rows, 0x5a);
+
+    for (auto _ : state) {
+        Size stride = 0;
+        uint8_t* pointer = rs.getPointer(allocation, &stride);
+        if (pointer == nullptr || stride < kRowBytes) {
+            state.SkipWithError("allocationGetPointer failed");
+            break;
+        }
+        for (uint32_t row = 0; row < rows; row++) {
+            memcpy(pointer + row * stride, source.data() + row * kRowBytes, kRowBytes);
+        }
+        rs.context()->contextFinish();
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_Allocation2DPointerCopy)->Range(16, 4096);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LatencyStats.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V1_0 {
+namespace implementation {
+
+void LatencyStats::Histogram::record(int64_t latencyNs) {
+    latencyNs = std::max<int64_t>(latencyNs, 0);
+
+    size_t bucket = 0;
+    for (uint64_t us = latencyNs / 1000; us != 0 && bucket < kNumBuckets - 1; us >>= 1) {
+        bucket++;
+    }
+
+    buckets[bucket]++;
+    count++;
+    sumNs += latencyNs;
+    maxNs = std::max(maxNs, latencyNs);
+}
+
+void LatencyStats::Histogram::dump(int fd, const char* label) const {
+    if (count == 0) {
+        return;
+    }
+
+    dprintf(fd, "    %s latency: count %" PRIu64 ", mean %.3f ms, max %.3f ms\n", label, count,
+            sumNs / 1e6 / count, maxNs / 1e6);
+    dprintf(fd, "     ");
+    for (size_t i = 0; i < kNumBuckets; i++) {
+        if (buckets[i] == 0) {
+            continue;
+        }
+        if (i == kNumBuckets - 1) {
+            dprintf(fd, " >=%" PRIu64 "us:%" PRIu64, uint64_t(1) << (i - 1), buckets[i]);
+        } else {
+            dprintf(fd, " <%" PRIu64 "us:%" PRIu64, uint64_t(1) << i, buckets[i]);
+        }
+    }
+    dprintf(fd, "\n");
+}
+
+void LatencyStats::addSensor(int32_t sensorHandle, const std::string& name, bool isWakeUpSensor) {
+    std::lock_guard<std::mutex> lock(mLock);
+    SensorStats& stats = mSensors[sensorHandle];
+    stats.name = name;
+    stats.isWakeUpSensor = isWakeUpSensor;
+}
+
+LatencyStats::SensorStats* LatencyStats::getLocked(int32_t sensorHandle) {
+    return &mSensors[sensorHandle];
+}
+
+void LatencyStats::popPendingWakeUpsLocked() {
+    mPendingHead = (mPendingHead + 1) % kMaxPendingWakeUps;
+    mPendingCount--;
+}
+
+void LatencyStats::recordDelivered(const Event* events, size_t count, int64_t nowNs) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    // Batches hold runs of events from the same sensor, so only look up the first of each run
+    for (size_t i = 0; i < count;) {
+        int32_t sensorHandle = events[i].sensorHandle;
+        SensorStats* stats = getLocked(sensorHandle);
+
+        size_t runStart = i;
+        for (; i < count && events[i].sensorHandle == sensorHandle; i++) {
+            // Meta data events, such as flush complete events, do not carry a timestamp
+            if (events[i].sensorType != SensorType::META_DATA && events[i].timestamp > 0) {
+                stats->delivery.record(nowNs - events[i].timestamp);
+            }
+        }
+        stats->delivered += i - runStart;
+
+        if (stats->isWakeUpSensor) {
+            if (mPendingCount == kMaxPendingWakeUps) {
+                const PendingWakeUps& oldest = mPendingWakeUps[mPendingHead];
+                getLocked(oldest.sensorHandle)->abandoned += oldest.count;
+                popPendingWakeUpsLocked();
+            }
+            mPendingWakeUps[(mPendingHead + mPendingCount) % kMaxPendingWakeUps] = {
+                    nowNs, sensorHandle, i - runStart};
+            mPendingCount++;
+        }
+    }
+}
+
+void LatencyStats::recordDropped(const Event* events, size_t count) {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (size_t i = 0; i < count;) {
+        int32_t sensorHandle = events[i].sensorHandle;
+        size_t runStart = i;
+        while (i < count && events[i].sensorHandle == sensorHandle) {
+            i++;
+        }
+        getLocked(sensorHandle)->dropped += i - runStart;
+    }
+}
+
+void LatencyStats::recordWakeUpHandled(size_t count, int64_t nowNs) {
+    std::lock_guard<std::mutex> lock(mLock);
+    while (count > 0 && mPendingCount > 0) {
+        PendingWakeUps& pending = mPendingWakeUps[mPendingHead];
+        size_t handled = std::min(count, pending.count);
+
+        Histogram& acknowledgement = getLocked(pending.sensorHandle)->acknowledgement;
+        for (size_t i = 0; i < handled; i++) {
+            acknowledgement.record(nowNs - pending.deliveredNs);
+        }
+
+        count -= handled;
+        pending.count -= handled;
+        if (pending.count == 0) {
+            popPendingWakeUpsLocked();
+        }
+    }
+}
+
+void LatencyStats::abandonWakeUpEvents() {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (; mPendingCount > 0; popPendingWakeUpsLocked()) {
+        const PendingWakeUps& pending = mPendingWakeUps[mPendingHead];
+        getLocked(pending.sensorHandle)->abandoned += pending.count;
+    }
+}
+
+void LatencyStats::dump(int fd) const {
+    // The fd may be slow to drain, so print a copy rather than hold up the recording paths
+    std::map<int32_t, SensorStats> sensors;
+    size_t pendingCount;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        sensors = mSensors;
+        pendingCount = mPendingCount;
+    }
+
+    dprintf(fd, "Sensor event latency:\n");
+    for (const auto& entry : sensors) {
+        const SensorStats& stats = entry.second;
+        dprintf(fd, "  0x%08x %s%s: delivered %" PRIu64 ", dropped %" PRIu64, entry.first,
+                stats.name.empty() ? "(unknown)" : stats.name.c_str(),
+                stats.isWakeUpSensor ? " (wake-up)" : "", stats.delivered, stats.dropped);
+        if (stats.isWakeUpSensor) {
+            dprintf(fd, ", unacknowledged %" PRIu64, stats.abandoned);
+        }
+        dprintf(fd, "\n");
+        stats.delivery.dump(fd, "delivery");
+        stats.acknowledgement.dump(fd, "acknowledgement");
+    }
+    dprintf(fd, "  WAKE_UP event runs awaiting acknowledgement: %zu\n", pendingCount);
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
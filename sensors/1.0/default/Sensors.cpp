@@ -19,6 +19,7 @@
 #include "multihal.h"
 
 #include <android-base/logging.h>
+#include <utils/SystemClock.h>
 
 #include <sys/stat.h>
 
@@ -56,7 +57,9 @@ static Result ResultFromStatus(status_t err) {
 Sensors::Sensors()
     : mInitCheck(NO_INIT),
       mSensorModule(nullptr),
-      mSensorDevice(nullptr) {
+      mSensorDevice(nullptr),
+      mPollBuffer(kPollMaxBufferSize),
+      mPollEvents(kPollMaxBufferSize) {
     status_t err = OK;
     if (UseMultiHal()) {
         mSensorModule = ::get_multi_hal_module_info();
@@ -106,6 +109,18 @@ Sensors::Sensors()
         }
     }
 
+    sensor_t const *list;
+    int count = mSensorModule->get_sensors_list(mSensorModule, &list);
+    if (count < 0) {
+        LOG(ERROR) << "get_sensors_list failed: " << count;
+        count = 0;
+    }
+    // The 1.0 HAL has no way for the framework to acknowledge WAKE_UP events, so every sensor is
+    // declared without acknowledgement tracking.
+    for (int i = 0; i < count; ++i) {
+        mLatencyStats.addSensor(list[i].handle, list[i].name, false /* isWakeUpSensor */);
+    }
+
     mInitCheck = OK;
 }
 
@@ -162,7 +177,7 @@ Return<void> Sensors::poll(int32_t maxCount, poll_cb _hidl_cb) {
     hidl_vec<Event> out;
     hidl_vec<SensorInfo> dynamicSensorsAdded;
 
-    std::unique_ptr<sensors_event_t[]> data;
+    std::unique_lock<std::mutex> bufferLock;
     int err = android::NO_ERROR;
 
     { // scope of reentry lock
@@ -186,11 +201,14 @@ Return<void> Sensors::poll(int32_t maxCount, poll_cb _hidl_cb) {
         if (maxCount <= 0) {
             err = android::BAD_VALUE;
         } else {
+            // Held until the events have been delivered so that the buffers are not reused by
+            // another call to poll() while the client is still reading them.
+            bufferLock = std::unique_lock<std::mutex>(mPollBufferLock);
+
             int bufferSize = maxCount <= kPollMaxBufferSize ? maxCount : kPollMaxBufferSize;
-            data.reset(new sensors_event_t[bufferSize]);
             err = mSensorDevice->poll(
                     reinterpret_cast<sensors_poll_device_t *>(mSensorDevice),
-                    data.get(), bufferSize);
+                    mPollBuffer.data(), bufferSize);
         }
     }
 
@@ -200,6 +218,7 @@ Return<void> Sensors::poll(int32_t maxCount, poll_cb _hidl_cb) {
     }
 
     const size_t count = (size_t)err;
+    const sensors_event_t *data = mPollBuffer.data();
 
     for (size_t i = 0; i < count; ++i) {
         if (data[i].type != SENSOR_TYPE_DYNAMIC_SENSOR_META) {
@@ -217,14 +236,16 @@ Return<void> Sensors::poll(int32_t maxCount, poll_cb _hidl_cb) {
 
         SensorInfo info;
         convertFromSensor(*dyn->sensor, &info);
+        mLatencyStats.addSensor(dyn->handle, dyn->sensor->name, false /* isWakeUpSensor */);
 
         size_t numDynamicSensors = dynamicSensorsAdded.size();
         dynamicSensorsAdded.resize(numDynamicSensors + 1);
         dynamicSensorsAdded[numDynamicSensors] = info;
     }
 
-    out.resize(count);
-    convertFromSensorEvents(err, data.get(), &out);
+    convertFromSensorEvents(count, data, mPollEvents.data());
+    out.setToExternal(mPollEvents.data(), count);
+    mLatencyStats.recordDelivered(mPollEvents.data(), count, ::android::elapsedRealtimeNano());
 
     _hidl_cb(Result::OK, out, dynamicSensorsAdded);
 
@@ -328,17 +349,15 @@ Return<void> Sensors::configDirectReport(
     return Void();
 }
 
-// static
-void Sensors::convertFromSensorEvents(
-        size_t count,
-        const sensors_event_t *srcArray,
-        hidl_vec<Event> *dstVec) {
-    for (size_t i = 0; i < count; ++i) {
-        const sensors_event_t &src = srcArray[i];
-        Event *dst = &(*dstVec)[i];
-
-        convertFromSensorEvent(src, dst);
+Return<void> Sensors::debug(
+        const hidl_handle& fd, const hidl_vec<hidl_string>& /* options */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        LOG(ERROR) << "debug called with no handle";
+        return Void();
     }
+
+    mLatencyStats.dump(fd->data[0]);
+    return Void();
 }
 
 ISensors *HIDL_FETCH_ISensors(const char * /* hal */) {
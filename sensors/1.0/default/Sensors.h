@@ -18,10 +18,13 @@
 
 #define HARDWARE_INTERFACES_SENSORS_V1_0_DEFAULT_SENSORS_H_
 
+#include "LatencyStats.h"
+
 #include <android-base/macros.h>
 #include <android/hardware/sensors/1.0/ISensors.h>
 #include <hardware/sensors.h>
 #include <mutex>
+#include <vector>
 
 namespace android {
 namespace hardware {
@@ -62,6 +65,9 @@ struct Sensors : public ::android::hardware::sensors::V1_0::ISensors {
             int32_t sensorHandle, int32_t channelHandle, RateLevel rate,
             configDirectReport_cb _hidl_cb) override;
 
+    Return<void> debug(
+            const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
 private:
     static constexpr int32_t kPollMaxBufferSize = 128;
     status_t mInitCheck;
@@ -69,10 +75,16 @@ private:
     sensors_poll_device_1_t *mSensorDevice;
     std::mutex mPollLock;
 
-    int getHalDeviceVersion() const;
+    // Buffers reused by every call to poll(), guarded by mPollBufferLock until the events
+    // have been handed to the client.
+    std::mutex mPollBufferLock;
+    std::vector<sensors_event_t> mPollBuffer;
+    std::vector<Event> mPollEvents;
 
-    static void convertFromSensorEvents(
-            size_t count, const sensors_event_t *src, hidl_vec<Event> *dst);
+    // Latency of the events returned by poll(), reported by debug()
+    LatencyStats mLatencyStats;
+
+    int getHalDeviceVersion() const;
 
     DISALLOW_COPY_AND_ASSIGN(Sensors);
 };
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <sensors/convert.h>
+#include <string.h>
+
+#include <memory>
+#include <vector>
+
+using ::android::hardware::hidl_vec;
+using ::android::hardware::sensors::V1_0::Event;
+using ::android::hardware::sensors::V1_0::implementation::convertFromSensorEvent;
+using ::android::hardware::sensors::V1_0::implementation::convertFromSensorEvents;
+
+namespace {
+
+// Matches Sensors::kPollMaxBufferSize
+constexpr size_t kPollMaxBufferSize = 128;
+
+enum Workload {
+    // A single accelerometer batch
+    ACCEL_ONLY = 0,
+    // Accelerometer, gyroscope and magnetometer batches flushed one after the other
+    IMU_RUNS = 1,
+    // Accelerometer and light events interleaved one by one
+    INTERLEAVED = 2,
+};
+
+std::vector<sensors_event_t> makeEvents(Workload workload) {
+    std::vector<sensors_event_t> events(kPollMaxBufferSize);
+    for (size_t i = 0; i < events.size(); ++i) {
+        sensors_event_t& ev = events[i];
+        ev.version = sizeof(sensors_event_t);
+        ev.timestamp = 1000000 * i;
+
+        switch (workload) {
+            case ACCEL_ONLY:
+                ev.type = SENSOR_TYPE_ACCELEROMETER;
+                break;
+            case IMU_RUNS: {
+                static const int32_t kTypes[] = {SENSOR_TYPE_ACCELEROMETER, SENSOR_TYPE_GYROSCOPE,
+                                                 SENSOR_TYPE_MAGNETIC_FIELD};
+                ev.type = kTypes[i * 3 / events.size()];
+                break;
+            }
+            case INTERLEAVED:
+                ev.type = (i % 2) ? SENSOR_TYPE_LIGHT : SENSOR_TYPE_ACCELEROMETER;
+                break;
+        }
+
+        ev.sensor = ev.type;
+        ev.acceleration.x = 0.1f * i;
+        ev.acceleration.y = 0.2f * i;
+        ev.acceleration.z = 9.8f;
+        ev.acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
+    }
+    return events;
+}
+
+}  // namespace
+
+// The conversion done by poll() before persistent buffers: a new event buffer and a new
+// hidl_vec on every call, converting one event at a time.
+static void BM_PollConvertPerEvent(benchmark::State& state) {
+    std::vector<sensors_event_t> events = makeEvents(static_cast<Workload>(state.range(0)));
+
+    for (auto _ : state) {
+        std::unique_ptr<sensors_event_t[]> data(new sensors_event_t[kPollMaxBufferSize]);
+        memcpy(data.get(), events.data(), events.size() * sizeof(sensors_event_t));
+
+        hidl_vec<Event> out;
+        out.resize(events.size());
+        for (size_t i = 0; i < events.size(); ++i) {
+            convertFromSensorEvent(data[i], &out[i]);
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * events.size());
+}
+BENCHMARK(BM_PollConvertPerEvent)->Arg(ACCEL_ONLY)->Arg(IMU_RUNS)->Arg(INTERLEAVED);
+
+// The conversion done by poll() now: persistent buffers and conversion grouped by sensor type.
+static void BM_PollConvertGrouped(benchmark::State& state) {
+    std::vector<sensors_event_t> events = makeEvents(static_cast<Workload>(state.range(0)));
+    std::vector<sensors_event_t> data(kPollMaxBufferSize);
+    std::vector<Event> converted(kPollMaxBufferSize);
+
+    for (auto _ : state) {
+        memcpy(data.data(), events.data(), events.size() * sizeof(sensors_event_t));
+
+        hidl_vec<Event> out;
+        convertFromSensorEvents(events.size(), data.data(), converted.data());
+        out.setToExternal(converted.data(), events.size());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * events.size());
+}
+BENCHMARK(BM_PollConvertGrouped)->Arg(ACCEL_ONLY)->Arg(IMU_RUNS)->Arg(INTERLEAVED);
+
+BENCHMARK_MAIN();
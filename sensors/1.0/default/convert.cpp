@@ -198,6 +198,56 @@ void convertFromSensorEvent(const sensors_event_t &src, Event *dst) {
     }
 }
 
+static bool isVec3SensorType(int32_t type) {
+    switch (type) {
+        case SENSOR_TYPE_ACCELEROMETER:
+        case SENSOR_TYPE_MAGNETIC_FIELD:
+        case SENSOR_TYPE_ORIENTATION:
+        case SENSOR_TYPE_GYROSCOPE:
+        case SENSOR_TYPE_GRAVITY:
+        case SENSOR_TYPE_LINEAR_ACCELERATION:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void convertFromSensorEvents(size_t count, const sensors_event_t *src, Event *dst) {
+    typedef ::android::hardware::sensors::V1_0::SensorType SensorType;
+
+    size_t i = 0;
+    while (i < count) {
+        // Batched events are typically delivered as runs of the same sensor type, so pick the
+        // conversion once per run rather than once per event.
+        const int32_t type = src[i].type;
+        size_t end = i + 1;
+        while (end < count && src[end].type == type) {
+            ++end;
+        }
+
+        if (isVec3SensorType(type)) {
+            for (; i < end; ++i) {
+                // The whole event is sent over HIDL, so the rest of the union must not keep the
+                // bytes of a previous event converted into the same buffer.
+                Event *d = &dst[i];
+                *d = {
+                    .sensorHandle = src[i].sensor,
+                    .sensorType = (SensorType)type,
+                    .timestamp = src[i].timestamp
+                };
+                d->u.vec3.x = src[i].acceleration.x;
+                d->u.vec3.y = src[i].acceleration.y;
+                d->u.vec3.z = src[i].acceleration.z;
+                d->u.vec3.status = (SensorStatus)src[i].acceleration.status;
+            }
+        } else {
+            for (; i < end; ++i) {
+                convertFromSensorEvent(src[i], &dst[i]);
+            }
+        }
+    }
+}
+
 void convertToSensorEvent(const Event &src, sensors_event_t *dst) {
     *dst = {.version = sizeof(sensors_event_t),
             .sensor = src.sensorHandle,
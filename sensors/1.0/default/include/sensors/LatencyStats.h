@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HARDWARE_INTERFACES_SENSORS_V1_0_DEFAULT_INCLUDE_LATENCY_STATS_H_
+
+#define HARDWARE_INTERFACES_SENSORS_V1_0_DEFAULT_INCLUDE_LATENCY_STATS_H_
+
+#include <android/hardware/sensors/1.0/types.h>
+
+#include <array>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V1_0 {
+namespace implementation {
+
+/*
+ * Per-sensor delivery statistics, printed by ISensors::debug().
+ *
+ * Two latencies are tracked, each in a histogram with power-of-two buckets:
+ *  - delivery: from the event timestamp until the event was handed to the framework,
+ *  - acknowledgement: from delivery of a WAKE_UP event until the framework reported it as
+ *    handled.
+ * Events that could not be delivered at all are counted as dropped.
+ *
+ * Recording takes one short lock per batch and never allocates once every sensor has been seen,
+ * so it is cheap enough to leave enabled on production devices.
+ */
+class LatencyStats {
+   public:
+    /*
+     * Declare a sensor so that it is listed by dump() and its WAKE_UP events are tracked until
+     * they are acknowledged. Events from undeclared sensors are still counted.
+     */
+    void addSensor(int32_t sensorHandle, const std::string& name, bool isWakeUpSensor);
+
+    /*
+     * Record events handed to the framework at nowNs, which must use the same clock as the event
+     * timestamps (elapsedRealtimeNano).
+     */
+    void recordDelivered(const Event* events, size_t count, int64_t nowNs);
+
+    /*
+     * Record events that were discarded instead of being handed to the framework.
+     */
+    void recordDropped(const Event* events, size_t count);
+
+    /*
+     * Record that the framework has handled the oldest count WAKE_UP events delivered so far.
+     */
+    void recordWakeUpHandled(size_t count, int64_t nowNs);
+
+    /*
+     * Stop waiting for acknowledgement of the WAKE_UP events delivered so far, for example when
+     * the wake lock is released because the framework did not respond in time.
+     */
+    void abandonWakeUpEvents();
+
+    void dump(int fd) const;
+
+   private:
+    // Bucket i counts latencies in [2^(i-1), 2^i) microseconds; bucket 0 counts those below 1 us
+    // and the last bucket also counts everything beyond it.
+    static constexpr size_t kNumBuckets = 26;
+
+    struct Histogram {
+        std::array<uint64_t, kNumBuckets> buckets{};
+        uint64_t count = 0;
+        int64_t sumNs = 0;
+        int64_t maxNs = 0;
+
+        void record(int64_t latencyNs);
+        void dump(int fd, const char* label) const;
+    };
+
+    struct SensorStats {
+        std::string name;
+        bool isWakeUpSensor = false;
+        Histogram delivery;
+        Histogram acknowledgement;
+        uint64_t delivered = 0;
+        uint64_t dropped = 0;
+        uint64_t abandoned = 0;
+    };
+
+    // Consecutive WAKE_UP events from one sensor that were delivered together
+    struct PendingWakeUps {
+        int64_t deliveredNs;
+        int32_t sensorHandle;
+        size_t count;
+    };
+
+    // Bounds the memory used if the framework stops acknowledging WAKE_UP events
+    static constexpr size_t kMaxPendingWakeUps = 1024;
+
+    SensorStats* getLocked(int32_t sensorHandle);
+    void popPendingWakeUpsLocked();
+
+    mutable std::mutex mLock;
+    std::map<int32_t, SensorStats> mSensors;
+    // Ring buffer of the WAKE_UP event runs awaiting acknowledgement, oldest first
+    std::array<PendingWakeUps, kMaxPendingWakeUps> mPendingWakeUps;
+    size_t mPendingHead = 0;
+    size_t mPendingCount = 0;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+
+#endif  // HARDWARE_INTERFACES_SENSORS_V1_0_DEFAULT_INCLUDE_LATENCY_STATS_H_
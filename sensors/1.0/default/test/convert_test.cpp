@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "convert.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+using ::android::hardware::sensors::V1_0::Event;
+using ::android::hardware::sensors::V1_0::SensorStatus;
+using ::android::hardware::sensors::V1_0::SensorType;
+using ::android::hardware::sensors::V1_0::implementation::convertFromSensorEvents;
+
+namespace {
+
+sensors_event_t makeUncalibratedEvent() {
+    sensors_event_t event = {};
+    event.version = sizeof(sensors_event_t);
+    event.sensor = 2;
+    event.type = SENSOR_TYPE_GYROSCOPE_UNCALIBRATED;
+    event.timestamp = 1000;
+    event.uncalibrated_gyro.x_uncalib = 1.0f;
+    event.uncalibrated_gyro.y_uncalib = 2.0f;
+    event.uncalibrated_gyro.z_uncalib = 3.0f;
+    event.uncalibrated_gyro.x_bias = 4.0f;
+    event.uncalibrated_gyro.y_bias = 5.0f;
+    event.uncalibrated_gyro.z_bias = 6.0f;
+    return event;
+}
+
+sensors_event_t makeAccelerometerEvent() {
+    sensors_event_t event = {};
+    event.version = sizeof(sensors_event_t);
+    event.sensor = 1;
+    event.type = SENSOR_TYPE_ACCELEROMETER;
+    event.timestamp = 2000;
+    event.acceleration.x = 0.5f;
+    event.acceleration.y = -0.5f;
+    event.acceleration.z = 9.8f;
+    event.acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
+    return event;
+}
+
+}  // namespace
+
+TEST(ConvertTest, Vec3EventsClearTheRestOfTheUnion) {
+    Event event;
+    sensors_event_t uncalibrated = makeUncalibratedEvent();
+    convertFromSensorEvents(1, &uncalibrated, &event);
+    ASSERT_EQ(SensorType::GYROSCOPE_UNCALIBRATED, event.sensorType);
+    ASSERT_EQ(6.0f, event.u.uncal.z_bias);
+
+    // Same slot, as when poll() reuses its buffer
+    sensors_event_t accelerometer = makeAccelerometerEvent();
+    convertFromSensorEvents(1, &accelerometer, &event);
+    EXPECT_EQ(1, event.sensorHandle);
+    EXPECT_EQ(SensorType::ACCELEROMETER, event.sensorType);
+    EXPECT_EQ(2000, event.timestamp);
+    EXPECT_EQ(0.5f, event.u.vec3.x);
+    EXPECT_EQ(-0.5f, event.u.vec3.y);
+    EXPECT_EQ(9.8f, event.u.vec3.z);
+    EXPECT_EQ(SensorStatus::ACCURACY_HIGH, event.u.vec3.status);
+
+    const uint8_t* payload = reinterpret_cast<const uint8_t*>(&event.u);
+    for (size_t i = sizeof(event.u.vec3); i < sizeof(event.u); i++) {
+        EXPECT_EQ(0, payload[i]) << "at byte " << i;
+    }
+}
+
+TEST(ConvertTest, ConvertsRunsOfMixedTypes) {
+    sensors_event_t src[] = {makeAccelerometerEvent(), makeAccelerometerEvent(),
+                             makeUncalibratedEvent(), makeAccelerometerEvent()};
+    Event dst[4];
+    convertFromSensorEvents(4, src, dst);
+    EXPECT_EQ(SensorType::ACCELEROMETER, dst[0].sensorType);
+    EXPECT_EQ(SensorType::ACCELEROMETER, dst[1].sensorType);
+    EXPECT_EQ(SensorType::GYROSCOPE_UNCALIBRATED, dst[2].sensorType);
+    EXPECT_EQ(4.0f, dst[2].u.uncal.x_bias);
+    EXPECT_EQ(SensorType::ACCELEROMETER, dst[3].sensorType);
+    EXPECT_EQ(9.8f, dst[3].u.vec3.z);
+}
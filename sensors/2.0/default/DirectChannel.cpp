@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DirectChannel.h"
+
+#include <cutils/ashmem.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <log/log.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::hardware::sensors::V1_0::SensorsEventFormatOffset;
+
+constexpr size_t kOffsetSize = static_cast<size_t>(SensorsEventFormatOffset::SIZE_FIELD);
+constexpr size_t kOffsetToken = static_cast<size_t>(SensorsEventFormatOffset::REPORT_TOKEN);
+constexpr size_t kOffsetType = static_cast<size_t>(SensorsEventFormatOffset::SENSOR_TYPE);
+constexpr size_t kOffsetAtomicCounter =
+        static_cast<size_t>(SensorsEventFormatOffset::ATOMIC_COUNTER);
+constexpr size_t kOffsetTimestamp = static_cast<size_t>(SensorsEventFormatOffset::TIMESTAMP);
+constexpr size_t kOffsetData = static_cast<size_t>(SensorsEventFormatOffset::DATA);
+constexpr size_t kOffsetReserved = static_cast<size_t>(SensorsEventFormatOffset::RESERVED);
+constexpr size_t kEventSize = static_cast<size_t>(SensorsEventFormatOffset::TOTAL_LENGTH);
+
+static_assert(sizeof(Event::u) == kOffsetReserved - kOffsetData,
+              "Event payload does not match the direct report data field");
+
+std::unique_ptr<DirectChannel> DirectChannel::create(const SharedMemInfo& mem) {
+    const native_handle_t* handle = mem.memoryHandle.getNativeHandle();
+    if (handle == nullptr || handle->numFds < 1 || mem.size < kEventSize) {
+        return nullptr;
+    }
+
+    int fd = dup(handle->data[0]);
+    if (fd < 0) {
+        ALOGE("Failed to duplicate direct channel fd: %s", strerror(errno));
+        return nullptr;
+    }
+
+    // Touching pages past the end of the region would raise SIGBUS in the HAL
+    int regionSize = ashmem_get_size_region(fd);
+    if (regionSize < 0 || static_cast<size_t>(regionSize) < mem.size) {
+        ALOGE("Direct channel size %" PRIu32 " exceeds the ashmem region size %d", mem.size,
+              regionSize);
+        close(fd);
+        return nullptr;
+    }
+
+    void* base = mmap(nullptr, mem.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("Failed to map direct channel memory: %s", strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+    // The shared memory must be cleared when the channel is registered
+    memset(base, 0, mem.size);
+
+    return std::unique_ptr<DirectChannel>(
+            new DirectChannel(fd, static_cast<uint8_t*>(base), mem.size));
+}
+
+DirectChannel::DirectChannel(int fd, uint8_t* base, size_t size)
+    : mFd(fd), mBase(base), mSize(size), mWriteOffset(0), mCounter(0) {}
+
+DirectChannel::~DirectChannel() {
+    munmap(mBase, mSize);
+    close(mFd);
+}
+
+void DirectChannel::write(int32_t reportToken, const Event& event) {
+    if (mWriteOffset + kEventSize > mSize) {
+        mWriteOffset = 0;
+    }
+
+    uint8_t* record = mBase + mWriteOffset;
+    int32_t size = kEventSize;
+    int32_t type = static_cast<int32_t>(event.sensorType);
+    memcpy(record + kOffsetSize, &size, sizeof(size));
+    memcpy(record + kOffsetToken, &reportToken, sizeof(reportToken));
+    memcpy(record + kOffsetType, &type, sizeof(type));
+    memcpy(record + kOffsetTimestamp, &event.timestamp, sizeof(event.timestamp));
+    memcpy(record + kOffsetData, &event.u, kOffsetReserved - kOffsetData);
+    memset(record + kOffsetReserved, 0, kEventSize - kOffsetReserved);
+
+    // The counter starts at 1 and skips 0 when it wraps, since 0 marks an unwritten record. It is
+    // written last so that a reader that observes the new value also observes the payload.
+    if (++mCounter == 0) {
+        mCounter = 1;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    *reinterpret_cast<volatile uint32_t*>(record + kOffsetAtomicCounter) = mCounter;
+
+    mWriteOffset += kEventSize;
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
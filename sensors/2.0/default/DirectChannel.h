@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_SENSORS_V2_0_DIRECTCHANNEL_H
+#define ANDROID_HARDWARE_SENSORS_V2_0_DIRECTCHANNEL_H
+
+#include <android/hardware/sensors/1.0/types.h>
+
+#include <memory>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::hardware::sensors::V1_0::Event;
+using ::android::hardware::sensors::V1_0::SharedMemInfo;
+
+/**
+ * A client supplied ashmem region that sensor events are written to directly, using the layout
+ * described by SensorsEventFormatOffset. The region is used as a ring of fixed size records, each
+ * published by writing its atomic counter last.
+ */
+class DirectChannel {
+   public:
+    /**
+     * Map the shared memory described by mem and clear it. Returns nullptr if the memory cannot be
+     * mapped or is too small to hold a single event.
+     */
+    static std::unique_ptr<DirectChannel> create(const SharedMemInfo& mem);
+
+    ~DirectChannel();
+
+    /**
+     * Append the event to the ring, tagged with the given report token.
+     */
+    void write(int32_t reportToken, const Event& event);
+
+   private:
+    DirectChannel(int fd, uint8_t* base, size_t size);
+
+    // Duplicate of the client's file descriptor, so the mapping outlives the HIDL call
+    int mFd;
+    uint8_t* mBase;
+    size_t mSize;
+
+    size_t mWriteOffset;
+    uint32_t mCounter;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_SENSORS_V2_0_DIRECTCHANNEL_H
@@ -16,8 +16,6 @@
 
 #include "Sensor.h"
 
-#include <utils/SystemClock.h>
-
 #include <cmath>
 
 namespace android {
@@ -26,128 +24,97 @@ namespace sensors {
 namespace V2_0 {
 namespace implementation {
 
-using ::android::hardware::sensors::V1_0::MetaDataEventType;
 using ::android::hardware::sensors::V1_0::SensorFlagBits;
+using ::android::hardware::sensors::V1_0::SensorFlagShift;
 using ::android::hardware::sensors::V1_0::SensorStatus;
 
 static constexpr float kDefaultMaxDelayUs = 10 * 1000 * 1000;
+static constexpr uint32_t kDefaultFifoMaxEventCount = 300;
+static constexpr float kGravityEarth = 9.80665f;  // m/s^2
+
+// Flags advertising ashmem direct channel support up to the given rate level. Every sensor
+// supports the channel type, since registration is not tied to a sensor, but only sensors that
+// can sample at a rate level's nominal rate advertise that level.
+static constexpr uint32_t directReportFlags(RateLevel maxRateLevel) {
+    return static_cast<uint32_t>(SensorFlagBits::DIRECT_CHANNEL_ASHMEM) |
+           (static_cast<uint32_t>(maxRateLevel)
+            << static_cast<uint32_t>(SensorFlagShift::DIRECT_REPORT));
+}
 
-Sensor::Sensor(ISensorsEventCallback* callback)
-    : mIsEnabled(false),
-      mSamplingPeriodNs(0),
-      mLastSampleTimeNs(0),
-      mCallback(callback),
-      mMode(OperationMode::NORMAL) {
-    mRunThread = std::thread(startThread, this);
+// Sampling period used for each direct report rate level
+static int64_t directReportPeriodNs(RateLevel rate) {
+    switch (rate) {
+        case RateLevel::NORMAL:
+            return 1000 * 1000 * 1000 / 50;  // 50 Hz
+        case RateLevel::FAST:
+            return 1000 * 1000 * 1000 / 200;  // 200 Hz
+        case RateLevel::VERY_FAST:
+            return 1000 * 1000 * 1000 / 800;  // 800 Hz
+        default:
+            return 0;
+    }
 }
 
+Sensor::Sensor(SensorScheduler* scheduler) : mScheduler(scheduler), mMode(OperationMode::NORMAL) {}
+
 Sensor::~Sensor() {
-    std::unique_lock<std::mutex> lock(mRunMutex);
-    mStopThread = true;
-    mIsEnabled = false;
-    mWaitCV.notify_all();
-    lock.release();
-    mRunThread.join();
+    mScheduler->removeSensor(this);
 }
 
 const SensorInfo& Sensor::getSensorInfo() const {
     return mSensorInfo;
 }
 
-void Sensor::batch(int32_t samplingPeriodNs) {
-    if (samplingPeriodNs < mSensorInfo.minDelay * 1000) {
-        samplingPeriodNs = mSensorInfo.minDelay * 1000;
-    } else if (samplingPeriodNs > mSensorInfo.maxDelay * 1000) {
-        samplingPeriodNs = mSensorInfo.maxDelay * 1000;
+void Sensor::batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs) {
+    if (samplingPeriodNs < mSensorInfo.minDelay * 1000LL) {
+        samplingPeriodNs = mSensorInfo.minDelay * 1000LL;
+    } else if (samplingPeriodNs > mSensorInfo.maxDelay * 1000LL) {
+        samplingPeriodNs = mSensorInfo.maxDelay * 1000LL;
     }
 
-    if (mSamplingPeriodNs != samplingPeriodNs) {
-        mSamplingPeriodNs = samplingPeriodNs;
-        // Wake up the 'run' thread to check if a new event should be generated now
-        mWaitCV.notify_all();
+    if (maxReportLatencyNs < 0) {
+        maxReportLatencyNs = 0;
     }
+
+    mScheduler->setBatchParams(this, samplingPeriodNs, maxReportLatencyNs);
 }
 
 void Sensor::activate(bool enable) {
-    if (mIsEnabled != enable) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
-        mIsEnabled = enable;
-        mWaitCV.notify_all();
-    }
+    mScheduler->setEnabled(this, enable);
 }
 
 Result Sensor::flush() {
     // Only generate a flush complete event if the sensor is enabled and if the sensor is not a
     // one-shot sensor.
-    if (!mIsEnabled || (mSensorInfo.flags & static_cast<uint32_t>(SensorFlagBits::ONE_SHOT_MODE))) {
+    if (mSensorInfo.flags & static_cast<uint32_t>(SensorFlagBits::ONE_SHOT_MODE)) {
         return Result::BAD_VALUE;
     }
 
-    // Note: If a sensor supports batching, write all of the currently batched events for the sensor
-    // to the Event FMQ prior to writing the flush complete event.
-    Event ev;
-    ev.sensorHandle = mSensorInfo.sensorHandle;
-    ev.sensorType = SensorType::META_DATA;
-    ev.u.meta.what = MetaDataEventType::META_DATA_FLUSH_COMPLETE;
-    std::vector<Event> evs{ev};
-    mCallback->postEvents(evs, isWakeUpSensor());
-
-    return Result::OK;
-}
-
-void Sensor::startThread(Sensor* sensor) {
-    sensor->run();
-}
-
-void Sensor::run() {
-    std::unique_lock<std::mutex> runLock(mRunMutex);
-    constexpr int64_t kNanosecondsInSeconds = 1000 * 1000 * 1000;
-
-    while (!mStopThread) {
-        if (!mIsEnabled || mMode == OperationMode::DATA_INJECTION) {
-            mWaitCV.wait(runLock, [&] {
-                return ((mIsEnabled && mMode == OperationMode::NORMAL) || mStopThread);
-            });
-        } else {
-            timespec curTime;
-            clock_gettime(CLOCK_REALTIME, &curTime);
-            int64_t now = (curTime.tv_sec * kNanosecondsInSeconds) + curTime.tv_nsec;
-            int64_t nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-
-            if (now >= nextSampleTime) {
-                mLastSampleTimeNs = now;
-                nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-                mCallback->postEvents(readEvents(), isWakeUpSensor());
-            }
-
-            mWaitCV.wait_for(runLock, std::chrono::nanoseconds(nextSampleTime - now));
-        }
-    }
+    // The scheduler writes all of the currently batched events for the sensor to the Event FMQ
+    // prior to writing the flush complete event.
+    return mScheduler->flush(this) ? Result::OK : Result::BAD_VALUE;
 }
 
-bool Sensor::isWakeUpSensor() {
+bool Sensor::isWakeUpSensor() const {
     return mSensorInfo.flags & static_cast<uint32_t>(SensorFlagBits::WAKE_UP);
 }
 
-std::vector<Event> Sensor::readEvents() {
-    std::vector<Event> events;
+void Sensor::readEvents(int64_t timestamp, std::vector<Event>* events) {
     Event event;
     event.sensorHandle = mSensorInfo.sensorHandle;
     event.sensorType = mSensorInfo.type;
-    event.timestamp = ::android::elapsedRealtimeNano();
+    event.timestamp = timestamp;
     event.u.vec3.x = 0;
     event.u.vec3.y = 0;
     event.u.vec3.z = 0;
     event.u.vec3.status = SensorStatus::ACCURACY_HIGH;
-    events.push_back(event);
-    return events;
+    events->push_back(event);
 }
 
 void Sensor::setOperationMode(OperationMode mode) {
     if (mMode != mode) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
         mMode = mode;
-        mWaitCV.notify_all();
+        mScheduler->setDataInjection(this, mode == OperationMode::DATA_INJECTION);
     }
 }
 
@@ -163,39 +130,58 @@ Result Sensor::injectEvent(const Event& event) {
     } else if (!supportsDataInjection()) {
         result = Result::INVALID_OPERATION;
     } else if (mMode == OperationMode::DATA_INJECTION) {
-        mCallback->postEvents(std::vector<Event>{event}, isWakeUpSensor());
+        mScheduler->postEvents(std::vector<Event>{event}, isWakeUpSensor() ? 1 : 0);
     } else {
         result = Result::BAD_VALUE;
     }
     return result;
 }
 
-OnChangeSensor::OnChangeSensor(ISensorsEventCallback* callback)
-    : Sensor(callback), mPreviousEventSet(false) {}
+Result Sensor::configDirectReport(int32_t channelHandle, RateLevel rate, int32_t* reportToken) {
+    if (!(mSensorInfo.flags & static_cast<uint32_t>(SensorFlagBits::DIRECT_CHANNEL_ASHMEM))) {
+        return Result::INVALID_OPERATION;
+    }
+
+    uint32_t maxRateLevel = (mSensorInfo.flags &
+                             static_cast<uint32_t>(SensorFlagBits::MASK_DIRECT_REPORT)) >>
+                            static_cast<uint32_t>(SensorFlagShift::DIRECT_REPORT);
+    if (static_cast<uint32_t>(rate) > maxRateLevel) {
+        return Result::BAD_VALUE;
+    }
 
-void OnChangeSensor::activate(bool enable) {
-    Sensor::activate(enable);
-    if (!enable) {
-        mPreviousEventSet = false;
+    if (!mScheduler->configDirectReport(this, channelHandle, directReportPeriodNs(rate))) {
+        return Result::BAD_VALUE;
     }
+
+    *reportToken = mSensorInfo.sensorHandle;
+    return Result::OK;
+}
+
+OnChangeSensor::OnChangeSensor(SensorScheduler* scheduler)
+    : Sensor(scheduler), mPreviousEventSet(false) {}
+
+void OnChangeSensor::resetState() {
+    mPreviousEventSet = false;
 }
 
-std::vector<Event> OnChangeSensor::readEvents() {
-    std::vector<Event> events = Sensor::readEvents();
-    std::vector<Event> outputEvents;
+void OnChangeSensor::readEvents(int64_t timestamp, std::vector<Event>* events) {
+    size_t first = events->size();
+    Sensor::readEvents(timestamp, events);
 
-    for (auto iter = events.begin(); iter != events.end(); ++iter) {
-        Event ev = *iter;
+    // Only keep the samples whose value differs from the last reported one
+    size_t out = first;
+    for (size_t i = first; i < events->size(); i++) {
+        const Event& ev = (*events)[i];
         if (ev.u.vec3 != mPreviousEvent.u.vec3 || !mPreviousEventSet) {
-            outputEvents.push_back(ev);
             mPreviousEvent = ev;
             mPreviousEventSet = true;
+            (*events)[out++] = ev;
         }
     }
-    return outputEvents;
+    events->resize(out);
 }
 
-AccelSensor::AccelSensor(int32_t sensorHandle, ISensorsEventCallback* callback) : Sensor(callback) {
+AccelSensor::AccelSensor(int32_t sensorHandle, SensorScheduler* scheduler) : Sensor(scheduler) {
     mSensorInfo.sensorHandle = sensorHandle;
     mSensorInfo.name = "Accel Sensor";
     mSensorInfo.vendor = "Vendor String";
@@ -208,13 +194,24 @@ AccelSensor::AccelSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
     mSensorInfo.minDelay = 20 * 1000;    // microseconds
     mSensorInfo.maxDelay = kDefaultMaxDelayUs;
     mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoMaxEventCount;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::DATA_INJECTION);
+    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::DATA_INJECTION) |
+                        directReportFlags(RateLevel::NORMAL);
 };
 
-PressureSensor::PressureSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
-    : Sensor(callback) {
+void AccelSensor::readEvents(int64_t timestamp, std::vector<Event>* events) {
+    size_t first = events->size();
+    Sensor::readEvents(timestamp, events);
+
+    // Report a device lying flat on a table
+    for (size_t i = first; i < events->size(); i++) {
+        (*events)[i].u.vec3.z = kGravityEarth;
+    }
+}
+
+PressureSensor::PressureSensor(int32_t sensorHandle, SensorScheduler* scheduler)
+    : Sensor(scheduler) {
     mSensorInfo.sensorHandle = sensorHandle;
     mSensorInfo.name = "Pressure Sensor";
     mSensorInfo.vendor = "Vendor String";
@@ -227,13 +224,13 @@ PressureSensor::PressureSensor(int32_t sensorHandle, ISensorsEventCallback* call
     mSensorInfo.minDelay = 100 * 1000;  // microseconds
     mSensorInfo.maxDelay = kDefaultMaxDelayUs;
     mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoMaxEventCount;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = 0;
+    mSensorInfo.flags = directReportFlags(RateLevel::STOP);
 };
 
-MagnetometerSensor::MagnetometerSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
-    : Sensor(callback) {
+MagnetometerSensor::MagnetometerSensor(int32_t sensorHandle, SensorScheduler* scheduler)
+    : Sensor(scheduler) {
     mSensorInfo.sensorHandle = sensorHandle;
     mSensorInfo.name = "Magnetic Field Sensor";
     mSensorInfo.vendor = "Vendor String";
@@ -246,13 +243,13 @@ MagnetometerSensor::MagnetometerSensor(int32_t sensorHandle, ISensorsEventCallba
     mSensorInfo.minDelay = 20 * 1000;  // microseconds
     mSensorInfo.maxDelay = kDefaultMaxDelayUs;
     mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoMaxEventCount;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = 0;
+    mSensorInfo.flags = directReportFlags(RateLevel::NORMAL);
 };
 
-LightSensor::LightSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
-    : OnChangeSensor(callback) {
+LightSensor::LightSensor(int32_t sensorHandle, SensorScheduler* scheduler)
+    : OnChangeSensor(scheduler) {
     mSensorInfo.sensorHandle = sensorHandle;
     mSensorInfo.name = "Light Sensor";
     mSensorInfo.vendor = "Vendor String";
@@ -267,11 +264,12 @@ LightSensor::LightSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
     mSensorInfo.fifoReservedEventCount = 0;
     mSensorInfo.fifoMaxEventCount = 0;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::ON_CHANGE_MODE);
+    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::ON_CHANGE_MODE) |
+                        directReportFlags(RateLevel::STOP);
 };
 
-ProximitySensor::ProximitySensor(int32_t sensorHandle, ISensorsEventCallback* callback)
-    : OnChangeSensor(callback) {
+ProximitySensor::ProximitySensor(int32_t sensorHandle, SensorScheduler* scheduler)
+    : OnChangeSensor(scheduler) {
     mSensorInfo.sensorHandle = sensorHandle;
     mSensorInfo.name = "Proximity Sensor";
     mSensorInfo.vendor = "Vendor String";
@@ -287,10 +285,11 @@ ProximitySensor::ProximitySensor(int32_t sensorHandle, ISensorsEventCallback* ca
     mSensorInfo.fifoMaxEventCount = 0;
     mSensorInfo.requiredPermission = "";
     mSensorInfo.flags =
-            static_cast<uint32_t>(SensorFlagBits::ON_CHANGE_MODE | SensorFlagBits::WAKE_UP);
+            static_cast<uint32_t>(SensorFlagBits::ON_CHANGE_MODE | SensorFlagBits::WAKE_UP) |
+            directReportFlags(RateLevel::STOP);
 };
 
-GyroSensor::GyroSensor(int32_t sensorHandle, ISensorsEventCallback* callback) : Sensor(callback) {
+GyroSensor::GyroSensor(int32_t sensorHandle, SensorScheduler* scheduler) : Sensor(scheduler) {
     mSensorInfo.sensorHandle = sensorHandle;
     mSensorInfo.name = "Gyro Sensor";
     mSensorInfo.vendor = "Vendor String";
@@ -303,13 +302,13 @@ GyroSensor::GyroSensor(int32_t sensorHandle, ISensorsEventCallback* callback) :
     mSensorInfo.minDelay = 2.5f * 1000;  // microseconds
     mSensorInfo.maxDelay = kDefaultMaxDelayUs;
     mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoMaxEventCount;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = 0;
+    mSensorInfo.flags = directReportFlags(RateLevel::FAST);
 };
 
-AmbientTempSensor::AmbientTempSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
-    : OnChangeSensor(callback) {
+AmbientTempSensor::AmbientTempSensor(int32_t sensorHandle, SensorScheduler* scheduler)
+    : OnChangeSensor(scheduler) {
     mSensorInfo.sensorHandle = sensorHandle;
     mSensorInfo.name = "Ambient Temp Sensor";
     mSensorInfo.vendor = "Vendor String";
@@ -324,11 +323,12 @@ AmbientTempSensor::AmbientTempSensor(int32_t sensorHandle, ISensorsEventCallback
     mSensorInfo.fifoReservedEventCount = 0;
     mSensorInfo.fifoMaxEventCount = 0;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::ON_CHANGE_MODE);
+    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::ON_CHANGE_MODE) |
+                        directReportFlags(RateLevel::STOP);
 };
 
-DeviceTempSensor::DeviceTempSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
-    : OnChangeSensor(callback) {
+DeviceTempSensor::DeviceTempSensor(int32_t sensorHandle, SensorScheduler* scheduler)
+    : OnChangeSensor(scheduler) {
     mSensorInfo.sensorHandle = sensorHandle;
     mSensorInfo.name = "Device Temp Sensor";
     mSensorInfo.vendor = "Vendor String";
@@ -343,12 +343,13 @@ DeviceTempSensor::DeviceTempSensor(int32_t sensorHandle, ISensorsEventCallback*
     mSensorInfo.fifoReservedEventCount = 0;
     mSensorInfo.fifoMaxEventCount = 0;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::ON_CHANGE_MODE);
+    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::ON_CHANGE_MODE) |
+                        directReportFlags(RateLevel::STOP);
 }
 
 RelativeHumiditySensor::RelativeHumiditySensor(int32_t sensorHandle,
-                                               ISensorsEventCallback* callback)
-    : OnChangeSensor(callback) {
+                                               SensorScheduler* scheduler)
+    : OnChangeSensor(scheduler) {
     mSensorInfo.sensorHandle = sensorHandle;
     mSensorInfo.name = "Relative Humidity Sensor";
     mSensorInfo.vendor = "Vendor String";
@@ -363,7 +364,8 @@ RelativeHumiditySensor::RelativeHumiditySensor(int32_t sensorHandle,
     mSensorInfo.fifoReservedEventCount = 0;
     mSensorInfo.fifoMaxEventCount = 0;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::ON_CHANGE_MODE);
+    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::ON_CHANGE_MODE) |
+                        directReportFlags(RateLevel::STOP);
 }
 
 }  // namespace implementation
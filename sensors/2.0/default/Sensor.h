@@ -17,16 +17,15 @@
 #ifndef ANDROID_HARDWARE_SENSORS_V2_0_SENSOR_H
 #define ANDROID_HARDWARE_SENSORS_V2_0_SENSOR_H
 
+#include "SensorScheduler.h"
+
 #include <android/hardware/sensors/1.0/types.h>
 
-#include <condition_variable>
-#include <memory>
-#include <mutex>
-#include <thread>
 #include <vector>
 
 using ::android::hardware::sensors::V1_0::Event;
 using ::android::hardware::sensors::V1_0::OperationMode;
+using ::android::hardware::sensors::V1_0::RateLevel;
 using ::android::hardware::sensors::V1_0::Result;
 using ::android::hardware::sensors::V1_0::SensorInfo;
 using ::android::hardware::sensors::V1_0::SensorType;
@@ -37,56 +36,55 @@ namespace sensors {
 namespace V2_0 {
 namespace implementation {
 
-class ISensorsEventCallback {
-   public:
-    virtual ~ISensorsEventCallback(){};
-    virtual void postEvents(const std::vector<Event>& events, bool wakeup) = 0;
-};
-
 class Sensor {
    public:
-    Sensor(ISensorsEventCallback* callback);
+    Sensor(SensorScheduler* scheduler);
     virtual ~Sensor();
 
     const SensorInfo& getSensorInfo() const;
-    void batch(int32_t samplingPeriodNs);
-    virtual void activate(bool enable);
+    void batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs);
+    void activate(bool enable);
     Result flush();
 
     void setOperationMode(OperationMode mode);
     bool supportsDataInjection() const;
     Result injectEvent(const Event& event);
 
+    /**
+     * Start or stop reporting the sensor into a direct channel. On success reportToken is set to
+     * the token that identifies the sensor's events in the channel.
+     */
+    Result configDirectReport(int32_t channelHandle, RateLevel rate, int32_t* reportToken);
+
+    bool isWakeUpSensor() const;
+
    protected:
-    void run();
-    virtual std::vector<Event> readEvents();
-    static void startThread(Sensor* sensor);
+    friend class SensorScheduler;
 
-    bool isWakeUpSensor();
+    /**
+     * Called by the SensorScheduler to append the sample taken at the given timestamp to events.
+     */
+    virtual void readEvents(int64_t timestamp, std::vector<Event>* events);
 
-    bool mIsEnabled;
-    int64_t mSamplingPeriodNs;
-    int64_t mLastSampleTimeNs;
-    SensorInfo mSensorInfo;
+    /**
+     * Called by the SensorScheduler when the sensor is enabled, before it is first sampled.
+     */
+    virtual void resetState() {}
 
-    std::atomic_bool mStopThread;
-    std::condition_variable mWaitCV;
-    std::mutex mRunMutex;
-    std::thread mRunThread;
+    SensorInfo mSensorInfo;
 
-    ISensorsEventCallback* mCallback;
+    SensorScheduler* mScheduler;
 
     OperationMode mMode;
 };
 
 class OnChangeSensor : public Sensor {
    public:
-    OnChangeSensor(ISensorsEventCallback* callback);
-
-    virtual void activate(bool enable) override;
+    OnChangeSensor(SensorScheduler* scheduler);
 
    protected:
-    virtual std::vector<Event> readEvents() override;
+    virtual void readEvents(int64_t timestamp, std::vector<Event>* events) override;
+    virtual void resetState() override;
 
    protected:
     Event mPreviousEvent;
@@ -95,47 +93,50 @@ class OnChangeSensor : public Sensor {
 
 class AccelSensor : public Sensor {
    public:
-    AccelSensor(int32_t sensorHandle, ISensorsEventCallback* callback);
+    AccelSensor(int32_t sensorHandle, SensorScheduler* scheduler);
+
+   protected:
+    virtual void readEvents(int64_t timestamp, std::vector<Event>* events) override;
 };
 
 class GyroSensor : public Sensor {
    public:
-    GyroSensor(int32_t sensorHandle, ISensorsEventCallback* callback);
+    GyroSensor(int32_t sensorHandle, SensorScheduler* scheduler);
 };
 
 class AmbientTempSensor : public OnChangeSensor {
    public:
-    AmbientTempSensor(int32_t sensorHandle, ISensorsEventCallback* callback);
+    AmbientTempSensor(int32_t sensorHandle, SensorScheduler* scheduler);
 };
 
 class DeviceTempSensor : public OnChangeSensor {
    public:
-    DeviceTempSensor(int32_t sensorHandle, ISensorsEventCallback* callback);
+    DeviceTempSensor(int32_t sensorHandle, SensorScheduler* scheduler);
 };
 
 class PressureSensor : public Sensor {
    public:
-    PressureSensor(int32_t sensorHandle, ISensorsEventCallback* callback);
+    PressureSensor(int32_t sensorHandle, SensorScheduler* scheduler);
 };
 
 class MagnetometerSensor : public Sensor {
    public:
-    MagnetometerSensor(int32_t sensorHandle, ISensorsEventCallback* callback);
+    MagnetometerSensor(int32_t sensorHandle, SensorScheduler* scheduler);
 };
 
 class LightSensor : public OnChangeSensor {
    public:
-    LightSensor(int32_t sensorHandle, ISensorsEventCallback* callback);
+    LightSensor(int32_t sensorHandle, SensorScheduler* scheduler);
 };
 
 class ProximitySensor : public OnChangeSensor {
    public:
-    ProximitySensor(int32_t sensorHandle, ISensorsEventCallback* callback);
+    ProximitySensor(int32_t sensorHandle, SensorScheduler* scheduler);
 };
 
 class RelativeHumiditySensor : public OnChangeSensor {
    public:
-    RelativeHumiditySensor(int32_t sensorHandle, ISensorsEventCallback* callback);
+    RelativeHumiditySensor(int32_t sensorHandle, SensorScheduler* scheduler);
 };
 
 }  // namespace implementation
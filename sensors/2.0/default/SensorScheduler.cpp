@@ -0,0 +1,435 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SensorScheduler.h"
+
+#include "Sensor.h"
+
+#include <utils/SystemClock.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::hardware::sensors::V1_0::MetaDataEventType;
+using ::android::hardware::sensors::V1_0::SensorType;
+
+SensorScheduler::SensorScheduler(ISensorsEventCallback* callback)
+    : mCallback(callback),
+      mReportDeadlineNs(INT64_MAX),
+      mNextChannelHandle(1),
+      mNextDirectReportGeneration(0),
+      mWakeupCount(0),
+      mBatchCount(0),
+      mStopThread(false) {
+    mRunThread = std::thread(startThread, this);
+}
+
+SensorScheduler::~SensorScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopThread = true;
+        mWaitCV.notify_all();
+    }
+    mRunThread.join();
+}
+
+void SensorScheduler::addSensor(Sensor* sensor) {
+    const SensorInfo& info = sensor->getSensorInfo();
+
+    SensorState state;
+    state.sensor = sensor;
+    state.enabled = false;
+    state.dataInjection = false;
+    state.samplingPeriodNs = info.minDelay * 1000LL;
+    state.maxReportLatencyNs = 0;
+    state.lastSampleTimeNs = 0;
+    state.generation = 0;
+    state.fifoCapacity = info.fifoMaxEventCount;
+    state.fifo.reserve(std::max<size_t>(state.fifoCapacity, 1));
+
+    std::lock_guard<std::mutex> postLock(mPostLock);
+    std::lock_guard<std::mutex> lock(mLock);
+    mSensors[info.sensorHandle] = std::move(state);
+
+    // Make sure that draining every FIFO at once never needs to grow the batch
+    size_t batchCapacity = 0;
+    for (const auto& entry : mSensors) {
+        batchCapacity += entry.second.fifo.capacity();
+    }
+    mBatch.reserve(batchCapacity + 1 /* flush complete event */);
+}
+
+void SensorScheduler::removeSensor(Sensor* sensor) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mSensors.find(sensor->getSensorInfo().sensorHandle);
+    if (it != mSensors.end() && it->second.sensor == sensor) {
+        // Any pending deadline for the sensor is discarded when it expires
+        for (auto report = mDirectReports.begin(); report != mDirectReports.end();) {
+            if (report->first.second == it->first) {
+                report = mDirectReports.erase(report);
+            } else {
+                ++report;
+            }
+        }
+        mSensors.erase(it);
+    }
+}
+
+void SensorScheduler::setEnabled(Sensor* sensor, bool enabled) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mSensors.find(sensor->getSensorInfo().sensorHandle);
+    if (it == mSensors.end() || it->second.enabled == enabled) {
+        return;
+    }
+
+    SensorState* state = &it->second;
+    state->enabled = enabled;
+    state->lastSampleTimeNs = 0;
+    if (enabled) {
+        sensor->resetState();
+    } else {
+        // Events batched for a sensor that has been disabled are no longer of interest
+        state->fifo.clear();
+    }
+    scheduleLocked(state, ::android::elapsedRealtimeNano());
+}
+
+bool SensorScheduler::isEnabled(const Sensor* sensor) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mSensors.find(sensor->getSensorInfo().sensorHandle);
+    return it != mSensors.end() && it->second.enabled;
+}
+
+void SensorScheduler::setBatchParams(Sensor* sensor, int64_t samplingPeriodNs,
+                                     int64_t maxReportLatencyNs) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mSensors.find(sensor->getSensorInfo().sensorHandle);
+    if (it == mSensors.end()) {
+        return;
+    }
+
+    SensorState* state = &it->second;
+    if (state->samplingPeriodNs == samplingPeriodNs &&
+        state->maxReportLatencyNs == maxReportLatencyNs) {
+        return;
+    }
+
+    int64_t now = ::android::elapsedRealtimeNano();
+    state->samplingPeriodNs = samplingPeriodNs;
+    state->maxReportLatencyNs = maxReportLatencyNs;
+
+    // Events already in the FIFO must not be held for longer than the new report latency
+    if (!state->fifo.empty() && maxReportLatencyNs < mReportDeadlineNs - now) {
+        mReportDeadlineNs = now + maxReportLatencyNs;
+    }
+    scheduleLocked(state, now);
+}
+
+void SensorScheduler::setDataInjection(Sensor* sensor, bool dataInjection) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mSensors.find(sensor->getSensorInfo().sensorHandle);
+    if (it != mSensors.end() && it->second.dataInjection != dataInjection) {
+        it->second.dataInjection = dataInjection;
+        scheduleLocked(&it->second, ::android::elapsedRealtimeNano());
+    }
+}
+
+bool SensorScheduler::flush(Sensor* sensor) {
+    std::lock_guard<std::mutex> postLock(mPostLock);
+    std::unique_lock<std::mutex> lock(mLock);
+    auto it = mSensors.find(sensor->getSensorInfo().sensorHandle);
+    if (it == mSensors.end() || !it->second.enabled) {
+        return false;
+    }
+
+    // A flush request empties the hardware FIFO, so deliver what every sensor has batched so far
+    // ahead of the flush complete event.
+    size_t numWakeupEvents = drainFifosLocked(&mBatch);
+    lock.unlock();
+
+    Event ev;
+    ev.sensorHandle = sensor->getSensorInfo().sensorHandle;
+    ev.sensorType = SensorType::META_DATA;
+    ev.u.meta.what = MetaDataEventType::META_DATA_FLUSH_COMPLETE;
+    mBatch.push_back(ev);
+    if (sensor->isWakeUpSensor()) {
+        numWakeupEvents++;
+    }
+
+    mCallback->postEvents(mBatch, numWakeupEvents);
+    mBatchCount++;
+    return true;
+}
+
+void SensorScheduler::postEvents(const std::vector<Event>& events, size_t numWakeupEvents) {
+    std::lock_guard<std::mutex> postLock(mPostLock);
+    mCallback->postEvents(events, numWakeupEvents);
+    mBatchCount++;
+}
+
+int32_t SensorScheduler::registerDirectChannel(std::unique_ptr<DirectChannel> channel) {
+    std::lock_guard<std::mutex> lock(mLock);
+    int32_t channelHandle = mNextChannelHandle++;
+    mDirectChannels[channelHandle] = std::move(channel);
+    return channelHandle;
+}
+
+void SensorScheduler::unregisterDirectChannel(int32_t channelHandle) {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto report = mDirectReports.begin(); report != mDirectReports.end();) {
+        if (report->first.first == channelHandle) {
+            report = mDirectReports.erase(report);
+        } else {
+            ++report;
+        }
+    }
+
+    // Unmaps the shared memory. Pending deadlines for the channel are discarded when they expire.
+    mDirectChannels.erase(channelHandle);
+}
+
+bool SensorScheduler::hasDirectChannel(int32_t channelHandle) {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mDirectChannels.find(channelHandle) != mDirectChannels.end();
+}
+
+bool SensorScheduler::configDirectReport(Sensor* sensor, int32_t channelHandle,
+                                         int64_t samplingPeriodNs) {
+    std::lock_guard<std::mutex> lock(mLock);
+    int32_t sensorHandle = sensor->getSensorInfo().sensorHandle;
+    if (mDirectChannels.find(channelHandle) == mDirectChannels.end() ||
+        mSensors.find(sensorHandle) == mSensors.end()) {
+        return false;
+    }
+
+    auto key = std::make_pair(channelHandle, sensorHandle);
+    if (samplingPeriodNs <= 0) {
+        mDirectReports.erase(key);
+        return true;
+    }
+
+    DirectReport report;
+    report.samplingPeriodNs = samplingPeriodNs;
+    report.generation = mNextDirectReportGeneration++;
+    mDirectReports[key] = report;
+
+    mDeadlines.push(
+            {::android::elapsedRealtimeNano(), sensorHandle, report.generation, channelHandle});
+    mWaitCV.notify_all();
+    return true;
+}
+
+void SensorScheduler::stopDirectReports(int32_t channelHandle) {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto report = mDirectReports.begin(); report != mDirectReports.end();) {
+        if (report->first.first == channelHandle) {
+            report = mDirectReports.erase(report);
+        } else {
+            ++report;
+        }
+    }
+}
+
+void SensorScheduler::unregisterAllDirectChannels() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mDirectReports.clear();
+
+    // Unmaps the shared memory. Pending deadlines for the channels are discarded when they expire.
+    mDirectChannels.clear();
+}
+
+uint64_t SensorScheduler::getWakeupCount() const {
+    return mWakeupCount.load();
+}
+
+uint64_t SensorScheduler::getBatchCount() const {
+    return mBatchCount.load();
+}
+
+void SensorScheduler::startThread(SensorScheduler* scheduler) {
+    scheduler->run();
+}
+
+void SensorScheduler::run() {
+    std::unique_lock<std::mutex> lock(mLock);
+
+    while (!mStopThread) {
+        int64_t now = ::android::elapsedRealtimeNano();
+        bool report = now >= mReportDeadlineNs;
+
+        while (!mDeadlines.empty() && mDeadlines.top().timeNs <= now) {
+            Deadline deadline = mDeadlines.top();
+            mDeadlines.pop();
+
+            if (deadline.channelHandle != kFifoChannel) {
+                int64_t next = sampleDirectLocked(deadline, now);
+                if (next != 0) {
+                    mDeadlines.push({next, deadline.sensorHandle, deadline.generation,
+                                     deadline.channelHandle});
+                }
+                continue;
+            }
+
+            auto it = mSensors.find(deadline.sensorHandle);
+            if (it == mSensors.end() || it->second.generation != deadline.generation) {
+                // The sensor has been reconfigured since this deadline was scheduled
+                continue;
+            }
+
+            SensorState* state = &it->second;
+            report |= sampleLocked(state, deadline.timeNs);
+            state->lastSampleTimeNs = deadline.timeNs;
+
+            // If the thread fell behind, skip the missed samples rather than producing a burst
+            int64_t next = deadline.timeNs + state->samplingPeriodNs;
+            if (next <= now) {
+                next = now + state->samplingPeriodNs;
+            }
+            mDeadlines.push({next, deadline.sensorHandle, state->generation, kFifoChannel});
+        }
+
+        if (report) {
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> postLock(mPostLock);
+                lock.lock();
+                size_t numWakeupEvents = drainFifosLocked(&mBatch);
+                lock.unlock();
+
+                if (!mBatch.empty()) {
+                    mCallback->postEvents(mBatch, numWakeupEvents);
+                    mBatchCount++;
+                }
+            }
+            lock.lock();
+            continue;
+        }
+
+        int64_t wakeTimeNs = mReportDeadlineNs;
+        if (!mDeadlines.empty()) {
+            wakeTimeNs = std::min(wakeTimeNs, mDeadlines.top().timeNs);
+        }
+
+        if (wakeTimeNs == INT64_MAX) {
+            mWaitCV.wait(lock);
+        } else {
+            mWaitCV.wait_for(lock, std::chrono::nanoseconds(wakeTimeNs - now));
+        }
+        mWakeupCount++;
+    }
+}
+
+bool SensorScheduler::isSamplingLocked(const SensorState& state) const {
+    return state.enabled && !state.dataInjection && state.samplingPeriodNs > 0;
+}
+
+void SensorScheduler::scheduleLocked(SensorState* state, int64_t now) {
+    // Invalidate any deadline that is already queued for the sensor
+    state->generation++;
+
+    if (isSamplingLocked(*state)) {
+        int64_t next = std::max(state->lastSampleTimeNs + state->samplingPeriodNs, now);
+        mDeadlines.push({next, state->sensor->getSensorInfo().sensorHandle, state->generation,
+                         kFifoChannel});
+    }
+
+    // Wake up the 'run' thread to check if a new event should be generated now
+    mWaitCV.notify_all();
+}
+
+bool SensorScheduler::sampleLocked(SensorState* state, int64_t timestamp) {
+    size_t previousSize = state->fifo.size();
+    state->sensor->readEvents(timestamp, &state->fifo);
+    if (state->fifo.size() == previousSize) {
+        // On-change sensors only produce an event when their value changes
+        return false;
+    }
+
+    if (state->fifoCapacity == 0 || state->maxReportLatencyNs == 0) {
+        // The sensor does not batch, so report the sample right away
+        return true;
+    }
+
+    if (previousSize == 0) {
+        int64_t reportDeadlineNs = INT64_MAX;
+        if (state->maxReportLatencyNs < INT64_MAX - timestamp) {
+            reportDeadlineNs = timestamp + state->maxReportLatencyNs;
+        }
+        mReportDeadlineNs = std::min(mReportDeadlineNs, reportDeadlineNs);
+    }
+
+    return state->fifo.size() >= state->fifoCapacity;
+}
+
+int64_t SensorScheduler::sampleDirectLocked(const Deadline& deadline, int64_t now) {
+    auto report =
+            mDirectReports.find(std::make_pair(deadline.channelHandle, deadline.sensorHandle));
+    if (report == mDirectReports.end() || report->second.generation != deadline.generation) {
+        return 0;
+    }
+
+    auto state = mSensors.find(deadline.sensorHandle);
+    auto channel = mDirectChannels.find(deadline.channelHandle);
+    if (state == mSensors.end() || channel == mDirectChannels.end()) {
+        return 0;
+    }
+
+    mDirectEvents.clear();
+    state->second.sensor->readEvents(deadline.timeNs, &mDirectEvents);
+    for (const Event& event : mDirectEvents) {
+        // The sensor handle doubles as the report token returned by configDirectReport
+        channel->second->write(deadline.sensorHandle, event);
+    }
+
+    int64_t next = deadline.timeNs + report->second.samplingPeriodNs;
+    if (next <= now) {
+        next = now + report->second.samplingPeriodNs;
+    }
+    return next;
+}
+
+size_t SensorScheduler::drainFifosLocked(std::vector<Event>* batch) {
+    size_t numWakeupEvents = 0;
+
+    batch->clear();
+    for (auto& entry : mSensors) {
+        SensorState& state = entry.second;
+        if (state.fifo.empty()) {
+            continue;
+        }
+
+        if (state.sensor->isWakeUpSensor()) {
+            numWakeupEvents += state.fifo.size();
+        }
+        batch->insert(batch->end(), state.fifo.begin(), state.fifo.end());
+        state.fifo.clear();
+    }
+
+    mReportDeadlineNs = INT64_MAX;
+    return numWakeupEvents;
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_SENSORS_V2_0_SENSORSCHEDULER_H
+#define ANDROID_HARDWARE_SENSORS_V2_0_SENSORSCHEDULER_H
+
+#include "DirectChannel.h"
+
+#include <android/hardware/sensors/1.0/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::hardware::sensors::V1_0::Event;
+
+class ISensorsEventCallback {
+   public:
+    virtual ~ISensorsEventCallback(){};
+
+    /**
+     * Deliver a batch of events. numWakeupEvents is the number of events in the batch that were
+     * generated by WAKE_UP sensors and must be acknowledged through the Wake Lock FMQ.
+     */
+    virtual void postEvents(const std::vector<Event>& events, size_t numWakeupEvents) = 0;
+};
+
+class Sensor;
+
+/**
+ * Drives all of the mock sensors from a single thread.
+ *
+ * Each enabled sensor has an entry in a heap of sampling deadlines. When a deadline expires the
+ * sensor is sampled into its emulated hardware FIFO. The FIFOs of all sensors are drained together,
+ * in a single call to ISensorsEventCallback::postEvents, as soon as any sensor's oldest batched
+ * sample reaches its maxReportLatencyNs, a FIFO fills up, or a non-batching sensor produces a
+ * sample. This mirrors how a sensor hub wakes the AP and lets the framework see one write and one
+ * wake per batch rather than one per sample.
+ *
+ * Sensors configured for direct report get additional deadlines, one per channel, at the rate
+ * requested for that channel. Those samples bypass the FIFO and are written straight into the
+ * channel's shared memory.
+ */
+class SensorScheduler {
+   public:
+    SensorScheduler(ISensorsEventCallback* callback);
+    ~SensorScheduler();
+
+    void addSensor(Sensor* sensor);
+    void removeSensor(Sensor* sensor);
+
+    void setEnabled(Sensor* sensor, bool enabled);
+    bool isEnabled(const Sensor* sensor);
+    void setBatchParams(Sensor* sensor, int64_t samplingPeriodNs, int64_t maxReportLatencyNs);
+    void setDataInjection(Sensor* sensor, bool dataInjection);
+
+    /**
+     * Write any events batched for the sensor, followed by a flush complete event. Returns false
+     * if the sensor is not enabled.
+     */
+    bool flush(Sensor* sensor);
+
+    /**
+     * Deliver events that did not originate from the scheduler, such as injected events.
+     */
+    void postEvents(const std::vector<Event>& events, size_t numWakeupEvents);
+
+    /**
+     * Take ownership of a direct channel and return the handle that identifies it.
+     */
+    int32_t registerDirectChannel(std::unique_ptr<DirectChannel> channel);
+    void unregisterDirectChannel(int32_t channelHandle);
+    bool hasDirectChannel(int32_t channelHandle);
+
+    /**
+     * Report the sensor into the channel every samplingPeriodNs, or stop reporting it if
+     * samplingPeriodNs is 0. Returns false if the channel does not exist.
+     */
+    bool configDirectReport(Sensor* sensor, int32_t channelHandle, int64_t samplingPeriodNs);
+
+    /**
+     * Stop reporting every sensor into the channel.
+     */
+    void stopDirectReports(int32_t channelHandle);
+
+    /**
+     * Stop every direct report and unregister every direct channel. The handles of the channels
+     * are not handed out again.
+     */
+    void unregisterAllDirectChannels();
+
+    /**
+     * Number of times the scheduler thread has woken up to sample sensors.
+     */
+    uint64_t getWakeupCount() const;
+
+    /**
+     * Number of batches handed to the ISensorsEventCallback.
+     */
+    uint64_t getBatchCount() const;
+
+   private:
+    struct SensorState {
+        Sensor* sensor;
+        bool enabled;
+        bool dataInjection;
+        int64_t samplingPeriodNs;
+        int64_t maxReportLatencyNs;
+        int64_t lastSampleTimeNs;
+
+        // Incremented whenever the sampling configuration changes so that stale entries in the
+        // deadline heap can be discarded.
+        uint32_t generation;
+
+        // Emulated hardware FIFO. Its capacity is the sensor's fifoMaxEventCount.
+        std::vector<Event> fifo;
+        size_t fifoCapacity;
+    };
+
+    struct DirectReport {
+        int64_t samplingPeriodNs;
+        uint32_t generation;
+    };
+
+    // Channel handle of the deadlines that sample a sensor into its FIFO. Direct channel handles
+    // start at 1.
+    static constexpr int32_t kFifoChannel = 0;
+
+    struct Deadline {
+        int64_t timeNs;
+        int32_t sensorHandle;
+        uint32_t generation;
+        int32_t channelHandle;
+
+        bool operator>(const Deadline& other) const { return timeNs > other.timeNs; }
+    };
+
+    static void startThread(SensorScheduler* scheduler);
+    void run();
+
+    bool isSamplingLocked(const SensorState& state) const;
+    void scheduleLocked(SensorState* state, int64_t now);
+
+    /**
+     * Sample the sensor into its FIFO. Returns true if the FIFOs must be drained immediately.
+     */
+    bool sampleLocked(SensorState* state, int64_t timestamp);
+
+    /**
+     * Move the contents of every FIFO into batch. Returns the number of events from WAKE_UP
+     * sensors.
+     */
+    size_t drainFifosLocked(std::vector<Event>* batch);
+
+    /**
+     * Sample the sensor for a direct report deadline and write the events into the channel.
+     * Returns the time of the next sample, or 0 if the report is no longer active.
+     */
+    int64_t sampleDirectLocked(const Deadline& deadline, int64_t now);
+
+    ISensorsEventCallback* mCallback;
+
+    std::mutex mLock;
+    std::condition_variable mWaitCV;
+    std::map<int32_t, SensorState> mSensors;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> mDeadlines;
+
+    // The earliest time at which a batched event must be delivered, or INT64_MAX if the FIFOs are
+    // empty.
+    int64_t mReportDeadlineNs;
+
+    // Serializes draining the FIFOs and writing them out, so that a flush complete event is always
+    // written after the batch holding the sensor's earlier events. Acquired before mLock.
+    std::mutex mPostLock;
+
+    // Reused between batches to avoid allocating on every delivery.
+    std::vector<Event> mBatch;
+
+    std::map<int32_t, std::unique_ptr<DirectChannel>> mDirectChannels;
+    int32_t mNextChannelHandle;
+
+    // Active direct reports keyed by channel handle and sensor handle
+    std::map<std::pair<int32_t, int32_t>, DirectReport> mDirectReports;
+    uint32_t mNextDirectReportGeneration;
+
+    // Scratch buffer for the samples written to direct channels
+    std::vector<Event> mDirectEvents;
+
+    std::atomic<uint64_t> mWakeupCount;
+    std::atomic<uint64_t> mBatchCount;
+
+    bool mStopThread;
+    std::thread mRunThread;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_SENSORS_V2_0_SENSORSCHEDULER_H
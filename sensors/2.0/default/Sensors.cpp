@@ -18,6 +18,12 @@
 
 #include <android/hardware/sensors/2.0/types.h>
 #include <log/log.h>
+#include <utils/SystemClock.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
 
 namespace android {
 namespace hardware {
@@ -29,14 +35,21 @@ using ::android::hardware::sensors::V1_0::Event;
 using ::android::hardware::sensors::V1_0::OperationMode;
 using ::android::hardware::sensors::V1_0::RateLevel;
 using ::android::hardware::sensors::V1_0::Result;
+using ::android::hardware::sensors::V1_0::SharedMemFormat;
 using ::android::hardware::sensors::V1_0::SharedMemInfo;
+using ::android::hardware::sensors::V1_0::SharedMemType;
 using ::android::hardware::sensors::V2_0::SensorTimeout;
 using ::android::hardware::sensors::V2_0::WakeLockQueueFlagBits;
 
 constexpr const char* kWakeLockName = "SensorsHAL_WAKEUP";
 
+// Maximum time to wait for the framework to drain the Event FMQ when writing a batch that does
+// not fit in the queue's free space
+constexpr int64_t kWriteTimeoutNs = 100 * 1000 * 1000;  // 100 ms
+
 Sensors::Sensors()
     : mEventQueueFlag(nullptr),
+      mScheduler(std::make_unique<SensorScheduler>(this /* callback */)),
       mNextHandle(1),
       mOutstandingWakeUpEvents(0),
       mReadWakeLockQueueRun(false),
@@ -54,6 +67,13 @@ Sensors::Sensors()
 }
 
 Sensors::~Sensors() {
+    // Stop sampling before the sensors and the scheduler go away
+    for (auto sensor : mSensors) {
+        sensor.second->activate(false /* enable */);
+    }
+    mSensors.clear();
+    mScheduler.reset();
+
     deleteEventFlag();
     mReadWakeLockQueueRun = false;
     mWakeLockThread.join();
@@ -99,12 +119,18 @@ Return<Result> Sensors::initialize(
         sensor.second->activate(false /* enable */);
     }
 
+    // Direct channels registered by the previous client are no longer valid
+    mScheduler->unregisterAllDirectChannels();
+
     // Stop the Wake Lock thread if it is currently running
     if (mReadWakeLockQueueRun.load()) {
         mReadWakeLockQueueRun = false;
         mWakeLockThread.join();
     }
 
+    // A new Wake Lock FMQ will not acknowledge the events written to the previous one
+    mLatencyStats.abandonWakeUpEvents();
+
     // Save a reference to the callback
     mCallback = sensorsCallback;
 
@@ -138,10 +164,10 @@ Return<Result> Sensors::initialize(
 }
 
 Return<Result> Sensors::batch(int32_t sensorHandle, int64_t samplingPeriodNs,
-                              int64_t /* maxReportLatencyNs */) {
+                              int64_t maxReportLatencyNs) {
     auto sensor = mSensors.find(sensorHandle);
     if (sensor != mSensors.end()) {
-        sensor->second->batch(samplingPeriodNs);
+        sensor->second->batch(samplingPeriodNs, maxReportLatencyNs);
         return Result::OK;
     }
     return Result::BAD_VALUE;
@@ -164,33 +190,135 @@ Return<Result> Sensors::injectSensorData(const Event& event) {
     return Result::BAD_VALUE;
 }
 
-Return<void> Sensors::registerDirectChannel(const SharedMemInfo& /* mem */,
+Return<void> Sensors::registerDirectChannel(const SharedMemInfo& mem,
                                             registerDirectChannel_cb _hidl_cb) {
-    _hidl_cb(Result::INVALID_OPERATION, -1 /* channelHandle */);
+    if (mem.type != SharedMemType::ASHMEM) {
+        _hidl_cb(Result::INVALID_OPERATION, -1 /* channelHandle */);
+        return Return<void>();
+    }
+
+    if (mem.format != SharedMemFormat::SENSORS_EVENT) {
+        _hidl_cb(Result::BAD_VALUE, -1 /* channelHandle */);
+        return Return<void>();
+    }
+
+    std::unique_ptr<DirectChannel> channel = DirectChannel::create(mem);
+    if (channel == nullptr) {
+        _hidl_cb(Result::BAD_VALUE, -1 /* channelHandle */);
+        return Return<void>();
+    }
+
+    _hidl_cb(Result::OK, mScheduler->registerDirectChannel(std::move(channel)));
     return Return<void>();
 }
 
-Return<Result> Sensors::unregisterDirectChannel(int32_t /* channelHandle */) {
-    return Result::INVALID_OPERATION;
+Return<Result> Sensors::unregisterDirectChannel(int32_t channelHandle) {
+    // Unregistering a channel that does not exist, or no longer exists, is harmless
+    mScheduler->unregisterDirectChannel(channelHandle);
+    return Result::OK;
 }
 
-Return<void> Sensors::configDirectReport(int32_t /* sensorHandle */, int32_t /* channelHandle */,
-                                         RateLevel /* rate */, configDirectReport_cb _hidl_cb) {
-    _hidl_cb(Result::INVALID_OPERATION, 0 /* reportToken */);
+Return<void> Sensors::configDirectReport(int32_t sensorHandle, int32_t channelHandle,
+                                         RateLevel rate, configDirectReport_cb _hidl_cb) {
+    if (!mScheduler->hasDirectChannel(channelHandle)) {
+        _hidl_cb(Result::BAD_VALUE, 0 /* reportToken */);
+        return Return<void>();
+    }
+
+    if (sensorHandle == -1) {
+        // A sensor handle of -1 may only be used to stop every sensor on the channel
+        if (rate != RateLevel::STOP) {
+            _hidl_cb(Result::BAD_VALUE, 0 /* reportToken */);
+            return Return<void>();
+        }
+
+        mScheduler->stopDirectReports(channelHandle);
+        _hidl_cb(Result::OK, 0 /* reportToken */);
+        return Return<void>();
+    }
+
+    auto sensor = mSensors.find(sensorHandle);
+    if (sensor == mSensors.end()) {
+        _hidl_cb(Result::BAD_VALUE, 0 /* reportToken */);
+        return Return<void>();
+    }
+
+    int32_t reportToken = 0;
+    Result result = sensor->second->configDirectReport(channelHandle, rate, &reportToken);
+    _hidl_cb(result, reportToken);
     return Return<void>();
 }
 
-void Sensors::postEvents(const std::vector<Event>& events, bool wakeup) {
+Return<void> Sensors::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* options */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        ALOGE("debug called with no handle");
+        return Void();
+    }
+
+    int fdOut = fd->data[0];
+    dprintf(fdOut, "Scheduler wakeups: %" PRIu64 ", batches: %" PRIu64 "\n",
+            mScheduler->getWakeupCount(), mScheduler->getBatchCount());
+    mLatencyStats.dump(fdOut);
+    return Void();
+}
+
+void Sensors::postEvents(const std::vector<Event>& events, size_t numWakeupEvents) {
     std::lock_guard<std::mutex> lock(mWriteLock);
-    if (mEventQueue->write(events.data(), events.size())) {
-        mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
+    bool written = false;
+    size_t eventsWritten = 0;
+    if (events.size() <= mEventQueue->availableToWrite()) {
+        // Common case: the whole batch is delivered with a single write and a single wake
+        written = mEventQueue->write(events.data(), events.size());
+        if (written) {
+            eventsWritten = events.size();
+            mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
+        }
+    } else {
+        // A batch flushed from the sensor FIFOs may be larger than the Event FMQ. Write it in
+        // chunks, waiting for the framework to read each one.
+        size_t maxChunk = mEventQueue->getQuantumCount();
+        written = true;
+        while (written && eventsWritten < events.size()) {
+            size_t count = std::min(maxChunk, events.size() - eventsWritten);
+            written = mEventQueue->writeBlocking(
+                    events.data() + eventsWritten, count,
+                    static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ),
+                    static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS), kWriteTimeoutNs,
+                    mEventQueueFlag);
+            if (written) {
+                eventsWritten += count;
+            }
+        }
+    }
+
+    mLatencyStats.recordDelivered(events.data(), eventsWritten, ::android::elapsedRealtimeNano());
+    if (!written) {
+        // The framework did not make room in the Event FMQ in time
+        ALOGW("Dropping %zu of %zu events, the Event FMQ is full", events.size() - eventsWritten,
+              events.size());
+        mLatencyStats.recordDropped(events.data() + eventsWritten, events.size() - eventsWritten);
+    }
 
-        if (wakeup) {
-            // Keep track of the number of outstanding WAKE_UP events in order to properly hold
-            // a wake lock until the framework has secured a wake lock
-            updateWakeLock(events.size(), 0 /* eventsHandled */);
+    if (!written && numWakeupEvents > 0) {
+        // Only the WAKE_UP events that reached the framework are acknowledged
+        numWakeupEvents = countWakeUpEvents(events.data(), eventsWritten);
+    }
+    if (numWakeupEvents > 0) {
+        // Keep track of the number of outstanding WAKE_UP events in order to properly hold
+        // a wake lock until the framework has secured a wake lock
+        updateWakeLock(numWakeupEvents, 0 /* eventsHandled */);
+    }
+}
+
+size_t Sensors::countWakeUpEvents(const Event* events, size_t count) const {
+    size_t numWakeupEvents = 0;
+    for (size_t i = 0; i < count; i++) {
+        auto sensor = mSensors.find(events[i].sensorHandle);
+        if (sensor != mSensors.end() && sensor->second->isWakeUpSensor()) {
+            numWakeupEvents++;
         }
     }
+    return numWakeupEvents;
 }
 
 void Sensors::updateWakeLock(int32_t eventsWritten, int32_t eventsHandled) {
@@ -219,6 +347,7 @@ void Sensors::updateWakeLock(int32_t eventsWritten, int32_t eventsHandled) {
             ALOGD("No events read from wake lock FMQ for %d seconds, auto releasing wake lock",
                   SensorTimeout::WAKE_LOCK_SECONDS);
             mOutstandingWakeUpEvents = 0;
+            mLatencyStats.abandonWakeUpEvents();
         }
 
         if (mOutstandingWakeUpEvents == 0 && release_wake_lock(kWakeLockName) == 0) {
@@ -237,6 +366,9 @@ void Sensors::readWakeLockFMQ() {
         mWakeLockQueue->readBlocking(&eventsHandled, 1 /* count */, 0 /* readNotification */,
                                      static_cast<uint32_t>(WakeLockQueueFlagBits::DATA_WRITTEN),
                                      kReadTimeoutNs);
+        if (eventsHandled > 0) {
+            mLatencyStats.recordWakeUpHandled(eventsHandled, ::android::elapsedRealtimeNano());
+        }
         updateWakeLock(0 /* eventsWritten */, eventsHandled);
     }
 }
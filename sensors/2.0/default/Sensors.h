@@ -17,13 +17,16 @@
 #ifndef ANDROID_HARDWARE_SENSORS_V2_0_SENSORS_H
 #define ANDROID_HARDWARE_SENSORS_V2_0_SENSORS_H
 
+#include "DirectChannel.h"
 #include "Sensor.h"
+#include "SensorScheduler.h"
 
 #include <android/hardware/sensors/2.0/ISensors.h>
 #include <fmq/MessageQueue.h>
 #include <hardware_legacy/power.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <sensors/LatencyStats.h>
 
 #include <atomic>
 #include <memory>
@@ -38,6 +41,7 @@ namespace implementation {
 using ::android::sp;
 using ::android::hardware::EventFlag;
 using ::android::hardware::hidl_array;
+using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_memory;
 using ::android::hardware::hidl_string;
 using ::android::hardware::hidl_vec;
@@ -83,7 +87,9 @@ struct Sensors : public ISensors, public ISensorsEventCallback {
     Return<void> configDirectReport(int32_t sensorHandle, int32_t channelHandle, RateLevel rate,
                                     configDirectReport_cb _hidl_cb) override;
 
-    void postEvents(const std::vector<Event>& events, bool wakeup) override;
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
+    void postEvents(const std::vector<Event>& events, size_t numWakeupEvents) override;
 
    private:
     /**
@@ -92,7 +98,10 @@ struct Sensors : public ISensors, public ISensorsEventCallback {
     template <class SensorType>
     void AddSensor() {
         std::shared_ptr<SensorType> sensor =
-                std::make_shared<SensorType>(mNextHandle++ /* sensorHandle */, this /* callback */);
+                std::make_shared<SensorType>(mNextHandle++ /* sensorHandle */, mScheduler.get());
+        mScheduler->addSensor(sensor.get());
+        mLatencyStats.addSensor(sensor->getSensorInfo().sensorHandle, sensor->getSensorInfo().name,
+                                sensor->isWakeUpSensor());
         mSensors[sensor->getSensorInfo().sensorHandle] = sensor;
     }
 
@@ -113,6 +122,11 @@ struct Sensors : public ISensors, public ISensorsEventCallback {
      */
     void updateWakeLock(int32_t eventsWritten, int32_t eventsHandled);
 
+    /**
+     * Number of the events generated by WAKE_UP sensors
+     */
+    size_t countWakeUpEvents(const Event* events, size_t count) const;
+
     using EventMessageQueue = MessageQueue<Event, kSynchronizedReadWrite>;
     using WakeLockMessageQueue = MessageQueue<uint32_t, kSynchronizedReadWrite>;
 
@@ -136,11 +150,22 @@ struct Sensors : public ISensors, public ISensorsEventCallback {
      */
     sp<ISensorsCallback> mCallback;
 
+    /**
+     * Single thread that samples every sensor and batches their events. Must outlive mSensors.
+     */
+    std::unique_ptr<SensorScheduler> mScheduler;
+
     /**
      * A map of the available sensors
      */
     std::map<int32_t, std::shared_ptr<Sensor>> mSensors;
 
+    /**
+     * Delivery, acknowledgement and drop statistics of the events written to the Event FMQ,
+     * reported by debug()
+     */
+    ::android::hardware::sensors::V1_0::implementation::LatencyStats mLatencyStats;
+
     /**
      * The next available sensor handle
      */
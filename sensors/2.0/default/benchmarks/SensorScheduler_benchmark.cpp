@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Sensor.h"
+#include "SensorScheduler.h"
+
+#include <benchmark/benchmark.h>
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using ::android::hardware::sensors::V1_0::SensorFlagBits;
+using ::android::hardware::sensors::V2_0::implementation::ISensorsEventCallback;
+using ::android::hardware::sensors::V2_0::implementation::Sensor;
+using ::android::hardware::sensors::V2_0::implementation::SensorScheduler;
+
+namespace {
+
+constexpr int kNumSensors = 10;
+constexpr int64_t kSamplingPeriodNs = 5 * 1000 * 1000;  // 200 Hz
+constexpr uint32_t kFifoMaxEventCount = 1000;
+
+// Stands in for the Event FMQ: each call to postEvents is one write and one wake of the reader
+class CountingCallback : public ISensorsEventCallback {
+   public:
+    void postEvents(const std::vector<Event>& events, size_t /* numWakeupEvents */) override {
+        mPosts++;
+        mEvents += events.size();
+    }
+
+    std::atomic<uint64_t> mPosts{0};
+    std::atomic<uint64_t> mEvents{0};
+};
+
+class BenchmarkSensor : public Sensor {
+   public:
+    BenchmarkSensor(int32_t sensorHandle, SensorScheduler* scheduler) : Sensor(scheduler) {
+        mSensorInfo.sensorHandle = sensorHandle;
+        mSensorInfo.name = "Benchmark Sensor";
+        mSensorInfo.vendor = "Vendor String";
+        mSensorInfo.version = 1;
+        mSensorInfo.type = SensorType::ACCELEROMETER;
+        mSensorInfo.minDelay = kSamplingPeriodNs / 1000;  // microseconds
+        mSensorInfo.maxDelay = kSamplingPeriodNs / 1000;  // microseconds
+        mSensorInfo.fifoReservedEventCount = 0;
+        mSensorInfo.fifoMaxEventCount = kFifoMaxEventCount;
+        mSensorInfo.flags = 0;
+    }
+};
+
+int64_t cpuTimeUs() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL + usage.ru_utime.tv_usec +
+           usage.ru_stime.tv_usec;
+}
+
+}  // namespace
+
+// Runs 10 sensors at 200 Hz for one second per iteration with the report latency (in milliseconds)
+// given by the benchmark argument, and reports how often the scheduler thread and the event reader
+// are woken up.
+static void BM_SchedulerWakeups(benchmark::State& state) {
+    CountingCallback callback;
+    SensorScheduler scheduler(&callback);
+
+    std::vector<std::unique_ptr<BenchmarkSensor>> sensors;
+    for (int i = 0; i < kNumSensors; i++) {
+        sensors.push_back(std::make_unique<BenchmarkSensor>(i + 1, &scheduler));
+        scheduler.addSensor(sensors.back().get());
+        sensors.back()->batch(kSamplingPeriodNs, state.range(0) * 1000 * 1000);
+    }
+
+    int64_t startCpuUs = cpuTimeUs();
+    uint64_t startWakeups = scheduler.getWakeupCount();
+    for (auto& sensor : sensors) {
+        sensor->activate(true);
+    }
+
+    for (auto _ : state) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    for (auto& sensor : sensors) {
+        sensor->activate(false);
+    }
+
+    using benchmark::Counter;
+    state.counters["scheduler_wakeups"] =
+            Counter(scheduler.getWakeupCount() - startWakeups, Counter::kIsRate);
+    state.counters["reader_wakeups"] = Counter(callback.mPosts.load(), Counter::kIsRate);
+    state.counters["events"] = Counter(callback.mEvents.load(), Counter::kIsRate);
+    state.counters["cpu_us"] = Counter(cpuTimeUs() - startCpuUs, Counter::kIsRate);
+}
+BENCHMARK(BM_SchedulerWakeups)
+        ->Arg(0)
+        ->Arg(20)
+        ->Arg(100)
+        ->Arg(1000)
+        ->Iterations(5)
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
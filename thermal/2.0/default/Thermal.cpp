@@ -16,10 +16,13 @@
 
 #define LOG_TAG "android.hardware.thermal@2.0-service-mock"
 
+#include <unistd.h>
+
 #include <cmath>
 #include <set>
 
 #include <android-base/logging.h>
+#include <android-base/properties.h>
 #include <hidl/HidlTransportSupport.h>
 
 #include "Thermal.h"
@@ -37,6 +40,8 @@ using ::android::hardware::thermal::V1_0::ThermalStatusCode;
 
 std::set<sp<IThermalChangedCallback>> gCallbacks;
 
+constexpr char kConfigProperty[] = "vendor.thermal.config";
+
 static const Temperature_1_0 kTemp_1_0 = {
         .type = static_cast<::android::hardware::thermal::V1_0::TemperatureType>(
                 TemperatureType::SKIN),
@@ -81,11 +86,69 @@ static const CpuUsage kCpuUsage = {
         .isOnline = true,
 };
 
+static Temperature_2_0 toTemperature(const SensorReading& reading) {
+    return {
+            .type = static_cast<TemperatureType>(reading.type),
+            .name = reading.name,
+            .value = reading.value,
+            .throttlingStatus = static_cast<ThrottlingSeverity>(reading.severity),
+    };
+}
+
+Thermal::Thermal() {
+    std::string configPath = android::base::GetProperty(kConfigProperty, "");
+    if (configPath.empty()) {
+        return;
+    }
+    ThermalConfig config;
+    if (!ThermalConfig::load(configPath, &config)) {
+        LOG(ERROR) << "Unable to load " << configPath << ", reporting mock values";
+        return;
+    }
+    auto engine = std::make_unique<ThermalEngine>(config);
+    if (!engine->start([this](const std::vector<SensorReading>& changed) {
+            sendThrottlingChanges(changed);
+        })) {
+        LOG(ERROR) << "Unable to start polling " << configPath << ", reporting mock values";
+        return;
+    }
+    LOG(INFO) << "Polling " << config.sensors.size() << " sensors from " << configPath;
+    engine_ = std::move(engine);
+}
+
 // Methods from ::android::hardware::thermal::V1_0::IThermal follow.
 Return<void> Thermal::getTemperatures(getTemperatures_cb _hidl_cb) {
     ThermalStatus status;
     status.code = ThermalStatusCode::SUCCESS;
-    std::vector<Temperature_1_0> temperatures = {kTemp_1_0};
+    std::vector<Temperature_1_0> temperatures;
+    if (engine_ == nullptr) {
+        temperatures = {kTemp_1_0};
+    } else {
+        std::vector<SensorReading> readings;
+        if (!engine_->readSensors(&readings)) {
+            status.code = ThermalStatusCode::FAILURE;
+            status.debugMessage = "Failed to read data";
+        }
+        const auto& sensors = engine_->config().sensors;
+        for (size_t i = 0; i < readings.size(); i++) {
+            // Only the types known to 1.0
+            if (readings[i].type > static_cast<int32_t>(TemperatureType::SKIN)) {
+                continue;
+            }
+            const auto& thresholds = sensors[i].hotThresholds;
+            temperatures.push_back({
+                    .type = static_cast<::android::hardware::thermal::V1_0::TemperatureType>(
+                            readings[i].type),
+                    .name = readings[i].name,
+                    .currentValue = readings[i].value,
+                    .throttlingThreshold =
+                            thresholds[static_cast<size_t>(ThrottlingSeverity::SEVERE)],
+                    .shutdownThreshold =
+                            thresholds[static_cast<size_t>(ThrottlingSeverity::SHUTDOWN)],
+                    .vrThrottlingThreshold = sensors[i].vrThreshold,
+            });
+        }
+    }
     _hidl_cb(status, temperatures);
     return Void();
 }
@@ -101,7 +164,26 @@ Return<void> Thermal::getCpuUsages(getCpuUsages_cb _hidl_cb) {
 Return<void> Thermal::getCoolingDevices(getCoolingDevices_cb _hidl_cb) {
     ThermalStatus status;
     status.code = ThermalStatusCode::SUCCESS;
-    std::vector<CoolingDevice_1_0> cooling_devices = {kCooling_1_0};
+    std::vector<CoolingDevice_1_0> cooling_devices;
+    if (engine_ == nullptr) {
+        cooling_devices = {kCooling_1_0};
+    } else {
+        std::vector<CoolingDeviceReading> readings;
+        if (!engine_->readCoolingDevices(&readings)) {
+            status.code = ThermalStatusCode::FAILURE;
+            status.debugMessage = "Failed to read data";
+        }
+        // 1.0 only knows of fans
+        for (const auto& reading : readings) {
+            if (reading.type == static_cast<uint32_t>(CoolingType::FAN)) {
+                cooling_devices.push_back({
+                        .type = ::android::hardware::thermal::V1_0::CoolingType::FAN_RPM,
+                        .name = reading.name,
+                        .currentValue = static_cast<float>(reading.value),
+                });
+            }
+        }
+    }
     _hidl_cb(status, cooling_devices);
     return Void();
 }
@@ -112,11 +194,23 @@ Return<void> Thermal::getCurrentTemperatures(bool filterType, TemperatureType ty
     ThermalStatus status;
     status.code = ThermalStatusCode::SUCCESS;
     std::vector<Temperature_2_0> temperatures;
-    if (filterType && type != kTemp_2_0.type) {
+    if (engine_ == nullptr) {
+        if (!filterType || type == kTemp_2_0.type) {
+            temperatures = {kTemp_2_0};
+        }
+    } else {
+        std::vector<SensorReading> readings;
+        if (engine_->readSensors(&readings)) {
+            for (const auto& reading : readings) {
+                if (!filterType || static_cast<TemperatureType>(reading.type) == type) {
+                    temperatures.push_back(toTemperature(reading));
+                }
+            }
+        }
+    }
+    if (temperatures.empty()) {
         status.code = ThermalStatusCode::FAILURE;
         status.debugMessage = "Failed to read data";
-    } else {
-        temperatures = {kTemp_2_0};
     }
     _hidl_cb(status, temperatures);
     return Void();
@@ -127,11 +221,30 @@ Return<void> Thermal::getTemperatureThresholds(bool filterType, TemperatureType
     ThermalStatus status;
     status.code = ThermalStatusCode::SUCCESS;
     std::vector<TemperatureThreshold> temperature_thresholds;
-    if (filterType && type != kTempThreshold.type) {
+    if (engine_ == nullptr) {
+        if (!filterType || type == kTempThreshold.type) {
+            temperature_thresholds = {kTempThreshold};
+        }
+    } else {
+        for (const auto& sensor : engine_->config().sensors) {
+            if (filterType && static_cast<TemperatureType>(sensor.type) != type) {
+                continue;
+            }
+            TemperatureThreshold threshold = {
+                    .type = static_cast<TemperatureType>(sensor.type),
+                    .name = sensor.name,
+                    .vrThrottlingThreshold = sensor.vrThreshold,
+            };
+            for (size_t i = 0; i < kNumSeverities; i++) {
+                threshold.hotThrottlingThresholds[i] = sensor.hotThresholds[i];
+                threshold.coldThrottlingThresholds[i] = NAN;
+            }
+            temperature_thresholds.push_back(std::move(threshold));
+        }
+    }
+    if (temperature_thresholds.empty()) {
         status.code = ThermalStatusCode::FAILURE;
         status.debugMessage = "Failed to read data";
-    } else {
-        temperature_thresholds = {kTempThreshold};
     }
     _hidl_cb(status, temperature_thresholds);
     return Void();
@@ -142,11 +255,27 @@ Return<void> Thermal::getCurrentCoolingDevices(bool filterType, CoolingType type
     ThermalStatus status;
     status.code = ThermalStatusCode::SUCCESS;
     std::vector<CoolingDevice_2_0> cooling_devices;
-    if (filterType && type != kCooling_2_0.type) {
+    if (engine_ == nullptr) {
+        if (!filterType || type == kCooling_2_0.type) {
+            cooling_devices = {kCooling_2_0};
+        }
+    } else {
+        std::vector<CoolingDeviceReading> readings;
+        if (engine_->readCoolingDevices(&readings)) {
+            for (const auto& reading : readings) {
+                if (!filterType || static_cast<CoolingType>(reading.type) == type) {
+                    cooling_devices.push_back({
+                            .type = static_cast<CoolingType>(reading.type),
+                            .name = reading.name,
+                            .value = reading.value,
+                    });
+                }
+            }
+        }
+    }
+    if (cooling_devices.empty()) {
         status.code = ThermalStatusCode::FAILURE;
         status.debugMessage = "Failed to read data";
-    } else {
-        cooling_devices = {kCooling_2_0};
     }
     _hidl_cb(status, cooling_devices);
     return Void();
@@ -218,6 +347,43 @@ Return<void> Thermal::unregisterThermalChangedCallback(
     return Void();
 }
 
+void Thermal::sendThrottlingChanges(const std::vector<SensorReading>& changed) {
+    std::vector<Temperature_2_0> temperatures;
+    for (const auto& reading : changed) {
+        temperatures.push_back(toTemperature(reading));
+    }
+
+    std::lock_guard<std::mutex> _lock(thermal_callback_mutex_);
+    for (auto it = callbacks_.begin(); it != callbacks_.end();) {
+        bool dead = false;
+        for (const auto& temperature : temperatures) {
+            if (it->is_filter_type && it->type != temperature.type) {
+                continue;
+            }
+            auto ret = it->callback->notifyThrottling(temperature);
+            if (!ret.isOk() && ret.isDeadObject()) {
+                dead = true;
+                break;
+            }
+        }
+        if (dead) {
+            LOG(ERROR) << "Dropping a dead callback";
+            it = callbacks_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+Return<void> Thermal::debug(const hidl_handle& handle, const hidl_vec<hidl_string>&) {
+    if (handle != nullptr && handle->numFds >= 1 && engine_ != nullptr) {
+        int fd = handle->data[0];
+        engine_->dump(fd);
+        fsync(fd);
+    }
+    return Void();
+}
+
 }  // namespace implementation
 }  // namespace V2_0
 }  // namespace thermal
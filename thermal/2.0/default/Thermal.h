@@ -21,6 +21,10 @@
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 
+#include <memory>
+
+#include "ThermalEngine.h"
+
 namespace android {
 namespace hardware {
 namespace thermal {
@@ -29,6 +33,7 @@ namespace implementation {
 
 using ::android::sp;
 using ::android::hardware::hidl_array;
+using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_memory;
 using ::android::hardware::hidl_string;
 using ::android::hardware::hidl_vec;
@@ -44,6 +49,7 @@ using Temperature_2_0 = ::android::hardware::thermal::V2_0::Temperature;
 using ::android::hardware::thermal::V2_0::IThermalChangedCallback;
 using ::android::hardware::thermal::V2_0::TemperatureThreshold;
 using ::android::hardware::thermal::V2_0::TemperatureType;
+using ::android::hardware::thermal::V2_0::ThrottlingSeverity;
 
 struct CallbackSetting {
     CallbackSetting(sp<IThermalChangedCallback> callback, bool is_filter_type, TemperatureType type)
@@ -53,8 +59,15 @@ struct CallbackSetting {
     TemperatureType type;
 };
 
+/*
+ * Reports constant mock values, unless vendor.thermal.config names a ThermalConfig file, in which
+ * case the sensors and cooling devices it lists are read and callbacks are notified of the
+ * throttling changes found by the ThermalEngine.
+ */
 class Thermal : public IThermal {
    public:
+    Thermal();
+
     // Methods from ::android::hardware::thermal::V1_0::IThermal follow.
     Return<void> getTemperatures(getTemperatures_cb _hidl_cb) override;
     Return<void> getCpuUsages(getCpuUsages_cb _hidl_cb) override;
@@ -74,9 +87,16 @@ class Thermal : public IThermal {
     Return<void> getCurrentCoolingDevices(bool filterType, CoolingType type,
                                           getCurrentCoolingDevices_cb _hidl_cb) override;
 
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) override;
+
    private:
+    void sendThrottlingChanges(const std::vector<SensorReading>& changed);
+
     std::mutex thermal_callback_mutex_;
     std::vector<CallbackSetting> callbacks_;
+    // Destroyed first, so its thread stops before the callbacks go away
+    std::unique_ptr<ThermalEngine> engine_;
 };
 
 }  // namespace implementation
@@ -0,0 +1,415 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.thermal@2.0-service-mock"
+
+#include "ThermalEngine.h"
+
+#include <cmath>
+#include <cstdlib>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+#include <android-base/stringprintf.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+namespace {
+
+template <typename T>
+struct TypeName {
+    const char* name;
+    T type;
+};
+
+// Values of TemperatureType
+constexpr TypeName<int32_t> kTemperatureTypes[] = {
+        {"UNKNOWN", -1},        {"CPU", 0},
+        {"GPU", 1},             {"BATTERY", 2},
+        {"SKIN", 3},            {"USB_PORT", 4},
+        {"POWER_AMPLIFIER", 5}, {"BCL_VOLTAGE", 6},
+        {"BCL_CURRENT", 7},     {"BCL_PERCENTAGE", 8},
+        {"NPU", 9},
+};
+
+// Values of CoolingType
+constexpr TypeName<uint32_t> kCoolingTypes[] = {
+        {"FAN", 0}, {"BATTERY", 1}, {"CPU", 2}, {"GPU", 3}, {"MODEM", 4}, {"NPU", 5},
+        {"COMPONENT", 6},
+};
+
+template <typename T, size_t N>
+bool parseType(const TypeName<T> (&types)[N], const std::string& name, T* type) {
+    for (const auto& entry : types) {
+        if (name == entry.name) {
+            *type = entry.type;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Accepts nan, unlike ParseFloat
+bool parseFloat(const std::string& text, float* value) {
+    char* end;
+    *value = strtof(text.c_str(), &end);
+    return !text.empty() && *end == '\0';
+}
+
+bool parseInterval(const std::string& text, std::chrono::milliseconds* interval) {
+    char* end;
+    long long value = strtoll(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || value <= 0) {
+        return false;
+    }
+    *interval = std::chrono::milliseconds(value);
+    return true;
+}
+
+struct timespec toTimespec(std::chrono::steady_clock::time_point when) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(when.time_since_epoch());
+    struct timespec ts;
+    ts.tv_sec = ns.count() / 1000000000;
+    ts.tv_nsec = ns.count() % 1000000000;
+    return ts;
+}
+
+}  // namespace
+
+bool ThermalConfig::parse(const std::string& text, ThermalConfig* config) {
+    ThermalConfig parsed;
+    int lineNumber = 0;
+    for (const auto& line : android::base::Split(text, "\n")) {
+        lineNumber++;
+        std::string trimmed = android::base::Trim(line);
+        if (trimmed.empty() || trimmed[0] == '#') {
+            continue;
+        }
+        std::vector<std::string> fields;
+        for (const auto& field : android::base::Split(trimmed, " \t")) {
+            if (!field.empty()) {
+                fields.push_back(field);
+            }
+        }
+
+        bool ok = false;
+        if (fields[0] == "poll" && fields.size() == 4) {
+            ok = parseInterval(fields[1], &parsed.slowPollInterval) &&
+                 parseInterval(fields[2], &parsed.fastPollInterval) &&
+                 parseFloat(fields[3], &parsed.fastPollMargin);
+        } else if (fields[0] == "sensor" && (fields.size() == 12 || fields.size() == 13)) {
+            SensorConfig sensor;
+            sensor.name = fields[1];
+            sensor.path = fields[3];
+            sensor.hotThresholds[0] = NAN;
+            sensor.vrThreshold = NAN;
+            ok = parseType(kTemperatureTypes, fields[2], &sensor.type) &&
+                 parseFloat(fields[4], &sensor.multiplier) &&
+                 parseFloat(fields[5], &sensor.hysteresis) &&
+                 (fields.size() == 12 || parseFloat(fields[12], &sensor.vrThreshold));
+            for (size_t i = 1; ok && i < kNumSeverities; i++) {
+                ok = parseFloat(fields[5 + i], &sensor.hotThresholds[i]);
+            }
+            parsed.sensors.push_back(std::move(sensor));
+        } else if (fields[0] == "cooling" && fields.size() == 4) {
+            CoolingDeviceConfig device;
+            device.name = fields[1];
+            device.path = fields[3];
+            ok = parseType(kCoolingTypes, fields[2], &device.type);
+            parsed.coolingDevices.push_back(std::move(device));
+        }
+        if (!ok) {
+            LOG(ERROR) << "Invalid thermal configuration at line " << lineNumber << ": " << line;
+            return false;
+        }
+    }
+    *config = std::move(parsed);
+    return true;
+}
+
+bool ThermalConfig::load(const std::string& path, ThermalConfig* config) {
+    std::string text;
+    if (!android::base::ReadFileToString(path, &text)) {
+        PLOG(ERROR) << "Unable to read " << path;
+        return false;
+    }
+    return parse(text, config);
+}
+
+ThermalEngine::ThermalEngine(const ThermalConfig& config) : config_(config), stats_() {}
+
+ThermalEngine::~ThermalEngine() {
+    stop();
+}
+
+bool ThermalEngine::start(ThrottlingSink sink) {
+    stop();
+
+    std::vector<Sensor> sensors(config_.sensors.size());
+    for (size_t i = 0; i < sensors.size(); i++) {
+        const std::string& path = config_.sensors[i].path;
+        sensors[i].fd.reset(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (sensors[i].fd == -1) {
+            PLOG(ERROR) << "Unable to open " << path;
+            return false;
+        }
+        sensors[i].severity = 0;
+    }
+    std::vector<android::base::unique_fd> coolingFds;
+    for (const auto& device : config_.coolingDevices) {
+        coolingFds.emplace_back(
+                TEMP_FAILURE_RETRY(open(device.path.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (coolingFds.back() == -1) {
+            PLOG(ERROR) << "Unable to open " << device.path;
+            return false;
+        }
+    }
+
+    epoll_fd_.reset(epoll_create1(EPOLL_CLOEXEC));
+    timer_fd_.reset(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+    stop_fd_.reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    if (epoll_fd_ == -1 || timer_fd_ == -1 || stop_fd_ == -1) {
+        PLOG(ERROR) << "Unable to create the polling fds";
+        return false;
+    }
+    for (int fd : {timer_fd_.get(), stop_fd_.get()}) {
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == -1) {
+            PLOG(ERROR) << "Unable to add fd to epoll set";
+            return false;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        sensors_ = std::move(sensors);
+        cooling_fds_ = std::move(coolingFds);
+        Clock::time_point now = Clock::now();
+        for (auto& sensor : sensors_) {
+            sensor.nextPoll = now;
+        }
+    }
+    sink_ = std::move(sink);
+    armTimer(Clock::now());
+    thread_ = std::thread([this]() { run(); });
+    return true;
+}
+
+void ThermalEngine::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    uint64_t one = 1;
+    if (TEMP_FAILURE_RETRY(write(stop_fd_, &one, sizeof(one))) != sizeof(one)) {
+        PLOG(ERROR) << "Unable to stop the polling thread";
+    }
+    thread_.join();
+}
+
+bool ThermalEngine::readValue(int fd, const std::string& path, double* value) {
+    char buf[32];
+    ssize_t n = TEMP_FAILURE_RETRY(pread(fd, buf, sizeof(buf) - 1, 0));
+    if (n <= 0) {
+        PLOG(ERROR) << "Unable to read " << path;
+        return false;
+    }
+    buf[n] = '\0';
+    char* end;
+    *value = strtod(buf, &end);
+    if (end == buf) {
+        LOG(ERROR) << "Invalid value in " << path << ": " << buf;
+        return false;
+    }
+    return true;
+}
+
+uint32_t ThermalEngine::getSeverity(const SensorConfig& sensor, float value,
+                                    uint32_t lastSeverity) {
+    uint32_t severity = 0;
+    for (uint32_t i = kNumSeverities - 1; i > 0; i--) {
+        if (!std::isnan(sensor.hotThresholds[i]) && value >= sensor.hotThresholds[i]) {
+            severity = i;
+            break;
+        }
+    }
+    // Stay at a higher severity until the temperature falls past the hysteresis
+    for (uint32_t i = lastSeverity; i > severity; i--) {
+        if (!std::isnan(sensor.hotThresholds[i]) &&
+            value >= sensor.hotThresholds[i] - sensor.hysteresis) {
+            return i;
+        }
+    }
+    return severity;
+}
+
+ThermalEngine::Clock::duration ThermalEngine::pollInterval(const SensorConfig& config,
+                                                           float value, uint32_t severity) const {
+    if (severity > 0) {
+        return config_.fastPollInterval;
+    }
+    for (size_t i = 1; i < kNumSeverities; i++) {
+        if (!std::isnan(config.hotThresholds[i])) {
+            return value >= config.hotThresholds[i] - config_.fastPollMargin
+                           ? config_.fastPollInterval
+                           : config_.slowPollInterval;
+        }
+    }
+    return config_.slowPollInterval;
+}
+
+void ThermalEngine::armTimer(Clock::time_point when) {
+    struct itimerspec spec = {};
+    spec.it_value = toTimespec(when);
+    // A zero it_value disarms the timer
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+        spec.it_value.tv_nsec = 1;
+    }
+    if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) == -1) {
+        PLOG(ERROR) << "Unable to arm the polling timer";
+    }
+}
+
+void ThermalEngine::run() {
+    while (true) {
+        struct epoll_event events[2];
+        int n = TEMP_FAILURE_RETRY(epoll_wait(epoll_fd_, events, 2, -1));
+        if (n == -1) {
+            PLOG(ERROR) << "epoll_wait failed";
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == stop_fd_) {
+                return;
+            }
+        }
+        uint64_t expirations;
+        if (read(timer_fd_, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+            poll();
+        }
+    }
+}
+
+void ThermalEngine::poll() {
+    std::vector<SensorReading> changed;
+    Clock::time_point nextPoll = Clock::time_point::max();
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        Clock::time_point now = Clock::now();
+        for (size_t i = 0; i < sensors_.size(); i++) {
+            const SensorConfig& config = config_.sensors[i];
+            Sensor& sensor = sensors_[i];
+            if (sensor.nextPoll <= now) {
+                double value;
+                Clock::duration interval = config_.slowPollInterval;
+                if (readValue(sensor.fd, config.path, &value)) {
+                    float celsius = value * config.multiplier;
+                    uint32_t severity = getSeverity(config, celsius, sensor.severity);
+                    if (severity != sensor.severity) {
+                        sensor.severity = severity;
+                        changed.push_back({config.name, config.type, celsius, severity});
+                    }
+                    interval = pollInterval(config, celsius, severity);
+                } else {
+                    stats_.readErrors++;
+                }
+                stats_.polls++;
+                if (interval == config_.fastPollInterval) {
+                    stats_.fastPolls++;
+                }
+                // Polls of sensors sharing an interval stay aligned, so they share wakeups
+                sensor.nextPoll = now + interval;
+            }
+            nextPoll = std::min(nextPoll, sensor.nextPoll);
+        }
+        if (!changed.empty()) {
+            stats_.batches++;
+            stats_.severityChanges += changed.size();
+        }
+    }
+
+    if (nextPoll != Clock::time_point::max()) {
+        armTimer(nextPoll);
+    }
+    if (!changed.empty() && sink_) {
+        sink_(changed);
+    }
+}
+
+bool ThermalEngine::readSensors(std::vector<SensorReading>* readings) {
+    std::lock_guard<std::mutex> lock(lock_);
+    readings->clear();
+    for (size_t i = 0; i < sensors_.size(); i++) {
+        const SensorConfig& config = config_.sensors[i];
+        double value;
+        if (!readValue(sensors_[i].fd, config.path, &value)) {
+            return false;
+        }
+        readings->push_back(
+                {config.name, config.type, static_cast<float>(value * config.multiplier),
+                 sensors_[i].severity});
+    }
+    return true;
+}
+
+bool ThermalEngine::readCoolingDevices(std::vector<CoolingDeviceReading>* readings) {
+    std::lock_guard<std::mutex> lock(lock_);
+    readings->clear();
+    for (size_t i = 0; i < cooling_fds_.size(); i++) {
+        const CoolingDeviceConfig& config = config_.coolingDevices[i];
+        double value;
+        if (!readValue(cooling_fds_[i], config.path, &value)) {
+            return false;
+        }
+        readings->push_back({config.name, config.type, static_cast<uint64_t>(value)});
+    }
+    return true;
+}
+
+ThermalEngine::Stats ThermalEngine::getStats() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return stats_;
+}
+
+void ThermalEngine::dump(int fd) {
+    Stats stats = getStats();
+    android::base::WriteStringToFd(
+            android::base::StringPrintf(
+                    "ThermalEngine: %zu sensors, %zu cooling devices\n"
+                    "  polls: %" PRIu64 " (%" PRIu64 " fast), read errors: %" PRIu64 "\n"
+                    "  severity changes: %" PRIu64 " in %" PRIu64 " batches\n",
+                    config_.sensors.size(), config_.coolingDevices.size(), stats.polls,
+                    stats.fastPolls, stats.readErrors, stats.severityChanges, stats.batches),
+            fd);
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
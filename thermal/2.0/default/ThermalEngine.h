@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_THERMAL_V2_0_THERMALENGINE_H
+#define ANDROID_HARDWARE_THERMAL_V2_0_THERMALENGINE_H
+
+#include <android-base/unique_fd.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+// One entry per ThrottlingSeverity, NONE included
+constexpr size_t kNumSeverities = 7;
+
+struct SensorConfig {
+    std::string name;
+    // A TemperatureType
+    int32_t type;
+    std::string path;
+    // Converts the value of the node to degrees Celsius, 0.001 for thermal zones
+    float multiplier;
+    // How far the temperature must fall below a threshold to leave its severity
+    float hysteresis;
+    // Indexed by ThrottlingSeverity, NAN where the severity isn't used
+    std::array<float, kNumSeverities> hotThresholds;
+    float vrThreshold;
+};
+
+struct CoolingDeviceConfig {
+    std::string name;
+    // A CoolingType
+    uint32_t type;
+    std::string path;
+};
+
+/*
+ * What the engine reads and how often. Configuration files have one entry per line:
+ *
+ *   poll <slow interval ms> <fast interval ms> <fast poll margin>
+ *   sensor <name> <type> <path> <multiplier> <hysteresis> <LIGHT> <MODERATE> <SEVERE> <CRITICAL>
+ *          <EMERGENCY> <SHUTDOWN> [<VR threshold>]
+ *   cooling <name> <type> <path>
+ *
+ * Types are named as in the HAL, such as SKIN or FAN. Unused thresholds are nan. Empty lines and
+ * lines starting with # are ignored.
+ */
+struct ThermalConfig {
+    std::vector<SensorConfig> sensors;
+    std::vector<CoolingDeviceConfig> coolingDevices;
+    std::chrono::milliseconds slowPollInterval{5000};
+    std::chrono::milliseconds fastPollInterval{500};
+    // Sensors this many degrees or less below their next threshold are polled at the fast
+    // interval, as are sensors that are already throttling.
+    float fastPollMargin = 5;
+
+    /*
+     * Returns false, after logging why, if the configuration is invalid.
+     */
+    static bool parse(const std::string& text, ThermalConfig* config);
+    static bool load(const std::string& path, ThermalConfig* config);
+};
+
+struct SensorReading {
+    std::string name;
+    int32_t type;
+    float value;
+    // A ThrottlingSeverity
+    uint32_t severity;
+};
+
+struct CoolingDeviceReading {
+    std::string name;
+    uint32_t type;
+    uint64_t value;
+};
+
+/*
+ * Polls the configured thermal sensors from a single thread, which waits on one epoll set holding
+ * a timerfd for the next sensor due and an eventfd to be stopped. Each sensor is polled at the slow
+ * interval, or at the fast interval while it is throttling or near its next threshold.
+ *
+ * The sensors whose severity changed in a poll are handed to the sink together, once the poll is
+ * done, so one sink call covers every sensor crossing a threshold at the same time.
+ */
+class ThermalEngine {
+   public:
+    using ThrottlingSink = std::function<void(const std::vector<SensorReading>& changed)>;
+
+    struct Stats {
+        uint64_t polls;
+        uint64_t fastPolls;
+        uint64_t readErrors;
+        uint64_t batches;
+        uint64_t severityChanges;
+    };
+
+    explicit ThermalEngine(const ThermalConfig& config);
+    ~ThermalEngine();
+
+    /*
+     * Opens the configured nodes and starts polling. Returns false if a node can't be opened.
+     */
+    bool start(ThrottlingSink sink);
+    void stop();
+
+    const ThermalConfig& config() const { return config_; }
+
+    /*
+     * Reads the sensors now. Their severities are the ones of the last poll.
+     */
+    bool readSensors(std::vector<SensorReading>* readings);
+    bool readCoolingDevices(std::vector<CoolingDeviceReading>* readings);
+
+    Stats getStats();
+    void dump(int fd);
+
+    static uint32_t getSeverity(const SensorConfig& sensor, float value, uint32_t lastSeverity);
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Sensor {
+        android::base::unique_fd fd;
+        uint32_t severity;
+        Clock::time_point nextPoll;
+    };
+
+    bool readValue(int fd, const std::string& path, double* value);
+    Clock::duration pollInterval(const SensorConfig& config, float value, uint32_t severity) const;
+    void armTimer(Clock::time_point when);
+    void run();
+    void poll();
+
+    const ThermalConfig config_;
+    ThrottlingSink sink_;
+
+    android::base::unique_fd epoll_fd_;
+    android::base::unique_fd timer_fd_;
+    android::base::unique_fd stop_fd_;
+    std::thread thread_;
+
+    std::mutex lock_;
+    std::vector<Sensor> sensors_;
+    std::vector<android::base::unique_fd> cooling_fds_;
+    Stats stats_;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_THERMAL_V2_0_THERMALENGINE_H
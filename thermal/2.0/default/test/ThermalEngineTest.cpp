@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ThermalEngine.h"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using android::base::WriteStringToFile;
+using android::hardware::thermal::V2_0::implementation::CoolingDeviceReading;
+using android::hardware::thermal::V2_0::implementation::SensorConfig;
+using android::hardware::thermal::V2_0::implementation::SensorReading;
+using android::hardware::thermal::V2_0::implementation::ThermalConfig;
+using android::hardware::thermal::V2_0::implementation::ThermalEngine;
+using namespace std::chrono_literals;
+
+// Values of ThrottlingSeverity
+constexpr uint32_t kNone = 0;
+constexpr uint32_t kLight = 1;
+constexpr uint32_t kSevere = 3;
+constexpr uint32_t kShutdown = 6;
+
+class ThermalEngineTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        ASSERT_EQ(0, mkdir(path("thermal_zone0").c_str(), 0700));
+        ASSERT_EQ(0, mkdir(path("thermal_zone1").c_str(), 0700));
+        ASSERT_EQ(0, mkdir(path("cooling_device0").c_str(), 0700));
+        setValue("thermal_zone0/temp", 30000);
+        setValue("thermal_zone1/temp", 30000);
+        setValue("cooling_device0/cur_state", 2);
+    }
+
+    void TearDown() override { engine_.reset(); }
+
+    std::string path(const std::string& node) const { return std::string(dir_.path) + "/" + node; }
+
+    // Rewrites the node in place, as the engine keeps it open
+    void setValue(const std::string& node, int64_t value) {
+        ASSERT_TRUE(WriteStringToFile(std::to_string(value) + "\n", path(node)));
+    }
+
+    std::string config(const std::string& poll) const {
+        return poll + "\n" +
+               "# skin sensor, throttling at 40, 45 and 50C, shutting down at 60C\n"
+               "sensor skin SKIN " + path("thermal_zone0/temp") +
+               " 0.001 2 40 nan 45 nan 50 60 48\n"
+               "sensor cpu CPU " + path("thermal_zone1/temp") + " 0.001 0 70 nan 80 nan nan 90\n"
+               "cooling fan FAN " + path("cooling_device0/cur_state") + "\n";
+    }
+
+    void startEngine(const std::string& poll) {
+        ThermalConfig parsed;
+        ASSERT_TRUE(ThermalConfig::parse(config(poll), &parsed));
+        engine_ = std::make_unique<ThermalEngine>(parsed);
+        ASSERT_TRUE(engine_->start([this](const std::vector<SensorReading>& changed) {
+            std::lock_guard<std::mutex> lock(lock_);
+            batches_.push_back(changed);
+            cv_.notify_all();
+        }));
+    }
+
+    // Waits for the next batch of changes
+    bool waitForBatch(std::vector<SensorReading>* batch) {
+        std::unique_lock<std::mutex> lock(lock_);
+        if (!cv_.wait_for(lock, 2s, [this]() { return !batches_.empty(); })) {
+            return false;
+        }
+        *batch = batches_.front();
+        batches_.erase(batches_.begin());
+        return true;
+    }
+
+    TemporaryDir dir_;
+    std::unique_ptr<ThermalEngine> engine_;
+    std::mutex lock_;
+    std::condition_variable cv_;
+    std::vector<std::vector<SensorReading>> batches_;
+};
+
+TEST_F(ThermalEngineTest, ParsesConfig) {
+    ThermalConfig parsed;
+    ASSERT_TRUE(ThermalConfig::parse(config("poll 1000 100 3"), &parsed));
+    EXPECT_EQ(1000ms, parsed.slowPollInterval);
+    EXPECT_EQ(100ms, parsed.fastPollInterval);
+    EXPECT_FLOAT_EQ(3, parsed.fastPollMargin);
+
+    ASSERT_EQ(2u, parsed.sensors.size());
+    const SensorConfig& skin = parsed.sensors[0];
+    EXPECT_EQ("skin", skin.name);
+    EXPECT_EQ(3, skin.type);
+    EXPECT_FLOAT_EQ(0.001, skin.multiplier);
+    EXPECT_FLOAT_EQ(2, skin.hysteresis);
+    EXPECT_TRUE(std::isnan(skin.hotThresholds[0]));
+    EXPECT_FLOAT_EQ(40, skin.hotThresholds[1]);
+    EXPECT_TRUE(std::isnan(skin.hotThresholds[2]));
+    EXPECT_FLOAT_EQ(60, skin.hotThresholds[6]);
+    EXPECT_FLOAT_EQ(48, skin.vrThreshold);
+    EXPECT_TRUE(std::isnan(parsed.sensors[1].vrThreshold));
+
+    ASSERT_EQ(1u, parsed.coolingDevices.size());
+    EXPECT_EQ("fan", parsed.coolingDevices[0].name);
+    EXPECT_EQ(0u, parsed.coolingDevices[0].type);
+}
+
+TEST_F(ThermalEngineTest, RejectsInvalidConfig) {
+    ThermalConfig parsed;
+    EXPECT_FALSE(ThermalConfig::parse("sensor skin WARM /dev/null 1 0 1 2 3 4 5 6\n", &parsed));
+    EXPECT_FALSE(ThermalConfig::parse("sensor skin SKIN /dev/null 1 0 1 2 3\n", &parsed));
+    EXPECT_FALSE(ThermalConfig::parse("sensor skin SKIN /dev/null 1 0 1 2 x 4 5 6\n", &parsed));
+    EXPECT_FALSE(ThermalConfig::parse("poll 0 100 5\n", &parsed));
+    EXPECT_FALSE(ThermalConfig::parse("fan FAN /dev/null\n", &parsed));
+}
+
+TEST_F(ThermalEngineTest, Severity) {
+    ThermalConfig parsed;
+    ASSERT_TRUE(ThermalConfig::parse(config(""), &parsed));
+    const SensorConfig& skin = parsed.sensors[0];
+    EXPECT_EQ(kNone, ThermalEngine::getSeverity(skin, 39.9, kNone));
+    EXPECT_EQ(kLight, ThermalEngine::getSeverity(skin, 40, kNone));
+    EXPECT_EQ(kSevere, ThermalEngine::getSeverity(skin, 47, kNone));
+    EXPECT_EQ(kShutdown, ThermalEngine::getSeverity(skin, 65, kLight));
+    // Hysteresis of 2C
+    EXPECT_EQ(kSevere, ThermalEngine::getSeverity(skin, 43.5, kSevere));
+    EXPECT_EQ(kLight, ThermalEngine::getSeverity(skin, 42.5, kSevere));
+    EXPECT_EQ(kLight, ThermalEngine::getSeverity(skin, 38.5, kLight));
+    EXPECT_EQ(kNone, ThermalEngine::getSeverity(skin, 37.5, kLight));
+}
+
+TEST_F(ThermalEngineTest, NotifiesThresholdCrossings) {
+    startEngine("poll 20 5 5");
+
+    setValue("thermal_zone0/temp", 46000);
+    std::vector<SensorReading> batch;
+    ASSERT_TRUE(waitForBatch(&batch));
+    ASSERT_EQ(1u, batch.size());
+    EXPECT_EQ("skin", batch[0].name);
+    EXPECT_EQ(3, batch[0].type);
+    EXPECT_FLOAT_EQ(46, batch[0].value);
+    EXPECT_EQ(kSevere, batch[0].severity);
+
+    // Within the hysteresis: no change
+    setValue("thermal_zone0/temp", 44000);
+    std::this_thread::sleep_for(100ms);
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        EXPECT_TRUE(batches_.empty());
+    }
+
+    setValue("thermal_zone0/temp", 30000);
+    ASSERT_TRUE(waitForBatch(&batch));
+    ASSERT_EQ(1u, batch.size());
+    EXPECT_EQ(kNone, batch[0].severity);
+}
+
+TEST_F(ThermalEngineTest, BatchesSimultaneousCrossings) {
+    // Both sensors cross a threshold before their first poll
+    setValue("thermal_zone0/temp", 41000);
+    setValue("thermal_zone1/temp", 85000);
+    startEngine("poll 50 5 1");
+
+    std::vector<SensorReading> batch;
+    ASSERT_TRUE(waitForBatch(&batch));
+    ASSERT_EQ(2u, batch.size());
+    EXPECT_EQ(kLight, batch[0].severity);
+    EXPECT_EQ(kSevere, batch[1].severity);
+
+    ThermalEngine::Stats stats = engine_->getStats();
+    EXPECT_EQ(1u, stats.batches);
+    EXPECT_EQ(2u, stats.severityChanges);
+}
+
+TEST_F(ThermalEngineTest, PollsFasterNearThresholds) {
+    startEngine("poll 1000 10 5");
+    std::this_thread::sleep_for(200ms);
+    ThermalEngine::Stats stats = engine_->getStats();
+    // Only the first poll of each sensor
+    EXPECT_EQ(2u, stats.polls);
+    EXPECT_EQ(0u, stats.fastPolls);
+
+    // 36C is within 5C of the first threshold of the skin sensor
+    setValue("thermal_zone0/temp", 36000);
+    std::this_thread::sleep_for(1100ms);
+    stats = engine_->getStats();
+    EXPECT_GE(stats.fastPolls, 10u);
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        EXPECT_TRUE(batches_.empty());
+    }
+
+    setValue("thermal_zone0/temp", 40000);
+    std::vector<SensorReading> batch;
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(waitForBatch(&batch));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 500ms);
+}
+
+TEST_F(ThermalEngineTest, ReadsCurrentValues) {
+    startEngine("poll 1000 100 5");
+    setValue("thermal_zone1/temp", 71500);
+
+    std::vector<SensorReading> sensors;
+    ASSERT_TRUE(engine_->readSensors(&sensors));
+    ASSERT_EQ(2u, sensors.size());
+    EXPECT_FLOAT_EQ(30, sensors[0].value);
+    EXPECT_FLOAT_EQ(71.5, sensors[1].value);
+    // The severity is the one of the last poll
+    EXPECT_EQ(kNone, sensors[1].severity);
+
+    std::vector<CoolingDeviceReading> devices;
+    ASSERT_TRUE(engine_->readCoolingDevices(&devices));
+    ASSERT_EQ(1u, devices.size());
+    EXPECT_EQ("fan", devices[0].name);
+    EXPECT_EQ(2u, devices[0].value);
+}
+
+TEST_F(ThermalEngineTest, FailsToStartWithMissingNode) {
+    ThermalConfig parsed;
+    ASSERT_TRUE(ThermalConfig::parse(
+            "sensor skin SKIN " + path("missing") + " 1 0 40 nan nan nan nan 60\n", &parsed));
+    ThermalEngine engine(parsed);
+    EXPECT_FALSE(engine.start(nullptr));
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CecTransmitQueue.h"
+
+#include <algorithm>
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace cec {
+namespace V1_0 {
+namespace implementation {
+
+CecTransmitQueue::CecTransmitQueue(const hdmi_cec_device_t* device)
+    : CecTransmitQueue(device, Config()) {}
+
+CecTransmitQueue::CecTransmitQueue(const hdmi_cec_device_t* device, const Config& config)
+    : mDevice(device), mConfig(config), mThread(&CecTransmitQueue::run, this) {}
+
+CecTransmitQueue::~CecTransmitQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    mPending.notify_one();
+    mThread.join();
+
+    std::unique_lock<std::mutex> lock(mLock);
+    for (auto& queue : mQueues) {
+        for (auto& request : queue) {
+            request->done = true;
+        }
+        queue.clear();
+    }
+    mDepth = 0;
+    mDone.notify_all();
+    // The callers still reference the queue until they are woken up
+    mDone.wait(lock, [this]() { return mWaiters == 0; });
+}
+
+int CecTransmitQueue::send(const cec_message_t& message) {
+    auto request = std::make_shared<Request>();
+    request->message = message;
+
+    std::unique_lock<std::mutex> lock(mLock);
+    if (mStopping) {
+        return HDMI_RESULT_FAIL;
+    }
+    if (mDepth >= mConfig.maxDepth) {
+        mStats.rejected++;
+        return HDMI_RESULT_BUSY;
+    }
+    request->sequence = mNextSequence++;
+    mQueues[message.destination % kNumDestinations].push_back(request);
+    mDepth++;
+    mStats.maxDepth = std::max(mStats.maxDepth, mDepth);
+    mPending.notify_one();
+
+    mWaiters++;
+    mDone.wait(lock, [&request]() { return request->done; });
+    mWaiters--;
+    if (mStopping) {
+        mDone.notify_all();
+    }
+    return request->result;
+}
+
+CecTransmitQueue::Stats CecTransmitQueue::getStats() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mStats;
+}
+
+std::shared_ptr<CecTransmitQueue::Request> CecTransmitQueue::nextRequestLocked(
+        Clock::time_point now, Clock::time_point* wakeUp) {
+    std::shared_ptr<Request> next;
+    *wakeUp = Clock::time_point::max();
+    for (const auto& queue : mQueues) {
+        if (queue.empty()) {
+            continue;
+        }
+        const std::shared_ptr<Request>& head = queue.front();
+        if (head->notBefore > now) {
+            *wakeUp = std::min(*wakeUp, head->notBefore);
+        } else if (next == nullptr || head->sequence < next->sequence) {
+            next = head;
+        }
+    }
+    return next;
+}
+
+bool CecTransmitQueue::completeLocked(Request* request, int result, Clock::time_point now) {
+    int retries = request->busyRetries + request->nackRetries;
+    bool retry = false;
+    if (result == HDMI_RESULT_BUSY) {
+        retry = request->busyRetries++ < mConfig.maxBusyRetries;
+    } else if (result == HDMI_RESULT_NACK) {
+        mStats.nacks++;
+        // A NACK is the expected answer to a polling message, sent to find free addresses. A
+        // broadcast is not acknowledged by its followers, so resending it won't change the answer.
+        retry = request->message.length > 0 && request->message.destination != CEC_ADDR_BROADCAST &&
+                request->nackRetries++ < mConfig.maxNackRetries;
+    }
+
+    if (retry) {
+        mStats.retries++;
+        request->notBefore = now + mConfig.retryBackoff * (1 << std::min(retries, 16));
+        return false;
+    }
+    if (result == HDMI_RESULT_SUCCESS) {
+        mStats.sent++;
+    }
+    request->result = result;
+    request->done = true;
+    return true;
+}
+
+void CecTransmitQueue::run() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (!mStopping) {
+        Clock::time_point wakeUp;
+        std::shared_ptr<Request> request = nextRequestLocked(Clock::now(), &wakeUp);
+        if (request == nullptr) {
+            if (wakeUp == Clock::time_point::max()) {
+                mPending.wait(lock);
+            } else {
+                mPending.wait_until(lock, wakeUp);
+            }
+            continue;
+        }
+
+        // The request stays at the head of its queue while it is sent, holding back the next
+        // messages to the same destination
+        lock.unlock();
+        int result = mDevice->send_message(mDevice, &request->message);
+        lock.lock();
+
+        if (completeLocked(request.get(), result, Clock::now())) {
+            mQueues[request->message.destination % kNumDestinations].pop_front();
+            mDepth--;
+            mDone.notify_all();
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace cec
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
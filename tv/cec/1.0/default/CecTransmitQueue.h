@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_TV_CEC_V1_0_CECTRANSMITQUEUE_H
+#define ANDROID_HARDWARE_TV_CEC_V1_0_CECTRANSMITQUEUE_H
+
+#include <hardware/hdmi_cec.h>
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace cec {
+namespace V1_0 {
+namespace implementation {
+
+/*
+ * Sends CEC messages through the legacy device from a single thread, the bus carrying one frame at
+ * a time anyway. Messages are kept in one queue per destination: a message waiting to be retried
+ * holds back the later messages to the same destination, but not the ones to other destinations.
+ *
+ * Callers still wait for the result of their own message, as they need to know whether it was
+ * acknowledged, but they no longer wait for the retries of unrelated messages.
+ */
+class CecTransmitQueue {
+   public:
+    struct Config {
+        // Messages queued or being sent; more are rejected with HDMI_RESULT_BUSY
+        size_t maxDepth = 16;
+        // Retries on top of the ones done by the device, the first one after retryBackoff and
+        // each of the next ones after twice as long as the previous one. None by default: the
+        // device already retries per the CEC spec and the framework retries failed messages.
+        int maxBusyRetries = 0;
+        int maxNackRetries = 0;
+        std::chrono::milliseconds retryBackoff{20};
+    };
+
+    struct Stats {
+        uint64_t sent;
+        uint64_t retries;
+        uint64_t nacks;
+        uint64_t rejected;
+        size_t maxDepth;
+    };
+
+    explicit CecTransmitQueue(const hdmi_cec_device_t* device);
+    CecTransmitQueue(const hdmi_cec_device_t* device, const Config& config);
+    ~CecTransmitQueue();
+
+    /*
+     * Queues the message and waits until it was sent or ran out of retries. Returns a
+     * HDMI_RESULT_* value, HDMI_RESULT_BUSY right away if the queue is full.
+     */
+    int send(const cec_message_t& message);
+
+    Stats getStats();
+
+   private:
+    using Clock = std::chrono::steady_clock;
+    // One per logical address, broadcast included
+    static constexpr size_t kNumDestinations = 16;
+
+    struct Request {
+        cec_message_t message;
+        uint64_t sequence;
+        int busyRetries = 0;
+        int nackRetries = 0;
+        Clock::time_point notBefore;
+        bool done = false;
+        int result = HDMI_RESULT_FAIL;
+    };
+
+    // Returns the oldest request due at the head of a queue, or null after setting wakeUp to
+    // when the next one will be
+    std::shared_ptr<Request> nextRequestLocked(Clock::time_point now, Clock::time_point* wakeUp);
+    // Returns false if the request is to be retried
+    bool completeLocked(Request* request, int result, Clock::time_point now);
+    void run();
+
+    const hdmi_cec_device_t* mDevice;
+    const Config mConfig;
+
+    std::mutex mLock;
+    // Wakes the transmit thread
+    std::condition_variable mPending;
+    // Wakes the callers
+    std::condition_variable mDone;
+    std::array<std::deque<std::shared_ptr<Request>>, kNumDestinations> mQueues;
+    size_t mDepth = 0;
+    uint64_t mNextSequence = 0;
+    // Callers waiting for their result
+    size_t mWaiters = 0;
+    bool mStopping = false;
+    Stats mStats = {};
+    std::thread mThread;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace cec
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_TV_CEC_V1_0_CECTRANSMITQUEUE_H
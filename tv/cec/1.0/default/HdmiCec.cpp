@@ -17,6 +17,8 @@
 #define LOG_TAG "android.hardware.tv.cec@1.0-impl"
 #include <android-base/logging.h>
 
+#include <algorithm>
+
 #include <hardware/hardware.h>
 #include <hardware/hdmi_cec.h>
 #include "HdmiCec.h"
@@ -264,7 +266,7 @@ static_assert(HDMI_OPTION_SYSTEM_CEC_CONTROL == static_cast<int>(OptionKey::SYST
 
 sp<IHdmiCecCallback> HdmiCec::mCallback = nullptr;
 
-HdmiCec::HdmiCec(hdmi_cec_device_t* device) : mDevice(device) {}
+HdmiCec::HdmiCec(hdmi_cec_device_t* device) : mDevice(device), mTransmitQueue(device) {}
 
 // Methods from ::android::hardware::tv::cec::V1_0::IHdmiCec follow.
 Return<Result> HdmiCec::addLogicalAddress(CecLogicalAddress addr) {
@@ -306,15 +308,16 @@ Return<void> HdmiCec::getPhysicalAddress(getPhysicalAddress_cb _hidl_cb) {
 }
 
 Return<SendMessageResult> HdmiCec::sendMessage(const CecMessage& message) {
+    if (message.body.size() > static_cast<size_t>(MaxLength::MESSAGE_BODY)) {
+        return SendMessageResult::FAIL;
+    }
     cec_message_t legacyMessage {
         .initiator = static_cast<cec_logical_address_t>(message.initiator),
         .destination = static_cast<cec_logical_address_t>(message.destination),
         .length = message.body.size(),
     };
-    for (size_t i = 0; i < message.body.size(); ++i) {
-        legacyMessage.body[i] = static_cast<unsigned char>(message.body[i]);
-    }
-    return static_cast<SendMessageResult>(mDevice->send_message(mDevice, &legacyMessage));
+    std::copy_n(message.body.data(), legacyMessage.length, legacyMessage.body);
+    return static_cast<SendMessageResult>(mTransmitQueue.send(legacyMessage));
 }
 
 Return<void> HdmiCec::setCallback(const sp<IHdmiCecCallback>& callback) {
@@ -25,6 +25,9 @@
 #include <hardware/hdmi_cec.h>
 
 #include <hidl/MQDescriptor.h>
+
+#include "CecTransmitQueue.h"
+
 namespace android {
 namespace hardware {
 namespace tv {
@@ -95,6 +98,7 @@ struct HdmiCec : public IHdmiCec, public hidl_death_recipient {
    private:
     static sp<IHdmiCecCallback> mCallback;
     const hdmi_cec_device_t* mDevice;
+    CecTransmitQueue mTransmitQueue;
 };
 
 extern "C" IHdmiCec* HIDL_FETCH_IHdmiCec(const char* name);
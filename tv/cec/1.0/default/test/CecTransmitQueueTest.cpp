@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CecTransmitQueue.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using android::hardware::tv::cec::V1_0::implementation::CecTransmitQueue;
+using namespace std::chrono_literals;
+
+namespace {
+
+struct Frame {
+    int destination;
+    std::vector<unsigned char> body;
+};
+
+/*
+ * Stands in for the legacy device. Each frame takes the bus latency to send, and its result is the
+ * next one of the scripted results for its destination, HDMI_RESULT_SUCCESS once they run out.
+ */
+class FakeCecDevice {
+   public:
+    FakeCecDevice() {
+        device_.send_message = sendMessage;
+        sInstance = this;
+    }
+    ~FakeCecDevice() { sInstance = nullptr; }
+
+    const hdmi_cec_device_t* device() const { return &device_; }
+
+    void setLatency(std::chrono::milliseconds latency) { latency_ = latency; }
+
+    void script(int destination, std::vector<int> results) {
+        std::lock_guard<std::mutex> lock(lock_);
+        results_[destination] = results;
+    }
+
+    std::vector<Frame> frames() {
+        std::lock_guard<std::mutex> lock(lock_);
+        return frames_;
+    }
+
+    bool waitForFrames(size_t count) {
+        for (int i = 0; i < 200; i++) {
+            if (frames().size() >= count) {
+                return true;
+            }
+            std::this_thread::sleep_for(5ms);
+        }
+        return false;
+    }
+
+   private:
+    static int sendMessage(const hdmi_cec_device_t* /* dev */, const cec_message_t* message) {
+        return sInstance->send(*message);
+    }
+
+    int send(const cec_message_t& message) {
+        std::this_thread::sleep_for(latency_);
+        std::lock_guard<std::mutex> lock(lock_);
+        frames_.push_back(
+                {message.destination, {message.body, message.body + message.length}});
+        std::vector<int>& results = results_[message.destination];
+        if (results.empty()) {
+            return HDMI_RESULT_SUCCESS;
+        }
+        int result = results.front();
+        results.erase(results.begin());
+        return result;
+    }
+
+    static FakeCecDevice* sInstance;
+
+    hdmi_cec_device_t device_ = {};
+    std::chrono::milliseconds latency_{0};
+    std::mutex lock_;
+    std::vector<int> results_[16];
+    std::vector<Frame> frames_;
+};
+
+FakeCecDevice* FakeCecDevice::sInstance = nullptr;
+
+cec_message_t makeMessage(int destination, std::vector<unsigned char> body) {
+    cec_message_t message = {};
+    message.initiator = CEC_ADDR_PLAYBACK_1;
+    message.destination = static_cast<cec_logical_address_t>(destination);
+    message.length = body.size();
+    std::copy(body.begin(), body.end(), message.body);
+    return message;
+}
+
+CecTransmitQueue::Config makeRetryConfig(std::chrono::milliseconds backoff) {
+    CecTransmitQueue::Config config;
+    config.maxBusyRetries = 3;
+    config.maxNackRetries = 1;
+    config.retryBackoff = backoff;
+    return config;
+}
+
+}  // namespace
+
+TEST(CecTransmitQueueTest, SendsMessages) {
+    FakeCecDevice fake;
+    CecTransmitQueue queue(fake.device());
+
+    EXPECT_EQ(HDMI_RESULT_SUCCESS, queue.send(makeMessage(CEC_ADDR_TV, {0x04})));
+    std::vector<Frame> frames = fake.frames();
+    ASSERT_EQ(1u, frames.size());
+    EXPECT_EQ(CEC_ADDR_TV, frames[0].destination);
+    EXPECT_EQ(std::vector<unsigned char>{0x04}, frames[0].body);
+    EXPECT_EQ(1u, queue.getStats().sent);
+}
+
+TEST(CecTransmitQueueTest, DoesNotRetryByDefault) {
+    FakeCecDevice fake;
+    fake.script(CEC_ADDR_TV, {HDMI_RESULT_BUSY, HDMI_RESULT_NACK});
+    CecTransmitQueue queue(fake.device());
+
+    EXPECT_EQ(HDMI_RESULT_BUSY, queue.send(makeMessage(CEC_ADDR_TV, {0x04})));
+    EXPECT_EQ(HDMI_RESULT_NACK, queue.send(makeMessage(CEC_ADDR_TV, {0x04})));
+    EXPECT_EQ(2u, fake.frames().size());
+    EXPECT_EQ(0u, queue.getStats().retries);
+}
+
+TEST(CecTransmitQueueTest, RetriesBusyBusWithBackoff) {
+    FakeCecDevice fake;
+    fake.script(CEC_ADDR_TV, {HDMI_RESULT_BUSY, HDMI_RESULT_BUSY});
+    CecTransmitQueue queue(fake.device(), makeRetryConfig(20ms));
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(HDMI_RESULT_SUCCESS, queue.send(makeMessage(CEC_ADDR_TV, {0x04})));
+    // 20ms, then twice as long
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 60ms);
+    EXPECT_EQ(3u, fake.frames().size());
+    EXPECT_EQ(2u, queue.getStats().retries);
+}
+
+TEST(CecTransmitQueueTest, GivesUpAfterRetries) {
+    FakeCecDevice fake;
+    fake.script(CEC_ADDR_TV, std::vector<int>(10, HDMI_RESULT_BUSY));
+    CecTransmitQueue::Config config = makeRetryConfig(1ms);
+    config.maxBusyRetries = 2;
+    CecTransmitQueue queue(fake.device(), config);
+
+    EXPECT_EQ(HDMI_RESULT_BUSY, queue.send(makeMessage(CEC_ADDR_TV, {0x04})));
+    EXPECT_EQ(3u, fake.frames().size());
+    EXPECT_EQ(0u, queue.getStats().sent);
+}
+
+TEST(CecTransmitQueueTest, RetriesNackExceptForPolls) {
+    FakeCecDevice fake;
+    fake.script(CEC_ADDR_TV, std::vector<int>(10, HDMI_RESULT_NACK));
+    CecTransmitQueue queue(fake.device(), makeRetryConfig(1ms));
+
+    // Polling messages have no body
+    EXPECT_EQ(HDMI_RESULT_NACK, queue.send(makeMessage(CEC_ADDR_TV, {})));
+    EXPECT_EQ(1u, fake.frames().size());
+
+    EXPECT_EQ(HDMI_RESULT_NACK, queue.send(makeMessage(CEC_ADDR_TV, {0x04})));
+    EXPECT_EQ(3u, fake.frames().size());
+    EXPECT_EQ(3u, queue.getStats().nacks);
+}
+
+TEST(CecTransmitQueueTest, DoesNotRetryBroadcastNack) {
+    FakeCecDevice fake;
+    fake.script(CEC_ADDR_BROADCAST, std::vector<int>(10, HDMI_RESULT_NACK));
+    CecTransmitQueue queue(fake.device(), makeRetryConfig(1ms));
+
+    EXPECT_EQ(HDMI_RESULT_NACK, queue.send(makeMessage(CEC_ADDR_BROADCAST, {0x82, 0x10, 0x00})));
+    EXPECT_EQ(1u, fake.frames().size());
+    EXPECT_EQ(0u, queue.getStats().retries);
+}
+
+TEST(CecTransmitQueueTest, KeepsOrderPerDestination) {
+    FakeCecDevice fake;
+    fake.script(CEC_ADDR_TV, {HDMI_RESULT_NACK});
+    CecTransmitQueue queue(fake.device(), makeRetryConfig(100ms));
+
+    std::thread first([&queue]() {
+        EXPECT_EQ(HDMI_RESULT_SUCCESS, queue.send(makeMessage(CEC_ADDR_TV, {0x01})));
+    });
+    // The first message is waiting to be retried
+    ASSERT_TRUE(fake.waitForFrames(1));
+    std::thread second([&queue]() {
+        EXPECT_EQ(HDMI_RESULT_SUCCESS, queue.send(makeMessage(CEC_ADDR_TV, {0x02})));
+    });
+    EXPECT_EQ(HDMI_RESULT_SUCCESS, queue.send(makeMessage(CEC_ADDR_PLAYBACK_1, {0x03})));
+    first.join();
+    second.join();
+
+    std::vector<Frame> frames = fake.frames();
+    ASSERT_EQ(4u, frames.size());
+    // Other destinations aren't held back by the retry
+    EXPECT_EQ(0x03, frames[1].body[0]);
+    EXPECT_EQ(0x01, frames[2].body[0]);
+    EXPECT_EQ(0x02, frames[3].body[0]);
+}
+
+TEST(CecTransmitQueueTest, RejectsMessagesWhenFull) {
+    FakeCecDevice fake;
+    fake.setLatency(200ms);
+    CecTransmitQueue::Config config;
+    config.maxDepth = 2;
+    CecTransmitQueue queue(fake.device(), config);
+
+    std::vector<std::thread> senders;
+    for (int destination : {CEC_ADDR_TV, CEC_ADDR_PLAYBACK_1}) {
+        senders.emplace_back([&queue, destination]() {
+            EXPECT_EQ(HDMI_RESULT_SUCCESS, queue.send(makeMessage(destination, {0x04})));
+        });
+    }
+    for (int i = 0; i < 100 && queue.getStats().maxDepth < 2; i++) {
+        std::this_thread::sleep_for(1ms);
+    }
+    ASSERT_EQ(2u, queue.getStats().maxDepth);
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(HDMI_RESULT_BUSY, queue.send(makeMessage(CEC_ADDR_BROADCAST, {0x04})));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 100ms);
+    for (auto& sender : senders) {
+        sender.join();
+    }
+    EXPECT_EQ(1u, queue.getStats().rejected);
+    EXPECT_EQ(2u, queue.getStats().sent);
+}
+
+TEST(CecTransmitQueueTest, ServesConcurrentSendersOnSlowBus) {
+    FakeCecDevice fake;
+    fake.setLatency(5ms);
+    CecTransmitQueue queue(fake.device());
+
+    std::vector<std::thread> senders;
+    for (int destination = 0; destination < 8; destination++) {
+        senders.emplace_back([&queue, destination]() {
+            for (int i = 0; i < 4; i++) {
+                EXPECT_EQ(HDMI_RESULT_SUCCESS, queue.send(makeMessage(destination, {0x04})));
+            }
+        });
+    }
+    for (auto& sender : senders) {
+        sender.join();
+    }
+    EXPECT_EQ(32u, fake.frames().size());
+    EXPECT_EQ(32u, queue.getStats().sent);
+    EXPECT_LE(queue.getStats().maxDepth, 8u);
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.usb@1.0-service"
+
+#include "PortStatusCache.h"
+
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+
+#include <log/log.h>
+
+namespace android {
+namespace hardware {
+namespace usb {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+constexpr char kSubsystem[] = "SUBSYSTEM=dual_role_usb";
+constexpr char kActionPrefix[] = "ACTION=";
+constexpr char kDevPathPrefix[] = "DEVPATH=";
+constexpr char kModePrefix[] = "DUAL_ROLE_USB_MODE=";
+constexpr char kPowerRolePrefix[] = "DUAL_ROLE_USB_POWER_ROLE=";
+constexpr char kDataRolePrefix[] = "DUAL_ROLE_USB_DATA_ROLE=";
+constexpr char kSupportedModesPrefix[] = "DUAL_ROLE_USB_SUPPORTED_MODES=";
+
+bool startsWith(const char* s, const char* prefix, const char** value) {
+    size_t length = strlen(prefix);
+    if (strncmp(s, prefix, length) != 0) {
+        return false;
+    }
+    *value = s + length;
+    return true;
+}
+
+bool readAttribute(const std::string& path, std::string* value) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    getline(file, *value);
+    return true;
+}
+
+// Values of PortMode, PortPowerRole and PortDataRole. The names don't overlap.
+bool parseRole(const std::string& name, uint32_t* role) {
+    if (name == "none") {
+        *role = 0;
+    } else if (name == "ufp" || name == "source" || name == "host") {
+        *role = 1;
+    } else if (name == "dfp" || name == "sink" || name == "device") {
+        *role = 2;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parseSupportedModes(const std::string& modes, uint32_t* mode) {
+    if (modes == "ufp dfp" || modes == "dfp ufp") {
+        *mode = 3;  // DRP
+    } else if (modes == "ufp") {
+        *mode = 1;
+    } else if (modes == "dfp") {
+        *mode = 2;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+bool PortState::operator==(const PortState& other) const {
+    return name == other.name && currentDataRole == other.currentDataRole &&
+           currentPowerRole == other.currentPowerRole && currentMode == other.currentMode &&
+           canChangeMode == other.canChangeMode && canChangeDataRole == other.canChangeDataRole &&
+           canChangePowerRole == other.canChangePowerRole &&
+           supportedModes == other.supportedModes;
+}
+
+PortStatusCache::PortStatusCache(const std::string& root) : mRoot(root), mScanned(false) {}
+
+bool PortStatusCache::readPort(const std::string& name, PortState* state) {
+    std::string node = mRoot + "/" + name;
+    std::string power, data, mode, supported;
+    if (!readAttribute(node + "/power_role", &power) ||
+            !readAttribute(node + "/data_role", &data) ||
+            !readAttribute(node + "/mode", &mode) ||
+            !readAttribute(node + "/supported_modes", &supported)) {
+        ALOGE("Failed to read the roles of %s", name.c_str());
+        return false;
+    }
+
+    state->name = name;
+    if (!parseRole(power, &state->currentPowerRole) ||
+            !parseRole(data, &state->currentDataRole) ||
+            !parseRole(mode, &state->currentMode) ||
+            !parseSupportedModes(supported, &state->supportedModes)) {
+        ALOGE("Unrecognized role of %s", name.c_str());
+        return false;
+    }
+    state->canChangePowerRole = access((node + "/power_role").c_str(), W_OK) == 0;
+    state->canChangeDataRole = access((node + "/data_role").c_str(), W_OK) == 0;
+    state->canChangeMode = access((node + "/mode").c_str(), W_OK) == 0;
+    return true;
+}
+
+bool PortStatusCache::rescan() {
+    DIR *dp = opendir(mRoot.c_str());
+    if (dp == NULL) {
+        ALOGE("Failed to open %s", mRoot.c_str());
+        std::lock_guard<std::mutex> lock(mLock);
+        mScanned = false;
+        return false;
+    }
+
+    std::vector<PortState> ports;
+    bool ok = true;
+    struct dirent *ep;
+    while ((ep = readdir(dp))) {
+        if (ep->d_type != DT_LNK) {
+            continue;
+        }
+        PortState state;
+        if (readPort(ep->d_name, &state)) {
+            ports.push_back(state);
+        } else {
+            ok = false;
+        }
+    }
+    closedir(dp);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mPorts = std::move(ports);
+    mScanned = ok;
+    return ok;
+}
+
+bool PortStatusCache::handleUevent(const char* msg, size_t length) {
+    bool subsystem = false;
+    const char* action = "";
+    const char* devPath = NULL;
+    const char* mode = NULL;
+    const char* powerRole = NULL;
+    const char* dataRole = NULL;
+    const char* supportedModes = NULL;
+
+    for (const char* cp = msg; cp < msg + length && *cp; cp += strlen(cp) + 1) {
+        if (!strcmp(cp, kSubsystem)) {
+            subsystem = true;
+        } else if (!startsWith(cp, kActionPrefix, &action) &&
+                !startsWith(cp, kDevPathPrefix, &devPath) &&
+                !startsWith(cp, kModePrefix, &mode) &&
+                !startsWith(cp, kPowerRolePrefix, &powerRole) &&
+                !startsWith(cp, kDataRolePrefix, &dataRole)) {
+            startsWith(cp, kSupportedModesPrefix, &supportedModes);
+        }
+    }
+    if (!subsystem || devPath == NULL) {
+        return false;
+    }
+
+    const char* slash = strrchr(devPath, '/');
+    std::string name(slash != NULL ? slash + 1 : devPath);
+    ALOGI("uevent %s %s", action, name.c_str());
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!strcmp(action, "remove")) {
+        return removePortLocked(name);
+    }
+
+    PortState state;
+    bool known = false;
+    for (const auto& port : mPorts) {
+        if (port.name == name) {
+            state = port;
+            known = true;
+            break;
+        }
+    }
+    // The event carries the roles; the capabilities of a new port still come from sysfs
+    bool parsed = known && mode != NULL && powerRole != NULL && dataRole != NULL &&
+            parseRole(mode, &state.currentMode) &&
+            parseRole(powerRole, &state.currentPowerRole) &&
+            parseRole(dataRole, &state.currentDataRole) &&
+            (supportedModes == NULL ||
+             parseSupportedModes(supportedModes, &state.supportedModes));
+    if (!parsed && !readPort(name, &state)) {
+        return false;
+    }
+    return updatePortLocked(state);
+}
+
+bool PortStatusCache::updatePortLocked(const PortState& state) {
+    for (auto& port : mPorts) {
+        if (port.name == state.name) {
+            if (port == state) {
+                return false;
+            }
+            port = state;
+            return true;
+        }
+    }
+    mPorts.push_back(state);
+    return true;
+}
+
+bool PortStatusCache::removePortLocked(const std::string& name) {
+    for (auto it = mPorts.begin(); it != mPorts.end(); ++it) {
+        if (it->name == name) {
+            mPorts.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PortStatusCache::getPorts(std::vector<PortState>* ports) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mScanned) {
+        return false;
+    }
+    *ports = mPorts;
+    return true;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace usb
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_USB_V1_0_PORTSTATUSCACHE_H
+#define ANDROID_HARDWARE_USB_V1_0_PORTSTATUSCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace usb {
+namespace V1_0 {
+namespace implementation {
+
+/*
+ * The status of a port, as reported in a PortStatus.
+ */
+struct PortState {
+    std::string name;
+    // Values of PortDataRole, PortPowerRole and PortMode
+    uint32_t currentDataRole = 0;
+    uint32_t currentPowerRole = 0;
+    uint32_t currentMode = 0;
+    bool canChangeMode = false;
+    bool canChangeDataRole = false;
+    bool canChangePowerRole = false;
+    uint32_t supportedModes = 0;
+
+    bool operator==(const PortState& other) const;
+    bool operator!=(const PortState& other) const { return !(*this == other); }
+};
+
+/*
+ * Keeps the status of the ports of the dual_role_usb class in memory. The class is scanned once,
+ * then kept up to date from the uevents of the subsystem: the roles are taken from the
+ * DUAL_ROLE_USB_* properties of the event, and only the port named by the event is read from
+ * sysfs if they are missing.
+ */
+class PortStatusCache {
+  public:
+    static constexpr const char* kDualRoleRoot = "/sys/class/dual_role_usb";
+
+    explicit PortStatusCache(const std::string& root = kDualRoleRoot);
+
+    /*
+     * Reads every port from sysfs. Returns false if the class can't be read or one of the ports
+     * has an attribute that can't be read or parsed.
+     */
+    bool rescan();
+
+    /*
+     * Applies a uevent, given as the NUL-separated strings read from the uevent socket. Returns
+     * true if a port was added, removed, or changed status.
+     */
+    bool handleUevent(const char* msg, size_t length);
+
+    /*
+     * Returns false if the ports have never been scanned successfully.
+     */
+    bool getPorts(std::vector<PortState>* ports);
+
+  private:
+    bool readPort(const std::string& name, PortState* state);
+    bool updatePortLocked(const PortState& state);
+    bool removePortLocked(const std::string& name);
+
+    const std::string mRoot;
+    std::mutex mLock;
+    bool mScanned;
+    std::vector<PortState> mPorts;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace usb
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_USB_V1_0_PORTSTATUSCACHE_H
@@ -115,195 +115,36 @@ Return<void> Usb::switchRole(const hidl_string& portName,
     return Void();
 }
 
-Status getCurrentRoleHelper(std::string portName,
-        PortRoleType type, uint32_t &currentRole)  {
-    std::string filename;
-    std::string roleName;
-
-    if (type == PortRoleType::POWER_ROLE) {
-        filename = "/sys/class/dual_role_usb/" +
-            portName + "/power_role";
-        currentRole = static_cast<uint32_t>(PortPowerRole::NONE);
-    } else if (type == PortRoleType::DATA_ROLE) {
-        filename = "/sys/class/dual_role_usb/" +
-            portName + "/data_role";
-        currentRole = static_cast<uint32_t> (PortDataRole::NONE);
-    } else if (type == PortRoleType::MODE) {
-        filename = "/sys/class/dual_role_usb/" +
-            portName + "/mode";
-        currentRole = static_cast<uint32_t> (PortMode::NONE);
-    }
+Status getPortStatusHelper(PortStatusCache& cache,
+        hidl_vec<PortStatus>& currentPortStatus) {
+    std::vector<PortState> ports;
 
-    if (readFile(filename, roleName)) {
-        ALOGE("getCurrentRole: Failed to open filesystem node");
+    if (!cache.getPorts(&ports) && !(cache.rescan() && cache.getPorts(&ports))) {
+        ALOGE("Error while retrieving port status");
         return Status::ERROR;
     }
 
-    if (roleName == "dfp")
-        currentRole = static_cast<uint32_t> (PortMode::DFP);
-    else if (roleName == "ufp")
-        currentRole = static_cast<uint32_t> (PortMode::UFP);
-    else if (roleName == "source")
-        currentRole = static_cast<uint32_t> (PortPowerRole::SOURCE);
-    else if (roleName == "sink")
-        currentRole = static_cast<uint32_t> (PortPowerRole::SINK);
-    else if (roleName == "host")
-        currentRole = static_cast<uint32_t> (PortDataRole::HOST);
-    else if (roleName == "device")
-        currentRole = static_cast<uint32_t> (PortDataRole::DEVICE);
-    else if (roleName != "none") {
-         /* case for none has already been addressed.
-          * so we check if the role isnt none.
-          */
-        return Status::UNRECOGNIZED_ROLE;
+    currentPortStatus.resize(ports.size());
+    for (size_t i = 0; i < ports.size(); i++) {
+        currentPortStatus[i].portName = ports[i].name;
+        currentPortStatus[i].currentDataRole =
+                static_cast<PortDataRole>(ports[i].currentDataRole);
+        currentPortStatus[i].currentPowerRole =
+                static_cast<PortPowerRole>(ports[i].currentPowerRole);
+        currentPortStatus[i].currentMode = static_cast<PortMode>(ports[i].currentMode);
+        currentPortStatus[i].canChangeMode = ports[i].canChangeMode;
+        currentPortStatus[i].canChangeDataRole = ports[i].canChangeDataRole;
+        currentPortStatus[i].canChangePowerRole = ports[i].canChangePowerRole;
+        currentPortStatus[i].supportedModes = static_cast<PortMode>(ports[i].supportedModes);
     }
     return Status::SUCCESS;
 }
 
-Status getTypeCPortNamesHelper(std::vector<std::string>& names) {
-    DIR *dp;
-
-    dp = opendir("/sys/class/dual_role_usb");
-    if (dp != NULL)
-    {
-rescan:
-        int32_t ports = 0;
-        int32_t current = 0;
-        struct dirent *ep;
-
-        while ((ep = readdir (dp))) {
-            if (ep->d_type == DT_LNK) {
-                ports++;
-            }
-        }
-
-        if (ports == 0) {
-            closedir(dp);
-            return Status::SUCCESS;
-        }
-
-        names.resize(ports);
-        rewinddir(dp);
-
-        while ((ep = readdir (dp))) {
-            if (ep->d_type == DT_LNK) {
-                /* Check to see if new ports were added since the first pass. */
-                if (current >= ports) {
-                    rewinddir(dp);
-                    goto rescan;
-                }
-                names[current++] = ep->d_name;
-            }
-        }
-
-        closedir (dp);
-        return Status::SUCCESS;
-    }
-
-    ALOGE("Failed to open /sys/class/dual_role_usb");
-    return Status::ERROR;
-}
-
-bool canSwitchRoleHelper(const std::string portName, PortRoleType type)  {
-    std::string filename = appendRoleNodeHelper(portName, type);
-    std::ofstream file(filename);
-
-    if (file.is_open()) {
-        file.close();
-        return true;
-    }
-    return false;
-}
-
-Status getPortModeHelper(const std::string portName, PortMode& portMode)  {
-    std::string filename = "/sys/class/dual_role_usb/" +
-    std::string(portName.c_str()) + "/supported_modes";
-    std::string modes;
-
-    if (readFile(filename, modes)) {
-        ALOGE("getSupportedRoles: Failed to open filesystem node");
-        return Status::ERROR;
-    }
-
-    if (modes == "ufp dfp")
-        portMode = PortMode::DRP;
-    else  if (modes == "ufp")
-        portMode = PortMode::UFP;
-    else if  (modes == "dfp")
-        portMode = PortMode::DFP;
-    else
-        return Status::UNRECOGNIZED_ROLE;
-
-        return Status::SUCCESS;
-}
-
-Status getPortStatusHelper (hidl_vec<PortStatus>& currentPortStatus) {
-    std::vector<std::string> names;
-    Status result = getTypeCPortNamesHelper(names);
-
-    if (result == Status::SUCCESS) {
-        currentPortStatus.resize(names.size());
-        for(std::vector<std::string>::size_type i = 0; i < names.size(); i++) {
-            ALOGI("%s", names[i].c_str());
-            currentPortStatus[i].portName = names[i];
-
-            uint32_t currentRole;
-            if (getCurrentRoleHelper(names[i], PortRoleType::POWER_ROLE,
-                    currentRole) == Status::SUCCESS) {
-                currentPortStatus[i].currentPowerRole =
-                static_cast<PortPowerRole> (currentRole);
-            } else {
-                ALOGE("Error while retreiving portNames");
-                goto done;
-            }
-
-            if (getCurrentRoleHelper(names[i],
-                    PortRoleType::DATA_ROLE, currentRole) == Status::SUCCESS) {
-                currentPortStatus[i].currentDataRole =
-                        static_cast<PortDataRole> (currentRole);
-            } else {
-                ALOGE("Error while retreiving current port role");
-                goto done;
-            }
-
-            if (getCurrentRoleHelper(names[i], PortRoleType::MODE,
-                    currentRole) == Status::SUCCESS) {
-                currentPortStatus[i].currentMode =
-                    static_cast<PortMode> (currentRole);
-            } else {
-                ALOGE("Error while retreiving current data role");
-                goto done;
-            }
-
-            currentPortStatus[i].canChangeMode =
-                canSwitchRoleHelper(names[i], PortRoleType::MODE);
-            currentPortStatus[i].canChangeDataRole =
-                canSwitchRoleHelper(names[i], PortRoleType::DATA_ROLE);
-            currentPortStatus[i].canChangePowerRole =
-                canSwitchRoleHelper(names[i], PortRoleType::POWER_ROLE);
-
-            ALOGI("canChangeMode: %d canChagedata: %d canChangePower:%d",
-                currentPortStatus[i].canChangeMode,
-                currentPortStatus[i].canChangeDataRole,
-                currentPortStatus[i].canChangePowerRole);
-
-            if (getPortModeHelper(names[i], currentPortStatus[i].supportedModes)
-                  != Status::SUCCESS) {
-                ALOGE("Error while retrieving port modes");
-                goto done;
-            }
-        }
-        return Status::SUCCESS;
-    }
-done:
-    return Status::ERROR;
-}
-
 Return<void> Usb::queryPortStatus() {
     hidl_vec<PortStatus> currentPortStatus;
     Status status;
 
-    status = getPortStatusHelper(currentPortStatus);
+    status = getPortStatusHelper(mPortCache, currentPortStatus);
     Return<void> ret = mCallback->notifyPortStatusChange(currentPortStatus,
        status);
     if (!ret.isOk())
@@ -318,7 +159,6 @@ struct data {
 
 static void uevent_event(uint32_t /*epevents*/, struct data *payload) {
     char msg[UEVENT_MSG_LEN + 2];
-    char *cp;
     int n;
 
     n = uevent_kernel_multicast_recv(payload->uevent_fd, msg, UEVENT_MSG_LEN);
@@ -329,23 +169,19 @@ static void uevent_event(uint32_t /*epevents*/, struct data *payload) {
 
     msg[n] = '\0';
     msg[n + 1] = '\0';
-    cp = msg;
-
-    while (*cp) {
-        if (!strcmp(cp, "SUBSYSTEM=dual_role_usb")) {
-            ALOGE("uevent received %s", cp);
-            if (payload->usb->mCallback != NULL) {
-                hidl_vec<PortStatus> currentPortStatus;
-                Status status = getPortStatusHelper(currentPortStatus);
-                Return<void> ret =
-                    payload->usb->mCallback->notifyPortStatusChange(currentPortStatus, status);
-                if (!ret.isOk())
-                    ALOGE("error %s", ret.description().c_str());
-            }
-            break;
-        }
-        /* advance to after the next \0 */
-        while (*cp++);
+
+    // Only ports that were added, removed or changed roles are worth a callback
+    if (!payload->usb->mPortCache.handleUevent(msg, n))
+        return;
+
+    if (payload->usb->mCallback != NULL) {
+        // The framework drops the ports missing from the list, so it has all of them
+        hidl_vec<PortStatus> currentPortStatus;
+        Status status = getPortStatusHelper(payload->usb->mPortCache, currentPortStatus);
+        Return<void> ret =
+            payload->usb->mCallback->notifyPortStatusChange(currentPortStatus, status);
+        if (!ret.isOk())
+            ALOGE("error %s", ret.description().c_str());
     }
 }
 
@@ -367,6 +203,9 @@ void* work(void* param) {
     payload.uevent_fd = uevent_fd;
     payload.usb = (android::hardware::usb::V1_0::implementation::Usb *)param;
 
+    // Events from now on are applied to a fresh scan
+    payload.usb->mPortCache.rescan();
+
     fcntl(uevent_fd, F_SETFL, O_NONBLOCK);
 
     ev.events = EPOLLIN;
@@ -6,6 +6,8 @@
 #include <hidl/Status.h>
 #include <log/log.h>
 
+#include "PortStatusCache.h"
+
 #ifdef LOG_TAG
 #undef LOG_TAG
 #endif
@@ -38,6 +40,8 @@ struct Usb : public IUsb {
     Return<void> queryPortStatus() override;
 
     sp<IUsbCallback> mCallback;
+    // Kept up to date by the uevent thread while a callback is set
+    PortStatusCache mPortCache;
     private:
         pthread_t mPoll;
         pthread_mutex_t mLock = PTHREAD_MUTEX_INITIALIZER;
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PortStatusCache.h"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+using android::base::WriteStringToFile;
+using android::hardware::usb::V1_0::implementation::PortState;
+using android::hardware::usb::V1_0::implementation::PortStatusCache;
+
+// Values of PortMode, PortPowerRole and PortDataRole
+constexpr uint32_t kUfp = 1;
+constexpr uint32_t kDfp = 2;
+constexpr uint32_t kDrp = 3;
+constexpr uint32_t kSource = 1;
+constexpr uint32_t kSink = 2;
+constexpr uint32_t kHost = 1;
+constexpr uint32_t kDevice = 2;
+
+class PortStatusCacheTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        root_ = std::string(dir_.path) + "/dual_role_usb";
+        devices_ = std::string(dir_.path) + "/devices";
+        ASSERT_EQ(0, mkdir(root_.c_str(), 0700));
+        ASSERT_EQ(0, mkdir(devices_.c_str(), 0700));
+        addPort("otg_default", "ufp dfp");
+        setRoles("otg_default", "ufp", "sink", "device");
+    }
+
+    // Ports are links to their device, as in sysfs
+    void addPort(const std::string& name, const std::string& supportedModes) {
+        std::string device = devices_ + "/" + name;
+        ASSERT_EQ(0, mkdir(device.c_str(), 0700));
+        ASSERT_EQ(0, symlink(device.c_str(), (root_ + "/" + name).c_str()));
+        ASSERT_TRUE(WriteStringToFile(supportedModes + "\n", device + "/supported_modes"));
+    }
+
+    void setRoles(const std::string& name, const std::string& mode, const std::string& power,
+                  const std::string& data) {
+        std::string device = devices_ + "/" + name;
+        ASSERT_TRUE(WriteStringToFile(mode + "\n", device + "/mode"));
+        ASSERT_TRUE(WriteStringToFile(power + "\n", device + "/power_role"));
+        ASSERT_TRUE(WriteStringToFile(data + "\n", device + "/data_role"));
+    }
+
+    // Builds a uevent as read from the uevent socket
+    static std::string uevent(const std::vector<std::string>& fields) {
+        std::string msg;
+        for (const auto& field : fields) {
+            msg += field;
+            msg += '\0';
+        }
+        return msg;
+    }
+
+    static std::string changeEvent(const std::string& name, const std::string& mode,
+                                   const std::string& power, const std::string& data) {
+        return uevent({"change@/devices/soc/usb/dual_role_usb/" + name, "ACTION=change",
+                       "DEVPATH=/devices/soc/usb/dual_role_usb/" + name,
+                       "SUBSYSTEM=dual_role_usb", "DUAL_ROLE_USB_SUPPORTED_MODES=ufp dfp",
+                       "DUAL_ROLE_USB_MODE=" + mode, "DUAL_ROLE_USB_POWER_ROLE=" + power,
+                       "DUAL_ROLE_USB_DATA_ROLE=" + data, "DUAL_ROLE_USB_POWERS_VCONN=n"});
+    }
+
+    static bool handle(PortStatusCache* cache, const std::string& msg) {
+        return cache->handleUevent(msg.data(), msg.size());
+    }
+
+    TemporaryDir dir_;
+    std::string root_;
+    std::string devices_;
+};
+
+TEST_F(PortStatusCacheTest, Scan) {
+    PortStatusCache cache(root_);
+    std::vector<PortState> ports;
+    EXPECT_FALSE(cache.getPorts(&ports));
+
+    ASSERT_TRUE(cache.rescan());
+    ASSERT_TRUE(cache.getPorts(&ports));
+    ASSERT_EQ(1u, ports.size());
+    EXPECT_EQ("otg_default", ports[0].name);
+    EXPECT_EQ(kUfp, ports[0].currentMode);
+    EXPECT_EQ(kSink, ports[0].currentPowerRole);
+    EXPECT_EQ(kDevice, ports[0].currentDataRole);
+    EXPECT_EQ(kDrp, ports[0].supportedModes);
+    EXPECT_TRUE(ports[0].canChangeMode);
+    EXPECT_TRUE(ports[0].canChangePowerRole);
+    EXPECT_TRUE(ports[0].canChangeDataRole);
+}
+
+TEST_F(PortStatusCacheTest, ScanFailsOnUnknownRole) {
+    setRoles("otg_default", "ufp", "sink", "otg");
+    PortStatusCache cache(root_);
+    EXPECT_FALSE(cache.rescan());
+    std::vector<PortState> ports;
+    EXPECT_FALSE(cache.getPorts(&ports));
+}
+
+TEST_F(PortStatusCacheTest, AppliesRolesFromUevent) {
+    PortStatusCache cache(root_);
+    ASSERT_TRUE(cache.rescan());
+
+    // The sysfs nodes are stale on purpose: the event alone must be used
+    EXPECT_TRUE(handle(&cache, changeEvent("otg_default", "dfp", "source", "host")));
+    std::vector<PortState> ports;
+    ASSERT_TRUE(cache.getPorts(&ports));
+    ASSERT_EQ(1u, ports.size());
+    EXPECT_EQ(kDfp, ports[0].currentMode);
+    EXPECT_EQ(kSource, ports[0].currentPowerRole);
+    EXPECT_EQ(kHost, ports[0].currentDataRole);
+}
+
+TEST_F(PortStatusCacheTest, IgnoresUnchangedRoles) {
+    PortStatusCache cache(root_);
+    ASSERT_TRUE(cache.rescan());
+    EXPECT_FALSE(handle(&cache, changeEvent("otg_default", "ufp", "sink", "device")));
+}
+
+TEST_F(PortStatusCacheTest, IgnoresOtherSubsystems) {
+    PortStatusCache cache(root_);
+    ASSERT_TRUE(cache.rescan());
+    EXPECT_FALSE(handle(&cache, uevent({"change@/devices/soc/battery", "ACTION=change",
+                                        "DEVPATH=/devices/soc/battery",
+                                        "SUBSYSTEM=power_supply"})));
+}
+
+TEST_F(PortStatusCacheTest, ReadsSysfsWithoutRoleProperties) {
+    PortStatusCache cache(root_);
+    ASSERT_TRUE(cache.rescan());
+    setRoles("otg_default", "dfp", "source", "host");
+
+    EXPECT_TRUE(handle(&cache, uevent({"change@/devices/soc/usb/dual_role_usb/otg_default",
+                                       "ACTION=change",
+                                       "DEVPATH=/devices/soc/usb/dual_role_usb/otg_default",
+                                       "SUBSYSTEM=dual_role_usb"})));
+    std::vector<PortState> ports;
+    ASSERT_TRUE(cache.getPorts(&ports));
+    EXPECT_EQ(kDfp, ports[0].currentMode);
+    EXPECT_EQ(kHost, ports[0].currentDataRole);
+}
+
+TEST_F(PortStatusCacheTest, AddsAndRemovesPorts) {
+    PortStatusCache cache(root_);
+    ASSERT_TRUE(cache.rescan());
+
+    addPort("usbc1", "dfp");
+    setRoles("usbc1", "dfp", "source", "host");
+    EXPECT_TRUE(handle(&cache, uevent({"add@/devices/soc/usb/dual_role_usb/usbc1", "ACTION=add",
+                                       "DEVPATH=/devices/soc/usb/dual_role_usb/usbc1",
+                                       "SUBSYSTEM=dual_role_usb"})));
+    std::vector<PortState> ports;
+    ASSERT_TRUE(cache.getPorts(&ports));
+    ASSERT_EQ(2u, ports.size());
+    EXPECT_EQ("usbc1", ports[1].name);
+    EXPECT_EQ(kDfp, ports[1].supportedModes);
+    EXPECT_EQ(kSource, ports[1].currentPowerRole);
+
+    EXPECT_TRUE(handle(&cache, uevent({"remove@/devices/soc/usb/dual_role_usb/otg_default",
+                                       "ACTION=remove",
+                                       "DEVPATH=/devices/soc/usb/dual_role_usb/otg_default",
+                                       "SUBSYSTEM=dual_role_usb"})));
+    ASSERT_TRUE(cache.getPorts(&ports));
+    ASSERT_EQ(1u, ports.size());
+    EXPECT_EQ("usbc1", ports[0].name);
+}
+
+TEST_F(PortStatusCacheTest, UnreadablePortIsNotAdded) {
+    PortStatusCache cache(root_);
+    ASSERT_TRUE(cache.rescan());
+    EXPECT_FALSE(handle(&cache, uevent({"add@/devices/soc/usb/dual_role_usb/ghost", "ACTION=add",
+                                        "DEVPATH=/devices/soc/usb/dual_role_usb/ghost",
+                                        "SUBSYSTEM=dual_role_usb"})));
+    std::vector<PortState> ports;
+    ASSERT_TRUE(cache.getPorts(&ports));
+    EXPECT_EQ(1u, ports.size());
+}